@@ -25,6 +25,7 @@
 #include <QFile>
 #include <QTextStream>
 #include "FileLogger.h"
+#include "Metrics.h"
 #include "../Imap/Model/Utils.h"
 
 namespace Common
@@ -46,6 +47,7 @@ void FileLogger::setFileLogging(const bool enabled, const QString &fileName)
         m_fileLog = new QTextStream(logFile);
     } else {
         if (m_fileLog) {
+            dumpMetrics();
             QIODevice *dev = m_fileLog->device();
             delete m_fileLog;
             delete dev;
@@ -56,9 +58,27 @@ void FileLogger::setFileLogging(const bool enabled, const QString &fileName)
 
 FileLogger::~FileLogger()
 {
+    if (m_fileLog)
+        dumpMetrics();
     delete m_fileLog;
 }
 
+void FileLogger::dumpMetrics()
+{
+    if (!m_fileLog && !m_consoleLog)
+        return;
+
+    const QString prefix = QDateTime::currentDateTime().toString(QLatin1String("hh:mm:ss.zzz")) + QLatin1String(" [metrics] ");
+    Q_FOREACH(const QString &line, MetricsRegistry::instance()->dump()) {
+        if (m_fileLog)
+            *m_fileLog << prefix << line << "\n";
+        if (m_consoleLog)
+            qDebug() << (prefix + line).toUtf8().constData();
+    }
+    if (m_fileLog)
+        m_fileLog->flush();
+}
+
 void FileLogger::escapeCrLf(QString &s)
 {
     s.replace(QLatin1Char('\r'), 0x240d /* SYMBOL FOR CARRIAGE RETURN */)
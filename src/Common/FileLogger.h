@@ -48,6 +48,9 @@ public slots:
 
     void setAutoFlush(const bool autoFlush);
 
+    /** @short Write a snapshot of the MetricsRegistry into the log */
+    void dumpMetrics();
+
 protected:
     QString formatMessage(uint parser, const Common::LogMessage &message) const;
     void escapeCrLf(QString &s);
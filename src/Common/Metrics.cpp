@@ -0,0 +1,197 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QMutexLocker>
+#include "Metrics.h"
+
+namespace Common
+{
+
+MetricsCounter::MetricsCounter(): m_value(0)
+{
+}
+
+void MetricsCounter::reset()
+{
+    m_value.store(0, std::memory_order_relaxed);
+}
+
+MetricsHistogram::MetricsHistogram(): m_count(0), m_sum(0), m_max(0)
+{
+    for (int i = 0; i < BUCKETS; ++i)
+        m_buckets[i].store(0, std::memory_order_relaxed);
+}
+
+int MetricsHistogram::bucketForValue(qint64 value)
+{
+    int i = 0;
+    while (value > 0 && i < BUCKETS - 1) {
+        value >>= 1;
+        ++i;
+    }
+    return i;
+}
+
+/** @short Smallest value which no longer fits into the bucket #i */
+qint64 MetricsHistogram::bucketUpperBound(const int i)
+{
+    return Q_INT64_C(1) << i;
+}
+
+void MetricsHistogram::record(qint64 value)
+{
+    if (value < 0)
+        value = 0;
+    m_buckets[bucketForValue(value)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    qint64 previousMax = m_max.load(std::memory_order_relaxed);
+    while (previousMax < value && !m_max.compare_exchange_weak(previousMax, value, std::memory_order_relaxed)) {
+        // previousMax got updated by the failed exchange, so just retry
+    }
+}
+
+qint64 MetricsHistogram::count() const
+{
+    return m_count.load(std::memory_order_relaxed);
+}
+
+qint64 MetricsHistogram::sum() const
+{
+    return m_sum.load(std::memory_order_relaxed);
+}
+
+qint64 MetricsHistogram::max() const
+{
+    return m_max.load(std::memory_order_relaxed);
+}
+
+qint64 MetricsHistogram::bucket(const int i) const
+{
+    Q_ASSERT(i >= 0 && i < BUCKETS);
+    return m_buckets[i].load(std::memory_order_relaxed);
+}
+
+/** @short Return an upper bound of the requested percentile
+
+The result is only as precise as the bucket width, i.e. it is the exclusive upper limit of the bucket where the
+percentile falls, capped by the biggest value seen so far.
+*/
+qint64 MetricsHistogram::percentile(const int percent) const
+{
+    const qint64 total = count();
+    if (total == 0)
+        return 0;
+    const qint64 wanted = (total * percent + 99) / 100;
+    qint64 seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+        seen += bucket(i);
+        if (seen >= wanted && seen > 0)
+            return i == 0 ? 0 : qMin(bucketUpperBound(i) - 1, max());
+    }
+    return max();
+}
+
+void MetricsHistogram::reset()
+{
+    for (int i = 0; i < BUCKETS; ++i)
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+MetricsTimer::MetricsTimer(MetricsHistogram *histogram): m_histogram(histogram)
+{
+    m_timer.start();
+}
+
+MetricsTimer::~MetricsTimer()
+{
+    m_histogram->record(m_timer.nsecsElapsed() / 1000);
+}
+
+MetricsRegistry::MetricsRegistry()
+{
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+    qDeleteAll(m_counters);
+    qDeleteAll(m_histograms);
+}
+
+MetricsRegistry *MetricsRegistry::instance()
+{
+    static MetricsRegistry registry;
+    return &registry;
+}
+
+MetricsCounter *MetricsRegistry::counter(const QString &name)
+{
+    QMutexLocker locker(&m_mutex);
+    MetricsCounter *&res = m_counters[name];
+    if (!res)
+        res = new MetricsCounter();
+    return res;
+}
+
+MetricsHistogram *MetricsRegistry::histogram(const QString &name)
+{
+    QMutexLocker locker(&m_mutex);
+    MetricsHistogram *&res = m_histograms[name];
+    if (!res)
+        res = new MetricsHistogram();
+    return res;
+}
+
+/** @short Human-readable snapshot of all metrics, one line per metric */
+QStringList MetricsRegistry::dump() const
+{
+    QMutexLocker locker(&m_mutex);
+    QStringList res;
+    for (QMap<QString, MetricsCounter *>::const_iterator it = m_counters.constBegin(); it != m_counters.constEnd(); ++it) {
+        res << QString::fromUtf8("counter %1 %2").arg(it.key(), QString::number(it.value()->value()));
+    }
+    for (QMap<QString, MetricsHistogram *>::const_iterator it = m_histograms.constBegin(); it != m_histograms.constEnd(); ++it) {
+        const MetricsHistogram *h = it.value();
+        res << QString::fromUtf8("histogram %1 count=%2 sum=%3 max=%4 p50<=%5 p90<=%6 p99<=%7").arg(
+                   it.key(), QString::number(h->count()), QString::number(h->sum()), QString::number(h->max()),
+                   QString::number(h->percentile(50)), QString::number(h->percentile(90)),
+                   QString::number(h->percentile(99)));
+    }
+    return res;
+}
+
+/** @short Zero all metrics without invalidating the pointers handed out earlier */
+void MetricsRegistry::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    Q_FOREACH(MetricsCounter *c, m_counters) {
+        c->reset();
+    }
+    Q_FOREACH(MetricsHistogram *h, m_histograms) {
+        h->reset();
+    }
+}
+
+}
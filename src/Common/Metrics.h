@@ -0,0 +1,129 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef COMMON_METRICS_H
+#define COMMON_METRICS_H
+
+#include <atomic>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QMutex>
+#include <QStringList>
+
+namespace Common
+{
+
+/** @short A monotonic counter which can be bumped from any thread without locking */
+class MetricsCounter
+{
+public:
+    MetricsCounter();
+
+    void add(const qint64 amount = 1) { m_value.fetch_add(amount, std::memory_order_relaxed); }
+    qint64 value() const { return m_value.load(std::memory_order_relaxed); }
+    void reset();
+
+private:
+    MetricsCounter(const MetricsCounter &); // don't implement
+    MetricsCounter &operator=(const MetricsCounter &); // don't implement
+
+    std::atomic<qint64> m_value;
+};
+
+/** @short Histogram of non-negative values with power-of-two buckets
+
+The bucket #0 counts zeros, the bucket #i holds values from the range [2^(i-1), 2^i). The last bucket also catches
+everything which is bigger than that. Recording a value is lock-free and safe to call from any thread.
+*/
+class MetricsHistogram
+{
+public:
+    enum {BUCKETS = 32};
+
+    MetricsHistogram();
+
+    void record(qint64 value);
+    qint64 count() const;
+    qint64 sum() const;
+    qint64 max() const;
+    qint64 bucket(const int i) const;
+    qint64 percentile(const int percent) const;
+    void reset();
+
+    static int bucketForValue(qint64 value);
+    static qint64 bucketUpperBound(const int i);
+
+private:
+    MetricsHistogram(const MetricsHistogram &); // don't implement
+    MetricsHistogram &operator=(const MetricsHistogram &); // don't implement
+
+    std::atomic<qint64> m_buckets[BUCKETS];
+    std::atomic<qint64> m_count;
+    std::atomic<qint64> m_sum;
+    std::atomic<qint64> m_max;
+};
+
+/** @short Record the time spent in the current scope, in microseconds, into a histogram */
+class MetricsTimer
+{
+public:
+    explicit MetricsTimer(MetricsHistogram *histogram);
+    ~MetricsTimer();
+
+private:
+    MetricsTimer(const MetricsTimer &); // don't implement
+    MetricsTimer &operator=(const MetricsTimer &); // don't implement
+
+    MetricsHistogram *m_histogram;
+    QElapsedTimer m_timer;
+};
+
+/** @short Process-wide collection of named counters and histograms
+
+Looking up a metric by its name takes a lock, so the hot paths are expected to do that just once and keep the returned
+pointer around (a function-local static is the usual way). The returned objects live as long as the registry.
+*/
+class MetricsRegistry
+{
+public:
+    static MetricsRegistry *instance();
+
+    ~MetricsRegistry();
+
+    MetricsCounter *counter(const QString &name);
+    MetricsHistogram *histogram(const QString &name);
+
+    QStringList dump() const;
+    void reset();
+
+private:
+    MetricsRegistry();
+    MetricsRegistry(const MetricsRegistry &); // don't implement
+    MetricsRegistry &operator=(const MetricsRegistry &); // don't implement
+
+    mutable QMutex m_mutex;
+    QMap<QString, MetricsCounter *> m_counters;
+    QMap<QString, MetricsHistogram *> m_histograms;
+};
+
+}
+
+#endif // COMMON_METRICS_H
@@ -32,6 +32,7 @@
 #  include "mimetypes-qt4/include/QMimeDatabase"
 #endif
 #include "Composer/MessageComposer.h"
+#include "Composer/MessageStream.h"
 #include "Imap/Encoders.h"
 #include "Imap/Model/FullMessageCombiner.h"
 #include "Imap/Model/ItemRoles.h"
@@ -285,10 +286,11 @@ QSharedPointer<QIODevice> ImapMessageAttachmentItem::rawData() const
     if (!index.isValid())
         return QSharedPointer<QIODevice>();
 
-    QSharedPointer<QIODevice> io(new QBuffer());
-    // This can probably be optimized to allow zero-copy operation through a pair of two QIODevices
-    static_cast<QBuffer*>(io.data())->setData(fullMessageCombiner->data());
-    io->open(QIODevice::ReadOnly);
+    // Both parts are shared with the Model instead of being concatenated into yet another copy of the message
+    QSharedPointer<MessageStream> io(new MessageStream());
+    io->appendData(fullMessageCombiner->headerData());
+    io->appendData(fullMessageCombiner->bodyData());
+    io->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
     return io;
 }
 
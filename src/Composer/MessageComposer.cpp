@@ -28,11 +28,12 @@
 #else
 #  include "mimetypes-qt4/include/QMimeDatabase"
 #endif
-#include <QUrl>
 #include <QUuid>
 #include "Common/Application.h"
 #include "Composer/ComposerAttachments.h"
+#include "Composer/MessageStream.h"
 #include "Imap/Encoders.h"
+#include "Imap/Model/DragAndDrop.h"
 #include "Imap/Model/ItemRoles.h"
 #include "Imap/Model/Model.h"
 #include "Imap/Model/Utils.h"
@@ -161,17 +162,10 @@ bool MessageComposer::dropMimeData(const QMimeData *data, Qt::DropAction action,
         return dropImapPart(stream);
     } else if (data->hasUrls()) {
         bool attached = false;
-        QList<QUrl> urls = data->urls();
-        foreach (const QUrl &url, urls) {
-#if QT_VERSION >= QT_VERSION_CHECK(4, 8, 0)
-            if (url.isLocalFile()) {
-#else
-            if (url.scheme() == QLatin1String("file")) {
-#endif
-                // Careful here -- we definitely don't want the boolean evaluation shortcuts taking effect!
-                // At the same time, any file being recognized and attached is enough to "satisfy" the drop
-                attached = addFileAttachment(url.path()) || attached;
-            }
+        Q_FOREACH(const QString &fileName, Imap::Mailbox::localFilesForDragAndDrop(data)) {
+            // Careful here -- we definitely don't want the boolean evaluation shortcuts taking effect!
+            // At the same time, any file being recognized and attached is enough to "satisfy" the drop
+            attached = addFileAttachment(fileName) || attached;
         }
         return attached;
     } else {
@@ -637,7 +631,26 @@ bool MessageComposer::writeAttachmentHeader(QIODevice *target, QString *errorMes
     return true;
 }
 
-bool MessageComposer::writeAttachmentBody(QIODevice *target, QString *errorMessage, const AttachmentItem *attachment) const
+namespace {
+
+/** @short Pass all data from the @arg source to the @arg target in reasonably small chunks */
+static void copyDeviceData(QIODevice *source, QIODevice *target)
+{
+    while (!source->atEnd()) {
+        QByteArray chunk = source->read(64 * 1024);
+        if (chunk.isEmpty())
+            break;
+        target->write(chunk);
+    }
+}
+
+}
+
+/** @short Add the attachment's body in its proper Content-Transfer-Encoding to the @arg stream
+
+The data are not read at this point, the stream reads them from the attachment's device when they are needed.
+*/
+bool MessageComposer::appendAttachmentBody(MessageStream *stream, QString *errorMessage, const AttachmentItem *attachment) const
 {
     if (!attachment->isAvailableLocally()) {
         *errorMessage = tr("Attachment %1 is not available").arg(attachment->caption());
@@ -648,39 +661,73 @@ bool MessageComposer::writeAttachmentBody(QIODevice *target, QString *errorMessa
         *errorMessage = tr("Attachment %1 disappeared").arg(attachment->caption());
         return false;
     }
-    while (!io->atEnd()) {
-        switch (attachment->suggestedCTE()) {
-        case AttachmentItem::CTE_BASE64:
-            // Base64 maps 6bit chunks into a single byte. Output shall have no more than 76 characters per line
-            // (not counting the CRLF pair).
-            target->write(io->read(76*6/8).toBase64() + "\r\n");
-            break;
-        default:
-            target->write(io->readAll());
-        }
+    // Base64 maps 6bit chunks into a single byte. Output shall have no more than 76 characters per line
+    // (not counting the CRLF pair).
+    if (!stream->appendDevice(io, attachment->suggestedCTE() == AttachmentItem::CTE_BASE64 ?
+                              MessageStream::ENCODING_BASE64 : MessageStream::ENCODING_NONE)) {
+        *errorMessage = tr("Attachment %1 cannot be read").arg(attachment->caption());
+        return false;
     }
     return true;
 }
 
+bool MessageComposer::writeAttachmentBody(QIODevice *target, QString *errorMessage, const AttachmentItem *attachment) const
+{
+    MessageStream stream;
+    if (!appendAttachmentBody(&stream, errorMessage, attachment))
+        return false;
+    stream.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    copyDeviceData(&stream, target);
+    return true;
+}
+
 bool MessageComposer::asRawMessage(QIODevice *target, QString *errorMessage) const
+{
+    QSharedPointer<QIODevice> stream = asRawMessageStream(errorMessage);
+    if (!stream)
+        return false;
+    copyDeviceData(stream.data(), target);
+    return true;
+}
+
+/** @short Return a device which produces the serialized message as it gets read
+
+Unlike asRawMessage(), this does not build the whole message in memory; the attachments are only read and encoded
+when the consumer gets to them. The returned device is random-access, its size() is known in advance, and it can
+be rewound by seek(0) to produce the very same message once again.
+*/
+QSharedPointer<QIODevice> MessageComposer::asRawMessageStream(QString *errorMessage) const
 {
     // We don't bother with checking that our boundary is not present in the individual parts. That's arguably wrong,
     // but we don't have much choice if we ever plan to use CATENATE.  It also looks like this is exactly how other MUAs
     // oeprate as well, so let's just join the universal dontcareism here.
     QByteArray boundary(generateMimeBoundary());
+    QSharedPointer<MessageStream> stream(new MessageStream());
 
-    writeCommonMessageBeginning(target, boundary);
+    {
+        QByteArray buf;
+        QBuffer io(&buf);
+        io.open(QIODevice::WriteOnly);
+        writeCommonMessageBeginning(&io, boundary);
+        stream->appendData(buf);
+    }
 
     if (!m_attachments.isEmpty()) {
         Q_FOREACH(const AttachmentItem *attachment, m_attachments) {
-            if (!writeAttachmentHeader(target, errorMessage, attachment, boundary))
-                return false;
-            if (!writeAttachmentBody(target, errorMessage, attachment))
-                return false;
+            QByteArray buf;
+            QBuffer io(&buf);
+            io.open(QIODevice::WriteOnly);
+            if (!writeAttachmentHeader(&io, errorMessage, attachment, boundary))
+                return QSharedPointer<QIODevice>();
+            stream->appendData(buf);
+            if (!appendAttachmentBody(stream.data(), errorMessage, attachment))
+                return QSharedPointer<QIODevice>();
         }
-        target->write("\r\n--" + boundary + "--\r\n");
+        stream->appendData("\r\n--" + boundary + "--\r\n");
     }
-    return true;
+
+    stream->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    return stream;
 }
 
 bool MessageComposer::asCatenateData(QList<Imap::Mailbox::CatenatePair> &target, QString *errorMessage) const
@@ -25,6 +25,7 @@
 
 #include <QAbstractListModel>
 #include <QPointer>
+#include <QSharedPointer>
 
 #include "Composer/ContentDisposition.h"
 #include "Composer/Recipients.h"
@@ -40,6 +41,7 @@ class Model;
 namespace Composer {
 
 class AttachmentItem;
+class MessageStream;
 
 /** @short Model storing individual parts of a composed message */
 class MessageComposer : public QAbstractListModel
@@ -71,6 +73,7 @@ public:
 
     bool isReadyForSerialization() const;
     bool asRawMessage(QIODevice *target, QString *errorMessage) const;
+    QSharedPointer<QIODevice> asRawMessageStream(QString *errorMessage) const;
     bool asCatenateData(QList<Imap::Mailbox::CatenatePair> &target, QString *errorMessage) const;
 
     QDateTime timestamp() const;
@@ -97,6 +100,7 @@ private:
     void writeCommonMessageBeginning(QIODevice *target, const QByteArray boundary) const;
     bool writeAttachmentHeader(QIODevice *target, QString *errorMessage, const AttachmentItem *attachment, const QByteArray &boundary) const;
     bool writeAttachmentBody(QIODevice *target, QString *errorMessage, const AttachmentItem *attachment) const;
+    bool appendAttachmentBody(MessageStream *stream, QString *errorMessage, const AttachmentItem *attachment) const;
 
     void writeHeaderWithMsgIds(QIODevice *target, const QByteArray &headerName, const QList<QByteArray> &messageIds) const;
 
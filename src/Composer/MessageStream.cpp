@@ -0,0 +1,165 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include "MessageStream.h"
+
+namespace Composer {
+
+/** @short Amount of raw data which make up one line of the base64 output */
+static const int base64LineInput = 76 * 6 / 8;
+
+MessageStream::MessageStream(QObject *parent):
+    QIODevice(parent), m_size(0), m_currentSegment(0), m_segmentOffset(0), m_encodedOffset(0)
+{
+}
+
+/** @short Add a chunk of data which will be passed through as-is */
+void MessageStream::appendData(const QByteArray &data)
+{
+    Q_ASSERT(!isOpen());
+    if (data.isEmpty())
+        return;
+    Segment segment;
+    segment.data = data;
+    segment.encoding = ENCODING_NONE;
+    m_segments << segment;
+    m_size += data.size();
+}
+
+/** @short Add a device whose data will be read, and possibly encoded, when they are needed
+
+Returns false if the @arg device cannot be used because its size is not known in advance.
+*/
+bool MessageStream::appendDevice(const QSharedPointer<QIODevice> &device, const Encoding encoding)
+{
+    Q_ASSERT(!isOpen());
+    if (!device || !device->isReadable() || device->isSequential() || !device->seek(0))
+        return false;
+    Segment segment;
+    segment.device = device;
+    segment.encoding = encoding;
+    m_segments << segment;
+    m_size += encodedSize(device->size(), encoding);
+    return true;
+}
+
+qint64 MessageStream::encodedSize(const qint64 size, const Encoding encoding)
+{
+    switch (encoding) {
+    case ENCODING_NONE:
+        break;
+    case ENCODING_BASE64:
+    {
+        // Each full line is followed by CRLF, and so is the last, partial one
+        const qint64 remainder = size % base64LineInput;
+        return size / base64LineInput * (76 + 2) + (remainder ? (remainder + 2) / 3 * 4 + 2 : 0);
+    }
+    }
+    return size;
+}
+
+qint64 MessageStream::size() const
+{
+    return m_size;
+}
+
+bool MessageStream::seek(qint64 pos)
+{
+    if (pos == 0) {
+        for (QList<Segment>::iterator it = m_segments.begin(); it != m_segments.end(); ++it) {
+            if (it->device && !it->device->seek(0))
+                return false;
+        }
+        m_currentSegment = 0;
+        m_segmentOffset = 0;
+        m_encoded.clear();
+        m_encodedOffset = 0;
+    } else if (pos != QIODevice::pos()) {
+        return false;
+    }
+    return QIODevice::seek(pos);
+}
+
+qint64 MessageStream::readData(char *data, qint64 maxSize)
+{
+    qint64 produced = 0;
+    while (produced < maxSize) {
+        if (m_encodedOffset < m_encoded.size()) {
+            // Some leftovers of the last encoded line
+            const int n = qMin<qint64>(m_encoded.size() - m_encodedOffset, maxSize - produced);
+            memcpy(data + produced, m_encoded.constData() + m_encodedOffset, n);
+            m_encodedOffset += n;
+            produced += n;
+            continue;
+        }
+
+        if (m_currentSegment >= m_segments.size())
+            break;
+
+        const Segment &segment = m_segments[m_currentSegment];
+        if (!segment.device) {
+            const qint64 n = qMin<qint64>(segment.data.size() - m_segmentOffset, maxSize - produced);
+            memcpy(data + produced, segment.data.constData() + m_segmentOffset, n);
+            m_segmentOffset += n;
+            produced += n;
+            if (m_segmentOffset == segment.data.size()) {
+                ++m_currentSegment;
+                m_segmentOffset = 0;
+            }
+            continue;
+        }
+
+        qint64 n = 0;
+        switch (segment.encoding) {
+        case ENCODING_NONE:
+            n = segment.device->read(data + produced, maxSize - produced);
+            if (n > 0)
+                produced += n;
+            break;
+        case ENCODING_BASE64:
+        {
+            QByteArray raw = segment.device->read(base64LineInput);
+            n = raw.size();
+            if (n > 0) {
+                m_encoded = raw.toBase64() + "\r\n";
+                m_encodedOffset = 0;
+            }
+            break;
+        }
+        }
+        if (n <= 0) {
+            ++m_currentSegment;
+            m_segmentOffset = 0;
+        }
+    }
+    return produced;
+}
+
+qint64 MessageStream::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+}
@@ -0,0 +1,82 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COMPOSER_MESSAGESTREAM_H
+#define COMPOSER_MESSAGESTREAM_H
+
+#include <QIODevice>
+#include <QList>
+#include <QSharedPointer>
+
+namespace Composer {
+
+/** @short Read-only device which produces a concatenation of byte arrays and other devices on demand
+
+The MessageComposer uses this for serializing a message without building a copy of the whole message in memory. The
+headers and MIME boundaries are small and are kept as byte arrays, while the attachments are read from their own
+devices (and encoded, if needed) only when somebody reads that part of the stream.
+
+The total size is known in advance, which is what an IMAP literal needs. The stream can be rewound by seek(0) so that
+the very same message can be sent more than once; seeking anywhere else is not supported. All of the devices added
+through appendDevice() must be random-access ones which are open for reading.
+*/
+class MessageStream: public QIODevice
+{
+public:
+    /** @short How shall the data of a device be transformed when producing the stream */
+    typedef enum {
+        ENCODING_NONE, /**< Pass the data through verbatim */
+        ENCODING_BASE64 /**< Base64 with lines of 76 characters, as required by RFC 2045 */
+    } Encoding;
+
+    explicit MessageStream(QObject *parent = 0);
+
+    void appendData(const QByteArray &data);
+    bool appendDevice(const QSharedPointer<QIODevice> &device, const Encoding encoding);
+
+    virtual qint64 size() const;
+    virtual bool seek(qint64 pos);
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize);
+    virtual qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    struct Segment {
+        QByteArray data;
+        QSharedPointer<QIODevice> device;
+        Encoding encoding;
+    };
+
+    static qint64 encodedSize(const qint64 size, const Encoding encoding);
+
+    QList<Segment> m_segments;
+    qint64 m_size;
+    int m_currentSegment;
+    qint64 m_segmentOffset;
+    QByteArray m_encoded;
+    int m_encodedOffset;
+};
+
+}
+
+#endif // COMPOSER_MESSAGESTREAM_H
@@ -0,0 +1,518 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QTimer>
+#include <QUuid>
+#include "Composer/Outbox.h"
+#include "Common/DeleteAfter.h"
+#include "Composer/MessageComposer.h"
+#include "Imap/Model/Model.h"
+#include "Imap/Tasks/BulkAppendTask.h"
+#include "MSA/AbstractMSA.h"
+
+namespace {
+const quint32 envelopeMagic = 0x54524f42;
+const quint32 envelopeVersion = 1;
+
+/** @short How long shall the MSA be kept around after the session ends, so that it can say goodbye properly */
+const int msaLingerMs = 60 * 1000;
+
+/** @short Upper bound on the number of seconds between two attempts to send a message */
+const int maximalRetryDelay = 3600;
+}
+
+namespace Composer
+{
+
+const int Outbox::maximalAttempts = 8;
+
+/** @short Create the outbox and load any messages which were left in the @arg directory by a previous run
+
+The outbox takes ownership of the @arg msaFactory.
+*/
+Outbox::Outbox(QObject *parent, Imap::Mailbox::Model *model, MSA::MSAFactory *msaFactory, const QString &directory):
+    QObject(parent), m_model(model), m_msaFactory(msaFactory), m_directory(directory), m_msa(0),
+    m_networkAvailable(!model || model->isNetworkAvailable())
+{
+    if (!m_directory.endsWith(QLatin1Char('/')))
+        m_directory.append(QLatin1Char('/'));
+    QDir().mkpath(m_directory);
+
+    m_retryTimer = new QTimer(this);
+    m_retryTimer->setSingleShot(true);
+    connect(m_retryTimer, SIGNAL(timeout()), this, SLOT(flush()));
+    if (m_model)
+        connect(m_model, SIGNAL(networkPolicyChanged()), this, SLOT(slotNetworkPolicyChanged()));
+
+    loadQueue();
+    if (!m_entries.isEmpty())
+        QTimer::singleShot(0, this, SLOT(flush()));
+}
+
+Outbox::~Outbox()
+{
+    delete m_msaFactory;
+}
+
+/** @short Use another way of submitting the messages from now on; the outbox takes ownership of the factory */
+void Outbox::setMsaFactory(MSA::MSAFactory *msaFactory)
+{
+    if (msaFactory == m_msaFactory)
+        return;
+    delete m_msaFactory;
+    m_msaFactory = msaFactory;
+}
+
+/** @short Serialize the message and put it into the queue
+
+The message will be saved into the @arg sentFolderName after its delivery, unless the folder name is empty. Returns
+false if the message cannot be serialized or stored.
+*/
+bool Outbox::enqueue(const MessageComposer *composer, const QString &sentFolderName, QString *errorMessage)
+{
+    QSharedPointer<QIODevice> source = composer->asRawMessageStream(errorMessage);
+    if (!source)
+        return false;
+
+    Entry entry;
+    entry.id = QUuid::createUuid().toString().remove(QLatin1Char('{')).remove(QLatin1Char('}'));
+    entry.from = composer->rawFromAddress();
+    entry.recipients = composer->rawRecipientAddresses();
+    entry.sentFolder = sentFolderName;
+    entry.timestamp = composer->timestamp();
+    entry.queuedAt = QDateTime::currentDateTime();
+    entry.nextAttempt = entry.queuedAt;
+
+    QFile target(messagePath(entry.id));
+    if (!target.open(QIODevice::WriteOnly)) {
+        *errorMessage = tr("Cannot store the message in %1: %2").arg(target.fileName(), target.errorString());
+        return false;
+    }
+    while (true) {
+        QByteArray chunk = source->read(64 * 1024);
+        if (chunk.isEmpty())
+            break;
+        if (target.write(chunk) != chunk.size()) {
+            *errorMessage = tr("Cannot store the message in %1: %2").arg(target.fileName(), target.errorString());
+            target.remove();
+            return false;
+        }
+    }
+    target.close();
+
+    if (!saveEntry(entry, errorMessage)) {
+        target.remove();
+        return false;
+    }
+
+    m_entries[entry.id] = entry;
+    emit countChanged(count());
+    QTimer::singleShot(0, this, SLOT(flush()));
+    return true;
+}
+
+/** @short Number of messages which are waiting for their delivery */
+int Outbox::count() const
+{
+    return pendingIds().size();
+}
+
+/** @short IDs of messages which were not delivered yet and which will be retried automatically, oldest first */
+QStringList Outbox::pendingIds() const
+{
+    QMap<QDateTime, QString> sorted;
+    Q_FOREACH(const Entry &entry, m_entries) {
+        if (!entry.delivered && !entry.isGivenUp())
+            sorted.insertMulti(entry.queuedAt, entry.id);
+    }
+    return sorted.values();
+}
+
+/** @short IDs of messages which the outbox has given up on, oldest first */
+QStringList Outbox::failedIds() const
+{
+    QMap<QDateTime, QString> sorted;
+    Q_FOREACH(const Entry &entry, m_entries) {
+        if (entry.isGivenUp())
+            sorted.insertMulti(entry.queuedAt, entry.id);
+    }
+    return sorted.values();
+}
+
+/** @short Addresses of the recipients of the queued message @arg id */
+QList<QByteArray> Outbox::recipients(const QString &id) const
+{
+    return m_entries.value(id).recipients;
+}
+
+/** @short The error which has prevented the submission of the message @arg id the last time */
+QString Outbox::lastError(const QString &id) const
+{
+    return m_entries.value(id).lastError;
+}
+
+/** @short Number of seconds to wait before another attempt after @arg attempts failed ones */
+int Outbox::retryDelay(const int attempts)
+{
+    return qMin(60 << qBound(0, attempts - 1, 6), maximalRetryDelay);
+}
+
+/** @short Try to submit all messages which are due, and to save those which were delivered already */
+void Outbox::flush()
+{
+    if (m_msa) {
+        // the current session will pick up everything which is due anyway
+        return;
+    }
+
+    saveDelivered();
+
+    if (!m_msaFactory)
+        return;
+
+    if (m_model && !m_model->isNetworkAvailable()) {
+        // Going online will bring us back here
+        m_retryTimer->stop();
+        return;
+    }
+
+    const QDateTime now = QDateTime::currentDateTime();
+    m_batch.clear();
+    Q_FOREACH(const QString &id, pendingIds()) {
+        if (m_entries[id].nextAttempt <= now)
+            m_batch << id;
+    }
+    if (m_batch.isEmpty()) {
+        scheduleRetry();
+        return;
+    }
+
+    m_retryTimer->stop();
+    m_msa = m_msaFactory->create(this);
+    connect(m_msa, SIGNAL(sent()), this, SLOT(slotMsaSent()));
+    connect(m_msa, SIGNAL(error(QString)), this, SLOT(slotMsaFailed(QString)));
+    connect(m_msa, SIGNAL(passwordRequested(QString,QString)), this, SIGNAL(passwordRequested(QString,QString)));
+    connect(this, SIGNAL(gotPassword(QString)), m_msa, SLOT(setPassword(QString)));
+    connect(this, SIGNAL(canceled()), m_msa, SLOT(cancel()));
+    m_msa->beginSession();
+    sendNext();
+}
+
+/** @short Give a message which the outbox has given up on another chance */
+void Outbox::retry(const QString &id)
+{
+    QMap<QString, Entry>::iterator it = m_entries.find(id);
+    if (it == m_entries.end() || it->delivered)
+        return;
+    it->attempts = 0;
+    it->nextAttempt = QDateTime::currentDateTime();
+    QString errorMessage;
+    if (!saveEntry(*it, &errorMessage) && m_model)
+        m_model->logTrace(0, Common::LOG_OTHER, QLatin1String("Outbox"), errorMessage);
+    emit countChanged(count());
+    flush();
+}
+
+/** @short Give all messages which the outbox has given up on another chance */
+void Outbox::retryAllFailed()
+{
+    Q_FOREACH(const QString &id, failedIds()) {
+        retry(id);
+    }
+}
+
+/** @short Make all messages due once the network becomes available again */
+void Outbox::slotNetworkPolicyChanged()
+{
+    const bool available = m_model && m_model->isNetworkAvailable();
+    const bool reconnected = available && !m_networkAvailable;
+    m_networkAvailable = available;
+    if (!reconnected)
+        return;
+
+    // The failures were quite likely caused by the lack of connectivity, so there's no point in waiting any longer
+    const QDateTime now = QDateTime::currentDateTime();
+    QString errorMessage;
+    for (QMap<QString, Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if (it->delivered || it->isGivenUp() || it->nextAttempt <= now)
+            continue;
+        it->nextAttempt = now;
+        if (!saveEntry(*it, &errorMessage) && m_model)
+            m_model->logTrace(0, Common::LOG_OTHER, QLatin1String("Outbox"), errorMessage);
+    }
+    flush();
+}
+
+void Outbox::setPassword(const QString &password)
+{
+    emit gotPassword(password);
+}
+
+void Outbox::cancelPassword()
+{
+    emit canceled();
+}
+
+void Outbox::sendNext()
+{
+    Q_ASSERT(m_msa);
+    if (m_batch.isEmpty()) {
+        finishSession();
+        return;
+    }
+
+    const QString id = m_batch.first();
+    m_currentData = openMessage(id);
+    if (!m_currentData) {
+        slotMsaFailed(tr("Cannot read the queued message from %1").arg(messagePath(id)));
+        return;
+    }
+    const Entry &entry = m_entries[id];
+    m_msa->sendMail(entry.from, entry.recipients, m_currentData);
+}
+
+void Outbox::slotMsaSent()
+{
+    if (!m_msa || m_batch.isEmpty())
+        return;
+
+    const QString id = m_batch.takeFirst();
+    m_currentData.clear();
+    Entry &entry = m_entries[id];
+    entry.delivered = true;
+    entry.lastError.clear();
+    emit messageSent(id);
+
+    if (entry.sentFolder.isEmpty()) {
+        removeEntry(id);
+    } else {
+        QString errorMessage;
+        // The copy is saved once the session is over, together with all other messages which were delivered
+        if (!saveEntry(entry, &errorMessage) && m_model)
+            m_model->logTrace(0, Common::LOG_OTHER, QLatin1String("Outbox"), errorMessage);
+    }
+    emit countChanged(count());
+    sendNext();
+}
+
+void Outbox::slotMsaFailed(const QString &message)
+{
+    if (!m_msa || m_batch.isEmpty())
+        return;
+
+    const QString id = m_batch.takeFirst();
+    m_currentData.clear();
+    Entry &entry = m_entries[id];
+    ++entry.attempts;
+    entry.lastError = message;
+    entry.nextAttempt = QDateTime::currentDateTime().addSecs(retryDelay(entry.attempts));
+    QString errorMessage;
+    if (!saveEntry(entry, &errorMessage) && m_model)
+        m_model->logTrace(0, Common::LOG_OTHER, QLatin1String("Outbox"), errorMessage);
+    if (entry.isGivenUp()) {
+        emit messageGivenUp(id, message);
+        emit countChanged(count());
+    } else {
+        emit messageFailed(id, message);
+    }
+
+    // The rest of this batch would quite likely fail for the very same reason
+    Q_FOREACH(const QString &other, m_batch) {
+        Entry &postponed = m_entries[other];
+        if (postponed.nextAttempt < entry.nextAttempt) {
+            postponed.nextAttempt = entry.nextAttempt;
+            saveEntry(postponed, &errorMessage);
+        }
+    }
+    m_batch.clear();
+    finishSession();
+}
+
+void Outbox::finishSession()
+{
+    disconnect(m_msa, 0, this, 0);
+    disconnect(this, 0, m_msa, 0);
+    m_msa->endSession();
+    new Common::DeleteAfter(m_msa, msaLingerMs);
+    m_msa = 0;
+    m_currentData.clear();
+    saveDelivered();
+    scheduleRetry();
+}
+
+/** @short Save all delivered messages into their target folders over IMAP, using one bulk APPEND per folder */
+void Outbox::saveDelivered()
+{
+    if (!m_model || !m_model->isNetworkAvailable())
+        return;
+
+    QStringList alreadySaving;
+    Q_FOREACH(const QStringList &ids, m_pendingSaves) {
+        alreadySaving << ids;
+    }
+
+    QMap<QString, QStringList> idsByFolder;
+    QMap<QString, QList<Imap::Mailbox::AppendItem> > itemsByFolder;
+    Q_FOREACH(const Entry &entry, m_entries) {
+        if (!entry.delivered || alreadySaving.contains(entry.id))
+            continue;
+        idsByFolder[entry.sentFolder] << entry.id;
+        itemsByFolder[entry.sentFolder] << Imap::Mailbox::AppendItem(messagePath(entry.id),
+                                                                     QStringList() << QLatin1String("\\Seen"),
+                                                                     entry.timestamp);
+    }
+
+    for (QMap<QString, QStringList>::const_iterator it = idsByFolder.constBegin(); it != idsByFolder.constEnd(); ++it) {
+        Imap::Mailbox::BulkAppendTask *task = m_model->bulkAppendIntoMailbox(it.key(), itemsByFolder[it.key()]);
+        m_pendingSaves[task] = *it;
+        connect(task, SIGNAL(itemAppended(int)), this, SLOT(slotAppendItemSucceeded(int)));
+        connect(task, SIGNAL(itemFailed(int,QString)), this, SLOT(slotAppendItemFailed(int,QString)));
+        connect(task, SIGNAL(completed(Imap::Mailbox::ImapTask*)), this, SLOT(slotAppendFinished()));
+        connect(task, SIGNAL(failed(QString)), this, SLOT(slotAppendFinished()));
+    }
+}
+
+void Outbox::slotAppendItemSucceeded(const int index)
+{
+    const QStringList ids = m_pendingSaves.value(static_cast<Imap::Mailbox::ImapTask*>(sender()));
+    if (index >= 0 && index < ids.size())
+        removeEntry(ids[index]);
+}
+
+void Outbox::slotAppendItemFailed(const int index, const QString &message)
+{
+    // The message stays around as a delivered one, so the next flush() will try to save it again
+    const QStringList ids = m_pendingSaves.value(static_cast<Imap::Mailbox::ImapTask*>(sender()));
+    if (index >= 0 && index < ids.size() && m_model) {
+        m_model->logTrace(0, Common::LOG_OTHER, QLatin1String("Outbox"),
+                          QString::fromUtf8("Cannot save message %1 to %2: %3").arg(
+                              ids[index], m_entries.value(ids[index]).sentFolder, message));
+    }
+}
+
+void Outbox::slotAppendFinished()
+{
+    m_pendingSaves.remove(static_cast<Imap::Mailbox::ImapTask*>(sender()));
+}
+
+/** @short Make sure that flush() gets called once the earliest postponed message is due */
+void Outbox::scheduleRetry()
+{
+    QDateTime earliest;
+    Q_FOREACH(const Entry &entry, m_entries) {
+        if (!entry.delivered && !entry.isGivenUp() && (!earliest.isValid() || entry.nextAttempt < earliest))
+            earliest = entry.nextAttempt;
+    }
+    if (!earliest.isValid()) {
+        m_retryTimer->stop();
+        return;
+    }
+    m_retryTimer->start(static_cast<int>(
+                            qBound<qint64>(0, QDateTime::currentDateTime().secsTo(earliest), maximalRetryDelay)) * 1000);
+}
+
+void Outbox::loadQueue()
+{
+    const QString suffix = QLatin1String(".envelope");
+    QDir dir(m_directory);
+    Q_FOREACH(const QString &fileName, dir.entryList(QStringList() << QLatin1String("*.envelope"), QDir::Files)) {
+        QFile file(dir.filePath(fileName));
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_4_6);
+        quint32 magic, version;
+        stream >> magic >> version;
+        if (stream.status() != QDataStream::Ok || magic != envelopeMagic || version != envelopeVersion)
+            continue;
+
+        Entry entry;
+        qint32 attempts;
+        entry.id = fileName.left(fileName.size() - suffix.size());
+        stream >> entry.from >> entry.recipients >> entry.sentFolder >> entry.timestamp >> entry.queuedAt
+               >> attempts >> entry.nextAttempt >> entry.delivered >> entry.lastError;
+        entry.attempts = attempts;
+        if (stream.status() != QDataStream::Ok || !QFile::exists(messagePath(entry.id)))
+            continue;
+        m_entries[entry.id] = entry;
+    }
+}
+
+/** @short Store the envelope of a queued message, replacing its previous version */
+bool Outbox::saveEntry(const Entry &entry, QString *errorMessage) const
+{
+    const QString target = envelopePath(entry.id);
+    QFile file(target + QLatin1String(".tmp"));
+    if (!file.open(QIODevice::WriteOnly)) {
+        *errorMessage = tr("Cannot store the message envelope in %1: %2").arg(file.fileName(), file.errorString());
+        return false;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream << envelopeMagic << envelopeVersion << entry.from << entry.recipients << entry.sentFolder << entry.timestamp
+           << entry.queuedAt << static_cast<qint32>(entry.attempts) << entry.nextAttempt << entry.delivered
+           << entry.lastError;
+    file.close();
+    if (stream.status() != QDataStream::Ok || file.error() != QFile::NoError) {
+        *errorMessage = tr("Cannot store the message envelope in %1: %2").arg(file.fileName(), file.errorString());
+        file.remove();
+        return false;
+    }
+    QFile::remove(target);
+    if (!file.rename(target)) {
+        *errorMessage = tr("Cannot store the message envelope in %1: %2").arg(target, file.errorString());
+        return false;
+    }
+    return true;
+}
+
+void Outbox::removeEntry(const QString &id)
+{
+    QFile::remove(envelopePath(id));
+    QFile::remove(messagePath(id));
+    m_entries.remove(id);
+}
+
+QString Outbox::messagePath(const QString &id) const
+{
+    return m_directory + id + QLatin1String(".eml");
+}
+
+QString Outbox::envelopePath(const QString &id) const
+{
+    return m_directory + id + QLatin1String(".envelope");
+}
+
+QSharedPointer<QIODevice> Outbox::openMessage(const QString &id) const
+{
+    QFile *file = new QFile(messagePath(id));
+    if (!file->open(QIODevice::ReadOnly)) {
+        delete file;
+        return QSharedPointer<QIODevice>();
+    }
+    return QSharedPointer<QIODevice>(file);
+}
+
+}
@@ -0,0 +1,161 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COMPOSER_OUTBOX_H
+#define COMPOSER_OUTBOX_H
+
+#include <QDateTime>
+#include <QMap>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QStringList>
+
+class QIODevice;
+class QTimer;
+
+namespace Imap {
+namespace Mailbox {
+class ImapTask;
+class Model;
+}
+}
+
+namespace MSA {
+class AbstractMSA;
+class MSAFactory;
+}
+
+namespace Composer {
+
+class MessageComposer;
+
+/** @short Persistent queue of messages which are waiting for submission
+
+Each queued message is serialized exactly once and stored in the outbox directory along with its envelope, so the
+queue survives restarts of the application. The messages are submitted in the background; all messages which are due
+are sent through a single MSA session so that an SMTP connection can be reused across them. Nothing is submitted
+while the IMAP model is offline, and everything becomes due again as soon as the network comes back. A failed attempt
+is retried later with an exponential backoff, until the outbox gives up after maximalAttempts; such a message stays in
+the queue until it is retried explicitly.
+
+Once a message has been delivered, it gets saved to the requested IMAP folder. The copy in the outbox is only removed
+after that save has succeeded, but a delivered message is never submitted again.
+*/
+class Outbox: public QObject
+{
+    Q_OBJECT
+public:
+    Outbox(QObject *parent, Imap::Mailbox::Model *model, MSA::MSAFactory *msaFactory, const QString &directory);
+    virtual ~Outbox();
+
+    void setMsaFactory(MSA::MSAFactory *msaFactory);
+
+    bool enqueue(const MessageComposer *composer, const QString &sentFolderName, QString *errorMessage);
+    int count() const;
+    QStringList pendingIds() const;
+    QStringList failedIds() const;
+    QList<QByteArray> recipients(const QString &id) const;
+    QString lastError(const QString &id) const;
+
+    static int retryDelay(const int attempts);
+
+    /** @short Number of failed attempts after which the message is not retried automatically anymore */
+    static const int maximalAttempts;
+
+public slots:
+    void flush();
+    void retry(const QString &id);
+    void retryAllFailed();
+    void setPassword(const QString &password);
+    void cancelPassword();
+
+signals:
+    void countChanged(const int count);
+    void messageSent(const QString &id);
+    /** @short An attempt to submit the message has failed, it will be retried later */
+    void messageFailed(const QString &id, const QString &message);
+    /** @short The last attempt to submit the message has failed; it won't be retried unless asked to */
+    void messageGivenUp(const QString &id, const QString &message);
+    void passwordRequested(const QString &user, const QString &host);
+    void gotPassword(const QString &password);
+    void canceled();
+
+private slots:
+    void slotNetworkPolicyChanged();
+    void slotMsaSent();
+    void slotMsaFailed(const QString &message);
+    void slotAppendItemSucceeded(const int index);
+    void slotAppendItemFailed(const int index, const QString &message);
+    void slotAppendFinished();
+
+private:
+    /** @short Everything which has to be remembered about a queued message */
+    struct Entry {
+        QString id;
+        QByteArray from;
+        QList<QByteArray> recipients;
+        QString sentFolder;
+        QDateTime timestamp;
+        QDateTime queuedAt;
+        int attempts;
+        QDateTime nextAttempt;
+        bool delivered;
+        QString lastError;
+
+        Entry(): attempts(0), delivered(false) {}
+
+        bool isGivenUp() const { return !delivered && attempts >= maximalAttempts; }
+    };
+
+    void loadQueue();
+    bool saveEntry(const Entry &entry, QString *errorMessage) const;
+    void removeEntry(const QString &id);
+    QString messagePath(const QString &id) const;
+    QString envelopePath(const QString &id) const;
+    QSharedPointer<QIODevice> openMessage(const QString &id) const;
+
+    void sendNext();
+    void finishSession();
+    void saveDelivered();
+    void scheduleRetry();
+
+    QPointer<Imap::Mailbox::Model> m_model;
+    MSA::MSAFactory *m_msaFactory;
+    QString m_directory;
+    QMap<QString, Entry> m_entries;
+
+    MSA::AbstractMSA *m_msa;
+    QStringList m_batch;
+    QSharedPointer<QIODevice> m_currentData;
+    /** @short IDs of the messages which are being saved by each of the bulk APPENDs, in the order of their items */
+    QMap<Imap::Mailbox::ImapTask*, QStringList> m_pendingSaves;
+    QTimer *m_retryTimer;
+    /** @short Was the network available when we checked the last time? */
+    bool m_networkAvailable;
+
+    Outbox(const Outbox &); // don't implement
+    Outbox &operator=(const Outbox &); // don't implement
+};
+
+}
+
+#endif // COMPOSER_OUTBOX_H
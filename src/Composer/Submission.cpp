@@ -193,15 +193,20 @@ void Submission::send()
 
 void Submission::slotMessageDataAvailable()
 {
-    m_rawMessageData.clear();
-    QBuffer buf(&m_rawMessageData);
-    buf.open(QIODevice::WriteOnly);
     QString errorMessage;
     QList<Imap::Mailbox::CatenatePair> catenateable;
 
-    if (shouldBuildMessageLocally() && !m_composer->asRawMessage(&buf, &errorMessage)) {
-        gotError(tr("Cannot send right now -- saving failed:\n %1").arg(errorMessage));
-        return;
+    // The very same stream is used for both APPEND and the MSA so that the Message-Id and the MIME boundaries match
+    if (shouldBuildMessageLocally()) {
+        m_rawMessageStream = m_composer->asRawMessageStream(&errorMessage);
+        if (!m_rawMessageStream) {
+            gotError(tr("Cannot send right now -- saving failed:\n %1").arg(errorMessage));
+            return;
+        }
+    } else {
+        QBuffer *emptyBuffer = new QBuffer();
+        emptyBuffer->open(QIODevice::ReadOnly);
+        m_rawMessageStream = QSharedPointer<QIODevice>(emptyBuffer);
     }
     if (m_model->isCatenateSupported() && !m_composer->asCatenateData(catenateable, &errorMessage)) {
         gotError(tr("Cannot send right now -- saving (CATENATE) failed:\n %1").arg(errorMessage));
@@ -229,7 +234,7 @@ void Submission::slotMessageDataAvailable()
             appendTask = QPointer<Imap::Mailbox::AppendTask>(
                         m_model->appendIntoMailbox(
                             m_sentFolderName,
-                            m_rawMessageData,
+                            m_rawMessageStream,
                             QStringList() << QLatin1String("\\Seen"),
                             m_composer->timestamp()));
         }
@@ -281,7 +286,9 @@ void Submission::slotInvokeMsaNow()
     } else if (m_genUrlAuthReceived && m_useBurl) {
         msa->sendBurl(m_composer->rawFromAddress(), m_composer->rawRecipientAddresses(), m_urlauth.toUtf8());
     } else {
-        msa->sendMail(m_composer->rawFromAddress(), m_composer->rawRecipientAddresses(), m_rawMessageData);
+        // The APPEND might have read the stream already
+        m_rawMessageStream->seek(0);
+        msa->sendMail(m_composer->rawFromAddress(), m_composer->rawRecipientAddresses(), m_rawMessageStream);
     }
 }
 
@@ -24,6 +24,7 @@
 
 #include <QPersistentModelIndex>
 #include <QPointer>
+#include <QSharedPointer>
 
 #include "Recipients.h"
 
@@ -130,7 +131,7 @@ private:
     bool m_useImapSubmit;
 
     SubmissionProgress m_state;
-    QByteArray m_rawMessageData;
+    QSharedPointer<QIODevice> m_rawMessageStream;
     int m_msaMaximalProgress;
 
     MessageComposer *m_composer;
@@ -43,6 +43,7 @@
 #include "Composer/MessageComposer.h"
 #include "Composer/ReplaceSignature.h"
 #include "Composer/Mailto.h"
+#include "Composer/Outbox.h"
 #include "Composer/SenderIdentitiesModel.h"
 #include "Composer/Submission.h"
 #include "Common/InvokeMethod.h"
@@ -710,6 +711,22 @@ void ComposeWidget::send()
     if (!buildMessageData())
         return;
 
+    if (!m_mainWindow->imapModel()->isNetworkAvailable() && m_mainWindow->outbox()) {
+        // There's no point in blocking this window until we get online again; the outbox will take care of that
+        QString errorMessage;
+        const bool saveToSent = m_settings->value(Common::SettingsNames::composerSaveToImapKey, true).toBool();
+        if (!m_mainWindow->outbox()->enqueue(m_submission->composer(),
+                                             saveToSent ?
+                                                 m_settings->value(Common::SettingsNames::composerImapSentKey, tr("Sent")).toString() :
+                                                 QString(),
+                                             &errorMessage)) {
+            gotError(tr("Cannot queue the message for sending: %1").arg(errorMessage));
+            return;
+        }
+        sent();
+        return;
+    }
+
     const bool reuseImapCreds = m_settings->value(Common::SettingsNames::smtpAuthReuseImapCredsKey, false).toBool();
     m_submission->setImapOptions(m_settings->value(Common::SettingsNames::composerSaveToImapKey, true).toBool(),
                                  m_settings->value(Common::SettingsNames::composerImapSentKey, tr("Sent")).toString(),
@@ -1227,6 +1244,19 @@ void ComposeWidget::sent()
 {
     // FIXME: move back to the currently selected mailbox
 
+    // Remember whom we have written to, so that these addresses get offered first when completing the recipients
+    Plugins::AddressbookPlugin *addressbook = m_mainWindow->pluginManager()->addressbook();
+    QList<QPair<Composer::RecipientKind, Imap::Message::MailAddress> > recipients;
+    QString errorMessage;
+    if (addressbook && parseRecipients(recipients, errorMessage)) {
+        Plugins::NameEmailList learned;
+        for (QList<QPair<Composer::RecipientKind, Imap::Message::MailAddress> >::const_iterator it = recipients.constBegin();
+             it != recipients.constEnd(); ++it) {
+            learned << Plugins::NameEmail(it->second.name, it->second.mailbox + QLatin1Char('@') + it->second.host);
+        }
+        addressbook->learnRecipients(learned);
+    }
+
     m_sentMail = true;
     QTimer::singleShot(0, this, SLOT(close()));
 }
@@ -1242,8 +1272,6 @@ bool ComposeWidget::parseRecipients(QList<QPair<Composer::RecipientKind, Imap::M
         Imap::Message::MailAddress addr;
         bool ok = Imap::Message::MailAddress::fromPrettyString(addr, text);
         if (ok) {
-            // TODO: should we *really* learn every junk entered into a recipient field?
-            // m_mainWindow->addressBook()->learn(addr);
             results << qMakePair(kind, addr);
         } else {
             errorMessage = tr("Can't parse \"%1\" as an e-mail address.").arg(text);
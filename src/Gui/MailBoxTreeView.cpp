@@ -25,6 +25,7 @@
 #include <QDragMoveEvent>
 #include <QDropEvent>
 #include <QMenu>
+#include <QMimeData>
 #include "UiUtils/IconLoader.h"
 
 namespace Gui {
@@ -57,7 +58,7 @@ void MailBoxTreeView::dragMoveEvent(QDragMoveEvent *event)
     QTreeView::dragMoveEvent(event);
     if (!event->isAccepted())
         return;
-    if (event->keyboardModifiers() == Qt::ShiftModifier)
+    if (event->keyboardModifiers() == Qt::ShiftModifier && !isFileDrop(event))
         event->setDropAction(Qt::MoveAction);
     else
         event->setDropAction(Qt::CopyAction);
@@ -70,7 +71,10 @@ void MailBoxTreeView::dragMoveEvent(QDragMoveEvent *event)
 */
 void MailBoxTreeView::dropEvent(QDropEvent *event)
 {
-    if (event->keyboardModifiers() == Qt::ControlModifier) {
+    if (isFileDrop(event)) {
+        // Files are uploaded as they get read, so they can only ever be copied
+        event->setDropAction(Qt::CopyAction);
+    } else if (event->keyboardModifiers() == Qt::ControlModifier) {
         event->setDropAction(Qt::CopyAction);
     } else if (event->keyboardModifiers() == Qt::ShiftModifier) {
         event->setDropAction(Qt::MoveAction);
@@ -94,4 +98,11 @@ void MailBoxTreeView::dropEvent(QDropEvent *event)
     QTreeView::dropEvent(event);
 }
 
+/** @short Are there files being dropped from outside rather than messages from another mailbox? */
+bool MailBoxTreeView::isFileDrop(const QDropEvent *event)
+{
+    return event->mimeData()->hasUrls() &&
+            !event->mimeData()->hasFormat(QLatin1String("application/x-trojita-message-list"));
+}
+
 }
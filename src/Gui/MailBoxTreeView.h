@@ -37,6 +37,8 @@ public:
 protected:
     void dragMoveEvent(QDragMoveEvent *event);
     void dropEvent(QDropEvent *event);
+private:
+    static bool isFileDrop(const QDropEvent *event);
 };
 }
 
@@ -22,6 +22,7 @@
 #include <QApplication>
 #include <QFileDialog>
 #include <QNetworkReply>
+#include <QWebElement>
 #include <QWebFrame>
 
 #include "SimplePartWidget.h"
@@ -30,19 +31,22 @@
 #include "Gui/MessageView.h" // so that the compiler knows that it's a QObject
 #include "Gui/Util.h"
 #include "Imap/Encoders.h"
+#include "Imap/Model/Cache.h"
 #include "Imap/Model/ItemRoles.h"
 #include "Imap/Model/MailboxTree.h"
 #include "Imap/Model/Model.h"
 #include "Imap/Network/FileDownloadManager.h"
 #include "Imap/Model/Utils.h"
 #include "UiUtils/Color.h"
+#include "UiUtils/IncrementalPlainTextFormatter.h"
 
 namespace Gui
 {
 
 SimplePartWidget::SimplePartWidget(QWidget *parent, Imap::Network::MsgPartNetAccessManager *manager,
                                    const QModelIndex &partIndex, MessageView *messageView):
-    EmbeddedWebView(parent, manager), m_partIndex(partIndex), m_messageView(messageView), m_netAccessManager(manager)
+    EmbeddedWebView(parent, manager), m_partIndex(partIndex), m_messageView(messageView), m_netAccessManager(manager),
+    m_formatter(0)
 {
     Q_ASSERT(partIndex.isValid());
 
@@ -56,19 +60,11 @@ SimplePartWidget::SimplePartWidget(QWidget *parent, Imap::Network::MsgPartNetAcc
     url.setHost(QLatin1String("msg"));
     url.setPath(partIndex.data(Imap::Mailbox::RolePartPathToPart).toString());
     if (partIndex.data(Imap::Mailbox::RolePartMimeType).toString() == QLatin1String("text/plain")) {
-        if (partIndex.data(Imap::Mailbox::RolePartOctets).toUInt() < 100 * 1024) {
-            connect(this, SIGNAL(loadFinished(bool)), this, SLOT(slotMarkupPlainText()));
-        } else {
-            QFont font = Gui::Util::systemMonospaceFont();
-            setStaticWidth(QFontMetrics(font).maxWidth()*90);
-            QWebSettings *s = settings();
-            // TODO wtf does this not work?
-            const QString css(QLatin1String("data:text/css;charset=utf-8;base64,") +
-                              QLatin1String(QByteArray("pre{word-wrap:normal !important;white-space:pre !important;}").toBase64()));
-            s->setUserStyleSheetUrl(css);
-            s->setFontFamily(QWebSettings::StandardFont, font.family());
-        }
+        // Huge parts are formatted incrementally, see slotMarkupPlainText()
+        connect(this, SIGNAL(loadFinished(bool)), this, SLOT(slotMarkupPlainText()));
     }
+    // The chunks of a huge part which arrive while the first screen is still being loaded have to wait
+    connect(this, SIGNAL(loadFinished(bool)), this, SLOT(slotAppendPendingMarkup()));
     load(url);
 
     m_savePart = new QAction(tr("Save this message part..."), this);
@@ -111,11 +107,102 @@ void SimplePartWidget::slotMarkupPlainText()
         return;
 
     QPalette palette = QApplication::palette();
-
-    // and finally set the marked up page.
-    page()->mainFrame()->setHtml(UiUtils::htmlizedTextPart(m_partIndex, Gui::Util::systemMonospaceFont(),
+    const QString header = UiUtils::htmlizedTextPartHeader(Gui::Util::systemMonospaceFont(),
                                                            palette.base().color(), palette.text().color(),
-                                                           palette.link().color(), palette.linkVisited().color()));
+                                                           palette.link().color(), palette.linkVisited().color());
+    const UiUtils::FlowedFormat flowed = UiUtils::flowedFormatForPart(m_partIndex);
+
+    // The markup only depends on the part's data and its format=flowed setting; the styling is in the header
+    QString markup;
+    Imap::Mailbox::AbstractCache *cache = renderedPartCache();
+    if (cache) {
+        markup = cache->renderedPart(m_partIndex.data(Imap::Mailbox::RoleMailboxName).toString(),
+                                     m_partIndex.data(Imap::Mailbox::RoleMessageUid).toUInt(),
+                                     m_partIndex.data(Imap::Mailbox::RolePartId).toByteArray(),
+                                     UiUtils::plainTextToHtmlCacheVariant(flowed));
+    }
+    if (!markup.isNull() && markup.size() < UiUtils::IncrementalPlainTextFormatter::minimalIncrementalSize) {
+        page()->mainFrame()->setHtml(header + markup + UiUtils::htmlizedTextPartFooter());
+        return;
+    }
+
+    delete m_formatter;
+    m_formatter = 0;
+    m_pendingMarkup.clear();
+    if (!markup.isNull()) {
+        // Even the cached markup of a huge part is too much for a single setHtml()
+        m_formatter = new UiUtils::IncrementalPlainTextFormatter(this);
+        connect(m_formatter, SIGNAL(chunkReady(QString)), this, SLOT(slotAppendMarkedUpChunk(QString)));
+        showFirstScreen(header, m_formatter->replay(markup));
+        return;
+    }
+
+    const QString text = m_partIndex.data(Imap::Mailbox::RolePartUnicodeText).toString();
+    if (text.size() < UiUtils::IncrementalPlainTextFormatter::minimalIncrementalSize) {
+        // We cannot rely on the QWebFrame's toPlainText because of https://bugs.kde.org/show_bug.cgi?id=321160
+        markup = UiUtils::plainTextToHtml(text, flowed);
+        storeRenderedPart(markup);
+        page()->mainFrame()->setHtml(header + markup + UiUtils::htmlizedTextPartFooter());
+        return;
+    }
+
+    // The text is big, so show the first screenful right away and let the rest arrive in the background
+    m_formatter = new UiUtils::IncrementalPlainTextFormatter(this);
+    connect(m_formatter, SIGNAL(chunkReady(QString)), this, SLOT(slotAppendMarkedUpChunk(QString)));
+    connect(m_formatter, SIGNAL(finished()), this, SLOT(slotMarkupFinished()));
+    showFirstScreen(header, m_formatter->start(text, flowed));
+}
+
+void SimplePartWidget::showFirstScreen(const QString &header, QString firstScreen)
+{
+    // The chunks are separated by a newline which is already provided by the footer
+    if (firstScreen.endsWith(QLatin1Char('\n')))
+        firstScreen.chop(1);
+    page()->mainFrame()->setHtml(header + firstScreen + UiUtils::htmlizedTextPartFooter());
+}
+
+void SimplePartWidget::slotAppendMarkedUpChunk(const QString &html)
+{
+    m_pendingMarkup += html;
+    slotAppendPendingMarkup();
+}
+
+void SimplePartWidget::slotAppendPendingMarkup()
+{
+    if (m_pendingMarkup.isEmpty())
+        return;
+    QWebElement pre = page()->mainFrame()->findFirstElement(QLatin1String("pre"));
+    if (pre.isNull())
+        return;
+    pre.appendInside(m_pendingMarkup);
+    m_pendingMarkup.clear();
+}
+
+void SimplePartWidget::slotMarkupFinished()
+{
+    // The formatter keeps the whole markup, so whatever could not be shown yet does not get lost from the cache
+    Q_ASSERT(m_formatter);
+    storeRenderedPart(m_formatter->markup());
+}
+
+/** @short Return the cache which stores the rendered markup of message parts, if any */
+Imap::Mailbox::AbstractCache *SimplePartWidget::renderedPartCache() const
+{
+    const Imap::Mailbox::Model *model = 0;
+    if (!m_partIndex.isValid() || !Imap::Mailbox::Model::realTreeItem(m_partIndex, &model) || !model)
+        return 0;
+    return model->cache();
+}
+
+void SimplePartWidget::storeRenderedPart(const QString &markup)
+{
+    Imap::Mailbox::AbstractCache *cache = renderedPartCache();
+    const uint uid = m_partIndex.data(Imap::Mailbox::RoleMessageUid).toUInt();
+    if (!cache || !uid)
+        return;
+    cache->setRenderedPart(m_partIndex.data(Imap::Mailbox::RoleMailboxName).toString(), uid,
+                           m_partIndex.data(Imap::Mailbox::RolePartId).toByteArray(),
+                           UiUtils::plainTextToHtmlCacheVariant(UiUtils::flowedFormatForPart(m_partIndex)), markup);
 }
 
 void SimplePartWidget::slotFileNameRequested(QString *fileName)
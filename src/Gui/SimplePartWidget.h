@@ -32,8 +32,17 @@
 class QModelIndex;
 class QNetworkReply;
 
+namespace UiUtils
+{
+class IncrementalPlainTextFormatter;
+}
+
 namespace Imap
 {
+namespace Mailbox
+{
+class AbstractCache;
+}
 namespace Network
 {
 class MsgPartNetAccessManager;
@@ -63,6 +72,9 @@ public:
 private slots:
     void slotFileNameRequested(QString *fileName);
     void slotMarkupPlainText();
+    void slotAppendMarkedUpChunk(const QString &html);
+    void slotAppendPendingMarkup();
+    void slotMarkupFinished();
     void slotDownloadPart();
     void slotDownloadMessage();
 signals:
@@ -75,6 +87,13 @@ private:
     QAction *m_findAction;
     MessageView *m_messageView;
     Imap::Network::MsgPartNetAccessManager *m_netAccessManager;
+    UiUtils::IncrementalPlainTextFormatter *m_formatter;
+    /** @short Chunks from m_formatter which could not be appended yet because the document is still loading */
+    QString m_pendingMarkup;
+
+    Imap::Mailbox::AbstractCache *renderedPartCache() const;
+    void storeRenderedPart(const QString &markup);
+    void showFirstScreen(const QString &header, QString firstScreen);
 
     SimplePartWidget(const SimplePartWidget &); // don't implement
     SimplePartWidget &operator=(const SimplePartWidget &); // don't implement
@@ -33,6 +33,7 @@
 #include <QMenuBar>
 #include <QMessageBox>
 #include <QProgressBar>
+#include <QPushButton>
 #include <QScrollBar>
 #include <QSplitter>
 #include <QSslError>
@@ -51,6 +52,7 @@
 #include "Common/PortNumbers.h"
 #include "Common/SettingsNames.h"
 #include "Composer/Mailto.h"
+#include "Composer/Outbox.h"
 #include "Composer/SenderIdentitiesModel.h"
 #include "Imap/Model/ImapAccess.h"
 #include "Imap/Model/MailboxTree.h"
@@ -100,7 +102,8 @@ namespace Gui
 
 MainWindow::MainWindow(QSettings *settings): QMainWindow(), m_imapAccess(0), m_mainHSplitter(0), m_mainVSplitter(0),
     m_mainStack(0), m_layoutMode(LAYOUT_COMPACT), m_skipSavingOfUI(true), m_delayedStateSaving(0), m_actionSortNone(0),
-    m_ignoreStoredPassword(false), m_settings(settings), m_pluginManager(0), m_networkErrorMessageBox(0), m_trayIcon(0)
+    m_actionFailedOutgoingMessages(0), m_ignoreStoredPassword(false), m_settings(settings), m_pluginManager(0), m_networkErrorMessageBox(0), m_trayIcon(0),
+    m_outbox(0)
 {
     setAttribute(Qt::WA_AlwaysShowToolTips);
     // m_pluginManager must be created before calling createWidgets
@@ -284,6 +287,11 @@ void MainWindow::createActions()
     showImapCapabilities = new QAction(tr("IMAP Server In&formation..."), this);
     connect(showImapCapabilities, SIGNAL(triggered()), this, SLOT(slotShowImapInfo()));
 
+    m_actionFailedOutgoingMessages = new QAction(tr("&Failed Outgoing Messages..."), this);
+    m_actionFailedOutgoingMessages->setEnabled(false);
+    connect(m_actionFailedOutgoingMessages, SIGNAL(triggered()), this, SLOT(showFailedOutgoingMessages()));
+    updateFailedOutgoingMessages();
+
     showMenuBar = ShortcutHandler::instance()->createAction(QLatin1String("action_show_menubar"), this);
     showMenuBar->setCheckable(true);
     showMenuBar->setChecked(true);
@@ -575,6 +583,7 @@ void MainWindow::createMenus()
     imapMenu->addSeparator();
     ADD_ACTION(imapMenu, m_forwardAsAttachment);
     imapMenu->addSeparator();
+    ADD_ACTION(imapMenu, m_actionFailedOutgoingMessages);
     ADD_ACTION(imapMenu, expunge);
     imapMenu->addSeparator()->setText(tr("Network Access"));
     QMenu *netPolicyMenu = imapMenu->addMenu(tr("&Network Access"));
@@ -756,6 +765,17 @@ void MainWindow::setupModels()
     connect(imapModel(), SIGNAL(mailboxCreationFailed(QString,QString)), this, SLOT(slotMailboxCreateFailed(QString,QString)));
     connect(imapModel(), SIGNAL(mailboxSyncFailed(QString,QString)), this, SLOT(slotMailboxSyncFailed(QString,QString)));
 
+    // The outbox lives outside of the cache directory so that nuking the cache cannot lose any outgoing mail
+    delete m_outbox;
+    m_outbox = new Composer::Outbox(this, imapModel(), msaFactory(),
+                                    Common::writablePath(Common::LOCATION_DATA) + QLatin1String("outbox/"));
+    connect(m_outbox, SIGNAL(passwordRequested(QString,QString)), this, SLOT(outboxPasswordRequested(QString,QString)),
+            Qt::QueuedConnection);
+    connect(m_outbox, SIGNAL(messageFailed(QString,QString)), this, SLOT(outboxMessageFailed(QString,QString)));
+    connect(m_outbox, SIGNAL(messageGivenUp(QString,QString)), this, SLOT(outboxMessageGivenUp(QString,QString)));
+    connect(m_outbox, SIGNAL(countChanged(int)), this, SLOT(updateFailedOutgoingMessages()));
+    updateFailedOutgoingMessages();
+
     connect(imapModel(), SIGNAL(logged(uint,Common::LogMessage)), imapLogger, SLOT(slotImapLogged(uint,Common::LogMessage)));
     connect(imapModel(), SIGNAL(connectionStateChanged(uint,Imap::ConnectionState)), imapLogger, SLOT(onConnectionClosed(uint,Imap::ConnectionState)));
 
@@ -1141,6 +1161,9 @@ void MainWindow::networkPolicyOnline()
     netExpensive->setChecked(false);
     netOnline->setChecked(true);
     updateActionsOnlineOffline(true);
+    // Some of the MSAs depend on the server's capabilities, so the outbox gets a fresh factory before it starts sending
+    if (m_outbox)
+        m_outbox->setMsaFactory(msaFactory());
 }
 
 /** @short Updates GUI about reconnection attempts */
@@ -1224,6 +1247,101 @@ void MainWindow::authenticationContinue(const QString &password)
     }
 }
 
+void MainWindow::outboxPasswordRequested(const QString &user, const QString &host)
+{
+    if (m_settings->value(Common::SettingsNames::smtpAuthReuseImapCredsKey, false).toBool()) {
+        const QString password = imapModel()->imapPassword();
+        if (!password.isNull()) {
+            m_outbox->setPassword(password);
+            return;
+        }
+    }
+
+    Plugins::PasswordPlugin *password = pluginManager()->password();
+    Plugins::PasswordJob *job = password ?
+                password->requestPassword(QLatin1String("account-0"), QLatin1String("smtp")) : 0;
+    if (job) {
+        connect(job, SIGNAL(passwordAvailable(QString)), m_outbox, SLOT(setPassword(QString)));
+        // The queued messages will be retried later
+        connect(job, SIGNAL(error(Plugins::PasswordJob::Error,QString)), m_outbox, SLOT(cancelPassword()));
+        job->setAutoDelete(true);
+        job->start();
+        return;
+    }
+
+    bool ok;
+    const QString &pass = PasswordDialog::getPassword(this, tr("Authentication Required"),
+                                           tr("<p>Please provide SMTP password for user <b>%1</b> on <b>%2</b>:</p>").arg(
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+                                               Qt::escape(user),
+                                               Qt::escape(host)
+#else
+                                               user.toHtmlEscaped(),
+                                               host.toHtmlEscaped()
+#endif
+                                               ),
+                                           QString(), &ok);
+    if (ok)
+        m_outbox->setPassword(pass);
+    else
+        m_outbox->cancelPassword();
+}
+
+void MainWindow::outboxMessageFailed(const QString &id, const QString &message)
+{
+    Q_UNUSED(id);
+    showStatusMessage(tr("Sending of a queued message failed, it will be retried later: %1").arg(message));
+}
+
+void MainWindow::outboxMessageGivenUp(const QString &id, const QString &message)
+{
+    Q_UNUSED(id);
+    // The outbox is in the middle of its processing, so don't block it by a modal dialog
+    showStatusMessage(tr("Sending of a queued message failed repeatedly, it won't be retried automatically: %1. "
+                         "Use IMAP > Failed Outgoing Messages to try again.").arg(message));
+    updateFailedOutgoingMessages();
+}
+
+void MainWindow::updateFailedOutgoingMessages()
+{
+    if (!m_actionFailedOutgoingMessages)
+        return;
+    const int failed = m_outbox ? m_outbox->failedIds().size() : 0;
+    m_actionFailedOutgoingMessages->setEnabled(failed > 0);
+    m_actionFailedOutgoingMessages->setText(failed > 0 ?
+                                                tr("&Failed Outgoing Messages (%n)...", 0, failed) :
+                                                tr("&Failed Outgoing Messages..."));
+}
+
+void MainWindow::showFailedOutgoingMessages()
+{
+    if (!m_outbox)
+        return;
+    const QStringList ids = m_outbox->failedIds();
+    if (ids.isEmpty())
+        return;
+
+    QStringList details;
+    Q_FOREACH(const QString &id, ids) {
+        QStringList recipients;
+        Q_FOREACH(const QByteArray &recipient, m_outbox->recipients(id)) {
+            recipients << QString::fromUtf8(recipient);
+        }
+        details << tr("To %1: %2").arg(recipients.join(QLatin1String(", ")), m_outbox->lastError(id));
+    }
+
+    QMessageBox box(QMessageBox::Warning, tr("Failed Outgoing Messages"),
+                    tr("%n queued message(s) could not be sent. They are kept in the outbox until you try again.",
+                       0, ids.size()),
+                    QMessageBox::Close, this);
+    box.setDetailedText(details.join(QLatin1String("\n")));
+    QPushButton *retryButton = box.addButton(tr("&Retry Sending"), QMessageBox::AcceptRole);
+    box.setDefaultButton(retryButton);
+    box.exec();
+    if (box.clickedButton() == retryButton && m_outbox)
+        m_outbox->retryAllFailed();
+}
+
 void MainWindow::checkSslPolicy()
 {
     m_imapAccess->setSslPolicy(QMessageBox(static_cast<QMessageBox::Icon>(m_imapAccess->sslInfoIcon()),
@@ -48,6 +48,7 @@ class QTreeView;
 
 namespace Composer
 {
+class Outbox;
 class SenderIdentitiesModel;
 }
 
@@ -103,6 +104,7 @@ public:
     Plugins::PluginManager *pluginManager() { return m_pluginManager; }
     QSettings *settings() const { return m_settings; }
     MSA::MSAFactory *msaFactory();
+    Composer::Outbox *outbox() const { return m_outbox; }
 
     // FIXME: this should be changed to some wrapper when support for multiple accounts is available
     Imap::ImapAccess *imapAccess() const;
@@ -213,6 +215,12 @@ private slots:
 
     void showStatusMessage(const QString &message);
 
+    void outboxPasswordRequested(const QString &user, const QString &host);
+    void outboxMessageFailed(const QString &id, const QString &message);
+    void outboxMessageGivenUp(const QString &id, const QString &message);
+    void updateFailedOutgoingMessages();
+    void showFailedOutgoingMessages();
+
 protected:
     void resizeEvent(QResizeEvent *);
 
@@ -333,6 +341,7 @@ private:
     QAction *m_actionShowOnlySubscribed;
 
     QAction *m_actionContactEditor;
+    QAction *m_actionFailedOutgoingMessages;
 
     QToolBar *m_mainToolbar;
     QToolButton *m_replyButton;
@@ -355,6 +364,8 @@ private:
 
     QSystemTrayIcon *m_trayIcon;
     QPoint m_headerDragStart;
+
+    Composer::Outbox *m_outbox;
 };
 
 }
@@ -21,8 +21,10 @@
 */
 
 #include <QObject>
+#include <QStringList>
 #include <QUrl>
 
+#include "Common/Metrics.h"
 #include "Gui/Window.h"
 
 #include "MainWindowBridge.h"
@@ -51,4 +53,9 @@ void MainWindowBridge::composeMail(const QString &url)
         m_window->slotComposeMailUrl(QUrl::fromEncoded(url.toUtf8()));
 }
 
+QString MainWindowBridge::metrics()
+{
+    return Common::MetricsRegistry::instance()->dump().join(QLatin1String("\n"));
+}
+
 }
@@ -43,6 +43,8 @@ public slots:
     void showMainWindow();
     void showAddressbookWindow();
     void composeMail(const QString &url);
+    /** @short Snapshot of the internal cache and protocol metrics, one metric per line */
+    QString metrics();
 
 private:
     Gui::MainWindow *m_window;
@@ -0,0 +1,55 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef IMAP_APPENDDATA_H
+#define IMAP_APPENDDATA_H
+
+#include <QDateTime>
+#include <QIODevice>
+#include <QSharedPointer>
+#include <QStringList>
+
+namespace Imap {
+namespace Mailbox {
+
+/** @short One message to be uploaded by a bulk APPEND
+
+The message data either come from an already opened random-access device, or from a file which is only opened at the
+time the message is about to be sent, so that a huge number of messages can be queued without keeping them in memory
+or exhausting the file descriptors.
+*/
+struct AppendItem {
+    QString fileName;
+    QSharedPointer<QIODevice> data;
+    QStringList flags;
+    QDateTime timestamp;
+
+    AppendItem() {}
+    AppendItem(const QString &fileName, const QStringList &flags, const QDateTime &timestamp):
+        fileName(fileName), flags(flags), timestamp(timestamp) {}
+    AppendItem(const QSharedPointer<QIODevice> &data, const QStringList &flags, const QDateTime &timestamp):
+        data(data), flags(flags), timestamp(timestamp) {}
+};
+
+}
+}
+
+#endif // IMAP_APPENDDATA_H
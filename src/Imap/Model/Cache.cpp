@@ -33,5 +33,65 @@ AbstractCache::~AbstractCache()
 {
 }
 
+void AbstractCache::clearMessages(const QString &mailbox, const QList<uint> &uids)
+{
+    Q_FOREACH(const uint uid, uids) {
+        clearMessage(mailbox, uid);
+    }
+}
+
+void AbstractCache::copyMessages(const QString &sourceMailbox, const Imap::Uids &sourceUids,
+                                 const QString &targetMailbox, const Imap::Uids &targetUids)
+{
+    for (int i = 0; i < sourceUids.size() && i < targetUids.size(); ++i) {
+        MessageDataBundle metadata = messageMetadata(sourceMailbox, sourceUids[i]);
+        if (metadata.uid) {
+            metadata.uid = targetUids[i];
+            setMessageMetadata(targetMailbox, targetUids[i], metadata);
+        }
+        QStringList flags = msgFlags(sourceMailbox, sourceUids[i]);
+        if (!flags.isEmpty())
+            setMsgFlags(targetMailbox, targetUids[i], flags);
+    }
+    copyMessageParts(sourceMailbox, sourceUids, targetMailbox, targetUids);
+}
+
+bool AbstractCache::requestMessagePart(const QString &mailbox, const uint uid, const QByteArray &partId)
+{
+    Q_UNUSED(mailbox);
+    Q_UNUSED(uid);
+    Q_UNUSED(partId);
+    return false;
+}
+
+void AbstractCache::copyMessageParts(const QString &sourceMailbox, const Imap::Uids &sourceUids,
+                                     const QString &targetMailbox, const Imap::Uids &targetUids)
+{
+    Q_UNUSED(sourceMailbox);
+    Q_UNUSED(sourceUids);
+    Q_UNUSED(targetMailbox);
+    Q_UNUSED(targetUids);
+}
+
+QString AbstractCache::renderedPart(const QString &mailbox, const uint uid, const QByteArray &partId,
+                                    const QByteArray &variant) const
+{
+    Q_UNUSED(mailbox);
+    Q_UNUSED(uid);
+    Q_UNUSED(partId);
+    Q_UNUSED(variant);
+    return QString();
+}
+
+void AbstractCache::setRenderedPart(const QString &mailbox, const uint uid, const QByteArray &partId,
+                                    const QByteArray &variant, const QString &data)
+{
+    Q_UNUSED(mailbox);
+    Q_UNUSED(uid);
+    Q_UNUSED(partId);
+    Q_UNUSED(variant);
+    Q_UNUSED(data);
+}
+
 }
 }
@@ -107,6 +107,15 @@ public:
     virtual void clearAllMessages(const QString &mailbox) = 0;
     /** @short Remove all info for given message in the mailbox from cache */
     virtual void clearMessage(const QString mailbox, const uint uid) = 0;
+    /** @short Remove all info for several messages in the mailbox from cache */
+    virtual void clearMessages(const QString &mailbox, const QList<uint> &uids);
+    /** @short Make everything known about some messages available for their copies in another mailbox, too
+
+    This covers the metadata, flags and message parts. The @arg sourceUids and @arg targetUids correspond to each other
+    item by item, as reported by the COPYUID response code.
+    */
+    virtual void copyMessages(const QString &sourceMailbox, const Imap::Uids &sourceUids,
+                              const QString &targetMailbox, const Imap::Uids &targetUids);
 
     /** @short Returns all known data for a message in the given mailbox (except real parts data) */
     virtual MessageDataBundle messageMetadata(const QString &mailbox, uint uid) const = 0;
@@ -119,10 +128,23 @@ public:
 
     /** @short Return part data or a null QByteArray if none available */
     virtual QByteArray messagePart(const QString &mailbox, const uint uid, const QByteArray &partId) const = 0;
+    /** @short Start loading the part data without blocking the caller
+
+    Returns true when the data will be delivered through the messagePartLoaded() signal. When false is returned, the
+    part has to be looked up through messagePart() as usual. The default implementation never defers anything.
+    */
+    virtual bool requestMessagePart(const QString &mailbox, const uint uid, const QByteArray &partId);
     /** @short Save data for one message part */
     virtual void setMsgPart(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &data) = 0;
     /** @short Drop the data for a message part which is no longer needed */
     virtual void forgetMessagePart(const QString &mailbox, const uint uid, const QByteArray &partId) = 0;
+    /** @short Make the parts of messages which got copied to another mailbox available under their new UIDs as well
+
+    The @arg sourceUids and @arg targetUids correspond to each other item by item, as reported by the COPYUID response
+    code. The default implementation does nothing.
+    */
+    virtual void copyMessageParts(const QString &sourceMailbox, const Imap::Uids &sourceUids,
+                                  const QString &targetMailbox, const Imap::Uids &targetUids);
 
     /** @short Return cached threading info for a given mailbox */
     virtual QVector<Imap::Responses::ThreadingNode> messageThreading(const QString &mailbox) = 0;
@@ -132,9 +154,25 @@ public:
     /** @short How many days is it OK not to mark entries as accessed? */
     virtual void setRenewalThreshold(const int days) = 0;
 
+    /** @short Return a previously stored rendition of a message part, or a null QString if none is available
+
+    The @arg variant is an opaque identification of how the part got rendered; the result is only returned when it
+    matches the value which was passed to setRenderedPart(). The default implementation does not cache anything.
+    */
+    virtual QString renderedPart(const QString &mailbox, const uint uid, const QByteArray &partId,
+                                 const QByteArray &variant) const;
+    /** @short Remember the result of an expensive conversion of a message part for later display
+
+    The entry is dropped whenever the underlying part, message or mailbox gets removed from the cache.
+    */
+    virtual void setRenderedPart(const QString &mailbox, const uint uid, const QByteArray &partId,
+                                 const QByteArray &variant, const QString &data);
+
 signals:
     /** @short Some cache error has occurred */
     void error(const QString &error) const;
+    /** @short Result of a requestMessagePart() call, the data are null when the part could not be loaded after all */
+    void messagePartLoaded(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &data);
 };
 
 }
@@ -21,21 +21,37 @@
 */
 
 #include "CombinedCache.h"
+#include <QSet>
 #include "DiskPartCache.h"
 #include "SQLCache.h"
 
+namespace {
+
+/** @short How many characters of rendered message parts to keep in memory */
+const int renderedPartsMemoryLimit = 8 * 1024 * 1024;
+
+/** @short Rendered parts which are at least this long are also saved to disk */
+const int renderedPartsDiskThreshold = 64 * 1024;
+
+}
+
 namespace Imap
 {
 namespace Mailbox
 {
 
 CombinedCache::CombinedCache(QObject *parent, const QString &name, const QString &cacheDir):
-    AbstractCache(parent), name(name), cacheDir(cacheDir)
+    AbstractCache(parent), renderedParts(renderedPartsMemoryLimit), name(name), cacheDir(cacheDir)
 {
     sqlCache = new SQLCache(this);
     connect(sqlCache, SIGNAL(error(QString)), this, SIGNAL(error(QString)));
     diskPartCache = new DiskPartCache(this, cacheDir);
     connect(diskPartCache, SIGNAL(error(QString)), this, SIGNAL(error(QString)));
+    connect(diskPartCache, SIGNAL(messagePartLoaded(QString,uint,QByteArray,QByteArray)),
+            this, SIGNAL(messagePartLoaded(QString,uint,QByteArray,QByteArray)));
+    // The name of this directory cannot clash with the base64-encoded mailbox names used by the DiskPartCache
+    renderedPartsOnDisk = new DiskPartCache(this, cacheDir + QLatin1String("/rendered-parts"));
+    connect(renderedPartsOnDisk, SIGNAL(error(QString)), this, SIGNAL(error(QString)));
 }
 
 CombinedCache::~CombinedCache()
@@ -90,13 +106,46 @@ void CombinedCache::clearUidMapping(const QString &mailbox)
 void CombinedCache::clearAllMessages(const QString &mailbox)
 {
     sqlCache->clearAllMessages(mailbox);
+    purgeReleasedBlobs();
     diskPartCache->clearAllMessages(mailbox);
+    forgetRenderedParts(mailbox + QLatin1Char('\n'));
+    renderedPartsOnDisk->clearAllMessages(mailbox);
 }
 
 void CombinedCache::clearMessage(const QString mailbox, const uint uid)
 {
     sqlCache->clearMessage(mailbox, uid);
+    purgeReleasedBlobs();
     diskPartCache->clearMessage(mailbox, uid);
+    forgetRenderedParts(mailbox + QLatin1Char('\n') + QString::number(uid) + QLatin1Char('\n'));
+    renderedPartsOnDisk->clearMessage(mailbox, uid);
+}
+
+void CombinedCache::clearMessages(const QString &mailbox, const QList<uint> &uids)
+{
+    if (uids.isEmpty())
+        return;
+    sqlCache->clearMessages(mailbox, uids);
+    purgeReleasedBlobs();
+    diskPartCache->clearMessages(mailbox, uids);
+    QSet<QString> prefixes;
+    Q_FOREACH(const uint uid, uids) {
+        prefixes.insert(mailbox + QLatin1Char('\n') + QString::number(uid) + QLatin1Char('\n'));
+    }
+    Q_FOREACH(const QString &key, renderedParts.keys()) {
+        // The key is "mailbox\nuid\npart", see renderedPartKey()
+        const int uidEnd = key.indexOf(QLatin1Char('\n'), mailbox.size() + 1);
+        if (uidEnd != -1 && prefixes.contains(key.left(uidEnd + 1)))
+            renderedParts.remove(key);
+    }
+    renderedPartsOnDisk->clearMessages(mailbox, uids);
+}
+
+void CombinedCache::copyMessages(const QString &sourceMailbox, const Imap::Uids &sourceUids,
+                                 const QString &targetMailbox, const Imap::Uids &targetUids)
+{
+    sqlCache->copyMessages(sourceMailbox, sourceUids, targetMailbox, targetUids);
+    purgeReleasedBlobs();
 }
 
 QStringList CombinedCache::msgFlags(const QString &mailbox, const uint uid) const
@@ -123,24 +172,56 @@ QByteArray CombinedCache::messagePart(const QString &mailbox, const uint uid, co
 {
     QByteArray res = sqlCache->messagePart(mailbox, uid, partId);
     if (res.isEmpty()) {
-        res = diskPartCache->messagePart(mailbox, uid, partId);
+        QByteArray hash = sqlCache->externalPartHash(mailbox, uid, partId);
+        // Parts saved before the blobs were introduced are still looked up by their name
+        res = hash.isEmpty() ? diskPartCache->messagePart(mailbox, uid, partId) : diskPartCache->blob(hash);
     }
     return res;
 }
 
+bool CombinedCache::requestMessagePart(const QString &mailbox, const uint uid, const QByteArray &partId)
+{
+    // Only the big parts are worth a trip to the reader thread; the small ones are stored in the SQL cache and
+    // messagePart() returns them quickly.
+    QByteArray hash = sqlCache->externalPartHash(mailbox, uid, partId);
+    if (!hash.isEmpty())
+        return diskPartCache->requestBlob(hash, mailbox, uid, partId);
+    return diskPartCache->requestMessagePart(mailbox, uid, partId);
+}
+
 void CombinedCache::setMsgPart(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &data)
 {
     if (data.size() < 1024 * 1024) {
         sqlCache->setMsgPart(mailbox, uid, partId, data);
     } else {
-        diskPartCache->setMsgPart(mailbox, uid, partId, data);
+        QByteArray hash = SQLCache::partHash(data);
+        // The file might have gone missing even though the database still knows about the blob; that's also
+        // the reason why this part is being stored again, so let's not keep fetching it over and over.
+        if ((!sqlCache->hasPartBlob(hash) || !diskPartCache->hasBlob(hash)) && !diskPartCache->setBlob(hash, data)) {
+            // Don't refer to a blob which isn't there
+            sqlCache->forgetMessagePart(mailbox, uid, partId);
+        } else {
+            sqlCache->setExternalMsgPart(mailbox, uid, partId, hash);
+        }
+        diskPartCache->forgetMessagePart(mailbox, uid, partId);
     }
+    purgeReleasedBlobs();
 }
 
 void CombinedCache::forgetMessagePart(const QString &mailbox, const uint uid, const QByteArray &partId)
 {
     sqlCache->forgetMessagePart(mailbox, uid, partId);
+    purgeReleasedBlobs();
     diskPartCache->forgetMessagePart(mailbox, uid, partId);
+    renderedParts.remove(renderedPartKey(mailbox, uid, partId));
+    renderedPartsOnDisk->forgetMessagePart(mailbox, uid, partId);
+}
+
+void CombinedCache::copyMessageParts(const QString &sourceMailbox, const Imap::Uids &sourceUids,
+                                     const QString &targetMailbox, const Imap::Uids &targetUids)
+{
+    sqlCache->copyMessageParts(sourceMailbox, sourceUids, targetMailbox, targetUids);
+    purgeReleasedBlobs();
 }
 
 QVector<Imap::Responses::ThreadingNode> CombinedCache::messageThreading(const QString &mailbox)
@@ -158,5 +239,57 @@ void CombinedCache::setRenewalThreshold(const int days)
     sqlCache->setRenewalThreshold(days);
 }
 
+QString CombinedCache::renderedPart(const QString &mailbox, const uint uid, const QByteArray &partId,
+                                   const QByteArray &variant) const
+{
+    const QString key = renderedPartKey(mailbox, uid, partId);
+    if (RenderedPart *item = renderedParts.object(key)) {
+        return item->variant == variant ? item->data : QString();
+    }
+
+    // The on-disk format is the variant on the first line, followed by the UTF-8 encoded data
+    QByteArray buf = renderedPartsOnDisk->messagePart(mailbox, uid, partId);
+    int lineEnd = buf.indexOf('\n');
+    if (lineEnd == -1 || buf.left(lineEnd) != variant)
+        return QString();
+    QString data = QString::fromUtf8(buf.constData() + lineEnd + 1, buf.size() - lineEnd - 1);
+    renderedParts.insert(key, new RenderedPart(variant, data), data.size());
+    return data;
+}
+
+void CombinedCache::setRenderedPart(const QString &mailbox, const uint uid, const QByteArray &partId,
+                                    const QByteArray &variant, const QString &data)
+{
+    Q_ASSERT(!variant.contains('\n'));
+    renderedParts.insert(renderedPartKey(mailbox, uid, partId), new RenderedPart(variant, data), data.size());
+    if (data.size() >= renderedPartsDiskThreshold) {
+        renderedPartsOnDisk->setMsgPart(mailbox, uid, partId, variant + '\n' + data.toUtf8());
+    }
+}
+
+QString CombinedCache::renderedPartKey(const QString &mailbox, const uint uid, const QByteArray &partId)
+{
+    return mailbox + QLatin1Char('\n') + QString::number(uid) + QLatin1Char('\n') + QString::fromUtf8(partId);
+}
+
+/** @short Delete the files of those big message parts which are no longer referenced from the SQL cache */
+void CombinedCache::purgeReleasedBlobs()
+{
+    Q_FOREACH(const QByteArray &hash, sqlCache->takeReleasedExternalBlobs()) {
+        // The same data might have been stored again in the meanwhile
+        if (!sqlCache->hasPartBlob(hash))
+            diskPartCache->removeBlob(hash);
+    }
+}
+
+/** @short Remove all in-memory rendered parts whose key starts with the given prefix */
+void CombinedCache::forgetRenderedParts(const QString &keyPrefix)
+{
+    Q_FOREACH(const QString &key, renderedParts.keys()) {
+        if (key.startsWith(keyPrefix))
+            renderedParts.remove(key);
+    }
+}
+
 }
 }
@@ -23,6 +23,7 @@
 #ifndef IMAP_MODEL_COMBINEDCACHE_H
 #define IMAP_MODEL_COMBINEDCACHE_H
 
+#include <QCache>
 #include "Cache.h"
 
 namespace Imap
@@ -45,6 +46,14 @@ In future, this should be extended with an in-memory cache (but
 only after the MemoryCache rework) which should only speed-up certain
 operations. This will likely be implemented when we will switch from
 storing the actual data in the various TreeItem* instances.
+
+Big message parts are stored on disk as blobs named after a hash of
+their contents; the SQL cache keeps track of which messages refer to
+them, so that a copied message shares the same file.
+
+The rendered message parts are kept in a bounded in-memory cache. The
+big ones, which are expensive to recreate, are also stored on disk
+so that they survive a restart.
 */
 class CombinedCache : public AbstractCache
 {
@@ -73,6 +82,9 @@ public:
 
     virtual void clearAllMessages(const QString &mailbox);
     virtual void clearMessage(const QString mailbox, const uint uid);
+    virtual void clearMessages(const QString &mailbox, const QList<uint> &uids);
+    virtual void copyMessages(const QString &sourceMailbox, const Imap::Uids &sourceUids,
+                              const QString &targetMailbox, const Imap::Uids &targetUids);
 
     virtual MessageDataBundle messageMetadata(const QString &mailbox, const uint uid) const;
     virtual void setMessageMetadata(const QString &mailbox, const uint uid, const MessageDataBundle &metadata);
@@ -81,22 +93,44 @@ public:
     virtual void setMsgFlags(const QString &mailbox, const uint uid, const QStringList &flags);
 
     virtual QByteArray messagePart(const QString &mailbox, const uint uid, const QByteArray &partId) const;
+    virtual bool requestMessagePart(const QString &mailbox, const uint uid, const QByteArray &partId);
     virtual void setMsgPart(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &data);
     virtual void forgetMessagePart(const QString &mailbox, const uint uid, const QByteArray &partId);
+    virtual void copyMessageParts(const QString &sourceMailbox, const Imap::Uids &sourceUids,
+                                  const QString &targetMailbox, const Imap::Uids &targetUids);
 
     virtual QVector<Imap::Responses::ThreadingNode> messageThreading(const QString &mailbox);
     virtual void setMessageThreading(const QString &mailbox, const QVector<Imap::Responses::ThreadingNode> &threading);
 
     virtual void setRenewalThreshold(const int days);
 
+    virtual QString renderedPart(const QString &mailbox, const uint uid, const QByteArray &partId,
+                                 const QByteArray &variant) const;
+    virtual void setRenderedPart(const QString &mailbox, const uint uid, const QByteArray &partId,
+                                 const QByteArray &variant, const QString &data);
+
     /** @short Open a connection to the cache */
     bool open();
 
 private:
+    struct RenderedPart {
+        QByteArray variant;
+        QString data;
+        RenderedPart(const QByteArray &variant, const QString &data): variant(variant), data(data) {}
+    };
+
+    static QString renderedPartKey(const QString &mailbox, const uint uid, const QByteArray &partId);
+    void forgetRenderedParts(const QString &keyPrefix);
+    void purgeReleasedBlobs();
+
     /** @short The SQL-based cache */
     SQLCache *sqlCache;
     /** @short Cache for bigger message parts */
     DiskPartCache *diskPartCache;
+    /** @short Recently rendered message parts, the cost is their size in characters */
+    mutable QCache<QString, RenderedPart> renderedParts;
+    /** @short Persistent storage for rendered parts which are expensive to recreate */
+    DiskPartCache *renderedPartsOnDisk;
     /** @short Name of the DB connection */
     QString name;
     /** @short Directory to serve as a cache root */
@@ -23,6 +23,10 @@
 #include "DiskPartCache.h"
 #include <QDebug>
 #include <QDir>
+#include <QFileInfo>
+#include <QSet>
+#include <QThread>
+#include "Common/Metrics.h"
 
 namespace
 {
@@ -70,12 +74,22 @@ namespace Imap
 namespace Mailbox
 {
 
-DiskPartCache::DiskPartCache(QObject *parent, const QString &cacheDir_): QObject(parent), cacheDir(cacheDir_)
+DiskPartCache::DiskPartCache(QObject *parent, const QString &cacheDir_):
+    QObject(parent), cacheDir(cacheDir_), m_readerThread(0), m_reader(0)
 {
     if (!cacheDir.endsWith(QLatin1Char('/')))
         cacheDir.append(QLatin1Char('/'));
 }
 
+DiskPartCache::~DiskPartCache()
+{
+    if (m_readerThread) {
+        m_readerThread->quit();
+        m_readerThread->wait();
+        delete m_reader;
+    }
+}
+
 void DiskPartCache::clearAllMessages(const QString &mailbox)
 {
     QDir dir(dirForMailbox(mailbox));
@@ -96,15 +110,72 @@ void DiskPartCache::clearMessage(const QString mailbox, const uint uid)
     }
 }
 
+void DiskPartCache::clearMessages(const QString &mailbox, const QList<uint> &uids)
+{
+    if (uids.isEmpty())
+        return;
+    // Listing the directory once is much cheaper than doing that for each message
+    QSet<uint> wanted = uids.toSet();
+    QDir dir(dirForMailbox(mailbox));
+    Q_FOREACH(const QString& fname, dir.entryList(QStringList() << QLatin1String("*.cache"))) {
+        bool ok;
+        const uint uid = fname.left(fname.indexOf(QLatin1Char('_'))).toUInt(&ok);
+        if (!ok || !wanted.contains(uid))
+            continue;
+        if (! dir.remove(fname)) {
+            emit error(tr("Couldn't remove file %1 for message %2, mailbox %3").arg(fname, QString::number(uid), mailbox));
+        }
+    }
+}
+
 QByteArray DiskPartCache::messagePart(const QString &mailbox, const uint uid, const QByteArray &partId) const
 {
+    static Common::MetricsHistogram *const latency = Common::MetricsRegistry::instance()->histogram(QLatin1String("diskpartcache.messagePart.us"));
+    static Common::MetricsCounter *const hits = Common::MetricsRegistry::instance()->counter(QLatin1String("diskpartcache.messagePart.hits"));
+    static Common::MetricsCounter *const misses = Common::MetricsRegistry::instance()->counter(QLatin1String("diskpartcache.messagePart.misses"));
+    Common::MetricsTimer timer(latency);
     QFile buf(fileForPart(mailbox, uid, partId));
     if (! buf.open(QIODevice::ReadOnly)) {
+        misses->add();
         return QByteArray();
     }
+    hits->add();
     return qUncompress(buf.readAll());
 }
 
+/** @short Read the data for a message part in a background thread
+
+Returns false when the part is not in the cache at all. Otherwise the data are delivered later through the
+messagePartLoaded() signal, so that reading and decompressing big files doesn't block the caller.
+*/
+bool DiskPartCache::requestMessagePart(const QString &mailbox, const uint uid, const QByteArray &partId)
+{
+    static Common::MetricsCounter *const hits = Common::MetricsRegistry::instance()->counter(QLatin1String("diskpartcache.requestMessagePart.hits"));
+    static Common::MetricsCounter *const misses = Common::MetricsRegistry::instance()->counter(QLatin1String("diskpartcache.requestMessagePart.misses"));
+    QString fileName = fileForPart(mailbox, uid, partId);
+    if (!QFile::exists(fileName)) {
+        misses->add();
+        return false;
+    }
+    hits->add();
+    readInBackground(fileName, mailbox, uid, partId);
+    return true;
+}
+
+void DiskPartCache::readInBackground(const QString &fileName, const QString &mailbox, const uint uid, const QByteArray &partId)
+{
+    if (!m_readerThread) {
+        m_readerThread = new QThread(this);
+        m_reader = new DiskPartReader();
+        m_reader->moveToThread(m_readerThread);
+        connect(m_reader, SIGNAL(partRead(QString,uint,QByteArray,QByteArray)),
+                this, SIGNAL(messagePartLoaded(QString,uint,QByteArray,QByteArray)));
+        m_readerThread->start(QThread::LowPriority);
+    }
+    QMetaObject::invokeMethod(m_reader, "readPart", Qt::QueuedConnection, Q_ARG(QString, fileName),
+                              Q_ARG(QString, mailbox), Q_ARG(uint, uid), Q_ARG(QByteArray, partId));
+}
+
 void DiskPartCache::setMsgPart(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &data)
 {
     QString myPath = dirForMailbox(mailbox);
@@ -116,7 +187,68 @@ void DiskPartCache::setMsgPart(const QString &mailbox, const uint uid, const QBy
         emit error(tr("Couldn't save the part %1 of message %2 (mailbox %3) into file %4: %5 (%6)").arg(
                        QString::fromUtf8(partId), QString::number(uid), mailbox, fileName, buf.errorString(), fileErrorToString(buf.error())));
     }
-    buf.write(qCompress(data));
+    static Common::MetricsCounter *const written = Common::MetricsRegistry::instance()->counter(QLatin1String("diskpartcache.bytesWritten"));
+    const qint64 size = buf.write(qCompress(data));
+    if (size > 0)
+        written->add(size);
+}
+
+QByteArray DiskPartCache::blob(const QByteArray &hash) const
+{
+    static Common::MetricsCounter *const hits = Common::MetricsRegistry::instance()->counter(QLatin1String("diskpartcache.blob.hits"));
+    static Common::MetricsCounter *const misses = Common::MetricsRegistry::instance()->counter(QLatin1String("diskpartcache.blob.misses"));
+    QFile buf(fileForBlob(hash));
+    if (! buf.open(QIODevice::ReadOnly)) {
+        misses->add();
+        return QByteArray();
+    }
+    hits->add();
+    return qUncompress(buf.readAll());
+}
+
+/** @short Like requestMessagePart(), but reading a blob which is shared among any number of message parts */
+bool DiskPartCache::requestBlob(const QByteArray &hash, const QString &mailbox, const uint uid, const QByteArray &partId)
+{
+    QString fileName = fileForBlob(hash);
+    if (!QFile::exists(fileName))
+        return false;
+    readInBackground(fileName, mailbox, uid, partId);
+    return true;
+}
+
+bool DiskPartCache::hasBlob(const QByteArray &hash) const
+{
+    return QFile::exists(fileForBlob(hash));
+}
+
+bool DiskPartCache::setBlob(const QByteArray &hash, const QByteArray &data)
+{
+    QString fileName = fileForBlob(hash);
+    QDir().mkpath(QFileInfo(fileName).path());
+    QFile buf(fileName);
+    if (! buf.open(QIODevice::WriteOnly)) {
+        emit error(tr("Couldn't save a message part into file %1: %2 (%3)").arg(
+                       fileName, buf.errorString(), fileErrorToString(buf.error())));
+        return false;
+    }
+    static Common::MetricsCounter *const written = Common::MetricsRegistry::instance()->counter(QLatin1String("diskpartcache.bytesWritten"));
+    const QByteArray compressed = qCompress(data);
+    const qint64 size = buf.write(compressed);
+    if (size > 0)
+        written->add(size);
+    if (size != compressed.size() || !buf.flush()) {
+        emit error(tr("Couldn't save a message part into file %1: %2 (%3)").arg(
+                       fileName, buf.errorString(), fileErrorToString(buf.error())));
+        // Don't leave a truncated file behind, it would be served as a valid blob later on
+        buf.remove();
+        return false;
+    }
+    return true;
+}
+
+void DiskPartCache::removeBlob(const QByteArray &hash)
+{
+    QFile(fileForBlob(hash)).remove();
 }
 
 void DiskPartCache::forgetMessagePart(const QString &mailbox, const uint uid, const QByteArray &partId)
@@ -134,6 +266,24 @@ QString DiskPartCache::fileForPart(const QString &mailbox, const uint uid, const
     return QString::fromUtf8("%1/%2_%3.cache").arg(dirForMailbox(mailbox), QString::number(uid), QString::fromUtf8(partId));
 }
 
+/** @short Blobs are stored in a directory whose name cannot be produced by the base64 encoding of a mailbox name */
+QString DiskPartCache::fileForBlob(const QByteArray &hash) const
+{
+    const QString hex = QString::fromUtf8(hash.toHex());
+    return QString::fromUtf8("%1blobs/%2/%3.blob").arg(cacheDir, hex.left(2), hex);
+}
+
+void DiskPartReader::readPart(const QString &fileName, const QString &mailbox, const uint uid, const QByteArray &partId)
+{
+    static Common::MetricsHistogram *const latency = Common::MetricsRegistry::instance()->histogram(QLatin1String("diskpartcache.backgroundRead.us"));
+    Common::MetricsTimer timer(latency);
+    QFile buf(fileName);
+    QByteArray data;
+    if (buf.open(QIODevice::ReadOnly))
+        data = qUncompress(buf.readAll());
+    emit partRead(mailbox, uid, partId, data);
+}
+
 }
 }
 
@@ -25,12 +25,16 @@
 
 #include <QObject>
 
+class QThread;
+
 namespace Imap
 {
 
 namespace Mailbox
 {
 
+class DiskPartReader;
+
 /** @short Cache for storing big message parts using plain files on the disk
 
 The API is designed to be "similar" to the AbstractCache, but because certain
@@ -43,30 +47,63 @@ class DiskPartCache : public QObject
 public:
     /** @short Create the cache occupying the @arg cacheDir directory */
     DiskPartCache(QObject *parent, const QString &cacheDir);
+    virtual ~DiskPartCache();
 
     /** @short Delete all data of message parts which belongs to that particular mailbox */
     virtual void clearAllMessages(const QString &mailbox);
     /** @short Delete all data for a particular message in the given mailbox */
     virtual void clearMessage(const QString mailbox, const uint uid);
+    /** @short Delete all data for several messages in the given mailbox */
+    virtual void clearMessages(const QString &mailbox, const QList<uint> &uids);
 
     /** @short Return data for some message part, or a null QByteArray if not found */
     virtual QByteArray messagePart(const QString &mailbox, const uint uid, const QByteArray &partId) const;
+    bool requestMessagePart(const QString &mailbox, const uint uid, const QByteArray &partId);
     /** @short Store the data for a specified message part */
     virtual void setMsgPart(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &data);
     virtual void forgetMessagePart(const QString &mailbox, const uint uid, const QByteArray &partId);
 
+    /** @short Return the content-addressed blob identified by @arg hash, or a null QByteArray if not found */
+    QByteArray blob(const QByteArray &hash) const;
+    /** @short Read the blob in a background thread and report it as the data of the specified message part */
+    bool requestBlob(const QByteArray &hash, const QString &mailbox, const uint uid, const QByteArray &partId);
+    /** @short Is the blob identified by @arg hash present on disk? */
+    bool hasBlob(const QByteArray &hash) const;
+    /** @short Store the @arg data as a blob identified by its @arg hash, return true upon success */
+    bool setBlob(const QByteArray &hash, const QByteArray &data);
+    /** @short Delete the blob identified by @arg hash */
+    void removeBlob(const QByteArray &hash);
+
 signals:
     /** @short An error has occurred while performing cache operations */
     void error(const QString &message);
+    /** @short Data requested through requestMessagePart() are available; null data mean that the read has failed */
+    void messagePartLoaded(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &data);
 
 private:
     /** @short Return the directory which should be used as a storage dir for a particular mailbox */
     QString dirForMailbox(const QString &mailbox) const;
 
     QString fileForPart(const QString &mailbox, const uint uid, const QByteArray &partId) const;
+    QString fileForBlob(const QByteArray &hash) const;
+    void readInBackground(const QString &fileName, const QString &mailbox, const uint uid, const QByteArray &partId);
 
     /** @short The root directory for all caching */
     QString cacheDir;
+
+    QThread *m_readerThread;
+    DiskPartReader *m_reader;
+};
+
+/** @short Internal helper of DiskPartCache living in the reader thread */
+class DiskPartReader: public QObject
+{
+    Q_OBJECT
+public slots:
+    void readPart(const QString &fileName, const QString &mailbox, const uint uid, const QByteArray &partId);
+
+signals:
+    void partRead(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &data);
 };
 
 }
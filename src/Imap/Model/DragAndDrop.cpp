@@ -22,7 +22,9 @@
 
 #include "DragAndDrop.h"
 #include <QDataStream>
+#include <QFileInfo>
 #include <QMimeData>
+#include <QUrl>
 #include "Imap/Model/ItemRoles.h"
 
 namespace Imap {
@@ -46,5 +48,37 @@ QMimeData *mimeDataForDragAndDrop(const QModelIndex &index)
     return mimeData;
 }
 
+/** @short Return paths of all local files which are referenced by the dropped data */
+QStringList localFilesForDragAndDrop(const QMimeData *data)
+{
+    QStringList res;
+    Q_FOREACH(const QUrl &url, data->urls()) {
+#if QT_VERSION >= QT_VERSION_CHECK(4, 8, 0)
+        if (url.isLocalFile()) {
+#else
+        if (url.scheme() == QLatin1String("file")) {
+#endif
+            res << url.path();
+        }
+    }
+    return res;
+}
+
+/** @short Prepare the dropped RFC 5322 messages (*.eml files) for an upload through Model::bulkAppendIntoMailbox
+
+The files are not opened here; that only happens once each of them is about to be sent.
+*/
+QList<AppendItem> appendItemsForDroppedFiles(const QMimeData *data)
+{
+    QList<AppendItem> res;
+    Q_FOREACH(const QString &fileName, localFilesForDragAndDrop(data)) {
+        QFileInfo info(fileName);
+        if (!info.isFile() || info.suffix().compare(QLatin1String("eml"), Qt::CaseInsensitive) != 0)
+            continue;
+        res << AppendItem(fileName, QStringList() << QLatin1String("\\Seen"), QDateTime());
+    }
+    return res;
+}
+
 }
 }
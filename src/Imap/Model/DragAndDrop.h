@@ -24,12 +24,18 @@
 #define IMAP_MODEL_DRAGANDDROP_H
 
 #include <QModelIndex>
+#include "AppendData.h"
+
+class QMimeData;
 
 namespace Imap {
 namespace Mailbox {
 
 QMimeData *mimeDataForDragAndDrop(const QModelIndex &index);
 
+QStringList localFilesForDragAndDrop(const QMimeData *data);
+QList<AppendItem> appendItemsForDroppedFiles(const QMimeData *data);
+
 }
 }
 
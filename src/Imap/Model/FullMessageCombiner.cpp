@@ -59,6 +59,24 @@ QByteArray FullMessageCombiner::data() const
     return QByteArray();
 }
 
+/** @short Return the raw header of the message, without making a copy of the whole message as data() does */
+QByteArray FullMessageCombiner::headerData() const
+{
+    if (loaded())
+        return *(headerPartPtr()->dataPtr());
+
+    return QByteArray();
+}
+
+/** @short Return the raw body of the message, without making a copy of the whole message as data() does */
+QByteArray FullMessageCombiner::bodyData() const
+{
+    if (loaded())
+        return *(bodyPartPtr()->dataPtr());
+
+    return QByteArray();
+}
+
 bool FullMessageCombiner::loaded() const
 {
     if (!indexesValid())
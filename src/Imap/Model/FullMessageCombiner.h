@@ -51,6 +51,8 @@ class FullMessageCombiner : public QObject
 public:
     explicit FullMessageCombiner(const QModelIndex &m_messageIndex, QObject *parent = 0);
     QByteArray data() const;
+    QByteArray headerData() const;
+    QByteArray bodyData() const;
     bool loaded() const;
     void load();
 
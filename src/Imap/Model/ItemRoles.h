@@ -182,6 +182,10 @@ enum {
     RoleTaskIsVisible,
     /** @short A short explanaiton of the task -- what is it doing? */
     RoleTaskCompactName,
+    /** @short How many items has the task processed already; only available for tasks which can tell */
+    RoleTaskProgress,
+    /** @short How many items is the task going to process in total */
+    RoleTaskProgressMax,
 
     /** @short Content-Disposition (inline or attachment) of an attachment within MessageComposer
 
@@ -22,6 +22,7 @@
 
 #include "MailboxModel.h"
 #include "MailboxTree.h"
+#include "DragAndDrop.h"
 #include "ItemRoles.h"
 
 #include <QDebug>
@@ -253,7 +254,7 @@ Qt::DropActions MailboxModel::supportedDropActions() const
 
 QStringList MailboxModel::mimeTypes() const
 {
-    return QStringList() << QLatin1String("application/x-trojita-message-list");
+    return QStringList() << QLatin1String("application/x-trojita-message-list") << QLatin1String("text/uri-list");
 }
 
 #if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
@@ -287,6 +288,17 @@ bool MailboxModel::dropMimeData(const QMimeData *data, Qt::DropAction action,
     if (! target->isSelectable())
         return false;
 
+    if (!data->hasFormat(QLatin1String("application/x-trojita-message-list")) && data->hasUrls()) {
+        // The files are only read as they get uploaded, so their source must not go away
+        if (action != Qt::CopyAction)
+            return false;
+        QList<AppendItem> items = appendItemsForDroppedFiles(data);
+        if (items.isEmpty())
+            return false;
+        static_cast<Model *>(sourceModel())->bulkAppendIntoMailbox(target->mailbox(), items);
+        return true;
+    }
+
     QByteArray encodedData = data->data(QLatin1String("application/x-trojita-message-list"));
     QDataStream stream(&encodedData, QIODevice::ReadOnly);
 
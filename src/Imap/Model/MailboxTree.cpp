@@ -47,6 +47,48 @@ QVariantList addresListToQVariant(const QList<Imap::Message::MailAddress> &addre
     return res;
 }
 
+/** @short Translate a series of sequence numbers from EXPUNGE responses to the original positions of the messages
+
+Each EXPUNGE refers to the state of the mailbox after all of the previous ones were applied. The bookkeeping uses a
+Fenwick tree of the messages which are still present, so it takes O(n + k log n) for k expunges in a list of n messages.
+*/
+QVector<int> expungedPositions(const int listSize, const QList<uint> &seqNumbers)
+{
+    QVector<int> tree(listSize + 1, 0);
+    for (int i = 1; i <= listSize; ++i) {
+        ++tree[i];
+        const int j = i + (i & -i);
+        if (j <= listSize)
+            tree[j] += tree[i];
+    }
+    int topBit = 1;
+    while (topBit * 2 <= listSize)
+        topBit *= 2;
+
+    QVector<int> res;
+    res.reserve(seqNumbers.size());
+    int remaining = listSize;
+    Q_FOREACH(const uint number, seqNumbers) {
+        if (number == 0 || number > static_cast<uint>(remaining))
+            throw Imap::UnknownMessageIndex("EXPUNGE references message number which is out-of-bounds");
+        // Find the number-th message which is still present
+        int pos = 0;
+        int left = number;
+        for (int bit = topBit; bit; bit /= 2) {
+            const int next = pos + bit;
+            if (next <= listSize && tree[next] < left) {
+                pos = next;
+                left -= tree[next];
+            }
+        }
+        res << pos;
+        for (int i = pos + 1; i <= listSize; i += i & -i)
+            --tree[i];
+        --remaining;
+    }
+    return res;
+}
+
 }
 
 
@@ -337,8 +379,6 @@ void TreeItemMailbox::handleFetchResponse(Model *const model,
 {
     TreeItemMsgList *list = static_cast<TreeItemMsgList *>(m_children[0]);
 
-    Responses::Fetch::dataType::const_iterator uidRecord = response.data.find("UID");
-
     // Previously, we would ignore any FETCH responses until we are fully synced. This is rather hard do to "properly",
     // though.
     // What we want to achieve is to never store data into a "wrong" message. Theoretically, we are prone to just this
@@ -348,7 +388,7 @@ void TreeItemMailbox::handleFetchResponse(Model *const model,
     // It's worse when the data refer to some immutable piece of information like the bodystructure or body parts.
     // If that happens, then we have to actively prevent the data from being stored because we cannot know whether we would
     // be putting it into a correct bucket^Hmessage.
-    bool ignoreImmutableData = !list->fetched() && uidRecord == response.data.constEnd();
+    bool ignoreImmutableData = !list->fetched() && !response.has(Responses::Fetch::UID);
 
     int number = response.number - 1;
     if (number < 0 || number >= list->m_children.size())
@@ -358,8 +398,8 @@ void TreeItemMailbox::handleFetchResponse(Model *const model,
     TreeItemMessage *message = static_cast<TreeItemMessage *>(list->child(number, model));
 
     // At first, have a look at the response and check the UID of the message
-    if (uidRecord != response.data.constEnd()) {
-        uint receivedUid = static_cast<const Responses::RespData<uint>&>(*(uidRecord.value())).data;
+    if (response.has(Responses::Fetch::UID)) {
+        const uint receivedUid = response.uid;
         if (receivedUid == 0) {
             throw MailboxException(QString::fromUtf8("Server claims that message #%1 has UID 0")
                                    .arg(QString::number(response.number)).toUtf8().constData(), response);
@@ -413,49 +453,48 @@ void TreeItemMailbox::handleFetchResponse(Model *const model,
     bool gotInternalDate = false;
     bool updatedFlags = false;
 
-    for (Responses::Fetch::dataType::const_iterator it = response.data.begin(); it != response.data.end(); ++ it) {
-        if (it.key() == "UID") {
-            // established above
-            Q_ASSERT(static_cast<const Responses::RespData<uint>&>(*(it.value())).data == message->uid());
-        } else if (it.key() == "FLAGS") {
-            // Only emit signals when the flags have actually changed
-            QStringList newFlags = model->normalizeFlags(static_cast<const Responses::RespData<QStringList>&>(*(it.value())).data);
-            bool forceChange = !message->m_flagsHandled || (message->m_flags != newFlags);
-            message->setFlags(list, newFlags);
-            if (forceChange) {
-                updatedFlags = true;
-                changedMessage = message;
-            }
-        } else if (it.key() == "MODSEQ") {
-            quint64 num = static_cast<const Responses::RespData<quint64>&>(*(it.value())).data;
-            if (num > syncState.highestModSeq()) {
-                syncState.setHighestModSeq(num);
-                if (list->accessFetchStatus() == DONE) {
-                    // This means that everything is known already, so we are by definition OK to save stuff to disk.
-                    // We can also skip rebuilding the UID map and save just the HIGHESTMODSEQ, i.e. the SyncState.
-                    model->cache()->setMailboxSyncState(mailbox(), syncState);
-                } else {
-                    // it's already marked as dirty -> nothing to do here
-                }
+    if (response.has(Responses::Fetch::FLAGS)) {
+        // Only emit signals when the flags have actually changed
+        QStringList newFlags = model->normalizeFlags(response.flags);
+        bool forceChange = !message->m_flagsHandled || (message->m_flags != newFlags);
+        message->setFlags(list, newFlags);
+        if (forceChange) {
+            updatedFlags = true;
+            changedMessage = message;
+        }
+    }
+
+    if (response.has(Responses::Fetch::MODSEQ)) {
+        quint64 num = response.modSeq;
+        if (num > syncState.highestModSeq()) {
+            syncState.setHighestModSeq(num);
+            if (list->accessFetchStatus() == DONE) {
+                // This means that everything is known already, so we are by definition OK to save stuff to disk.
+                // We can also skip rebuilding the UID map and save just the HIGHESTMODSEQ, i.e. the SyncState.
+                model->cache()->setMailboxSyncState(mailbox(), syncState);
+            } else {
+                // it's already marked as dirty -> nothing to do here
             }
-        } else if (ignoreImmutableData) {
+        }
+    }
+
+    const uint immutableAttributes = Responses::Fetch::ENVELOPE | Responses::Fetch::BODYSTRUCTURE |
+            Responses::Fetch::RFC822_SIZE | Responses::Fetch::INTERNALDATE;
+    if (ignoreImmutableData) {
+        if ((response.attributes & immutableAttributes) || !response.data.isEmpty()) {
             QByteArray buf;
             QTextStream ss(&buf);
             ss << response;
             ss.flush();
             qDebug() << "Ignoring FETCH response to a mailbox that isn't synced yet:" << buf;
-            continue;
-        } else if (it.key() == "ENVELOPE") {
-            message->data()->m_envelope = static_cast<const Responses::RespData<Message::Envelope>&>(*(it.value())).data;
-            message->setFetchStatus(DONE);
-            gotEnvelope = true;
-            changedMessage = message;
-        } else if (it.key() == "BODYSTRUCTURE") {
+        }
+    } else {
+        if (response.has(Responses::Fetch::BODYSTRUCTURE)) {
             if (message->fetched()) {
                 // The message structure is already known, so we are free to ignore it
             } else {
                 // We had no idea about the structure of the message
-                auto newChildren = static_cast<const Message::AbstractMessage &>(*(it.value())).createTreeItems(message);
+                auto newChildren = response.bodyStructure()->createTreeItems(message);
                 if (!message->m_children.isEmpty()) {
                     QModelIndex messageIdx = message->toIndex(model);
                     model->beginRemoveRows(messageIdx, 0, message->m_children.size() - 1);
@@ -468,74 +507,87 @@ void TreeItemMailbox::handleFetchResponse(Model *const model,
                 }
                 savedBodyStructure = true;
             }
-        } else if (it.key() == "x-trojita-bodystructure") {
-            // do nothing
-        } else if (it.key() == "RFC822.SIZE") {
-            message->data()->m_size = static_cast<const Responses::RespData<uint>&>(*(it.value())).data;
-            gotSize = true;
-        } else if (it.key().startsWith("BODY[HEADER.FIELDS (")) {
-            // Process any headers found in any such response bit
-            const QByteArray &rawHeaders = static_cast<const Responses::RespData<QByteArray>&>(*(it.value())).data;
-            message->processAdditionalHeaders(model, rawHeaders);
+        }
+
+        // The ENVELOPE marks the message as fetched, so it has to be processed after the BODYSTRUCTURE
+        if (response.has(Responses::Fetch::ENVELOPE)) {
+            message->data()->m_envelope = response.envelope();
+            message->setFetchStatus(DONE);
+            gotEnvelope = true;
             changedMessage = message;
-        } else if (it.key().startsWith("BODY[") || it.key().startsWith("BINARY[")) {
-            if (it.key()[ it.key().size() - 1 ] != ']')
-                throw UnknownMessageIndex("Can't parse such BODY[]/BINARY[]", response);
-            TreeItemPart *part = partIdToPtr(model, message, it.key());
-            if (! part)
-                throw UnknownMessageIndex("Got BODY[]/BINARY[] fetch that did not resolve to any known part", response);
-            const QByteArray &data = static_cast<const Responses::RespData<QByteArray>&>(*(it.value())).data;
-            if (it.key().startsWith("BODY[")) {
-
-                // Check whether we are supposed to be loading the raw, undecoded part as well.
-                // The check has to be done via a direct pointer access to m_partRaw to make sure that it does not
-                // get instantiated when not actually needed.
-                if (part->m_partRaw && part->m_partRaw->loading()) {
-                    part->m_partRaw->m_data = data;
-                    part->m_partRaw->setFetchStatus(DONE);
-                    changedParts.append(part->m_partRaw);
-                    if (message->uid()) {
-                        model->cache()->forgetMessagePart(mailbox(), message->uid(), part->partId());
-                        model->cache()->setMsgPart(mailbox(), message->uid(), part->partId() + ".X-RAW", data);
+        }
+
+        if (response.has(Responses::Fetch::RFC822_SIZE)) {
+            message->data()->m_size = response.rfc822Size;
+            gotSize = true;
+        }
+
+        if (response.has(Responses::Fetch::INTERNALDATE)) {
+            message->data()->m_internalDate = response.internalDate();
+            gotInternalDate = true;
+        }
+
+        for (Responses::Fetch::dataType::const_iterator it = response.data.begin(); it != response.data.end(); ++ it) {
+            if (it.key().startsWith("BODY[HEADER.FIELDS (")) {
+                // Process any headers found in any such response bit
+                const QByteArray &rawHeaders = static_cast<const Responses::RespData<QByteArray>&>(*(it.value())).data;
+                message->processAdditionalHeaders(model, rawHeaders);
+                changedMessage = message;
+            } else if (it.key().startsWith("BODY[") || it.key().startsWith("BINARY[")) {
+                if (it.key()[ it.key().size() - 1 ] != ']')
+                    throw UnknownMessageIndex("Can't parse such BODY[]/BINARY[]", response);
+                TreeItemPart *part = partIdToPtr(model, message, it.key());
+                if (! part)
+                    throw UnknownMessageIndex("Got BODY[]/BINARY[] fetch that did not resolve to any known part", response);
+                const QByteArray &data = static_cast<const Responses::RespData<QByteArray>&>(*(it.value())).data;
+                if (it.key().startsWith("BODY[")) {
+                    // Check whether we are supposed to be loading the raw, undecoded part as well.
+                    // The check has to be done via a direct pointer access to m_partRaw to make sure that it does not
+                    // get instantiated when not actually needed.
+                    if (part->m_partRaw && part->m_partRaw->loading()) {
+                        part->m_partRaw->m_data = data;
+                        part->m_partRaw->setFetchStatus(DONE);
+                        changedParts.append(part->m_partRaw);
+                        if (message->uid()) {
+                            model->cache()->forgetMessagePart(mailbox(), message->uid(), part->partId());
+                            model->cache()->setMsgPart(mailbox(), message->uid(), part->partId() + ".X-RAW", data);
+                        }
                     }
-                }
 
-                // Do not overwrite the part data if we were not asked to fetch it.
-                // One possibility is that it's already there because it was fetched before. The second option is that
-                // we were in fact asked to only fetch the raw data and the user is not itnerested in the processed data at all.
-                if (part->loading()) {
-                    // got to decode the part data by hand
-                    Imap::decodeContentTransferEncoding(data, part->encoding(), part->dataPtr());
+                    // Do not overwrite the part data if we were not asked to fetch it.
+                    // One possibility is that it's already there because it was fetched before. The second option is that
+                    // we were in fact asked to only fetch the raw data and the user is not itnerested in the processed data at all.
+                    if (part->loading()) {
+                        // got to decode the part data by hand
+                        Imap::decodeContentTransferEncoding(data, part->encoding(), part->dataPtr());
+                        part->setFetchStatus(DONE);
+                        changedParts.append(part);
+                        if (message->uid()
+                                && model->cache()->messagePart(mailbox(), message->uid(), part->partId() + ".X-RAW").isNull()) {
+                            // Do not store the data into cache if the raw data are already there
+                            model->cache()->setMsgPart(mailbox(), message->uid(), part->partId(), part->m_data);
+                        }
+                    }
+
+                } else {
+                    // A BINARY FETCH item is already decoded for us, yay
+                    part->m_data = data;
                     part->setFetchStatus(DONE);
                     changedParts.append(part);
-                    if (message->uid()
-                            && model->cache()->messagePart(mailbox(), message->uid(), part->partId() + ".X-RAW").isNull()) {
-                        // Do not store the data into cache if the raw data are already there
+                    if (message->uid()) {
                         model->cache()->setMsgPart(mailbox(), message->uid(), part->partId(), part->m_data);
                     }
                 }
-
             } else {
-                // A BINARY FETCH item is already decoded for us, yay
-                part->m_data = data;
-                part->setFetchStatus(DONE);
-                changedParts.append(part);
-                if (message->uid()) {
-                    model->cache()->setMsgPart(mailbox(), message->uid(), part->partId(), part->m_data);
-                }
+                qDebug() << "TreeItemMailbox::handleFetchResponse: unknown FETCH identifier" << it.key();
             }
-        } else if (it.key() == "INTERNALDATE") {
-            message->data()->m_internalDate = static_cast<const Responses::RespData<QDateTime>&>(*(it.value())).data;
-            gotInternalDate = true;
-        } else {
-            qDebug() << "TreeItemMailbox::handleFetchResponse: unknown FETCH identifier" << it.key();
         }
     }
     if (message->uid()) {
         if (gotEnvelope && gotSize && savedBodyStructure && gotInternalDate) {
             Imap::Mailbox::AbstractCache::MessageDataBundle dataForCache;
             dataForCache.envelope = message->data()->m_envelope;
-            dataForCache.serializedBodyStructure = static_cast<const Responses::RespData<QByteArray>&>(*(response.data[ "x-trojita-bodystructure" ])).data;
+            dataForCache.serializedBodyStructure = response.serializedBodyStructure();
             dataForCache.size = message->data()->m_size;
             dataForCache.uid = message->uid();
             dataForCache.internalDate = message->data()->m_internalDate;
@@ -579,27 +631,25 @@ void TreeItemMailbox::saveSyncStateAndUids(Model * model)
 void TreeItemMailbox::handleExpunge(Model *const model, const Responses::NumberResponse &resp)
 {
     Q_ASSERT(resp.kind == Responses::EXPUNGE);
-    TreeItemMsgList *list = dynamic_cast<TreeItemMsgList *>(m_children[ 0 ]);
-    Q_ASSERT(list);
-    if (resp.number > static_cast<uint>(list->m_children.size()) || resp.number == 0) {
-        throw UnknownMessageIndex("EXPUNGE references message number which is out-of-bounds");
-    }
-    uint offset = resp.number - 1;
+    handleExpunges(model, QList<uint>() << resp.number);
+}
 
-    model->beginRemoveRows(list->toIndex(model), offset, offset);
-    auto it = list->m_children.begin() + offset;
-    TreeItemMessage *message = static_cast<TreeItemMessage *>(*it);
-    list->m_children.erase(it);
-    model->cache()->clearMessage(static_cast<TreeItemMailbox *>(list->parent())->mailbox(), message->uid());
-    for (int i = offset; i < list->m_children.size(); ++i) {
-        --static_cast<TreeItemMessage *>(list->m_children[i])->m_offset;
-    }
-    model->endRemoveRows();
+/** @short Process a series of EXPUNGE responses at once
 
-    --list->m_totalMessageCount;
-    list->recalcVariousMessageCountsOnExpunge(const_cast<Model *>(model), message);
+The @arg seqNumbers are in the order in which the EXPUNGE responses have arrived, i.e. each of them already accounts for
+the previous ones.
+*/
+void TreeItemMailbox::handleExpunges(Model *const model, const QList<uint> &seqNumbers)
+{
+    TreeItemMsgList *list = dynamic_cast<TreeItemMsgList *>(m_children[ 0 ]);
+    Q_ASSERT(list);
+    QVector<int> rows = expungedPositions(list->m_children.size(), seqNumbers);
+    qSort(rows);
 
-    delete message;
+    QList<TreeItemMessage *> expunged = removeMessages(model, rows);
+    list->m_totalMessageCount -= expunged.size();
+    list->recalcVariousMessageCountsOnExpunge(model, expunged);
+    qDeleteAll(expunged);
 
     // The UID map is not synced at this time, though, and we defer a decision on when to do this to the context
     // of the task which invoked this method. The idea is that this task has a better insight for potentially
@@ -607,6 +657,53 @@ void TreeItemMailbox::handleExpunge(Model *const model, const Responses::NumberR
     // Previously, the code would simetimes do this twice in a row, which is kinda suboptimal...
 }
 
+/** @short Remove messages at the specified @arg rows of the message list and forget about them in the cache
+
+The rows have to be sorted and unique. They are removed in contiguous ranges, from the end of the list, so that the Model's
+users only see one removal per range. The removed messages are returned and shall be deleted by the caller.
+*/
+QList<TreeItemMessage *> TreeItemMailbox::removeMessages(Model *const model, const QVector<int> &rows)
+{
+    QList<TreeItemMessage *> removed;
+    if (rows.isEmpty())
+        return removed;
+
+    TreeItemMsgList *list = dynamic_cast<TreeItemMsgList *>(m_children[ 0 ]);
+    Q_ASSERT(list);
+    QModelIndex listIndex = list->toIndex(model);
+    QList<uint> uids;
+
+    int last = rows.size() - 1;
+    while (last >= 0) {
+        int first = last;
+        while (first > 0 && rows[first - 1] == rows[first] - 1)
+            --first;
+        const int firstRow = rows[first];
+        const int lastRow = rows[last];
+        Q_ASSERT(lastRow < list->m_children.size());
+
+        model->beginRemoveRows(listIndex, firstRow, lastRow);
+        auto begin = list->m_children.begin() + firstRow;
+        auto end = list->m_children.begin() + lastRow + 1;
+        for (auto it = begin; it != end; ++it) {
+            TreeItemMessage *message = static_cast<TreeItemMessage *>(*it);
+            removed << message;
+            if (message->uid())
+                uids << message->uid();
+        }
+        auto it = list->m_children.erase(begin, end);
+        for (; it != list->m_children.end(); ++it) {
+            static_cast<TreeItemMessage *>(*it)->m_offset -= lastRow - firstRow + 1;
+        }
+        model->endRemoveRows();
+
+        last = first - 1;
+    }
+
+    model->cache()->clearMessages(mailbox(), uids);
+    return removed;
+}
+
 void TreeItemMailbox::handleVanished(Model *const model, const Responses::Vanished &resp)
 {
     TreeItemMsgList *list = dynamic_cast<TreeItemMsgList *>(m_children[ 0 ]);
@@ -618,6 +715,51 @@ void TreeItemMailbox::handleVanished(Model *const model, const Responses::Vanish
     // Remove duplicates -- even that garbage can be present in a perfectly valid VANISHED :(
     uids.erase(std::unique(uids.begin(), uids.end()), uids.end());
 
+    bool allUidsKnown = true;
+    for (auto it = list->m_children.constBegin(); allUidsKnown && it != list->m_children.constEnd(); ++it) {
+        allUidsKnown = static_cast<TreeItemMessage *>(*it)->uid() != 0;
+    }
+
+    if (allUidsKnown) {
+        // The usual case -- both lists are sorted by UID, so a single pass over them finds all messages to remove
+        if (!uids.isEmpty() && uids.front() == 0) {
+            qDebug() << "VANISHED informs about removal of UID zero...";
+            model->logTrace(listIndex.parent(), Common::LOG_MAILBOX_SYNC, QLatin1String("TreeItemMailbox::handleVanished"),
+                            QLatin1String("VANISHED contains UID zero for increased fun"));
+            uids.erase(uids.begin());
+        }
+        QVector<int> rows;
+        int unknown = 0;
+        auto uidIt = uids.constBegin();
+        for (int row = 0; row < list->m_children.size() && uidIt != uids.constEnd(); ) {
+            const uint current = static_cast<TreeItemMessage *>(list->m_children[row])->uid();
+            if (current < *uidIt) {
+                ++row;
+            } else if (current > *uidIt) {
+                ++unknown;
+                ++uidIt;
+            } else {
+                rows << row;
+                ++row;
+                ++uidIt;
+            }
+        }
+        unknown += uids.constEnd() - uidIt;
+        if (unknown && resp.earlier != Responses::Vanished::EARLIER) {
+            // VANISHED is free to refer to a non-existing UID...
+            model->logTrace(listIndex.parent(), Common::LOG_MAILBOX_SYNC, QLatin1String("TreeItemMailbox::handleVanished"),
+                            QString::fromUtf8("VANISHED refers to %1 UIDs which weren't found in the mailbox").arg(unknown));
+        }
+        if (!rows.isEmpty()) {
+            const uint highestUid = static_cast<TreeItemMessage *>(list->m_children[rows.last()])->uid();
+            if (syncState.uidNext() <= highestUid) {
+                syncState.setUidNext(highestUid + 1);
+            }
+        }
+        qDeleteAll(removeMessages(model, rows));
+        uids.clear();
+    }
+
     auto it = list->m_children.end();
     while (!uids.isEmpty()) {
         // We have to process each UID separately because the UIDs in the mailbox are not necessarily present
@@ -946,7 +1088,7 @@ void TreeItemMsgList::recalcVariousMessageCounts(Model *model)
     model->emitMessageCountChanged(static_cast<TreeItemMailbox *>(parent()));
 }
 
-void TreeItemMsgList::recalcVariousMessageCountsOnExpunge(Model *model, TreeItemMessage *expungedMessage)
+void TreeItemMsgList::recalcVariousMessageCountsOnExpunge(Model *model, const QList<TreeItemMessage *> &expungedMessages)
 {
     if (m_numberFetchingStatus != DONE) {
         // In case the counts weren't synced before, we cannot really rely on them now -> go to the slow path
@@ -954,13 +1096,15 @@ void TreeItemMsgList::recalcVariousMessageCountsOnExpunge(Model *model, TreeItem
         return;
     }
 
-    bool isRead, isRecent;
-    expungedMessage->checkFlagsReadRecent(isRead, isRecent);
-    if (expungedMessage->m_flagsHandled) {
-        if (!isRead)
-            --m_unreadMessageCount;
-        if (isRecent)
-            --m_recentMessageCount;
+    Q_FOREACH(TreeItemMessage *expungedMessage, expungedMessages) {
+        bool isRead, isRecent;
+        expungedMessage->checkFlagsReadRecent(isRead, isRecent);
+        if (expungedMessage->m_flagsHandled) {
+            if (!isRead)
+                --m_unreadMessageCount;
+            if (isRecent)
+                --m_recentMessageCount;
+        }
     }
     model->emitMessageCountChanged(static_cast<TreeItemMailbox *>(parent()));
 }
@@ -1444,12 +1588,14 @@ TreeItemPart::~TreeItemPart()
 unsigned int TreeItemPart::childrenCount(Model *const model)
 {
     Q_UNUSED(model);
+    materializeChildren();
     return m_children.size();
 }
 
 TreeItem *TreeItemPart::child(const int offset, Model *const model)
 {
     Q_UNUSED(model);
+    materializeChildren();
     if (offset >= 0 && offset < m_children.size())
         return m_children[ offset ];
     else
@@ -1464,6 +1610,33 @@ TreeItemChildrenList TreeItemPart::setChildren(const TreeItemChildrenList &items
     return res;
 }
 
+/** @short Remember the structure of the nested parts without creating the child items right away
+
+Messages with huge MIME trees (think mailing list digests or forwarded archives) would otherwise pay for
+instantiating thousands of items even though only a few of them are ever looked at. The children are created
+once somebody asks about them.
+*/
+void TreeItemPart::setLazyChildren(const QList<QSharedPointer<Message::AbstractMessage> > &bodies)
+{
+    Q_ASSERT(m_children.isEmpty());
+    m_lazyChildren = bodies;
+}
+
+void TreeItemPart::materializeChildren()
+{
+    if (m_lazyChildren.isEmpty())
+        return;
+
+    TreeItemChildrenList children;
+    for (auto it = m_lazyChildren.constBegin(); it != m_lazyChildren.constEnd(); ++it) {
+        children << (*it)->createTreeItems(this);
+    }
+    m_lazyChildren.clear();
+    auto oldChildren = setChildren(children);
+    Q_ASSERT(oldChildren.isEmpty());
+    Q_UNUSED(oldChildren);
+}
+
 void TreeItemPart::fetch(Model *const model)
 {
     if (fetched() || loading() || isUnavailable())
@@ -1485,6 +1658,7 @@ unsigned int TreeItemPart::rowCount(Model *const model)
 {
     // no call to fetch() required
     Q_UNUSED(model);
+    materializeChildren();
     return m_children.size();
 }
 
@@ -1577,9 +1751,9 @@ QVariant TreeItemPart::data(Model *const model, int role)
 
 bool TreeItemPart::hasChildren(Model *const model)
 {
-    // no need to fetch() here
+    // no need to fetch() here, and no need to instantiate the children either
     Q_UNUSED(model);
-    return ! m_children.isEmpty();
+    return !m_children.isEmpty() || !m_lazyChildren.isEmpty();
 }
 
 /** @short Returns true if we're a multipart, top-level item in the body of a message */
@@ -1705,6 +1879,7 @@ void TreeItemPart::silentlyReleaseMemoryRecursive()
     setFetchStatus(NONE);
     qDeleteAll(m_children);
     m_children.clear();
+    m_lazyChildren.clear();
 }
 
 
@@ -54,6 +54,7 @@ class TreeItem
     friend class MsgListModel; // for direct access to m_children
     friend class ThreadingMsgListModel; // for direct access to m_children
     friend class UpdateFlagsOfAllMessagesTask; // for direct access to m_children
+    friend class CopyMoveMessagesTask; // for direct access to m_children
 
 protected:
     /** @short Availability of an item */
@@ -185,6 +186,7 @@ public:
                              bool usingQresync);
     void rescanForChildMailboxes(Model *const model);
     void handleExpunge(Model *const model, const Responses::NumberResponse &resp);
+    void handleExpunges(Model *const model, const QList<uint> &seqNumbers);
     void handleExists(Model *const model, const Responses::NumberResponse &resp);
     void handleVanished(Model *const model, const Responses::Vanished &resp);
     bool isSelectable() const;
@@ -193,6 +195,7 @@ public:
 
 private:
     TreeItemPart *partIdToPtr(Model *model, TreeItemMessage *message, const QByteArray &msgId);
+    QList<TreeItemMessage *> removeMessages(Model *const model, const QVector<int> &rows);
 
     /** @short ImapTask which is currently responsible for well-being of this mailbox */
     QPointer<KeepMailboxOpenTask> maintainingTask;
@@ -223,7 +226,7 @@ public:
     int recentMessageCount(Model *const model);
     void fetchNumbers(Model *const model);
     void recalcVariousMessageCounts(Model *model);
-    void recalcVariousMessageCountsOnExpunge(Model *model, TreeItemMessage *expungedMessage);
+    void recalcVariousMessageCountsOnExpunge(Model *model, const QList<TreeItemMessage *> &expungedMessages);
     void resetWasUnreadState();
     bool numbersFetched() const;
 };
@@ -316,6 +319,9 @@ class TreeItemPart: public TreeItem
     QByteArray m_multipartRelatedStartPart;
     mutable TreeItemPart *m_partMime;
     mutable TreeItemPart *m_partRaw;
+    /** @short BODYSTRUCTURE of the nested parts which have not been turned into child items yet */
+    QList<QSharedPointer<Message::AbstractMessage> > m_lazyChildren;
+    void materializeChildren();
 public:
     TreeItemPart(TreeItem *parent, const QByteArray &mimeType);
     ~TreeItemPart();
@@ -323,6 +329,7 @@ public:
     virtual unsigned int childrenCount(Model *const model);
     virtual TreeItem *child(const int offset, Model *const model);
     virtual TreeItemChildrenList setChildren(const TreeItemChildrenList &items);
+    void setLazyChildren(const QList<QSharedPointer<Message::AbstractMessage> > &bodies);
 
     virtual void fetchFromCache(Model *const model);
     virtual void fetch(Model *const model);
@@ -123,6 +123,25 @@ void MemoryCache::forgetMessagePart(const QString &mailbox, const uint uid, cons
 
 }
 
+void MemoryCache::copyMessageParts(const QString &sourceMailbox, const Imap::Uids &sourceUids,
+                                   const QString &targetMailbox, const Imap::Uids &targetUids)
+{
+#ifdef CACHE_DEBUG
+    qDebug() << "copy message parts" << sourceMailbox << sourceUids << targetMailbox << targetUids;
+#endif
+    if (!parts.contains(sourceMailbox))
+        return;
+    // A shallow copy, so that inserting into the target mailbox cannot invalidate it
+    const QMap<uint, QMap<QByteArray, QByteArray> > source = parts[sourceMailbox];
+    for (int i = 0; i < sourceUids.size() && i < targetUids.size(); ++i) {
+        QMap<uint, QMap<QByteArray, QByteArray> >::const_iterator it = source.constFind(sourceUids[i]);
+        if (it == source.constEnd())
+            continue;
+        // The copy is cheap thanks to the implicit sharing of the QByteArrays
+        parts[targetMailbox][targetUids[i]] = *it;
+    }
+}
+
 void MemoryCache::setMsgFlags(const QString &mailbox, uint uid, const QStringList &newFlags)
 {
 #ifdef CACHE_DEBUG
@@ -33,13 +33,16 @@
 #include "Utils.h"
 #include "Common/FindWithUnknown.h"
 #include "Common/InvokeMethod.h"
+#include "Common/Metrics.h"
 #include "Imap/Encoders.h"
 #include "Imap/Tasks/AppendTask.h"
+#include "Imap/Tasks/BulkAppendTask.h"
 #include "Imap/Tasks/CreateMailboxTask.h"
 #include "Imap/Tasks/GetAnyConnectionTask.h"
 #include "Imap/Tasks/KeepMailboxOpenTask.h"
 #include "Imap/Tasks/OpenConnectionTask.h"
 #include "Imap/Tasks/UpdateFlagsTask.h"
+#include "Imap/Tasks/WatchMailboxTask.h"
 #include "Streams/SocketFactory.h"
 
 //#define DEBUG_PERIODICALLY_DUMP_TASKS
@@ -94,6 +97,17 @@ bool messageHasUidZero(const TreeItem *const item)
     return message->uid() == 0;
 }
 
+/** @short Length of the longest prefix from the @arg namespaces which contains the @arg mailbox, or -1 */
+int longestMatchingNamespace(const QList<Imap::Responses::NamespaceData> &namespaces, const QString &mailbox)
+{
+    int res = -1;
+    Q_FOREACH(const Imap::Responses::NamespaceData &ns, namespaces) {
+        if ((mailbox.startsWith(ns.prefix) || mailbox + ns.separator == ns.prefix) && ns.prefix.size() > res)
+            res = ns.prefix.size();
+    }
+    return res;
+}
+
 }
 
 namespace Imap
@@ -106,9 +120,11 @@ Model::Model(QObject *parent, AbstractCache *cache, SocketFactoryPtr socketFacto
     QAbstractItemModel(parent),
     // our tools
     m_cache(cache), m_socketFactory(std::move(socketFactory)), m_taskFactory(std::move(taskFactory)), m_maxParsers(4), m_mailboxes(0),
-    m_netPolicy(NETWORK_OFFLINE),  m_taskModel(0), m_hasImapPassword(false)
+    m_netPolicy(NETWORK_OFFLINE), m_namespacesKnown(false), m_taskModel(0), m_hasImapPassword(false)
 {
     m_cache->setParent(this);
+    connect(m_cache, SIGNAL(messagePartLoaded(QString,uint,QByteArray,QByteArray)),
+            this, SLOT(slotCachedPartLoaded(QString,uint,QByteArray,QByteArray)));
     m_startTls = m_socketFactory->startTlsRequired();
 
     m_mailboxes = new TreeItemMailbox(0);
@@ -136,6 +152,7 @@ Model::Model(QObject *parent, AbstractCache *cache, SocketFactoryPtr socketFacto
 
 Model::~Model()
 {
+    m_mailboxesByName.clear();
     delete m_mailboxes;
 }
 
@@ -169,7 +186,8 @@ void Model::responseReceived(const QMap<Parser *,ParserState>::iterator it)
         Q_ASSERT(resp);
         // Always log BAD responses from a central place. They're bad enough to warant an extra treatment.
         // FIXME: is it worth an UI popup?
-        if (Responses::State *stateResponse = dynamic_cast<Responses::State *>(resp.data())) {
+        Responses::State *stateResponse = dynamic_cast<Responses::State *>(resp.data());
+        if (stateResponse) {
             if (stateResponse->kind == Responses::BAD) {
                 QString buf;
                 QTextStream s(&buf);
@@ -189,9 +207,8 @@ void Model::responseReceived(const QMap<Parser *,ParserState>::iterator it)
             kind of sucks.
 
             So, we have to iterate over a copy of the original list and instead of
-            deleting Tasks, we store them into a temporary list. When we're done with
-            processing, we walk the original list once again and simply remove all
-            "deleted" items for real.
+            deleting Tasks, we leave them to runReadyTasks() which removes all the
+            "deleted" items from the original list for real once we're done with processing.
 
             This took me 3+ hours to track it down to what the hell was happening here,
             even though the underlying reason is simple -- QList::append() could invalidate
@@ -199,21 +216,36 @@ void Model::responseReceived(const QMap<Parser *,ParserState>::iterator it)
             */
 
             bool handled = false;
-            QList<ImapTask *> taskSnapshot = it->activeTasks;
-            QList<ImapTask *> deletedTasks;
-            QList<ImapTask *>::const_iterator taskEnd = taskSnapshot.constEnd();
 
-            // Try various tasks, perhaps it's their response. Also check if they're already finished and remove them.
-            for (QList<ImapTask *>::const_iterator taskIt = taskSnapshot.constBegin(); taskIt != taskEnd; ++taskIt) {
-                if (! handled) {
+            if (stateResponse && !stateResponse->tag.isEmpty()) {
+                // The tagged response marks the end of a command, so there's no point in remembering its owner anymore
+                QPointer<ImapTask> owner = it->commandOwners.take(stateResponse->tag);
+                // The response codes could carry information which is also interesting for other tasks, so only the
+                // plain ones are delivered directly to the task which has sent the command
+                if (owner && stateResponse->respCode == Responses::NONE && !owner->isFinished()
+                        && it->activeTasks.contains(owner)) {
+                    handled = plugResponseToTask(it, resp, owner);
+#ifdef DEBUG_TASK_ROUTING
+                    if (handled && it->parser) {
+                        logTrace(it->parser->parserId(), Common::LOG_TASKS, owner->debugIdentification(), QLatin1String("Handled through the tag index"));
+                    }
+#endif
+                }
+            }
+
+            if (!handled) {
+                QList<ImapTask *> taskSnapshot = it->activeTasks;
+                QList<ImapTask *>::const_iterator taskEnd = taskSnapshot.constEnd();
 
+                // Try various tasks, perhaps it's their response. The finished ones are removed by runReadyTasks().
+                for (QList<ImapTask *>::const_iterator taskIt = taskSnapshot.constBegin(); !handled && taskIt != taskEnd; ++taskIt) {
 #ifdef DEBUG_TASK_ROUTING
                     try {
                         logTrace(it->parser->parserId(), Common::LOG_TASKS, QString(),
                                  QString::fromAscii("Routing to %1 %2").arg(QString::fromAscii((*taskIt)->metaObject()->className()),
                                                                             (*taskIt)->debugIdentification()));
 #endif
-                    handled = resp->plug(*taskIt);
+                    handled = plugResponseToTask(it, resp, *taskIt);
 #ifdef DEBUG_TASK_ROUTING
                         if (handled) {
                             logTrace(it->parser->parserId(), Common::LOG_TASKS, (*taskIt)->debugIdentification(), QLatin1String("Handled"));
@@ -224,14 +256,8 @@ void Model::responseReceived(const QMap<Parser *,ParserState>::iterator it)
                     }
 #endif
                 }
-
-                if ((*taskIt)->isFinished()) {
-                    deletedTasks << *taskIt;
-                }
             }
 
-            removeDeletedTasks(deletedTasks, it->activeTasks);
-
             runReadyTasks();
 
             if (! handled) {
@@ -259,6 +285,12 @@ void Model::responseReceived(const QMap<Parser *,ParserState>::iterator it)
         }
     }
 
+    if (counter) {
+        static Common::MetricsHistogram *const batchSizes =
+                Common::MetricsRegistry::instance()->histogram(QLatin1String("model.responseBatch.size"));
+        batchSizes->record(counter);
+    }
+
     if (!it->parser) {
         // He's dead, Jim
         killParser(it.key(), PARSER_JUST_DELETE_LATER);
@@ -278,6 +310,14 @@ void Model::handleState(Imap::Parser *ptr, const Imap::Responses::State *const r
         if (tag == accessParser(ptr).logoutCmd) {
             // The LOGOUT is special, as it isn't associated with any task
             killParser(ptr, PARSER_KILL_EXPECTED);
+        } else if (tag == accessParser(ptr).capabilityRevalidationCmd) {
+            // The OpenConnectionTask has gone ahead with the cached capabilities; the untagged CAPABILITY has updated them
+            // already, so only the cache has to be refreshed
+            accessParser(ptr).capabilityRevalidationCmd.clear();
+            if (resp->kind == OK && accessParser(ptr).capabilities != m_postAuthCapabilitiesCache) {
+                logTrace(ptr->parserId(), Common::LOG_OTHER, QLatin1String("Model"), QLatin1String("Cached capabilities were stale"));
+                m_postAuthCapabilitiesCache = accessParser(ptr).capabilities;
+            }
         } else {
             if (accessParser(ptr).connState == CONN_STATE_LOGOUT)
                 return;
@@ -289,7 +329,10 @@ void Model::handleState(Imap::Parser *ptr, const Imap::Responses::State *const r
         // FIXME: we should probably just eat them and don't bother, as untagged OK/NO could be rather common...
         switch (resp->kind) {
         case BYE:
-            if (accessParser(ptr).logoutCmd.isEmpty()) {
+            if (accessParser(ptr).logoutCmd.isEmpty() && !accessParser(ptr).watchedMailbox.isEmpty()) {
+                // Losing a connection which was only watching a mailbox is no reason for going offline
+                changeConnectionState(ptr, CONN_STATE_LOGOUT);
+            } else if (accessParser(ptr).logoutCmd.isEmpty()) {
                 // The connection got closed but we haven't really requested that -- we better treat that as error, including
                 // going offline...
                 // ... but before that, expect that the connection will get closed soon
@@ -306,6 +349,12 @@ void Model::handleState(Imap::Parser *ptr, const Imap::Responses::State *const r
             if (resp->respCode == NONE) {
                 // This one probably should not be logged at all; dovecot sends these reponses to keep NATted connections alive
                 break;
+            } else if (resp->respCode == NOTIFICATIONOVERFLOW) {
+                // The server has given up on sending the NOTIFY events, so we're back to polling
+                logTrace(ptr->parserId(), Common::LOG_OTHER, QString(), QLatin1String("NOTIFY events overflowed, will poll for the message counts"));
+                accessParser(ptr).notifyActive = false;
+                invalidateAllMessageCounts();
+                break;
             } else {
                 logTrace(ptr->parserId(), Common::LOG_OTHER, QString(), QLatin1String("Warning: unhandled untagged OK with a response code"));
                 break;
@@ -417,6 +466,7 @@ void Model::finalizeIncrementalList(Parser *parser, const QString &parentMailbox
         beginInsertRows(parentIdx, (*it)->row(), (*it)->row());
     parentMbox->m_children.insert(it, mailboxes[0]);
     endInsertRows();
+    indexMailboxSubtree(static_cast<TreeItemMailbox *>(mailboxes[0]));
 }
 
 void Model::replaceChildMailboxes(TreeItemMailbox *mailboxPtr, const TreeItemChildrenList &mailboxes)
@@ -465,6 +515,8 @@ void Model::replaceChildMailboxes(TreeItemMailbox *mailboxPtr, const TreeItemChi
         auto oldItems = mailboxPtr->setChildren(TreeItemChildrenList());
         endRemoveRows();
 
+        for (auto it = oldItems.constBegin(); it != oldItems.constEnd(); ++it)
+            unindexMailboxSubtree(static_cast<TreeItemMailbox *>(*it));
         qDeleteAll(oldItems);
     }
 
@@ -473,6 +525,8 @@ void Model::replaceChildMailboxes(TreeItemMailbox *mailboxPtr, const TreeItemChi
         auto dummy = mailboxPtr->setChildren(mailboxes);
         endInsertRows();
         Q_ASSERT(dummy.isEmpty());
+        for (auto it = mailboxes.constBegin(); it != mailboxes.constEnd(); ++it)
+            indexMailboxSubtree(static_cast<TreeItemMailbox *>(*it));
     } else {
         auto dummy = mailboxPtr->setChildren(mailboxes);
         Q_ASSERT(dummy.isEmpty());
@@ -480,6 +534,26 @@ void Model::replaceChildMailboxes(TreeItemMailbox *mailboxPtr, const TreeItemChi
     emit dataChanged(parent, parent);
 }
 
+/** @short Make the mailbox and all of its known child mailboxes available through findMailboxByName() */
+void Model::indexMailboxSubtree(TreeItemMailbox *mailbox)
+{
+    m_mailboxesByName[mailbox->mailbox()] = mailbox;
+    // ignore first child, the TreeItemMsgList
+    for (auto it = mailbox->m_children.constBegin() + 1; it != mailbox->m_children.constEnd(); ++it)
+        indexMailboxSubtree(static_cast<TreeItemMailbox *>(*it));
+}
+
+/** @short Forget about the mailbox and its child mailboxes which are about to be deleted */
+void Model::unindexMailboxSubtree(TreeItemMailbox *mailbox)
+{
+    auto indexed = m_mailboxesByName.find(mailbox->mailbox());
+    // A newer item with the same name might have replaced this one already
+    if (indexed != m_mailboxesByName.end() && *indexed == mailbox)
+        m_mailboxesByName.erase(indexed);
+    for (auto it = mailbox->m_children.constBegin() + 1; it != mailbox->m_children.constEnd(); ++it)
+        unindexMailboxSubtree(static_cast<TreeItemMailbox *>(*it));
+}
+
 void Model::emitMessageCountChanged(TreeItemMailbox *const mailbox)
 {
     TreeItemMsgList *list = static_cast<TreeItemMsgList *>(mailbox->m_children[0]);
@@ -584,9 +658,20 @@ void Model::handleStatus(Imap::Parser *ptr, const Imap::Responses::Status *const
         updateCache |= list->m_recentMessageCount != static_cast<const int>(it.value());
         list->m_recentMessageCount = it.value();
     }
-    list->m_numberFetchingStatus = TreeItem::DONE;
+    if (list->m_numberFetchingStatus != TreeItem::NONE || (list->m_totalMessageCount != -1 && list->m_unreadMessageCount != -1)) {
+        // An unsolicited STATUS, e.g. one pushed through NOTIFY, might not be complete. Ask for the rest if needed.
+        list->m_numberFetchingStatus = TreeItem::DONE;
+    }
     emitMessageCountChanged(mailbox);
 
+    if (!resp->states.contains(Imap::Responses::Status::UNSEEN) && list->m_numberFetchingStatus == TreeItem::DONE
+            && !mailbox->maintainingTask) {
+        // The STATUS responses pushed through NOTIFY only carry MESSAGES, UIDNEXT and UIDVALIDITY (RFC 5465, section 5.1),
+        // so the number of unread messages which we have is likely stale by now. Our own STATUS asks for UNSEEN as well.
+        list->m_numberFetchingStatus = TreeItem::LOADING;
+        askForNumberOfMessages(list);
+    }
+
     if (updateCache) {
         // We have to be very careful to only touch the bits which are *not* used by the mailbox syncing code.
         // This is absolutely crucial -- STATUS is just a meaningless indicator, and stuff like the UID mapping
@@ -615,9 +700,11 @@ void Model::handleNamespace(Imap::Parser *ptr, const Imap::Responses::Namespace
 {
     if (accessParser(ptr).connState == CONN_STATE_LOGOUT)
         return;
-    return; // because it's broken and won't fly
-    Q_UNUSED(ptr);
-    Q_UNUSED(resp);
+    // These are only used for figuring out which mailboxes are covered by NOTIFY, see isCoveredByNotify()
+    m_personalNamespace = resp->personal;
+    m_otherUsersNamespace = resp->users;
+    m_sharedNamespace = resp->other;
+    m_namespacesKnown = true;
 }
 
 void Model::handleSort(Imap::Parser *ptr, const Imap::Responses::Sort *const resp)
@@ -986,7 +1073,7 @@ void Model::askForMsgMetadata(TreeItemMessage *item, const PreloadingMode preloa
     EMIT_LATER(this, dataChanged, Q_ARG(QModelIndex, item->toIndex(this)), Q_ARG(QModelIndex, item->toIndex(this)));
 }
 
-void Model::askForMsgPart(TreeItemPart *item, bool onlyFromCache)
+void Model::askForMsgPart(TreeItemPart *item, bool onlyFromCache, CacheLookupMode cacheLookup)
 {
     Q_ASSERT(item->message());   // TreeItemMessage
     Q_ASSERT(item->message()->parent());   // TreeItemMsgList
@@ -1008,10 +1095,20 @@ void Model::askForMsgPart(TreeItemPart *item, bool onlyFromCache)
         Q_ASSERT(itemForFetchOperation);
     }
 
-    const QByteArray &data = cache()->messagePart(mailboxPtr->mailbox(), uid,
-                                                  isSpecialRawPart ?
-                                                      itemForFetchOperation->partId() + ".X-RAW"
-                                                    : item->partId());
+    const QByteArray cachedPartId = isSpecialRawPart ? itemForFetchOperation->partId() + ".X-RAW" : item->partId();
+
+    if (!onlyFromCache && cacheLookup == CACHE_ASYNC_ALLOWED) {
+        // Big parts are read from the disk in a background thread. The result gets processed in slotCachedPartLoaded(),
+        // much like the data which arrive from the network.
+        if (cache()->requestMessagePart(mailboxPtr->mailbox(), uid, cachedPartId)
+                || (!isSpecialRawPart && cache()->requestMessagePart(mailboxPtr->mailbox(), uid,
+                                                                     itemForFetchOperation->partId() + ".X-RAW"))) {
+            item->setFetchStatus(TreeItem::LOADING);
+            return;
+        }
+    }
+
+    const QByteArray &data = cache()->messagePart(mailboxPtr->mailbox(), uid, cachedPartId);
     if (! data.isNull()) {
         item->m_data = data;
         item->setFetchStatus(TreeItem::DONE);
@@ -1072,6 +1169,10 @@ void Model::setNetworkPolicy(const NetworkPolicy policy)
                 // First of all, give the maintaining task a chance to finish its housekeeping
                 it->maintainingTask->stopForLogout();
             }
+            if (it->watchingTask) {
+                // The IDLE has to be terminated before the LOGOUT can be sent
+                it->watchingTask->stopForLogout();
+            }
             // Kill all tasks that are also using this connection
             Q_FOREACH(ImapTask *task, it->activeTasks) {
                 task->die(tr("Going offline"));
@@ -1112,6 +1213,9 @@ void Model::setNetworkPolicy(const NetworkPolicy policy)
         // updated message counts from all visible mailboxes.
         invalidateAllMessageCounts();
     }
+
+    // The watching connections are only used when the network is cheap
+    updateMailboxWatchers();
 }
 
 void Model::handleSocketDisconnectedResponse(Parser *ptr, const Responses::SocketDisconnectedResponse *const resp)
@@ -1123,6 +1227,11 @@ void Model::handleSocketDisconnectedResponse(Parser *ptr, const Responses::Socke
 
         // But we still absolutely want to clean up and kill the connection/Parser anyway
         killParser(ptr, PARSER_KILL_EXPECTED);
+    } else if (!accessParser(ptr).watchedMailbox.isEmpty()) {
+        // Only the watching of a single mailbox is affected, the rest can continue
+        logTrace(ptr->parserId(), Common::LOG_PARSE_ERROR, QString(), resp->message);
+        changeConnectionState(ptr, CONN_STATE_LOGOUT);
+        killParser(ptr, PARSER_KILL_EXPECTED);
     } else {
         logTrace(ptr->parserId(), Common::LOG_PARSE_ERROR, QString(), resp->message);
         changeConnectionState(ptr, CONN_STATE_LOGOUT);
@@ -1197,6 +1306,7 @@ void Model::updateCapabilities(Parser *parser, const QStringList capabilities)
     accessParser(parser).capabilities = uppercaseCaps;
     accessParser(parser).capabilitiesFresh = true;
     parser->enableLiteralPlus(uppercaseCaps.contains(QLatin1String("LITERAL+")));
+    parser->enableLiteralMinus(uppercaseCaps.contains(QLatin1String("LITERAL-")));
 
     for (QMap<Parser *,ParserState>::const_iterator it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
         if (it->connState == CONN_STATE_LOGOUT) {
@@ -1302,22 +1412,7 @@ TreeItemChildrenList::iterator Model::findMessageOrNextOneByUid(TreeItemMsgList
 
 TreeItemMailbox *Model::findMailboxByName(const QString &name) const
 {
-    return findMailboxByName(name, m_mailboxes);
-}
-
-TreeItemMailbox *Model::findMailboxByName(const QString &name, const TreeItemMailbox *const root) const
-{
-    Q_ASSERT(!root->m_children.isEmpty());
-    // Names are sorted, so linear search is not required. On the ohterhand, the mailbox sizes are typically small enough
-    // so that this shouldn't matter at all, and linear search is simple enough.
-    for (int i = 1; i < root->m_children.size(); ++i) {
-        TreeItemMailbox *mailbox = static_cast<TreeItemMailbox *>(root->m_children[i]);
-        if (name == mailbox->mailbox())
-            return mailbox;
-        else if (name.startsWith(mailbox->mailbox() + mailbox->separator()))
-            return findMailboxByName(name, mailbox);
-    }
-    return 0;
+    return m_mailboxesByName.value(name, 0);
 }
 
 /** @short Find a parent mailbox for the specified name */
@@ -1438,6 +1533,12 @@ void Model::changeConnectionState(Parser *parser, ConnectionState state)
 {
     accessParser(parser).connState = state;
     logTrace(parser->parserId(), Common::LOG_TASKS, QLatin1String("conn"), connectionStateToString(state));
+    if (state == CONN_STATE_SELECTED && accessParser(parser).timeToFirstMailbox < 0
+            && accessParser(parser).connectionTimer.isValid()) {
+        accessParser(parser).timeToFirstMailbox = accessParser(parser).connectionTimer.elapsed();
+        logTrace(parser->parserId(), Common::LOG_TASKS, QLatin1String("conn"),
+                 QString::fromUtf8("First mailbox synced %1 ms after connecting").arg(accessParser(parser).timeToFirstMailbox));
+    }
     emit connectionStateChanged(parser->parserId(), state);
 }
 
@@ -1468,6 +1569,8 @@ void Model::killParser(Parser *parser, ParserKillingMethod method)
     parser->disconnect();
     Q_ASSERT(accessParser(parser).parser);
     accessParser(parser).parser = 0;
+    // No more tagged responses are going to arrive over this connection
+    accessParser(parser).commandOwners.clear();
     switch (method) {
     case PARSER_KILL_EXPECTED:
         logTrace(parser->parserId(), Common::LOG_IO_WRITTEN, QString(), QLatin1String("*** Connection closed."));
@@ -1487,6 +1590,51 @@ void Model::slotParserLineReceived(Parser *parser, const QByteArray &line)
     logTrace(parser->parserId(), Common::LOG_IO_READ, QString(), QString::fromUtf8(line));
 }
 
+void Model::slotCachedPartLoaded(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &data)
+{
+    TreeItemMailbox *mailboxPtr = findMailboxByName(mailbox);
+    if (!mailboxPtr)
+        return;
+    QList<TreeItemMessage *> messages = findMessagesByUids(mailboxPtr, Imap::Uids() << uid);
+    if (messages.isEmpty() || !messages.front()->fetched()) {
+        // The message is gone, or its structure got released in the meanwhile
+        return;
+    }
+
+    const QByteArray rawSuffix(".X-RAW");
+    const bool isRawData = partId.endsWith(rawSuffix);
+    TreeItemPart *part = 0;
+    try {
+        part = mailboxPtr->partIdToPtr(this, messages.front(),
+                                       "BODY[" + (isRawData ? partId.left(partId.size() - rawSuffix.size()) : partId) + ']');
+    } catch (UnknownMessageIndex &) {
+    }
+    if (!part)
+        return;
+
+    QList<TreeItemPart *> targets;
+    if (isRawData && part->m_partRaw && part->m_partRaw->loading())
+        targets << part->m_partRaw;
+    // Raw data are just as good for the decoded part, see askForMsgPart()
+    if (part->loading())
+        targets << part;
+
+    Q_FOREACH(TreeItemPart *target, targets) {
+        if (data.isNull()) {
+            // The file could not be read after all, so let's try the usual way
+            askForMsgPart(target, false, CACHE_SYNC_ONLY);
+        } else if (target == part && isRawData) {
+            Imap::decodeContentTransferEncoding(data, part->encoding(), part->dataPtr());
+            part->setFetchStatus(TreeItem::DONE);
+        } else {
+            target->m_data = data;
+            target->setFetchStatus(TreeItem::DONE);
+        }
+        QModelIndex idx = target->toIndex(this);
+        emit dataChanged(idx, idx);
+    }
+}
+
 void Model::slotParserLineSent(Parser *parser, const QByteArray &line)
 {
     logTrace(parser->parserId(), Common::LOG_IO_WRITTEN, QString(), QString::fromUtf8(line));
@@ -1498,35 +1646,95 @@ void Model::setCache(AbstractCache *cache)
         m_cache->deleteLater();
     m_cache = cache;
     m_cache->setParent(this);
+    connect(m_cache, SIGNAL(messagePartLoaded(QString,uint,QByteArray,QByteArray)),
+            this, SLOT(slotCachedPartLoaded(QString,uint,QByteArray,QByteArray)));
 }
 
 void Model::runReadyTasks()
 {
     for (QMap<Parser *,ParserState>::iterator parserIt = m_parsers.begin(); parserIt != m_parsers.end(); ++parserIt) {
-        bool runSomething = false;
-        do {
-            runSomething = false;
+        while (!parserIt->tasksToRecheck.isEmpty()) {
             // See responseReceived() for more details about why we do need to iterate over a copy here.
-            // Basically, calls to ImapTask::perform could invalidate our precious iterators.
-            QList<ImapTask *> origList = parserIt->activeTasks;
+            // Basically, calls to ImapTask::perform could invalidate our precious iterators, and they could also
+            // schedule more tasks for a recheck.
+            QList<QPointer<ImapTask> > origList;
+            origList.swap(parserIt->tasksToRecheck);
             QList<ImapTask *> deletedList;
-            QList<ImapTask *>::const_iterator taskEnd = origList.constEnd();
-            for (QList<ImapTask *>::const_iterator taskIt = origList.constBegin(); taskIt != taskEnd; ++taskIt) {
-                ImapTask *task = *taskIt;
+            Q_FOREACH(const QPointer<ImapTask> &taskPtr, origList) {
+                ImapTask *task = taskPtr.data();
+                if (!task || deletedList.contains(task) || !parserIt->activeTasks.contains(task))
+                    continue;
                 if (task->isReadyToRun()) {
+                    const uint firstCommand = parserIt.key()->commandCounter();
                     task->perform();
-                    runSomething = true;
+                    rememberCommandOwner(parserIt.key(), firstCommand, task);
                 }
                 if (task->isFinished()) {
                     deletedList << task;
                 }
             }
             removeDeletedTasks(deletedList, parserIt->activeTasks);
+            if (!deletedList.isEmpty())
+                forgetCommandOwners(parserIt, deletedList);
 #ifdef TROJITA_DEBUG_TASK_TREE
             if (!deletedList.isEmpty())
                 checkTaskTreeConsistency();
 #endif
-        } while (runSomething);
+        }
+    }
+}
+
+/** @short Drop the routing hints pointing to the @arg deletedTasks or to tasks which are gone already
+
+The tagged responses for commands of a task which has died are not guaranteed to ever arrive.
+*/
+void Model::forgetCommandOwners(const QMap<Parser *,ParserState>::iterator it, const QList<ImapTask *> &deletedTasks)
+{
+    QHash<CommandHandle, QPointer<ImapTask> >::iterator ownerIt = it->commandOwners.begin();
+    while (ownerIt != it->commandOwners.end()) {
+        if (!*ownerIt || deletedTasks.contains(ownerIt->data()))
+            ownerIt = it->commandOwners.erase(ownerIt);
+        else
+            ++ownerIt;
+    }
+}
+
+/** @short Make sure that runReadyTasks() checks whether the task has become ready to run or whether it has finished */
+void Model::scheduleTaskRecheck(ImapTask *task)
+{
+    if (!task->parser)
+        return;
+    QMap<Parser *,ParserState>::iterator it = m_parsers.find(task->parser);
+    if (it == m_parsers.end())
+        return;
+    it->tasksToRecheck.append(task);
+}
+
+/** @short Offer a response to the task and remember which commands were queued by the task in the meanwhile */
+bool Model::plugResponseToTask(const QMap<Parser *,ParserState>::iterator it,
+                               const QSharedPointer<Responses::AbstractResponse> &resp, ImapTask *task)
+{
+    const uint firstCommand = it->parser ? it->parser->commandCounter() : 0;
+    bool handled = resp->plug(task);
+    if (it->parser)
+        rememberCommandOwner(it->parser, firstCommand, task);
+    return handled;
+}
+
+/** @short Remember that the commands which were queued since the @arg firstCommand were sent by the @arg task
+
+The routing of tagged responses uses this as a hint. When the task runs other tasks which queue their own commands,
+these nested tasks shall claim their commands first; that's why the existing entries are not overwritten here.
+*/
+void Model::rememberCommandOwner(Parser *parser, const uint firstCommand, ImapTask *task)
+{
+    QMap<Parser *,ParserState>::iterator it = m_parsers.find(parser);
+    if (it == m_parsers.end())
+        return;
+    for (uint i = firstCommand; i < parser->commandCounter(); ++i) {
+        const CommandHandle tag = Parser::tagForCommand(i);
+        if (!it->commandOwners.contains(tag))
+            it->commandOwners.insert(tag, task);
     }
 }
 
@@ -1552,7 +1760,11 @@ KeepMailboxOpenTask *Model::findTaskResponsibleFor(const QModelIndex &mailbox)
 KeepMailboxOpenTask *Model::findTaskResponsibleFor(TreeItemMailbox *mailboxPtr)
 {
     Q_ASSERT(mailboxPtr);
-    bool canCreateParallelConn = m_parsers.isEmpty(); // FIXME: multiple connections
+    bool canCreateParallelConn = true; // FIXME: multiple connections
+    for (QMap<Parser *,ParserState>::const_iterator it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
+        if (it->watchedMailbox.isEmpty())
+            canCreateParallelConn = false;
+    }
 
     if (mailboxPtr->maintainingTask) {
         // The requested mailbox already has the maintaining task associated
@@ -1572,7 +1784,7 @@ KeepMailboxOpenTask *Model::findTaskResponsibleFor(TreeItemMailbox *mailboxPtr)
         Q_ASSERT(!m_parsers.isEmpty());
 
         for (QMap<Parser *,ParserState>::const_iterator it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
-            if (it->connState == CONN_STATE_LOGOUT) {
+            if (it->connState == CONN_STATE_LOGOUT || !it->watchedMailbox.isEmpty()) {
                 // this one is not usable
                 continue;
             }
@@ -1645,6 +1857,19 @@ QModelIndex Model::findMailboxForItems(const QModelIndexList &items)
 void Model::slotTasksChanged()
 {
     dumpModelContents(m_taskModel);
+    for (QMap<Parser *,ParserState>::const_iterator it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
+        if (!it->parser)
+            continue;
+        const ResponseQueueStatistics stats = it->parser->responseQueueStatistics();
+        qDebug() << "Parser" << it->parser->parserId() << "response queue:" << stats.responses << "responses in"
+                 << stats.bursts << "bursts, peak length" << stats.peakQueueLength << "capacity" << stats.capacity
+                 << "commands in flight:" << it->parser->commandsInFlight();
+        qDebug() << "Parser" << it->parser->parserId() << "response allocator:" << stats.allocator.allocations
+                 << "allocations," << stats.allocator.recycled << "from existing slabs," << stats.allocator.slabs << "slabs,"
+                 << stats.allocator.inUse << "in use, peak" << stats.allocator.peakInUse;
+        if (it->timeToFirstMailbox >= 0)
+            qDebug() << "Parser" << it->parser->parserId() << "synced its first mailbox" << it->timeToFirstMailbox << "ms after connecting";
+    }
 }
 
 void Model::slotTaskDying(QObject *obj)
@@ -1652,6 +1877,7 @@ void Model::slotTaskDying(QObject *obj)
     ImapTask *task = static_cast<ImapTask *>(obj);
     for (QMap<Parser *,ParserState>::iterator it = m_parsers.begin(); it != m_parsers.end(); ++it) {
         it->activeTasks.removeOne(task);
+        forgetCommandOwners(it, QList<ImapTask *>() << task);
     }
     m_taskModel->slotTaskDestroyed(task);
 }
@@ -1718,11 +1944,11 @@ void Model::releaseMessageData(const QModelIndex &message)
 
 QStringList Model::capabilities() const
 {
-    if (m_parsers.isEmpty())
-        return QStringList();
-
-    if (m_parsers.constBegin()->capabilitiesFresh)
-        return m_parsers.constBegin()->capabilities;
+    for (QMap<Parser *,ParserState>::const_iterator it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
+        if (!it->watchedMailbox.isEmpty())
+            continue;
+        return it->capabilitiesFresh ? it->capabilities : QStringList();
+    }
 
     return QStringList();
 }
@@ -1779,6 +2005,16 @@ At the same time, some well-known flags are converted to their "canonical" form
 */
 QStringList Model::normalizeFlags(const QStringList &source) const
 {
+    // The messages in a mailbox tend to share just a few combinations of flags, and so can the lists which hold them
+    const int maxRecentNormalizedFlags = 16;
+    for (int i = 0; i < m_recentNormalizedFlags.size(); ++i) {
+        if (m_recentNormalizedFlags[i].first == source) {
+            if (i > 0)
+                m_recentNormalizedFlags.move(i, 0);
+            return m_recentNormalizedFlags.first().second;
+        }
+    }
+
     QStringList res;
 #if QT_VERSION >= QT_VERSION_CHECK(4, 7, 0)
     res.reserve(source.size());
@@ -1808,9 +2044,18 @@ QStringList Model::normalizeFlags(const QStringList &source) const
             res.append(*it);
         }
     }
-    // Always sort the flags when performing normalization to obtain reasonable results and be ready for possible future
-    // deduplication of the actual QLists
+    // Always sort the flags when performing normalization to obtain reasonable results and to be able to share
+    // the QLists among messages whose flags only arrived in a different order
     res.sort();
+    for (int i = 0; i < m_recentNormalizedFlags.size(); ++i) {
+        if (m_recentNormalizedFlags[i].second == res) {
+            res = m_recentNormalizedFlags[i].second;
+            break;
+        }
+    }
+    m_recentNormalizedFlags.prepend(qMakePair(source, res));
+    if (m_recentNormalizedFlags.size() > maxRecentNormalizedFlags)
+        m_recentNormalizedFlags.removeLast();
     return res;
 }
 
@@ -1926,6 +2171,15 @@ QModelIndex Model::messageIndexByUid(const QString &mailboxName, const uint uid)
 /** @short Forget any cached data about number of messages in all mailboxes */
 void Model::invalidateAllMessageCounts()
 {
+    const bool hasListStatus = capabilities().contains(QLatin1String("LIST-STATUS"));
+    QStringList batch;
+
+    QSet<QString> watched;
+    for (QMap<Parser *,ParserState>::const_iterator it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
+        if (!it->watchedMailbox.isEmpty() && it->connState != CONN_STATE_LOGOUT)
+            watched.insert(it->watchedMailbox);
+    }
+
     QList<TreeItemMailbox*> queue;
     queue.append(m_mailboxes);
     while (!queue.isEmpty()) {
@@ -1936,13 +2190,63 @@ void Model::invalidateAllMessageCounts()
         }
         TreeItemMsgList *list = dynamic_cast<TreeItemMsgList*>(head->m_children[0]);
 
-        if (list->m_numberFetchingStatus == TreeItem::DONE && !head->maintainingTask) {
+        if (list->m_numberFetchingStatus == TreeItem::DONE && !head->maintainingTask && !watched.contains(head->mailbox())
+                && !isCoveredByNotify(head->mailbox())) {
             // Ask only for data which were previously available
-            // Also don't mess with a mailbox which is already being kept up-to-date because it's selected.
-            list->m_numberFetchingStatus = TreeItem::NONE;
-            emitMessageCountChanged(head);
+            // Also don't mess with a mailbox which is already being kept up-to-date because it's selected or watched,
+            // or because the server pushes its updated numbers through NOTIFY.
+            const QString name = head->mailbox();
+            if (hasListStatus && !name.contains(QLatin1Char('%')) && !name.contains(QLatin1Char('*'))) {
+                // The old numbers remain visible until the new ones arrive
+                batch << name;
+            } else {
+                forgetMessageCounts(head);
+            }
+        }
+    }
+
+    if (!batch.isEmpty()) {
+        m_taskFactory->createListStatusTask(this, batch);
+    }
+}
+
+/** @short Does the server push the updated message counts of this mailbox through NOTIFY?
+
+The NotifyTask only registers for the personal namespaces. Without knowing where these are, no mailbox is
+considered to be covered.
+*/
+bool Model::isCoveredByNotify(const QString &mailbox) const
+{
+    bool notifyActive = false;
+    for (QMap<Parser *,ParserState>::const_iterator it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
+        if (it->notifyActive && it->parser && it->connState != CONN_STATE_LOGOUT) {
+            notifyActive = true;
+            break;
         }
     }
+    if (!notifyActive)
+        return false;
+
+    if (mailbox.compare(QLatin1String("INBOX"), Qt::CaseInsensitive) == 0)
+        return true;
+    if (!m_namespacesKnown)
+        return false;
+
+    // The most specific namespace wins, e.g. a shared "INBOX.shared." within the personal "INBOX."
+    const int personal = longestMatchingNamespace(m_personalNamespace, mailbox);
+    return personal >= 0 && personal > qMax(longestMatchingNamespace(m_otherUsersNamespace, mailbox),
+                                            longestMatchingNamespace(m_sharedNamespace, mailbox));
+}
+
+/** @short The numbers of messages in this mailbox are stale, ask for them again once they are needed */
+void Model::forgetMessageCounts(TreeItemMailbox *mailbox)
+{
+    TreeItemMsgList *list = dynamic_cast<TreeItemMsgList*>(mailbox->m_children[0]);
+    Q_ASSERT(list);
+    if (list->m_numberFetchingStatus != TreeItem::DONE)
+        return;
+    list->m_numberFetchingStatus = TreeItem::NONE;
+    emitMessageCountChanged(mailbox);
 }
 
 AppendTask *Model::appendIntoMailbox(const QString &mailbox, const QByteArray &rawMessageData, const QStringList &flags,
@@ -1951,12 +2255,23 @@ AppendTask *Model::appendIntoMailbox(const QString &mailbox, const QByteArray &r
     return m_taskFactory->createAppendTask(this, mailbox, rawMessageData, flags, timestamp);
 }
 
+AppendTask *Model::appendIntoMailbox(const QString &mailbox, const QSharedPointer<QIODevice> &rawMessageData, const QStringList &flags,
+                                     const QDateTime &timestamp)
+{
+    return m_taskFactory->createAppendTask(this, mailbox, rawMessageData, flags, timestamp);
+}
+
 AppendTask *Model::appendIntoMailbox(const QString &mailbox, const QList<CatenatePair> &data, const QStringList &flags,
                                      const QDateTime &timestamp)
 {
     return m_taskFactory->createAppendTask(this, mailbox, data, flags, timestamp);
 }
 
+BulkAppendTask *Model::bulkAppendIntoMailbox(const QString &mailbox, const QList<AppendItem> &items)
+{
+    return m_taskFactory->createBulkAppendTask(this, mailbox, items);
+}
+
 GenUrlAuthTask *Model::generateUrlAuthForMessage(const QString &host, const QString &user, const QString &mailbox,
                                                  const uint uidValidity, const uint uid, const QString &part, const QString &access)
 {
@@ -2056,5 +2371,70 @@ void Model::setNumberRefreshInterval(const int interval)
     m_periodicMailboxNumbersRefresh->start(interval * 1000);
 }
 
+void Model::setWatchedMailboxes(const QStringList &mailboxes)
+{
+    m_watchedMailboxes = mailboxes;
+    updateMailboxWatchers();
+}
+
+QStringList Model::watchedMailboxes() const
+{
+    return m_watchedMailboxes;
+}
+
+/** @short Open or close the dedicated connections so that they match the list of the watched mailboxes */
+void Model::updateMailboxWatchers()
+{
+    QSet<QString> alreadyWatched;
+    bool hasMainConnection = false;
+    QStringList mainCapabilities;
+    for (QMap<Parser *,ParserState>::const_iterator it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
+        if (!it->parser || it->connState == CONN_STATE_LOGOUT)
+            continue;
+        if (!it->watchedMailbox.isEmpty()) {
+            alreadyWatched.insert(it->watchedMailbox);
+        } else if (!hasMainConnection && it->capabilitiesFresh) {
+            hasMainConnection = true;
+            mainCapabilities = it->capabilities;
+        }
+    }
+
+    QStringList wanted;
+    if (m_netPolicy == NETWORK_ONLINE && hasMainConnection && mainCapabilities.contains(QLatin1String("IDLE"))
+            && !mainCapabilities.contains(QLatin1String("NOTIFY"))) {
+        // One connection is always left for everything else
+        wanted = m_watchedMailboxes.mid(0, qMax(0, m_maxParsers - 1));
+    }
+
+    for (QMap<Parser *,ParserState>::const_iterator it = m_parsers.constBegin(); it != m_parsers.constEnd(); ++it) {
+        if (!it->watchedMailbox.isEmpty() && it->parser && it->connState != CONN_STATE_LOGOUT
+                && !wanted.contains(it->watchedMailbox)) {
+            releaseWatcherConnection(it.key());
+        }
+    }
+
+    Q_FOREACH(const QString &mailbox, wanted) {
+        if (!alreadyWatched.contains(mailbox))
+            m_taskFactory->createWatchMailboxTask(this, mailbox);
+    }
+}
+
+/** @short Log out from a connection which was dedicated to watching a mailbox */
+void Model::releaseWatcherConnection(Parser *parser)
+{
+    ParserState &parserState = accessParser(parser);
+    if (!parserState.parser || parserState.connState == CONN_STATE_LOGOUT)
+        return;
+
+    if (parserState.watchingTask) {
+        parserState.watchingTask->stopForLogout();
+    }
+    Q_FOREACH(ImapTask *task, parserState.activeTasks) {
+        task->die(tr("The mailbox is no longer being watched"));
+    }
+    parserState.logoutCmd = parser->logout();
+    changeConnectionState(parser, CONN_STATE_LOGOUT);
+}
+
 }
 }
@@ -45,6 +45,7 @@ class QNetworkSession;
 class QSslError;
 
 class FakeCapabilitiesInjector;
+class ImapModelDisappearingMailboxTest;
 class ImapModelIdleTest;
 class LibMailboxSync;
 
@@ -113,10 +114,14 @@ class Model: public QAbstractItemModel
     mutable QMap<Parser *,ParserState> m_parsers;
     int m_maxParsers;
     mutable TreeItemMailbox *m_mailboxes;
+    /** @short All mailboxes in the tree below m_mailboxes, indexed by their full name */
+    QHash<QString, TreeItemMailbox *> m_mailboxesByName;
     mutable NetworkPolicy m_netPolicy;
     bool m_startTls;
 
     mutable QList<Imap::Responses::NamespaceData> m_personalNamespace, m_otherUsersNamespace, m_sharedNamespace;
+    /** @short Has the server told us about its namespaces? */
+    bool m_namespacesKnown;
 
     QList<QPair<QPair<QList<QSslCertificate>, QList<QSslError> >, bool> > m_sslErrorPolicy;
 
@@ -196,10 +201,17 @@ public:
     AppendTask* appendIntoMailbox(const QString &mailbox, const QByteArray &rawMessageData, const QStringList &flags,
                                   const QDateTime &timestamp);
 
+    /** @short Save a message into a mailbox, reading its data from a random-access device as they get sent */
+    AppendTask* appendIntoMailbox(const QString &mailbox, const QSharedPointer<QIODevice> &rawMessageData, const QStringList &flags,
+                                  const QDateTime &timestamp);
+
     /** @short Save a message into a mailbox using the CATENATE extension */
     AppendTask* appendIntoMailbox(const QString &mailbox, const QList<CatenatePair> &data, const QStringList &flags,
                                   const QDateTime &timestamp);
 
+    /** @short Save many messages into a mailbox at once, using MULTIAPPEND if available */
+    BulkAppendTask *bulkAppendIntoMailbox(const QString &mailbox, const QList<AppendItem> &items);
+
     /** @short Issue the GENURLAUTH command for a specified part/section */
     GenUrlAuthTask *generateUrlAuthForMessage(const QString &host, const QString &user, const QString &mailbox,
                                               const uint uidValidity, const uint uid, const QString &part, const QString &access);
@@ -287,6 +299,16 @@ public:
 
     void setNumberRefreshInterval(const int interval);
 
+    /** @short Watch these mailboxes for new arrivals even when they are not selected
+
+    Each of these mailboxes is kept open in IDLE on a connection of its own, so that the message counters are updated as
+    soon as anything changes. The total number of connections never exceeds the configured limit, mailboxes past that
+    limit are only refreshed by the periodic polling. Nothing extra is opened when the server supports NOTIFY, as the
+    changes are pushed through the main connection in that case.
+    */
+    void setWatchedMailboxes(const QStringList &mailboxes);
+    QStringList watchedMailboxes() const;
+
 public slots:
     /** @short Ask for an updated list of mailboxes on the server */
     void reloadMailboxList();
@@ -328,6 +350,9 @@ private slots:
     /** @short A maintaining task is about to die */
     void slotTaskDying(QObject *obj);
 
+    /** @short The cache has loaded a message part in the background */
+    void slotCachedPartLoaded(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &data);
+
     void setImapAuthError(const QString &error);
 
 signals:
@@ -444,6 +469,9 @@ private:
     friend class UpdateFlagsOfAllMessagesTask;
     friend class ListChildMailboxesTask;
     friend class NumberOfMessagesTask;
+    friend class ListStatusTask;
+    friend class NotifyTask;
+    friend class WatchMailboxTask;
     friend class FetchMsgMetadataTask;
     friend class ExpungeMailboxTask;
     friend class ExpungeMessagesTask;
@@ -463,9 +491,11 @@ private:
     friend class OfflineConnectionTask;
     friend class SortTask;
     friend class AppendTask;
+    friend class BulkAppendTask;
     friend class SubscribeUnsubscribeTask;
     friend class GenUrlAuthTask;
     friend class UidSubmitTask;
+    friend class CopyMoveMessagesTask; // needs access to findMailboxByName() for priming the UID map
 
     friend class TestingTaskFactory; // needs access to socketFactory
     friend class DummyNetworkWatcher; // needs access to the network policy manipulation
@@ -474,6 +504,7 @@ private:
 
     friend class ::FakeCapabilitiesInjector; // for injecting fake capabilities
     friend class ::ImapModelIdleTest; // needs access to findTaskResponsibleFor() for IDLE testing
+    friend class ::ImapModelDisappearingMailboxTest; // needs access to findMailboxByName() for checking the index
     friend class TaskPresentationModel; // needs access to the ParserState
     friend class ::LibMailboxSync; // needs access to accessParser/ParserState
 
@@ -484,11 +515,16 @@ private:
     void askForChildrenOfMailbox(TreeItemMailbox *item, bool forceReload);
     void askForMessagesInMailbox(TreeItemMsgList *item);
     void askForNumberOfMessages(TreeItemMsgList *item);
+    void forgetMessageCounts(TreeItemMailbox *mailbox);
+    bool isCoveredByNotify(const QString &mailbox) const;
 
     typedef enum {PRELOAD_PER_POLICY, PRELOAD_DISABLED} PreloadingMode;
 
     void askForMsgMetadata(TreeItemMessage *item, PreloadingMode preloadMode);
-    void askForMsgPart(TreeItemPart *item, bool onlyFromCache=false);
+    /** @short May the cache answer a request for message part at a later time? */
+    typedef enum {CACHE_ASYNC_ALLOWED, CACHE_SYNC_ONLY} CacheLookupMode;
+
+    void askForMsgPart(TreeItemPart *item, bool onlyFromCache=false, CacheLookupMode cacheLookup=CACHE_ASYNC_ALLOWED);
 
     void finalizeList(Parser *parser, TreeItemMailbox *const mailboxPtr);
     void finalizeIncrementalList(Parser *parser, const QString &parentMailboxName);
@@ -496,6 +532,10 @@ private:
     void genericHandleFetch(TreeItemMailbox *mailbox, const Imap::Responses::Fetch *const resp);
 
     void replaceChildMailboxes(TreeItemMailbox *mailboxPtr, const TreeItemChildrenList &mailboxes);
+    void updateMailboxWatchers();
+    void releaseWatcherConnection(Parser *parser);
+    void indexMailboxSubtree(TreeItemMailbox *mailbox);
+    void unindexMailboxSubtree(TreeItemMailbox *mailbox);
     void updateCapabilities(Parser *parser, const QStringList capabilities);
 
     TreeItem *translatePtr(const QModelIndex &index) const;
@@ -503,7 +543,6 @@ private:
     void emitMessageCountChanged(TreeItemMailbox *const mailbox);
 
     TreeItemMailbox *findMailboxByName(const QString &name) const;
-    TreeItemMailbox *findMailboxByName(const QString &name, const TreeItemMailbox *const root) const;
     TreeItemMailbox *findParentMailboxByName(const QString &name) const;
     QList<TreeItemMessage *> findMessagesByUids(const TreeItemMailbox *const mailbox, const Imap::Uids &uids);
     TreeItemChildrenList::iterator findMessageOrNextOneByUid(TreeItemMsgList *list, const uint uid);
@@ -548,6 +587,13 @@ private:
 
     void responseReceived(const QMap<Parser *,ParserState>::iterator it);
 
+    bool plugResponseToTask(const QMap<Parser *,ParserState>::iterator it,
+                            const QSharedPointer<Responses::AbstractResponse> &resp, ImapTask *task);
+
+    void rememberCommandOwner(Parser *parser, const uint firstCommand, ImapTask *task);
+    void forgetCommandOwners(const QMap<Parser *,ParserState>::iterator it, const QList<ImapTask *> &deletedTasks);
+    void scheduleTaskRecheck(ImapTask *task);
+
     /** @short Remove deleted Tasks from the activeTasks list */
     void removeDeletedTasks(const QList<ImapTask *> &deletedTasks, QList<ImapTask *> &activeTasks);
 
@@ -561,6 +607,8 @@ private:
     QMap<QByteArray,QByteArray> m_idResult;
 
     mutable QSet<QString> m_flagLiterals;
+    /** @short Recently normalized lists of flags along with their normalized form, the most recently used one first */
+    mutable QList<QPair<QStringList, QStringList> > m_recentNormalizedFlags;
 
     /** @short Username for login */
     QString m_imapUser;
@@ -575,6 +623,18 @@ private:
 
     QStringList m_capabilitiesBlacklist;
 
+    /** @short Mailboxes which shall be watched for changes through dedicated connections */
+    QStringList m_watchedMailboxes;
+
+    /** @short Capabilities which the server has advertised prior to the last successful LOGIN */
+    QStringList m_preAuthCapabilitiesCache;
+    /** @short Capabilities which were in effect after the last successful LOGIN
+
+    When the server greets a new connection with the same m_preAuthCapabilitiesCache, these are used right away instead of
+    waiting for the result of a CAPABILITY command.
+    */
+    QStringList m_postAuthCapabilitiesCache;
+
 protected slots:
     void responseReceived();
     void responseReceived(Imap::Parser *parser);
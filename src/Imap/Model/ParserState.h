@@ -23,6 +23,8 @@
 #ifndef IMAP_MODEL_PARSERSTATE_H
 #define IMAP_MODEL_PARSERSTATE_H
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QPointer>
 #include "../ConnectionState.h"
 #include "../Parser/Parser.h"
@@ -32,6 +34,7 @@ class Parser;
 namespace Mailbox {
 class ImapTask;
 class KeepMailboxOpenTask;
+class WatchMailboxTask;
 
 /** @short Helper structure for keeping track of each parser's state */
 struct ParserState {
@@ -51,10 +54,35 @@ struct ParserState {
     bool capabilitiesFresh;
     /** @short LIST responses which were not processed yet */
     QList<Responses::List> listResponses;
+    /** @short Does the server push the changes of the message counters through NOTIFY (RFC 5465)? */
+    bool notifyActive;
+    /** @short Name of the mailbox this connection is dedicated to watching, if any
+
+    Such a connection is never used for anything else.
+    */
+    QString watchedMailbox;
+    /** @short The WatchMailboxTask which owns this connection */
+    QPointer<WatchMailboxTask> watchingTask;
 
     /** @short Is the connection currently being processed? */
     int processingDepth;
 
+    /** @short Tasks which have queued the commands identified by these tags
+
+    This is merely a hint for routing the tagged responses; if a tag is not found here or if the task does not accept
+    the response, it gets offered to all active tasks in the usual order.
+    */
+    QHash<CommandHandle, QPointer<ImapTask> > commandOwners;
+    /** @short Tasks which might have become ready to run or which might have finished since the last check */
+    QList<QPointer<ImapTask> > tasksToRecheck;
+
+    /** @short A CAPABILITY command which double-checks the cached post-login capabilities, if any */
+    CommandHandle capabilityRevalidationCmd;
+    /** @short Started when the connection is being opened */
+    QElapsedTimer connectionTimer;
+    /** @short How many milliseconds it took from opening the connection to the first selected mailbox, or -1 */
+    qint64 timeToFirstMailbox;
+
     ParserState(Parser *parser);
     ParserState();
 };
@@ -21,9 +21,11 @@
 */
 
 #include "SQLCache.h"
+#include <QCryptographicHash>
 #include <QSqlError>
 #include <QSqlRecord>
 #include <QTimer>
+#include "Common/Metrics.h"
 #include "Common/SqlTransactionAutoAborter.h"
 
 //#define CACHE_DEBUG
@@ -129,6 +131,33 @@ if ( ! q.exec( QLatin1String("CREATE TABLE mailbox_sync_state ( " \
         return false; \
     }
 
+#define TROJITA_SQL_CACHE_CREATE_PARTS_HASH_INDEX \
+    if (! q.exec(QLatin1String("CREATE INDEX IF NOT EXISTS parts_hash ON parts (hash)"))) { \
+        emitError(SQLCache::tr("Can't create index parts_hash"), q); \
+        return false; \
+    }
+
+#define TROJITA_SQL_CACHE_CREATE_PARTS \
+    if (! q.exec(QLatin1String("CREATE TABLE parts (" \
+                               "mailbox STRING NOT NULL, " \
+                               "uid INT NOT NULL, " \
+                               "part_id BINARY, " \
+                               "hash BINARY NOT NULL, " \
+                               "PRIMARY KEY (mailbox, uid, part_id)" \
+                               ")"))) { \
+        emitError(SQLCache::tr("Can't create table parts"), q); \
+        return false; \
+    } \
+    TROJITA_SQL_CACHE_CREATE_PARTS_HASH_INDEX \
+    if (! q.exec(QLatin1String("CREATE TABLE part_blobs (" \
+                               "hash BINARY NOT NULL PRIMARY KEY, " \
+                               "refcount INT NOT NULL, " \
+                               "data BINARY" \
+                               ")"))) { \
+        emitError(SQLCache::tr("Can't create table part_blobs"), q); \
+        return false; \
+    }
+
 bool SQLCache::open(const QString &name, const QString &fileName)
 {
 #ifdef CACHE_DEBUG
@@ -207,7 +236,32 @@ bool SQLCache::open(const QString &name, const QString &fileName)
         }
     }
 
-    if (version != 6) {
+    if (version == 6) {
+        // V7 stores the data of message parts in a separate table, keyed by a hash of their contents. The old parts are
+        // simply thrown away; it's a cache, after all.
+        if (!q.exec(QLatin1String("DROP TABLE parts;"))) {
+            emitError(tr("Failed to drop old table parts"));
+            return false;
+        }
+        TROJITA_SQL_CACHE_CREATE_PARTS;
+        version = 7;
+        if (! q.exec(QLatin1String("UPDATE trojita SET version = 7;"))) {
+            emitError(tr("Failed to update cache DB scheme from v6 to v7"), q);
+            return false;
+        }
+    }
+
+    if (version == 7) {
+        // V8 has added an index which makes the lookup of all parts sharing a blob cheap
+        TROJITA_SQL_CACHE_CREATE_PARTS_HASH_INDEX;
+        version = 8;
+        if (! q.exec(QLatin1String("UPDATE trojita SET version = 8;"))) {
+            emitError(tr("Failed to update cache DB scheme from v7 to v8"), q);
+            return false;
+        }
+    }
+
+    if (version != 8) {
         emitError(tr("Unknown version"));
         return false;
     }
@@ -232,7 +286,7 @@ bool SQLCache::createTables()
         emitError(tr("Failed to prepare table structures"), q);
         return false;
     }
-    if (! q.exec(QLatin1String("INSERT INTO trojita ( version ) VALUES ( 6 )"))) {
+    if (! q.exec(QLatin1String("INSERT INTO trojita ( version ) VALUES ( 8 )"))) {
         emitError(tr("Can't store version info"), q);
         return false;
     }
@@ -267,15 +321,7 @@ bool SQLCache::createTables()
         emitError(tr("Can't create table flags"), q);
     }
 
-    if (! q.exec(QLatin1String("CREATE TABLE parts ("
-                               "mailbox STRING NOT NULL, "
-                               "uid INT NOT NULL, "
-                               "part_id BINARY, "
-                               "data BINARY, "
-                               "PRIMARY KEY (mailbox, uid, part_id)"
-                               ")"))) {
-        emitError(tr("Can't create table parts"), q);
-    }
+    TROJITA_SQL_CACHE_CREATE_PARTS;
 
     TROJITA_SQL_CACHE_CREATE_THREADING;
     TROJITA_SQL_CACHE_CREATE_SYNC_STATE;
@@ -414,13 +460,14 @@ bool SQLCache::prepareQueries()
     }
 
     queryMessagePart = QSqlQuery(db);
-    if (! queryMessagePart.prepare(QLatin1String("SELECT data FROM parts WHERE mailbox = ? AND uid = ? AND part_id = ?"))) {
+    if (! queryMessagePart.prepare(QLatin1String("SELECT part_blobs.data FROM parts JOIN part_blobs ON parts.hash = part_blobs.hash "
+                                                 "WHERE parts.mailbox = ? AND parts.uid = ? AND parts.part_id = ?"))) {
         emitError(tr("Failed to prepare queryMessagePart"), queryMessagePart);
         return false;
     }
 
     querySetMessagePart = QSqlQuery(db);
-    if (! querySetMessagePart.prepare(QLatin1String("INSERT OR REPLACE INTO parts ( mailbox, uid, part_id, data ) VALUES (?, ?, ?, ?)"))) {
+    if (! querySetMessagePart.prepare(QLatin1String("INSERT OR REPLACE INTO parts ( mailbox, uid, part_id, hash ) VALUES (?, ?, ?, ?)"))) {
         emitError(tr("Failed to prepare querySetMessagePart"), querySetMessagePart);
         return false;
     }
@@ -431,6 +478,91 @@ bool SQLCache::prepareQueries()
         return false;
     }
 
+    queryExternalPartHash = QSqlQuery(db);
+    if (! queryExternalPartHash.prepare(QLatin1String("SELECT parts.hash FROM parts JOIN part_blobs ON parts.hash = part_blobs.hash "
+                                                      "WHERE parts.mailbox = ? AND parts.uid = ? AND parts.part_id = ? "
+                                                      "AND part_blobs.data IS NULL"))) {
+        emitError(tr("Failed to prepare queryExternalPartHash"), queryExternalPartHash);
+        return false;
+    }
+
+    queryPartBlobExists = QSqlQuery(db);
+    if (! queryPartBlobExists.prepare(QLatin1String("SELECT 1 FROM part_blobs WHERE hash = ?"))) {
+        emitError(tr("Failed to prepare queryPartBlobExists"), queryPartBlobExists);
+        return false;
+    }
+
+    queryInsertPartBlob = QSqlQuery(db);
+    if (! queryInsertPartBlob.prepare(QLatin1String("INSERT OR IGNORE INTO part_blobs ( hash, refcount, data ) VALUES (?, 0, ?)"))) {
+        emitError(tr("Failed to prepare queryInsertPartBlob"), queryInsertPartBlob);
+        return false;
+    }
+
+    queryReferencePartBlob = QSqlQuery(db);
+    if (! queryReferencePartBlob.prepare(QLatin1String("UPDATE part_blobs SET refcount = refcount + 1 WHERE hash = ?"))) {
+        emitError(tr("Failed to prepare queryReferencePartBlob"), queryReferencePartBlob);
+        return false;
+    }
+
+    queryPartHashesOfMailbox = QSqlQuery(db);
+    if (! queryPartHashesOfMailbox.prepare(QLatin1String("SELECT hash, COUNT(*) FROM parts WHERE mailbox = ? GROUP BY hash"))) {
+        emitError(tr("Failed to prepare queryPartHashesOfMailbox"), queryPartHashesOfMailbox);
+        return false;
+    }
+
+    queryPartHashesOfMessage = QSqlQuery(db);
+    if (! queryPartHashesOfMessage.prepare(QLatin1String("SELECT hash, COUNT(*) FROM parts WHERE mailbox = ? AND uid = ? "
+                                                         "GROUP BY hash"))) {
+        emitError(tr("Failed to prepare queryPartHashesOfMessage"), queryPartHashesOfMessage);
+        return false;
+    }
+
+    queryPartHashesOfPart = QSqlQuery(db);
+    if (! queryPartHashesOfPart.prepare(QLatin1String("SELECT hash, COUNT(*) FROM parts WHERE mailbox = ? AND uid = ? "
+                                                      "AND part_id = ? GROUP BY hash"))) {
+        emitError(tr("Failed to prepare queryPartHashesOfPart"), queryPartHashesOfPart);
+        return false;
+    }
+
+    queryAdjustPartBlobRefcount = QSqlQuery(db);
+    if (! queryAdjustPartBlobRefcount.prepare(QLatin1String("UPDATE part_blobs SET refcount = refcount + ? WHERE hash = ?"))) {
+        emitError(tr("Failed to prepare queryAdjustPartBlobRefcount"), queryAdjustPartBlobRefcount);
+        return false;
+    }
+
+    queryUnusedPartBlob = QSqlQuery(db);
+    if (! queryUnusedPartBlob.prepare(QLatin1String("SELECT data IS NULL FROM part_blobs WHERE hash = ? AND refcount <= 0"))) {
+        emitError(tr("Failed to prepare queryUnusedPartBlob"), queryUnusedPartBlob);
+        return false;
+    }
+
+    queryRemovePartBlob = QSqlQuery(db);
+    if (! queryRemovePartBlob.prepare(QLatin1String("DELETE FROM part_blobs WHERE hash = ?"))) {
+        emitError(tr("Failed to prepare queryRemovePartBlob"), queryRemovePartBlob);
+        return false;
+    }
+
+    queryCopyParts = QSqlQuery(db);
+    if (! queryCopyParts.prepare(QLatin1String("INSERT OR REPLACE INTO parts ( mailbox, uid, part_id, hash ) "
+                                               "SELECT ?, ?, part_id, hash FROM parts WHERE mailbox = ? AND uid = ?"))) {
+        emitError(tr("Failed to prepare queryCopyParts"), queryCopyParts);
+        return false;
+    }
+
+    queryCopyMessageMetadata = QSqlQuery(db);
+    if (! queryCopyMessageMetadata.prepare(QLatin1String("INSERT OR REPLACE INTO msg_metadata ( mailbox, uid, data, lastAccessDate ) "
+                                                         "SELECT ?, ?, data, lastAccessDate FROM msg_metadata WHERE mailbox = ? AND uid = ?"))) {
+        emitError(tr("Failed to prepare queryCopyMessageMetadata"), queryCopyMessageMetadata);
+        return false;
+    }
+
+    queryCopyMessageFlags = QSqlQuery(db);
+    if (! queryCopyMessageFlags.prepare(QLatin1String("INSERT OR REPLACE INTO flags ( mailbox, uid, flags ) "
+                                                      "SELECT ?, ?, flags FROM flags WHERE mailbox = ? AND uid = ?"))) {
+        emitError(tr("Failed to prepare queryCopyMessageFlags"), queryCopyMessageFlags);
+        return false;
+    }
+
     queryMessageThreading = QSqlQuery(db);
     if (! queryMessageThreading.prepare(QLatin1String("SELECT threading FROM msg_threading WHERE mailbox = ?"))) {
         emitError(tr("Failed to prepare queryMessageThreading"), queryMessageThreading);
@@ -533,6 +665,8 @@ void SQLCache::setChildMailboxes(const QString &mailbox, const QList<MailboxMeta
 
 SyncState SQLCache::mailboxSyncState(const QString &mailbox) const
 {
+    static Common::MetricsHistogram *const latency = Common::MetricsRegistry::instance()->histogram(QLatin1String("sqlcache.mailboxSyncState.us"));
+    Common::MetricsTimer timer(latency);
     SyncState res;
     queryMailboxSyncState.bindValue(0, mailboxName(mailbox));
     if (! queryMailboxSyncState.exec()) {
@@ -568,6 +702,8 @@ void SQLCache::setMailboxSyncState(const QString &mailbox, const SyncState &stat
 
 Imap::Uids SQLCache::uidMapping(const QString &mailbox) const
 {
+    static Common::MetricsHistogram *const latency = Common::MetricsRegistry::instance()->histogram(QLatin1String("sqlcache.uidMapping.us"));
+    Common::MetricsTimer timer(latency);
     Imap::Uids res;
     queryUidMapping.bindValue(0, mailboxName(mailbox));
     if (! queryUidMapping.exec()) {
@@ -622,6 +758,8 @@ void SQLCache::clearAllMessages(const QString &mailbox)
     queryClearAllMessages2.bindValue(0, mailboxName(mailbox));
     queryClearAllMessages3.bindValue(0, mailboxName(mailbox));
     queryClearAllMessages4.bindValue(0, mailboxName(mailbox));
+    queryPartHashesOfMailbox.bindValue(0, mailboxName(mailbox));
+    releasePartBlobs(queryPartHashesOfMailbox);
     if (! queryClearAllMessages1.exec()) {
         emitError(tr("Query queryClearAllMessages1 failed"), queryClearAllMessages1);
     }
@@ -649,6 +787,9 @@ void SQLCache::clearMessage(const QString mailbox, uint uid)
     queryClearMessage2.bindValue(1, uid);
     queryClearMessage3.bindValue(0, mailboxName(mailbox));
     queryClearMessage3.bindValue(1, uid);
+    queryPartHashesOfMessage.bindValue(0, mailboxName(mailbox));
+    queryPartHashesOfMessage.bindValue(1, uid);
+    releasePartBlobs(queryPartHashesOfMessage);
     if (! queryClearMessage1.exec()) {
         emitError(tr("Query queryClearMessage1 failed"), queryClearMessage1);
     }
@@ -698,6 +839,10 @@ void SQLCache::setMsgFlags(const QString &mailbox, const uint uid, const QString
 
 AbstractCache::MessageDataBundle SQLCache::messageMetadata(const QString &mailbox, uint uid) const
 {
+    static Common::MetricsHistogram *const latency = Common::MetricsRegistry::instance()->histogram(QLatin1String("sqlcache.messageMetadata.us"));
+    static Common::MetricsCounter *const hits = Common::MetricsRegistry::instance()->counter(QLatin1String("sqlcache.messageMetadata.hits"));
+    static Common::MetricsCounter *const misses = Common::MetricsRegistry::instance()->counter(QLatin1String("sqlcache.messageMetadata.misses"));
+    Common::MetricsTimer timer(latency);
     AbstractCache::MessageDataBundle res;
     queryMessageMetadata.bindValue(0, mailboxName(mailbox));
     queryMessageMetadata.bindValue(1, uid);
@@ -706,6 +851,7 @@ AbstractCache::MessageDataBundle SQLCache::messageMetadata(const QString &mailbo
         return res;
     }
     if (queryMessageMetadata.first()) {
+        hits->add();
         res.uid = uid;
         QDataStream stream(qUncompress(queryMessageMetadata.value(0).toByteArray()));
         stream.setVersion(streamVersion);
@@ -724,6 +870,8 @@ AbstractCache::MessageDataBundle SQLCache::messageMetadata(const QString &mailbo
                 }
             }
         }
+    } else {
+        misses->add();
     }
     // "Not found" is not an error here
     return res;
@@ -752,6 +900,10 @@ void SQLCache::setMessageMetadata(const QString &mailbox, const uint uid, const
 
 QByteArray SQLCache::messagePart(const QString &mailbox, const uint uid, const QByteArray &partId) const
 {
+    static Common::MetricsHistogram *const latency = Common::MetricsRegistry::instance()->histogram(QLatin1String("sqlcache.messagePart.us"));
+    static Common::MetricsCounter *const hits = Common::MetricsRegistry::instance()->counter(QLatin1String("sqlcache.messagePart.hits"));
+    static Common::MetricsCounter *const misses = Common::MetricsRegistry::instance()->counter(QLatin1String("sqlcache.messagePart.misses"));
+    Common::MetricsTimer timer(latency);
     QByteArray res;
     queryMessagePart.bindValue(0, mailboxName(mailbox));
     queryMessagePart.bindValue(1, uid);
@@ -760,10 +912,14 @@ QByteArray SQLCache::messagePart(const QString &mailbox, const uint uid, const Q
         emitError(tr("Query queryMessagePart failed"), queryMessagePart);
         return res;
     }
-    if (queryMessagePart.first()) {
+    // External blobs have no data in here
+    if (queryMessagePart.first() && !queryMessagePart.value(0).isNull()) {
+        hits->add();
         res = qUncompress(queryMessagePart.value(0).toByteArray());
-        queryMessagePart.finish();
+    } else {
+        misses->add();
     }
+    queryMessagePart.finish();
     return res;
 }
 
@@ -772,22 +928,118 @@ void SQLCache::setMsgPart(const QString &mailbox, const uint uid, const QByteArr
 #ifdef CACHE_DEBUG
     qDebug() << "Saving message part" << partId << uid << mailbox;
 #endif
+    storePartReference(mailbox, uid, partId, partHash(data), &data);
+}
+
+void SQLCache::setExternalMsgPart(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &hash)
+{
+#ifdef CACHE_DEBUG
+    qDebug() << "Saving reference to an external message part" << partId << uid << mailbox;
+#endif
+    storePartReference(mailbox, uid, partId, hash, 0);
+}
+
+/** @short Make the message part refer to the blob identified by @arg hash, creating the blob when needed
+
+The @arg inlineData are only used when the blob does not exist yet; a null pointer creates an external blob.
+*/
+void SQLCache::storePartReference(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &hash,
+                                  const QByteArray *inlineData)
+{
     touchingDB();
+    queryPartHashesOfPart.bindValue(0, mailboxName(mailbox));
+    queryPartHashesOfPart.bindValue(1, uid);
+    queryPartHashesOfPart.bindValue(2, partId);
+    releasePartBlobs(queryPartHashesOfPart);
+
+    if (!hasPartBlob(hash)) {
+        queryInsertPartBlob.bindValue(0, hash);
+        queryInsertPartBlob.bindValue(1, inlineData ? QVariant(qCompress(*inlineData)) : QVariant(QVariant::ByteArray));
+        if (! queryInsertPartBlob.exec()) {
+            emitError(tr("Query queryInsertPartBlob failed"), queryInsertPartBlob);
+            return;
+        }
+    }
+
+    queryReferencePartBlob.bindValue(0, hash);
+    if (! queryReferencePartBlob.exec()) {
+        emitError(tr("Query queryReferencePartBlob failed"), queryReferencePartBlob);
+        return;
+    }
+
     querySetMessagePart.bindValue(0, mailboxName(mailbox));
     querySetMessagePart.bindValue(1, uid);
     querySetMessagePart.bindValue(2, partId);
-    querySetMessagePart.bindValue(3, qCompress(data));
+    querySetMessagePart.bindValue(3, hash);
     if (! querySetMessagePart.exec()) {
         emitError(tr("Query querySetMessagePart failed"), querySetMessagePart);
     }
 }
 
+/** @short Execute the @arg partHashes query and return the number of parts which refer to each of the blobs
+
+The query has to produce a hash and a count in each row, see queryPartHashesOfMessage and friends.
+*/
+QList<QPair<QByteArray, int> > SQLCache::partHashCounts(QSqlQuery &partHashes)
+{
+    QList<QPair<QByteArray, int> > res;
+    if (! partHashes.exec()) {
+        emitError(tr("Failed to look up the blobs of message parts"), partHashes);
+        return res;
+    }
+    while (partHashes.next()) {
+        res << qMakePair(partHashes.value(0).toByteArray(), partHashes.value(1).toInt());
+    }
+    partHashes.finish();
+    return res;
+}
+
+/** @short Drop the references from the parts matched by @arg partHashes to their blobs and delete the unused blobs
+
+The @arg partHashes is one of the queryPartHashesOf* queries whose values have already been bound. The rows in the
+parts table are left alone, it is up to the caller to remove them.
+*/
+void SQLCache::releasePartBlobs(QSqlQuery &partHashes)
+{
+    typedef QPair<QByteArray, int> HashCount;
+    Q_FOREACH(const HashCount &item, partHashCounts(partHashes)) {
+        queryAdjustPartBlobRefcount.bindValue(0, -item.second);
+        queryAdjustPartBlobRefcount.bindValue(1, item.first);
+        if (! queryAdjustPartBlobRefcount.exec()) {
+            emitError(tr("Query queryAdjustPartBlobRefcount failed"), queryAdjustPartBlobRefcount);
+            return;
+        }
+
+        queryUnusedPartBlob.bindValue(0, item.first);
+        if (! queryUnusedPartBlob.exec()) {
+            emitError(tr("Query queryUnusedPartBlob failed"), queryUnusedPartBlob);
+            return;
+        }
+        if (! queryUnusedPartBlob.first())
+            continue;
+        const bool external = queryUnusedPartBlob.value(0).toBool();
+        queryUnusedPartBlob.finish();
+        if (external)
+            m_releasedExternalBlobs << item.first;
+
+        queryRemovePartBlob.bindValue(0, item.first);
+        if (! queryRemovePartBlob.exec()) {
+            emitError(tr("Query queryRemovePartBlob failed"), queryRemovePartBlob);
+            return;
+        }
+    }
+}
+
 void SQLCache::forgetMessagePart(const QString &mailbox, const uint uid, const QByteArray &partId)
 {
 #ifdef CACHE_DEBUG
     qDebug() << "Forgetting message part" << partId << uid << mailbox;
 #endif
     touchingDB();
+    queryPartHashesOfPart.bindValue(0, mailboxName(mailbox));
+    queryPartHashesOfPart.bindValue(1, uid);
+    queryPartHashesOfPart.bindValue(2, partId);
+    releasePartBlobs(queryPartHashesOfPart);
     queryForgetMessagePart.bindValue(0, mailboxName(mailbox));
     queryForgetMessagePart.bindValue(1, uid);
     queryForgetMessagePart.bindValue(2, partId);
@@ -796,6 +1048,126 @@ void SQLCache::forgetMessagePart(const QString &mailbox, const uint uid, const Q
     }
 }
 
+void SQLCache::copyMessageParts(const QString &sourceMailbox, const Imap::Uids &sourceUids,
+                                const QString &targetMailbox, const Imap::Uids &targetUids)
+{
+    Q_ASSERT(sourceUids.size() == targetUids.size());
+    touchingDB();
+    for (int i = 0; i < sourceUids.size() && i < targetUids.size(); ++i) {
+        copyPartsOfMessage(sourceMailbox, sourceUids[i], targetMailbox, targetUids[i]);
+    }
+}
+
+void SQLCache::copyMessages(const QString &sourceMailbox, const Imap::Uids &sourceUids,
+                            const QString &targetMailbox, const Imap::Uids &targetUids)
+{
+#ifdef CACHE_DEBUG
+    qDebug() << "Copying" << sourceUids.size() << "messages from" << sourceMailbox << "to" << targetMailbox;
+#endif
+    Q_ASSERT(sourceUids.size() == targetUids.size());
+    // The delayed commit only happens from the event loop, so all of this ends up in a single transaction
+    touchingDB();
+    for (int i = 0; i < sourceUids.size() && i < targetUids.size(); ++i) {
+        queryCopyMessageMetadata.bindValue(0, mailboxName(targetMailbox));
+        queryCopyMessageMetadata.bindValue(1, targetUids[i]);
+        queryCopyMessageMetadata.bindValue(2, mailboxName(sourceMailbox));
+        queryCopyMessageMetadata.bindValue(3, sourceUids[i]);
+        if (! queryCopyMessageMetadata.exec()) {
+            emitError(tr("Query queryCopyMessageMetadata failed"), queryCopyMessageMetadata);
+            return;
+        }
+
+        queryCopyMessageFlags.bindValue(0, mailboxName(targetMailbox));
+        queryCopyMessageFlags.bindValue(1, targetUids[i]);
+        queryCopyMessageFlags.bindValue(2, mailboxName(sourceMailbox));
+        queryCopyMessageFlags.bindValue(3, sourceUids[i]);
+        if (! queryCopyMessageFlags.exec()) {
+            emitError(tr("Query queryCopyMessageFlags failed"), queryCopyMessageFlags);
+            return;
+        }
+
+        copyPartsOfMessage(sourceMailbox, sourceUids[i], targetMailbox, targetUids[i]);
+    }
+}
+
+void SQLCache::copyPartsOfMessage(const QString &sourceMailbox, const uint sourceUid, const QString &targetMailbox, const uint targetUid)
+{
+    // Whatever might have been cached under the new UID is stale
+    queryPartHashesOfMessage.bindValue(0, mailboxName(targetMailbox));
+    queryPartHashesOfMessage.bindValue(1, targetUid);
+    releasePartBlobs(queryPartHashesOfMessage);
+    queryClearMessage3.bindValue(0, mailboxName(targetMailbox));
+    queryClearMessage3.bindValue(1, targetUid);
+    if (! queryClearMessage3.exec()) {
+        emitError(tr("Query queryClearMessage3 failed"), queryClearMessage3);
+        return;
+    }
+
+    queryPartHashesOfMessage.bindValue(0, mailboxName(sourceMailbox));
+    queryPartHashesOfMessage.bindValue(1, sourceUid);
+    typedef QPair<QByteArray, int> HashCount;
+    Q_FOREACH(const HashCount &item, partHashCounts(queryPartHashesOfMessage)) {
+        queryAdjustPartBlobRefcount.bindValue(0, item.second);
+        queryAdjustPartBlobRefcount.bindValue(1, item.first);
+        if (! queryAdjustPartBlobRefcount.exec()) {
+            emitError(tr("Query queryAdjustPartBlobRefcount failed"), queryAdjustPartBlobRefcount);
+            return;
+        }
+    }
+
+    queryCopyParts.bindValue(0, mailboxName(targetMailbox));
+    queryCopyParts.bindValue(1, targetUid);
+    queryCopyParts.bindValue(2, mailboxName(sourceMailbox));
+    queryCopyParts.bindValue(3, sourceUid);
+    if (! queryCopyParts.exec()) {
+        emitError(tr("Query queryCopyParts failed"), queryCopyParts);
+    }
+}
+
+QByteArray SQLCache::partHash(const QByteArray &data)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+#else
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+#endif
+}
+
+bool SQLCache::hasPartBlob(const QByteArray &hash) const
+{
+    queryPartBlobExists.bindValue(0, hash);
+    if (! queryPartBlobExists.exec()) {
+        emitError(tr("Query queryPartBlobExists failed"), queryPartBlobExists);
+        return false;
+    }
+    bool res = queryPartBlobExists.first();
+    queryPartBlobExists.finish();
+    return res;
+}
+
+QByteArray SQLCache::externalPartHash(const QString &mailbox, const uint uid, const QByteArray &partId) const
+{
+    QByteArray res;
+    queryExternalPartHash.bindValue(0, mailboxName(mailbox));
+    queryExternalPartHash.bindValue(1, uid);
+    queryExternalPartHash.bindValue(2, partId);
+    if (! queryExternalPartHash.exec()) {
+        emitError(tr("Query queryExternalPartHash failed"), queryExternalPartHash);
+        return res;
+    }
+    if (queryExternalPartHash.first())
+        res = queryExternalPartHash.value(0).toByteArray();
+    queryExternalPartHash.finish();
+    return res;
+}
+
+QList<QByteArray> SQLCache::takeReleasedExternalBlobs()
+{
+    QList<QByteArray> res = m_releasedExternalBlobs;
+    m_releasedExternalBlobs.clear();
+    return res;
+}
+
 QVector<Imap::Responses::ThreadingNode> SQLCache::messageThreading(const QString &mailbox)
 {
     QVector<Imap::Responses::ThreadingNode> res;
@@ -51,6 +51,11 @@ et cetera. In short, the layout of the database is supposed to act as a quick an
 cache and is certainly *not* meant to be accessed by third-party applications. Please, do
 consider it an opaque format.
 
+The data of message parts are stored only once no matter how many messages contain them. Each
+part is a reference to a reference-counted blob identified by a hash of its contents. A blob
+can also be "external", which means that only the reference counting is done here and that
+the data themselves live elsewhere, e.g. in a DiskPartCache.
+
 Some ideas for improvements:
 - Don't store full string mailbox names in each table, use another table for it
 - Merge uid_mapping with mailbox_sync_state, and also msg_metadata with flags
@@ -78,6 +83,8 @@ public:
 
     virtual void clearAllMessages(const QString &mailbox);
     virtual void clearMessage(const QString mailbox, const uint uid);
+    virtual void copyMessages(const QString &sourceMailbox, const Imap::Uids &sourceUids,
+                              const QString &targetMailbox, const Imap::Uids &targetUids);
 
     virtual MessageDataBundle messageMetadata(const QString &mailbox, uint uid) const;
     virtual void setMessageMetadata(const QString &mailbox, const uint uid, const MessageDataBundle &metadata);
@@ -88,6 +95,19 @@ public:
     virtual QByteArray messagePart(const QString &mailbox, const uint uid, const QByteArray &partId) const;
     virtual void setMsgPart(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &data);
     virtual void forgetMessagePart(const QString &mailbox, const uint uid, const QByteArray &partId);
+    virtual void copyMessageParts(const QString &sourceMailbox, const Imap::Uids &sourceUids,
+                                  const QString &targetMailbox, const Imap::Uids &targetUids);
+
+    /** @short Return the key under which the data of a message part are stored */
+    static QByteArray partHash(const QByteArray &data);
+    /** @short Is there a blob with the given hash already? */
+    bool hasPartBlob(const QByteArray &hash) const;
+    /** @short Make a message part refer to an external blob */
+    void setExternalMsgPart(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &hash);
+    /** @short Return the hash of the external blob a message part refers to, or a null QByteArray if it isn't external */
+    QByteArray externalPartHash(const QString &mailbox, const uint uid, const QByteArray &partId) const;
+    /** @short Return the hashes of external blobs which are no longer referenced since the last call */
+    QList<QByteArray> takeReleasedExternalBlobs();
 
     virtual QVector<Imap::Responses::ThreadingNode> messageThreading(const QString &mailbox);
     virtual void setMessageThreading(const QString &mailbox, const QVector<Imap::Responses::ThreadingNode> &threading);
@@ -113,6 +133,12 @@ private:
     /** @short We're about to touch the DB, so it might be a good time to start a transaction */
     void touchingDB();
 
+    void storePartReference(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &hash,
+                            const QByteArray *inlineData);
+    QList<QPair<QByteArray, int> > partHashCounts(QSqlQuery &partHashes);
+    void releasePartBlobs(QSqlQuery &partHashes);
+    void copyPartsOfMessage(const QString &sourceMailbox, const uint sourceUid, const QString &targetMailbox, const uint targetUid);
+
     /** @short Initialize the database */
     void init();
 
@@ -149,6 +175,19 @@ private:
     mutable QSqlQuery queryMessagePart;
     mutable QSqlQuery querySetMessagePart;
     mutable QSqlQuery queryForgetMessagePart;
+    mutable QSqlQuery queryExternalPartHash;
+    mutable QSqlQuery queryPartBlobExists;
+    mutable QSqlQuery queryInsertPartBlob;
+    mutable QSqlQuery queryReferencePartBlob;
+    mutable QSqlQuery queryPartHashesOfMailbox;
+    mutable QSqlQuery queryPartHashesOfMessage;
+    mutable QSqlQuery queryPartHashesOfPart;
+    mutable QSqlQuery queryAdjustPartBlobRefcount;
+    mutable QSqlQuery queryUnusedPartBlob;
+    mutable QSqlQuery queryRemovePartBlob;
+    mutable QSqlQuery queryCopyParts;
+    mutable QSqlQuery queryCopyMessageMetadata;
+    mutable QSqlQuery queryCopyMessageFlags;
     mutable QSqlQuery queryMessageThreading;
     mutable QSqlQuery querySetMessageThreading;
 
@@ -156,6 +195,9 @@ private:
     QTimer *tooMuchTimeWithoutCommit;
     bool inTransaction;
 
+    /** @short Hashes of external blobs whose reference count has dropped to zero */
+    QList<QByteArray> m_releasedExternalBlobs;
+
     /** @short A point in time against which the "last accessed on" data is computed */
     static QDate accessingThresholdDate;
 
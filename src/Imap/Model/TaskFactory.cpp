@@ -25,6 +25,7 @@
 #include "Imap/Model/TaskPresentationModel.h"
 #include "Imap/Parser/Parser.h"
 #include "Imap/Tasks/AppendTask.h"
+#include "Imap/Tasks/BulkAppendTask.h"
 #include "Imap/Tasks/CopyMoveMessagesTask.h"
 #include "Imap/Tasks/CreateMailboxTask.h"
 #include "Imap/Tasks/DeleteMailboxTask.h"
@@ -36,14 +37,17 @@
 #include "Imap/Tasks/GetAnyConnectionTask.h"
 #include "Imap/Tasks/IdTask.h"
 #include "Imap/Tasks/KeepMailboxOpenTask.h"
+#include "Imap/Tasks/ListStatusTask.h"
 #include "Imap/Tasks/Fake_ListChildMailboxesTask.h"
 #include "Imap/Tasks/Fake_OpenConnectionTask.h"
+#include "Imap/Tasks/NotifyTask.h"
 #include "Imap/Tasks/NumberOfMessagesTask.h"
 #include "Imap/Tasks/ObtainSynchronizedMailboxTask.h"
 #include "Imap/Tasks/OpenConnectionTask.h"
 #include "Imap/Tasks/UidSubmitTask.h"
 #include "Imap/Tasks/UpdateFlagsTask.h"
 #include "Imap/Tasks/UpdateFlagsOfAllMessagesTask.h"
+#include "Imap/Tasks/WatchMailboxTask.h"
 #include "Imap/Tasks/ThreadTask.h"
 #include "Imap/Tasks/NoopTask.h"
 #include "Imap/Tasks/UnSelectTask.h"
@@ -126,6 +130,21 @@ NumberOfMessagesTask *TaskFactory::createNumberOfMessagesTask(Model *model, cons
     return new NumberOfMessagesTask(model, mailbox);
 }
 
+ListStatusTask *TaskFactory::createListStatusTask(Model *model, const QStringList &mailboxes)
+{
+    return new ListStatusTask(model, mailboxes);
+}
+
+NotifyTask *TaskFactory::createNotifyTask(Model *model, ImapTask *dependingTask)
+{
+    return new NotifyTask(model, dependingTask);
+}
+
+WatchMailboxTask *TaskFactory::createWatchMailboxTask(Model *model, const QString &mailbox)
+{
+    return new WatchMailboxTask(model, mailbox);
+}
+
 ObtainSynchronizedMailboxTask *TaskFactory::createObtainSynchronizedMailboxTask(Model *model, const QModelIndex &mailboxIndex,
         ImapTask *parentTask, KeepMailboxOpenTask *keepTask)
 {
@@ -179,12 +198,23 @@ AppendTask *TaskFactory::createAppendTask(Model *model, const QString &targetMai
     return new AppendTask(model, targetMailbox, rawMessageData, flags, timestamp);
 }
 
+AppendTask *TaskFactory::createAppendTask(Model *model, const QString &targetMailbox, const QSharedPointer<QIODevice> &rawMessageData,
+                                          const QStringList &flags, const QDateTime &timestamp)
+{
+    return new AppendTask(model, targetMailbox, rawMessageData, flags, timestamp);
+}
+
 AppendTask *TaskFactory::createAppendTask(Model *model, const QString &targetMailbox, const QList<CatenatePair> &data,
                                           const QStringList &flags, const QDateTime &timestamp)
 {
     return new AppendTask(model, targetMailbox, data, flags, timestamp);
 }
 
+BulkAppendTask *TaskFactory::createBulkAppendTask(Model *model, const QString &targetMailbox, const QList<AppendItem> &items)
+{
+    return new BulkAppendTask(model, targetMailbox, items);
+}
+
 SubscribeUnsubscribeTask *TaskFactory::createSubscribeUnsubscribeTask(Model *model, const QString &mailboxName,
                                                                       const SubscribeUnsubscribeOperation operation)
 {
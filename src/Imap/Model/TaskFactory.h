@@ -26,6 +26,8 @@
 #include <memory>
 #include <QMap>
 #include <QModelIndex>
+#include <QSharedPointer>
+#include "AppendData.h"
 #include "CatenateData.h"
 #include "CopyMoveOperation.h"
 #include "FlagsOperation.h"
@@ -33,6 +35,8 @@
 #include "UidSubmitData.h"
 #include "Imap/Parser/Uids.h"
 
+class QIODevice;
+
 namespace Imap
 {
 class Parser;
@@ -40,6 +44,7 @@ namespace Mailbox
 {
 
 class AppendTask;
+class BulkAppendTask;
 class CopyMoveMessagesTask;
 class CreateMailboxTask;
 class DeleteMailboxTask;
@@ -64,6 +69,9 @@ class SortTask;
 class SubscribeUnsubscribeTask;
 class GenUrlAuthTask;
 class UidSubmitTask;
+class ListStatusTask;
+class NotifyTask;
+class WatchMailboxTask;
 
 class Model;
 class TreeItemMailbox;
@@ -87,6 +95,9 @@ public:
     virtual KeepMailboxOpenTask *createKeepMailboxOpenTask(Model *model, const QModelIndex &mailbox, Parser *oldParser);
     virtual ListChildMailboxesTask *createListChildMailboxesTask(Model *model, const QModelIndex &mailbox);
     virtual NumberOfMessagesTask *createNumberOfMessagesTask(Model *model, const QModelIndex &mailbox);
+    virtual ListStatusTask *createListStatusTask(Model *model, const QStringList &mailboxes);
+    virtual NotifyTask *createNotifyTask(Model *model, ImapTask *dependingTask);
+    virtual WatchMailboxTask *createWatchMailboxTask(Model *model, const QString &mailbox);
     virtual ObtainSynchronizedMailboxTask *createObtainSynchronizedMailboxTask(Model *model, const QModelIndex &mailboxIndex,
             ImapTask *parentTask, KeepMailboxOpenTask *keepTask);
     virtual OpenConnectionTask *createOpenConnectionTask(Model *model);
@@ -104,8 +115,11 @@ public:
     virtual SortTask *createSortTask(Model *model, const QModelIndex &mailbox, const QStringList &searchConditions, const QStringList &sortCriteria);
     virtual AppendTask *createAppendTask(Model *model, const QString &targetMailbox, const QByteArray &rawMessageData,
                                          const QStringList &flags, const QDateTime &timestamp);
+    virtual AppendTask *createAppendTask(Model *model, const QString &targetMailbox, const QSharedPointer<QIODevice> &rawMessageData,
+                                         const QStringList &flags, const QDateTime &timestamp);
     virtual AppendTask *createAppendTask(Model *model, const QString &targetMailbox, const QList<CatenatePair> &data,
                                          const QStringList &flags, const QDateTime &timestamp);
+    virtual BulkAppendTask *createBulkAppendTask(Model *model, const QString &targetMailbox, const QList<AppendItem> &items);
     virtual SubscribeUnsubscribeTask *createSubscribeUnsubscribeTask(Model *model, const QString &mailboxName,
                                                                      const SubscribeUnsubscribeOperation operation);
     virtual SubscribeUnsubscribeTask *createSubscribeUnsubscribeTask(Model *model, ImapTask *parentTask, const QString &mailboxName,
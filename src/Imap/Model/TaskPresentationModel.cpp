@@ -199,12 +199,14 @@ QVariant TaskPresentationModel::data(const QModelIndex &index, int role) const
             className.remove(QLatin1String("Imap::Mailbox::"));
             return tr("%1: %2").arg(className, task->debugIdentification());
         }
-    case RoleTaskCompactName: {
+    case RoleTaskCompactName:
+    case RoleTaskProgress:
+    case RoleTaskProgressMax: {
         if (isParserState) {
             return QVariant();
         } else {
             ImapTask *task = static_cast<ImapTask *>(index.internalPointer());
-            return task->taskData(RoleTaskCompactName);
+            return task->taskData(role);
         }
     }
     default:
@@ -359,6 +359,7 @@ void ThreadingMsgListModel::handleRowsAboutToBeRemoved(const QModelIndex &parent
         Q_ASSERT(it != threading.end());
         it->uid = 0;
         it->ptr = 0;
+        m_pendingPrune << it->internalId;
     }
 }
 
@@ -373,10 +374,14 @@ void ThreadingMsgListModel::handleRowsRemoved(const QModelIndex &parent, int sta
 
 void ThreadingMsgListModel::delayedPrune()
 {
+    if (m_pendingPrune.isEmpty())
+        return;
+
     emit layoutAboutToBeChanged();
-    updatePersistentIndexesPhase1();
-    pruneTree();
-    updatePersistentIndexesPhase2();
+    QList<uint> pending = m_pendingPrune;
+    m_pendingPrune.clear();
+    pruneTree(pending);
+    updatePersistentIndexesInPlace();
     emit layoutChanged();
 }
 
@@ -431,6 +436,7 @@ void ThreadingMsgListModel::resetMe()
     modelResetInProgress = true;
     threading.clear();
     ptrToInternal.clear();
+    m_pendingPrune.clear();
     unknownUids.clear();
     threadedRootIds.clear();
     m_currentSortResult.clear();
@@ -465,6 +471,7 @@ void ThreadingMsgListModel::updateNoThreading()
     ptrToInternal.clear();
     unknownUids.clear();
     threadedRootIds.clear();
+    m_pendingPrune.clear();
 
     int upstreamMessages = sourceModel()->rowCount();
     QList<uint> allIds;
@@ -696,8 +703,14 @@ void ThreadingMsgListModel::slotIncrementalThreadingAvailable(const Responses::E
     QHash<uint,void *> uidToPtrCache;
 
 
+    // Everything happens within a single layout change. The nodes of the affected messages are recreated under their
+    // original internal IDs, so the persistent indexes which point to them survive and only have to be moved to their
+    // new rows along with the rest.
     emit layoutAboutToBeChanged();
-    updatePersistentIndexesPhase1();
+    // Only the affected threads have to be pruned. Messages which were removed recently are included as well because
+    // they would otherwise stay around as fake nodes while registerThreading() works on the tree.
+    QList<uint> detachedNodes = m_pendingPrune;
+    m_pendingPrune.clear();
     for (QList<TreeItemMessage*>::const_iterator it = affectedMessages.constBegin(); it != affectedMessages.constEnd(); ++it) {
         QHash<void *,uint>::const_iterator ptrMappingIt = ptrToInternal.constFind(*it);
         Q_ASSERT(ptrMappingIt != ptrToInternal.constEnd());
@@ -705,15 +718,12 @@ void ThreadingMsgListModel::slotIncrementalThreadingAvailable(const Responses::E
         Q_ASSERT(threadIt != threading.end());
         uidToPtrCache[(*it)->uid()] = threadIt->ptr;
         threadIt->ptr = 0;
+        detachedNodes << threadIt->internalId;
     }
-    pruneTree();
-    updatePersistentIndexesPhase2();
-    emit layoutChanged();
+    pruneTree(detachedNodes);
 
     // Second phase: for each message whose UID is returned by the server, update the threading data
     QSet<uint> usedNodes;
-    emit layoutAboutToBeChanged();
-    updatePersistentIndexesPhase1();
     for (Responses::ESearch::IncrementalThreadingData_t::const_iterator it = data.constBegin(); it != data.constEnd(); ++it) {
         registerThreading(it->thread, 0, uidToPtrCache, usedNodes);
         int actualOffset = threading[0].children.size() - 1;
@@ -729,7 +739,7 @@ void ThreadingMsgListModel::slotIncrementalThreadingAvailable(const Responses::E
             }
         }
     }
-    updatePersistentIndexesPhase2();
+    updatePersistentIndexesInPlace();
     emit layoutChanged();
 }
 
@@ -1011,14 +1021,18 @@ void ThreadingMsgListModel::registerThreading(const QVector<Imap::Responses::Thr
             // The child will be registered to the list of parent's children after the if/else branch
             threading[ fake.internalId ] = fake;
             nodeId = fake.internalId;
+            m_pendingPrune << nodeId;
         } else {
             QHash<void *,uint>::const_iterator nodeIt = ptrToInternal.constFind(*ptrIt);
             // The following assert would fail if there was a node with a valid UID, but not in our ptrToInternal mapping.
             // That is however non-issue, as we pre-create nodes for all messages beforehand.
             Q_ASSERT(nodeIt != ptrToInternal.constEnd());
             nodeId = *nodeIt;
-            // This is needed for the incremental stuff
-            threading[nodeId].ptr = static_cast<TreeItem*>(*ptrIt);
+            // This is needed for the incremental stuff where the node might have been pruned away in the meanwhile
+            ThreadNodeInfo &info = threading[nodeId];
+            info.internalId = nodeId;
+            info.uid = node.num;
+            info.ptr = static_cast<TreeItem*>(*ptrIt);
         }
         threading[nodeId].offset = threading[parentId].children.size();
         threading[ parentId ].children.append(nodeId);
@@ -1076,17 +1090,55 @@ void ThreadingMsgListModel::updatePersistentIndexesPhase2()
     oldPtrs.clear();
 }
 
+/** @short Update persistent indexes after some nodes were removed from the tree or moved around within it
+
+The nodes which survive keep their internal IDs, so only those indexes which point to a removed node or to a node which
+has moved to another row have to change. This is much cheaper than mapping all of them through the source model and back
+again through updatePersistentIndexesPhase1() and updatePersistentIndexesPhase2().
+*/
+void ThreadingMsgListModel::updatePersistentIndexesInPlace()
+{
+    QModelIndexList oldIndexes;
+    QModelIndexList newIndexes;
+    Q_FOREACH(const QModelIndex &idx, persistentIndexList()) {
+        QHash<uint,ThreadNodeInfo>::const_iterator it = threading.constFind(idx.internalId());
+        if (it == threading.constEnd()) {
+            oldIndexes << idx;
+            newIndexes << QModelIndex();
+        } else if (it->offset != idx.row()) {
+            oldIndexes << idx;
+            newIndexes << createIndex(it->offset, idx.column(), it->internalId);
+        }
+    }
+    if (!oldIndexes.isEmpty())
+        changePersistentIndexList(oldIndexes, newIndexes);
+}
+
+/** @short Remove all fake messages from the threading tree */
 void ThreadingMsgListModel::pruneTree()
 {
-    // Our mapping (threading) is completely unsorted, which means that we simply don't have any way of walking the tree from
-    // the top. Instead, we got to work with a random walk, processing nodes in an unspecified order.  If we iterated on the QHash
-    // directly, we'd hit an issue with iterator ordering (basically, we want to be able to say "hey, I don't care at which point
-    // of the iteration I'm right now, the next node to process should be that one, and then we should resume with the rest").
-    QList<uint> pending = threading.keys();
+    m_pendingPrune.clear();
+    pruneTree(threading.keys());
+}
+
+/** @short Remove fake messages from the threading tree, looking just at the nodes listed in @arg pending
+
+The list has to include all fake nodes which are present in the tree. Only the threads which contain these nodes are
+touched, so removing a few messages from a huge mailbox doesn't have to walk through all of the threading.
+*/
+void ThreadingMsgListModel::pruneTree(QList<uint> pending)
+{
+    // When a node is removed from its parent's list of children, its slot is set to zero instead of erasing it right away.
+    // Zero is the ID of the root item which is never anybody's child, and keeping the slots in place means that the
+    // offsets of all siblings remain valid while we're busy, so we can use them for locating nodes in their parents'
+    // lists of children. The zero slots are squeezed out once we're done, along with the renumbering.
 
     // These are the parents whose children will have to be renumbered later on
     QSet<uint> parentsForRenumbering;
 
+    // Thread roots which went away (mapped to zero) or which got replaced by another node
+    QHash<uint, uint> replacedRoots;
+
     for (QList<uint>::iterator id = pending.begin(); id != pending.end(); /* nothing */) {
         // Convert to the hashmap
         // The "it" iterator point to the current node in the threading mapping
@@ -1105,81 +1157,90 @@ void ThreadingMsgListModel::pruneTree()
         if (it->ptr) {
             // regular and valid message -> skip
             ++id;
+            continue;
+        }
+
+        // a fake one
+
+        // each node has a parent
+        QHash<uint, ThreadNodeInfo>::iterator parent = threading.find(it->parent);
+        Q_ASSERT(parent != threading.end());
+
+        // and the node itself has to be found in its parent's children
+        QList<uint>::iterator childIt;
+        if (it->offset >= 0 && it->offset < parent->children.size() && parent->children[it->offset] == it->internalId) {
+            childIt = parent->children.begin() + it->offset;
         } else {
-            // a fake one
-
-            // each node has a parent
-            QHash<uint, ThreadNodeInfo>::iterator parent = threading.find(it->parent);
-            Q_ASSERT(parent != threading.end());
-
-            // and the node itself has to be found in its parent's children
-            QList<uint>::iterator childIt = qFind(parent->children.begin(), parent->children.end(), it->internalId);
-            Q_ASSERT(childIt != parent->children.end());
-            // The offset of this child might no longer be correct, though -- we're postponing the actual deletion until later
-
-            if (it->children.isEmpty()) {
-                // This is a leaf node, so we can just remove it
-                childIt = parent->children.erase(childIt);
-                // We do not perform the renumbering immediately, that would lead to an O(n^2) performance when deleting nodes.
-                parentsForRenumbering.insert(it->parent);
-                parentsForRenumbering.remove(it->internalId);
-
-                if (it->parent == 0) {
-                    threadedRootIds.removeOne(it->internalId);
-                }
-                threading.erase(it);
-                ++id;
+            childIt = qFind(parent->children.begin(), parent->children.end(), it->internalId);
+        }
+        Q_ASSERT(childIt != parent->children.end());
 
-            } else {
-                // This node has some children, so we can't just delete it. Instead of that, we promote its first child
-                // to replace this node.
-                QHash<uint, ThreadNodeInfo>::iterator replaceWith = threading.find(it->children.first());
-                Q_ASSERT(replaceWith != threading.end());
-
-                // The offsets will, again, be updated later on
-                parentsForRenumbering.insert(it->parent);
-                parentsForRenumbering.insert(replaceWith.key());
-                parentsForRenumbering.remove(it->internalId);
-
-                // Replace the node
-                *childIt = it->children.first();
-                replaceWith->parent = parent->internalId;
-
-                // Now merge the lists of children
-                it->children.removeFirst();
-                replaceWith->children = replaceWith->children + it->children;
-
-                // Fix parent information of all children of the replacement node
-                for (int i = 0; i < replaceWith->children.size(); ++i) {
-                    QHash<uint, ThreadNodeInfo>::iterator sibling = threading.find(replaceWith->children[i]);
-                    Q_ASSERT(sibling != threading.end());
-                    sibling->parent = replaceWith.key();
-                }
+        // Some of our own children might have been removed already
+        it->children.removeAll(0);
 
-                if (parent->internalId == 0) {
-                    // Update the list of all thread roots
-                    QList<uint>::iterator rootIt = qFind(threadedRootIds.begin(), threadedRootIds.end(), it->internalId);
-                    if (rootIt != threadedRootIds.end())
-                        *rootIt = replaceWith->internalId;
-                }
+        if (it->children.isEmpty()) {
+            // This is a leaf node, so we can just remove it
+            *childIt = 0;
+            parentsForRenumbering.insert(it->parent);
+            parentsForRenumbering.remove(it->internalId);
+
+            if (it->parent == 0) {
+                replacedRoots[it->internalId] = 0;
+            }
+            threading.erase(it);
+            ++id;
 
-                // Now that all references are gone, remove the original node
-                threading.erase(it);
+        } else {
+            // This node has some children, so we can't just delete it. Instead of that, we promote its first child
+            // to replace this node.
+            QHash<uint, ThreadNodeInfo>::iterator replaceWith = threading.find(it->children.first());
+            Q_ASSERT(replaceWith != threading.end());
+
+            // The offsets of the children will be updated later on
+            parentsForRenumbering.insert(replaceWith.key());
+            parentsForRenumbering.remove(it->internalId);
+
+            // Replace the node
+            *childIt = replaceWith.key();
+            replaceWith->parent = parent->internalId;
+            replaceWith->offset = childIt - parent->children.begin();
+
+            // Now merge the lists of children
+            it->children.removeFirst();
+            replaceWith->children += it->children;
+
+            // Fix parent information of all children of the replacement node
+            for (int i = 0; i < replaceWith->children.size(); ++i) {
+                if (!replaceWith->children[i])
+                    continue;
+                QHash<uint, ThreadNodeInfo>::iterator sibling = threading.find(replaceWith->children[i]);
+                Q_ASSERT(sibling != threading.end());
+                sibling->parent = replaceWith.key();
+            }
 
-                if (!replaceWith->ptr) {
-                    // If the just-promoted item is also a fake one, we'll have to visit it as well. This assignment is safe,
-                    // because we've already processed the current item and are completely done with it. The worst which can
-                    // happen is that we'll visit the same node twice, which is reasonably acceptable.
-                    *id = replaceWith.key();
-                }
+            if (parent->internalId == 0) {
+                replacedRoots[it->internalId] = replaceWith->internalId;
+            }
+
+            // Now that all references are gone, remove the original node
+            threading.erase(it);
+
+            if (!replaceWith->ptr) {
+                // If the just-promoted item is also a fake one, we'll have to visit it as well. This assignment is safe,
+                // because we've already processed the current item and are completely done with it. The worst which can
+                // happen is that we'll visit the same node twice, which is reasonably acceptable.
+                *id = replaceWith.key();
+            } else {
+                ++id;
             }
         }
     }
 
-    // Now fix the sequential numbering of all siblings of deleted children
+    // Now get rid of the removed children and fix the sequential numbering of all siblings
     Q_FOREACH(const auto parentId, parentsForRenumbering) {
-        auto parentIt = threading.constFind(parentId);
-        Q_ASSERT(parentIt != threading.constEnd());
+        auto parentIt = threading.find(parentId);
+        Q_ASSERT(parentIt != threading.end());
+        parentIt->children.removeAll(0);
         int offset = 0;
         for (auto childNumber = parentIt->children.constBegin(); childNumber != parentIt->children.constEnd(); ++childNumber, ++offset) {
             auto childIt = threading.find(*childNumber);
@@ -1187,6 +1248,22 @@ void ThreadingMsgListModel::pruneTree()
             childIt->offset = offset;
         }
     }
+
+    // Update the list of all thread roots in a single pass
+    if (!replacedRoots.isEmpty()) {
+        QList<uint> roots;
+        Q_FOREACH(uint rootId, threadedRootIds) {
+            // The replacement might have been replaced as well
+            QHash<uint, uint>::const_iterator replacement = replacedRoots.constFind(rootId);
+            while (rootId && replacement != replacedRoots.constEnd()) {
+                rootId = *replacement;
+                replacement = replacedRoots.constFind(rootId);
+            }
+            if (rootId)
+                roots << rootId;
+        }
+        threadedRootIds = roots;
+    }
 }
 
 QStringList ThreadingMsgListModel::supportedCapabilities()
@@ -205,6 +205,7 @@ private:
 
     void updatePersistentIndexesPhase1();
     void updatePersistentIndexesPhase2();
+    void updatePersistentIndexesInPlace();
 
     /** @short Shall we ask for SORT/SEARCH automatically? */
     typedef enum {
@@ -224,6 +225,7 @@ private:
 
     /** @short Remove fake messages from the threading tree */
     void pruneTree();
+    void pruneTree(QList<uint> pending);
 
     /** @short Check current thread for "unread messages" */
     bool threadContainsUnreadMessages(const uint root) const;
@@ -260,6 +262,9 @@ private:
     /** @short Messages with unknown UIDs */
     QSet<TreeItem*> unknownUids;
 
+    /** @short Internal IDs of nodes whose messages were removed since the last call to pruneTree() */
+    QList<uint> m_pendingPrune;
+
     /** @short Threading algorithm we're using for this request */
     QByteArray requestedAlgorithm;
 
@@ -60,6 +60,8 @@ QHash<int, QByteArray> VisibleTasksModel::roleNames() const
 {
     QHash<int, QByteArray> roleNames;
     roleNames[RoleTaskCompactName] = "compactName";
+    roleNames[RoleTaskProgress] = "progress";
+    roleNames[RoleTaskProgressMax] = "progressMax";
     return roleNames;
 }
 
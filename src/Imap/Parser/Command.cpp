@@ -20,6 +20,7 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <ctype.h>
+#include <QIODevice>
 #include <QStringList>
 #include "Command.h"
 
@@ -75,7 +76,10 @@ QTextStream &operator<<(QTextStream &stream, const PartOfCommand &part)
     }
     break;
     case LITERAL:
-        stream << "{" << part.text.length() << "}" << endl << part.text;
+        if (part.source)
+            stream << "{" << part.source->size() << "}" << endl << "[literal data]";
+        else
+            stream << "{" << part.text.length() << "}" << endl << part.text;
         break;
     case IDLE:
         stream << "IDLE" << endl << "[Entering IDLE mode...]";
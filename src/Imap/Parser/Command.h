@@ -24,8 +24,11 @@
 
 #include <QDateTime>
 #include <QList>
+#include <QSharedPointer>
 #include <QTextStream>
 
+class QIODevice;
+
 /** @short Namespace for IMAP interaction */
 namespace Imap
 {
@@ -72,21 +75,28 @@ TokenType howToTransmit(const QByteArray &str);
  * This class therefore encapsulates the "part of command" along with enough information on how it should
  * be transfered.
  *
+ * Big literals can be read from a QIODevice instead of being kept in memory as a whole. The device has to be
+ * opened for reading, its size() has to be known in advance and it has to stay alive until the command is sent.
+ *
  */
 class PartOfCommand
 {
     TokenType kind; /**< What encoding to use for this item */
     QByteArray text; /**< Actual text to send */
+    QSharedPointer<QIODevice> source; /**< Device providing the data of a literal, if any */
     bool numberSent;
+    bool dataSent;
 
     friend QTextStream &operator<<(QTextStream &stream, const PartOfCommand &c);
     friend class ::Imap::Parser;
 
 public:
     /** Default constructor */
-    PartOfCommand(const TokenType kind, const QByteArray &text): kind(kind), text(text), numberSent(false) {}
+    PartOfCommand(const TokenType kind, const QByteArray &text): kind(kind), text(text), numberSent(false), dataSent(false) {}
     /** Constructor that guesses correct type for passed string */
-    PartOfCommand(const QByteArray &text): kind(howToTransmit(text)), text(text), numberSent(false) {}
+    PartOfCommand(const QByteArray &text): kind(howToTransmit(text)), text(text), numberSent(false), dataSent(false) {}
+    /** A literal whose data are streamed from the @arg source device */
+    PartOfCommand(const QSharedPointer<QIODevice> &source): kind(LITERAL), source(source), numberSent(false), dataSent(false) {}
 };
 
 /** @short Abstract class for specifying what command to execute */
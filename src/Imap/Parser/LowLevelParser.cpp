@@ -368,8 +368,10 @@ QVariant getAnything(const QByteArray &line, int &start)
 
 Imap::Uids getSequence(const QByteArray &line, int &start)
 {
+    // The sequence is usually parsed from a complete line, but response codes like COPYUID pass just the sequence itself
+    const int end = line.endsWith("\r\n") ? line.size() - 2 : line.size();
     uint num = LowLevelParser::getUInt(line, start);
-    if (start >= line.size() - 2) {
+    if (start >= end) {
         // It's definitely just a number because there's no more data in here
         return Imap::Uids() << num;
     } else {
@@ -379,7 +381,7 @@ Imap::Uids getSequence(const QByteArray &line, int &start)
         enum {COMMA, RANGE} currentType = COMMA;
 
         // Try to find further items in the sequence set
-        while (line[start] == ':' || line[start] == ',') {
+        while (start < end && (line[start] == ':' || line[start] == ',')) {
             // it's a sequence set
 
             if (line[start] == ':') {
@@ -393,7 +395,7 @@ Imap::Uids getSequence(const QByteArray &line, int &start)
             }
 
             ++start;
-            if (start >= line.size() - 2) throw NoData("Truncated sequence set", line, start);
+            if (start >= end) throw NoData("Truncated sequence set", line, start);
 
             uint num = LowLevelParser::getUInt(line, start);
             if (currentType == COMMA) {
@@ -805,7 +805,8 @@ Mailbox::TreeItemChildrenList MsgMessage::createTreeItems(Mailbox::TreeItem *par
 {
     Mailbox::TreeItemChildrenList list;
     Mailbox::TreeItemPart *part = new Mailbox::TreeItemPartMultipartMessage(parent, envelope);
-    part->setChildren(body->createTreeItems(part));     // always returns an empty list -> no need to qDeleteAll()
+    // The nested message is only turned into child items on demand
+    part->setLazyChildren(QList<QSharedPointer<AbstractMessage> >() << body);
     storeInterestingFields(part);
     list << part;
     return list;
@@ -813,12 +814,10 @@ Mailbox::TreeItemChildrenList MsgMessage::createTreeItems(Mailbox::TreeItem *par
 
 Mailbox::TreeItemChildrenList MultiMessage::createTreeItems(Mailbox::TreeItem *parent) const
 {
-    Mailbox::TreeItemChildrenList list, list2;
+    Mailbox::TreeItemChildrenList list;
     Mailbox::TreeItemPart *part = new Mailbox::TreeItemPart(parent, "multipart/" + mediaSubType);
-    for (QList<QSharedPointer<AbstractMessage> >::const_iterator it = bodies.begin(); it != bodies.end(); ++it) {
-        list2 << (*it)->createTreeItems(part);
-    }
-    part->setChildren(list2);   // always returns an empty list -> no need to qDeleteAll()
+    // The nested parts are only turned into child items on demand
+    part->setLazyChildren(bodies);
     storeInterestingFields(part);
     list << part;
     return list;
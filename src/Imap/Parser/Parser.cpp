@@ -21,6 +21,7 @@
 */
 #include <algorithm>
 #include <QDebug>
+#include <QIODevice>
 #include <QStringList>
 #include <QMutexLocker>
 #include <QProcess>
@@ -28,6 +29,7 @@
 #include <QTime>
 #include <QTimer>
 #include "Parser.h"
+#include "Common/Metrics.h"
 #include "Imap/Encoders.h"
 #include "LowLevelParser.h"
 #include "../../Streams/IODeviceSocket.h"
@@ -87,16 +89,20 @@ namespace Imap
 {
 
 Parser::Parser(QObject *parent, Streams::Socket *socket, const uint myId):
-    QObject(parent), socket(socket), m_lastTagUsed(0), idling(false), waitForInitialIdle(false),
-    literalPlus(false), waitingForContinuation(false), startTlsInProgress(false), compressDeflateInProgress(false),
+    QObject(parent), socket(socket), m_lastTagUsed(0), m_executeCommandsScheduled(false), m_commandsInFlight(0),
+    m_literalBytesLeft(0), respQueueHead(0), m_responseAllocator(new ResponseAllocator()),
+    idling(false), waitForInitialIdle(false), literalPlus(false), literalMinus(false), waitingForContinuation(false), startTlsInProgress(false), compressDeflateInProgress(false),
     waitingForConnection(true), waitingForEncryption(socket->isConnectingEncryptedSinceStart()), waitingForSslPolicy(false),
     m_expectsInitialGreeting(true), readingMode(ReadingLine), oldLiteralPosition(0), m_parserId(myId)
 {
+    // Reserving the space explicitly also prevents the vector from shrinking when a burst of responses gets released
+    respQueue.reserve(128);
     connect(socket, SIGNAL(disconnected(const QString &)),
             this, SLOT(handleDisconnected(const QString &)));
     connect(socket, SIGNAL(readyRead()), this, SLOT(handleReadyRead()));
     connect(socket, SIGNAL(stateChanged(Imap::ConnectionState,QString)), this, SLOT(slotSocketStateChanged(Imap::ConnectionState,QString)));
     connect(socket, SIGNAL(encrypted()), this, SLOT(handleSocketEncrypted()));
+    connect(socket, SIGNAL(bytesWritten(qint64)), this, SLOT(handleSocketBytesWritten()));
 }
 
 CommandHandle Parser::noop()
@@ -241,6 +247,24 @@ CommandHandle Parser::list(const QString &reference, const QString &mailbox, con
     return queueCommand(cmd);
 }
 
+CommandHandle Parser::listMultiple(const QString &reference, const QStringList &mailboxes, const QStringList &returnOptions)
+{
+    Commands::Command cmd("LIST");
+    cmd << reference.toUtf8() << Commands::PartOfCommand(Commands::ATOM_NO_SPACE_AROUND, " (");
+    Q_FOREACH(const QString &mailbox, mailboxes) {
+        cmd << encodeImapFolderName(mailbox);
+    }
+    cmd << Commands::PartOfCommand(Commands::ATOM_NO_SPACE_AROUND, ")");
+    if (!returnOptions.isEmpty()) {
+        cmd << Commands::PartOfCommand(Commands::ATOM_NO_SPACE_AROUND, " RETURN (");
+        Q_FOREACH(const QString &option, returnOptions) {
+            cmd << Commands::PartOfCommand(Commands::ATOM, option.toUtf8());
+        }
+        cmd << Commands::PartOfCommand(Commands::ATOM_NO_SPACE_AROUND, ")");
+    }
+    return queueCommand(cmd);
+}
+
 CommandHandle Parser::lSub(const QString &reference, const QString &mailbox)
 {
     return queueCommand(Commands::Command("LSUB") << reference.toUtf8() << encodeImapFolderName(mailbox));
@@ -266,6 +290,38 @@ CommandHandle Parser::append(const QString &mailbox, const QByteArray &message,
     return queueCommand(command);
 }
 
+CommandHandle Parser::append(const QString &mailbox, const QSharedPointer<QIODevice> &message, const QStringList &flags,
+                             const QDateTime &timestamp)
+{
+    Q_ASSERT(message && message->isReadable() && !message->isSequential());
+    Commands::Command command("APPEND");
+    command << encodeImapFolderName(mailbox);
+    if (flags.count())
+        command << Commands::PartOfCommand(Commands::ATOM, "(" + flags.join(QLatin1String(" ")).toUtf8() + ")");
+    if (timestamp.isValid())
+        command << Commands::PartOfCommand(Imap::dateTimeToInternalDate(timestamp).toUtf8());
+    command << Commands::PartOfCommand(message);
+
+    return queueCommand(command);
+}
+
+CommandHandle Parser::multiAppend(const QString &mailbox, const QList<Imap::Mailbox::AppendItem> &messages)
+{
+    Q_ASSERT(!messages.isEmpty());
+    Commands::Command command("APPEND");
+    command << encodeImapFolderName(mailbox);
+    Q_FOREACH(const Imap::Mailbox::AppendItem &item, messages) {
+        Q_ASSERT(item.data && item.data->isReadable() && !item.data->isSequential());
+        if (item.flags.count())
+            command << Commands::PartOfCommand(Commands::ATOM, "(" + item.flags.join(QLatin1String(" ")).toUtf8() + ")");
+        if (item.timestamp.isValid())
+            command << Commands::PartOfCommand(Imap::dateTimeToInternalDate(item.timestamp).toUtf8());
+        command << Commands::PartOfCommand(item.data);
+    }
+
+    return queueCommand(command);
+}
+
 CommandHandle Parser::appendCatenate(const QString &mailbox, const QList<Imap::Mailbox::CatenatePair> &data,
                                      const QStringList &flags, const QDateTime &timestamp)
 {
@@ -568,6 +624,16 @@ CommandHandle Parser::enable(const QList<QByteArray> &extensions)
     return queueCommand(cmd);
 }
 
+CommandHandle Parser::notifySet(const QList<QByteArray> &eventGroups)
+{
+    Commands::Command cmd("NOTIFY");
+    cmd << Commands::PartOfCommand(Commands::ATOM, "SET");
+    Q_FOREACH(const QByteArray &item, eventGroups) {
+        cmd << Commands::PartOfCommand(Commands::ATOM, item);
+    }
+    return queueCommand(cmd);
+}
+
 CommandHandle Parser::genUrlAuth(const QByteArray &url, const QByteArray mechanism)
 {
     Commands::Command cmd("GENURLAUTH");
@@ -612,15 +678,24 @@ CommandHandle Parser::queueCommand(Commands::Command command)
     CommandHandle tag = generateTag();
     command.addTag(tag);
     cmdQueue.append(command);
-    QTimer::singleShot(0, this, SLOT(executeCommands()));
+    // All commands which are queued before returning to the event loop get sent together
+    if (!m_executeCommandsScheduled) {
+        m_executeCommandsScheduled = true;
+        QTimer::singleShot(0, this, SLOT(executeCommands()));
+    }
     return tag;
 }
 
 void Parser::queueResponse(const QSharedPointer<Responses::AbstractResponse> &resp)
 {
     respQueue.push_back(resp);
+    const int queueLength = respQueue.size() - respQueueHead;
+    ++m_respQueueStats.responses;
+    if (queueLength > m_respQueueStats.peakQueueLength)
+        m_respQueueStats.peakQueueLength = queueLength;
     // Try to limit the signal rate -- when there are multiple items in the queue, there's no point in sending more signals
-    if (respQueue.size() == 1) {
+    if (queueLength == 1) {
+        ++m_respQueueStats.bursts;
         emit responseReceived(this);
     }
 
@@ -643,26 +718,59 @@ void Parser::queueResponse(const QSharedPointer<Responses::AbstractResponse> &re
 
 bool Parser::hasResponse() const
 {
-    return ! respQueue.empty();
+    return respQueueHead < respQueue.size();
 }
 
 QSharedPointer<Responses::AbstractResponse> Parser::getResponse()
 {
     QSharedPointer<Responses::AbstractResponse> ptr;
-    if (respQueue.empty())
+    if (respQueueHead == respQueue.size())
         return ptr;
-    ptr = respQueue.front();
-    respQueue.pop_front();
+    ptr = respQueue[respQueueHead];
+    respQueue[respQueueHead].clear();
+    ++respQueueHead;
+    if (respQueueHead == respQueue.size()) {
+        // The whole burst has been consumed, so let's recycle the queue's storage for the next one
+        respQueue.resize(0);
+        respQueueHead = 0;
+    }
     return ptr;
 }
 
+QSharedPointer<Responses::AbstractResponse> Parser::peekResponse() const
+{
+    return respQueueHead < respQueue.size() ? respQueue[respQueueHead] : QSharedPointer<Responses::AbstractResponse>();
+}
+
+ResponseQueueStatistics Parser::responseQueueStatistics() const
+{
+    ResponseQueueStatistics res = m_respQueueStats;
+    res.capacity = respQueue.capacity();
+    res.allocator = m_responseAllocator->statistics();
+    return res;
+}
+
 QByteArray Parser::generateTag()
 {
-    return QString::fromUtf8("y%1").arg(m_lastTagUsed++).toUtf8();
+    return tagForCommand(m_lastTagUsed++);
+}
+
+uint Parser::commandCounter() const
+{
+    return m_lastTagUsed;
+}
+
+CommandHandle Parser::tagForCommand(const uint number)
+{
+    return "y" + QByteArray::number(number);
 }
 
 void Parser::handleReadyRead()
 {
+    static Common::MetricsHistogram *const readLatency =
+            Common::MetricsRegistry::instance()->histogram(QLatin1String("parser.readyRead.us"));
+    Common::MetricsTimer timer(readLatency);
+
     while (!waitingForEncryption && !waitingForSslPolicy) {
         switch (readingMode) {
         case ReadingLine:
@@ -717,7 +825,15 @@ void Parser::reallyReadLine()
                 QTimer::singleShot(0, this, SLOT(finishStartTls()));
                 return;
             }
-            processLine(currentLine);
+            {
+                static Common::MetricsHistogram *const parseLatency =
+                        Common::MetricsRegistry::instance()->histogram(QLatin1String("parser.processLine.us"));
+                static Common::MetricsCounter *const bytesParsed =
+                        Common::MetricsRegistry::instance()->counter(QLatin1String("parser.bytesParsed"));
+                bytesParsed->add(currentLine.size());
+                Common::MetricsTimer parseTimer(parseLatency);
+                processLine(currentLine);
+            }
             currentLine.clear();
             oldLiteralPosition = 0;
         } else {
@@ -728,12 +844,23 @@ void Parser::reallyReadLine()
     }
 }
 
+/** @short Send as many queued commands as possible
+
+The commands are pipelined, i.e. the queue is only stopped by something which really needs the server's reply first,
+like a synchronizing literal, IDLE, STARTTLS or COMPRESS. Everything which can be sent right now is passed to the
+socket in a single write.
+*/
 void Parser::executeCommands()
 {
+    m_executeCommandsScheduled = false;
     while (! waitingForContinuation && ! waitForInitialIdle &&
            ! waitingForConnection && ! waitingForEncryption && ! waitingForSslPolicy &&
-           ! cmdQueue.isEmpty() && ! startTlsInProgress && !compressDeflateInProgress)
+           ! cmdQueue.isEmpty() && ! startTlsInProgress && !compressDeflateInProgress && !m_literalSource)
         executeACommand();
+    if (!m_pendingWrite.isEmpty()) {
+        socket->write(m_pendingWrite);
+        m_pendingWrite.clear();
+    }
 }
 
 void Parser::finishStartTls()
@@ -769,6 +896,40 @@ void Parser::handleSocketEncrypted()
     executeCommands();
 }
 
+/** @short Pass the next chunks of a streamed literal to the socket
+
+Returns true when the whole literal has been sent. Otherwise, the rest is sent from handleSocketBytesWritten() once the
+socket's buffer gets drained, so that the amount of the buffered data does not depend on the size of the literal.
+*/
+bool Parser::sendLiteralChunks()
+{
+    enum { CHUNK_SIZE = 64 * 1024, HIGH_WATER_MARK = 4 * CHUNK_SIZE };
+
+    while (m_literalBytesLeft > 0) {
+        if (socket->bytesToWrite() >= HIGH_WATER_MARK)
+            return false;
+        QByteArray chunk = m_literalSource->read(qMin<qint64>(m_literalBytesLeft, CHUNK_SIZE));
+        if (chunk.isEmpty()) {
+            // The announced octet count cannot be satisfied, so the rest of this connection is garbage. The command
+            // queue remains frozen until the Model kills this parser.
+            m_literalBytesLeft = 0;
+            queueResponse(QSharedPointer<Responses::AbstractResponse>(
+                              new Responses::ParseErrorResponse(InvalidArgument("Literal data ended prematurely"))));
+            return false;
+        }
+        socket->write(chunk);
+        m_literalBytesLeft -= chunk.size();
+    }
+    m_literalSource.clear();
+    return true;
+}
+
+void Parser::handleSocketBytesWritten()
+{
+    if (m_literalSource && m_literalBytesLeft > 0 && sendLiteralChunks())
+        executeCommands();
+}
+
 /** @short We've previously frozen the command queue, so it's time to kick it a bit and keep the usual sending/receiving again */
 void Parser::handleCompressionPossibleActivated()
 {
@@ -809,7 +970,7 @@ void Parser::executeACommand()
 #ifdef PRINT_TRAFFIC_TX
         qDebug() << m_parserId << ">>>" << buf.left(PRINT_TRAFFIC_TX).trimmed();
 #endif
-        socket->write(buf);
+        m_pendingWrite.append(buf);
         idling = false;
         cmdQueue.pop_front();
         emit lineSent(this, buf);
@@ -836,16 +997,19 @@ void Parser::executeACommand()
         }
         break;
         case Commands::LITERAL:
-            if (literalPlus) {
-                buf.append('{');
-                buf.append(QByteArray::number(part.text.size()));
-                buf.append("+}\r\n");
-                buf.append(part.text);
-            } else if (part.numberSent) {
-                buf.append(part.text);
-            } else {
+        {
+            const qint64 literalSize = part.source ? part.source->size() : part.text.size();
+            if (literalPlus || (literalMinus && literalSize <= 4096)) {
+                // Non-synchronizing literals do not need a round trip; LITERAL- only allows them up to 4096 bytes
+                if (!part.numberSent) {
+                    buf.append('{');
+                    buf.append(QByteArray::number(literalSize));
+                    buf.append("+}\r\n");
+                    part.numberSent = true;
+                }
+            } else if (!part.numberSent) {
                 buf.append('{');
-                buf.append(QByteArray::number(part.text.size()));
+                buf.append(QByteArray::number(literalSize));
                 buf.append("}\r\n");
 #ifdef PRINT_TRAFFIC_TX
                 if (printThisCommand)
@@ -853,7 +1017,7 @@ void Parser::executeACommand()
                 else
                     qDebug() << m_parserId << ">>> [sensitive command] -- added literal";
 #endif
-                socket->write(buf);
+                m_pendingWrite.append(buf);
                 part.numberSent = true;
                 waitingForContinuation = true;
                 Q_ASSERT(literalCommandTag.isEmpty());
@@ -862,7 +1026,27 @@ void Parser::executeACommand()
                 emit lineSent(this, sensitiveCommand ? privateMessage : buf);
                 return; // and wait for continuation request
             }
+
+            if (!part.source) {
+                buf.append(part.text);
+            } else if (!part.dataSent) {
+                // Everything up to now goes out first, then the literal data are pumped straight from the device
+                part.dataSent = true;
+#ifdef PRINT_TRAFFIC_TX
+                qDebug() << m_parserId << ">>>" << buf.left(PRINT_TRAFFIC_TX).trimmed() << "[streaming literal data]";
+#endif
+                emit lineSent(this, buf + "[" + QByteArray::number(literalSize) + " octets of literal data]");
+                m_pendingWrite.append(buf);
+                buf.clear();
+                socket->write(m_pendingWrite);
+                m_pendingWrite.clear();
+                m_literalSource = part.source;
+                m_literalBytesLeft = literalSize;
+                if (!sendLiteralChunks())
+                    return; // the rest of this command will be sent once the literal is out
+            }
             break;
+        }
         case Commands::IDLE_DONE:
             Q_ASSERT(false); // is handled above
             break;
@@ -871,7 +1055,8 @@ void Parser::executeACommand()
 #ifdef PRINT_TRAFFIC_TX
             qDebug() << m_parserId << ">>>" << buf.left(PRINT_TRAFFIC_TX).trimmed();
 #endif
-            socket->write(buf);
+            m_pendingWrite.append(buf);
+            ++m_commandsInFlight;
             idling = true;
             waitForInitialIdle = true;
             cmdQueue.pop_front();
@@ -884,7 +1069,8 @@ void Parser::executeACommand()
 #ifdef PRINT_TRAFFIC_TX
             qDebug() << m_parserId << ">>>" << buf.left(PRINT_TRAFFIC_TX).trimmed();
 #endif
-            socket->write(buf);
+            m_pendingWrite.append(buf);
+            ++m_commandsInFlight;
             startTlsInProgress = true;
             emit lineSent(this, buf);
             return;
@@ -895,7 +1081,8 @@ void Parser::executeACommand()
 #ifdef PRINT_TRAFFIC_TX
             qDebug() << m_parserId << ">>>" << buf.left(PRINT_TRAFFIC_TX).trimmed();
 #endif
-            socket->write(buf);
+            m_pendingWrite.append(buf);
+            ++m_commandsInFlight;
             compressDeflateInProgress = true;
             cmdQueue.pop_front();
             emit lineSent(this, buf);
@@ -911,7 +1098,8 @@ void Parser::executeACommand()
             else
                 qDebug() << m_parserId << ">>> [sensitive command]";
 #endif
-            socket->write(buf);
+            m_pendingWrite.append(buf);
+            ++m_commandsInFlight;
             cmdQueue.pop_front();
             emit lineSent(this, sensitiveCommand ? privateMessage : buf);
             break;
@@ -997,17 +1185,20 @@ QSharedPointer<Responses::AbstractResponse> Parser::parseUntaggedNumber(
             throw UnexpectedHere(line, start);   // expected CRLF
         else
             try {
-                return QSharedPointer<Responses::AbstractResponse>(
-                           new Responses::NumberResponse(kind, number));
+                return m_responseAllocator->create<Responses::NumberResponse>(kind, number);
             } catch (UnexpectedHere &e) {
                 throw UnexpectedHere(e.what(), line, start);
             }
         break;
 
     case Responses::FETCH:
-        return QSharedPointer<Responses::AbstractResponse>(
-                   new Responses::Fetch(number, line, start));
-        break;
+    {
+        QSharedPointer<Responses::AbstractResponse> resp = m_responseAllocator->create<Responses::Fetch>(number, line, start);
+        Responses::Fetch *fetch = static_cast<Responses::Fetch *>(resp.data());
+        if (fetch->has(Responses::Fetch::FLAGS))
+            shareFlags(fetch->flags);
+        return resp;
+    }
 
     default:
         break;
@@ -1052,8 +1243,7 @@ QSharedPointer<Responses::AbstractResponse> Parser::parseUntaggedText(
     case Responses::BAD:
     case Responses::PREAUTH:
     case Responses::BYE:
-        return QSharedPointer<Responses::AbstractResponse>(
-                   new Responses::State(QByteArray(), kind, line, start));
+        return m_responseAllocator->create<Responses::State>(QByteArray(), kind, line, start);
     case Responses::LIST:
     case Responses::LSUB:
         return QSharedPointer<Responses::AbstractResponse>(
@@ -1103,6 +1293,24 @@ QSharedPointer<Responses::AbstractResponse> Parser::parseUntaggedText(
     throw UnexpectedHere(line, start);
 }
 
+void Parser::shareFlags(QStringList &flags)
+{
+    // A mailbox sync brings thousands of messages, yet there are usually just a handful of distinct combinations
+    // of their flags. Sharing the lists saves memory for the whole lifetime of the messages in the Model.
+    const int maxRecentFlagLists = 16;
+    for (int i = 0; i < m_recentFlagLists.size(); ++i) {
+        if (m_recentFlagLists[i] == flags) {
+            flags = m_recentFlagLists[i];
+            if (i > 0)
+                m_recentFlagLists.move(i, 0);
+            return;
+        }
+    }
+    m_recentFlagLists.prepend(flags);
+    if (m_recentFlagLists.size() > maxRecentFlagLists)
+        m_recentFlagLists.removeLast();
+}
+
 QSharedPointer<Responses::AbstractResponse> Parser::parseTagged(const QByteArray &line)
 {
     int pos = 0;
@@ -1111,6 +1319,9 @@ QSharedPointer<Responses::AbstractResponse> Parser::parseTagged(const QByteArray
     const Responses::Kind kind = Responses::kindFromString(LowLevelParser::getAtom(line, pos));
     ++pos;
 
+    if (m_commandsInFlight > 0)
+        --m_commandsInFlight;
+
     if (compressDeflateInProgress && compressDeflateCommand == tag + ' ') {
         switch (kind) {
         case Responses::OK:
@@ -1127,8 +1338,7 @@ QSharedPointer<Responses::AbstractResponse> Parser::parseTagged(const QByteArray
         QTimer::singleShot(0, this, SLOT(handleCompressionPossibleActivated()));
     }
 
-    return QSharedPointer<Responses::AbstractResponse>(
-               new Responses::State(tag, kind, line, pos));
+    return m_responseAllocator->create<Responses::State>(tag, kind, line, pos);
 }
 
 void Parser::enableLiteralPlus(const bool enabled)
@@ -1136,6 +1346,16 @@ void Parser::enableLiteralPlus(const bool enabled)
     literalPlus = enabled;
 }
 
+void Parser::enableLiteralMinus(const bool enabled)
+{
+    literalMinus = enabled;
+}
+
+int Parser::commandsInFlight() const
+{
+    return m_commandsInFlight;
+}
+
 void Parser::handleDisconnected(const QString &reason)
 {
     emit lineReceived(this, "*** Socket disconnected: " + reason.toUtf8());
@@ -1153,6 +1373,8 @@ Parser::~Parser()
     socket->disconnect(this);
     socket->close();
     socket->deleteLater();
+    // The responses which are still queued or referenced from elsewhere keep the allocator alive
+    m_responseAllocator->detach();
 }
 
 uint Parser::parserId() const
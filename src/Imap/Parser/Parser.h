@@ -23,11 +23,14 @@
 #define IMAP_PARSER_H
 #include <QLinkedList>
 #include <QSharedPointer>
+#include <QVector>
 #include "Command.h"
 #include "Response.h"
+#include "ResponseAllocator.h"
 #include "Sequence.h"
 #include "../ConnectionState.h"
 #include "../Exceptions.h"
+#include "Imap/Model/AppendData.h"
 #include "Imap/Model/CatenateData.h"
 #include "Imap/Model/UidSubmitData.h"
 
@@ -54,6 +57,22 @@ typedef QByteArray CommandHandle;
 // this is required for clang 3.0
 typedef QMap<QByteArray, quint64> MapByteArrayUint64;
 
+/** @short Statistics about the parser's queue of responses, for debugging purposes */
+struct ResponseQueueStatistics {
+    /** @short Number of responses which were queued for processing since the parser was created */
+    quint64 responses;
+    /** @short Number of bursts, i.e. how many times the queue has changed from being empty to being non-empty */
+    quint64 bursts;
+    /** @short Largest number of responses which were waiting in the queue at the same time */
+    int peakQueueLength;
+    /** @short Number of items the queue can hold without having to grow its storage */
+    int capacity;
+    /** @short Counters of the allocator which holds the most common responses */
+    ResponseAllocatorStatistics allocator;
+
+    ResponseQueueStatistics(): responses(0), bursts(0), peakQueueLength(0), capacity(0) {}
+};
+
 /** @short Class that does all IMAP parsing */
 class Parser : public QObject
 {
@@ -75,11 +94,28 @@ public:
     /** @short De-queue and return parsed response */
     QSharedPointer<Responses::AbstractResponse> getResponse();
 
+    /** @short Return the next parsed response without de-queueing it, or a null pointer if there's none */
+    QSharedPointer<Responses::AbstractResponse> peekResponse() const;
+
+    ResponseQueueStatistics responseQueueStatistics() const;
+
     /** @short Enable/Disable sending literals using the LITERAL+ extension */
     void enableLiteralPlus(const bool enabled=true);
 
+    /** @short Enable/Disable sending small literals using the LITERAL- extension (RFC 7888) */
+    void enableLiteralMinus(const bool enabled=true);
+
+    /** @short Number of commands which have been sent to the server and are still waiting for their tagged response */
+    int commandsInFlight() const;
+
     uint parserId() const;
 
+    /** @short Number of commands which have been queued so far */
+    uint commandCounter() const;
+
+    /** @short Return the tag which was or will be assigned to the command with the specified sequence number */
+    static CommandHandle tagForCommand(const uint number);
+
 public slots:
 
     /** @short CAPABILITY, RFC 3501 section 6.1.1 */
@@ -133,6 +169,9 @@ public slots:
     /** @short LIST, RFC3501 section 6.3.8, as extended by RFC5258 */
     CommandHandle list(const QString &reference, const QString &mailbox, const QStringList &returnOptions = QStringList());
 
+    /** @short LIST with multiple mailbox patterns, RFC5258 section 3 */
+    CommandHandle listMultiple(const QString &reference, const QStringList &mailboxes, const QStringList &returnOptions);
+
     /** @short LSUB, RFC3501 section 6.3.9 */
     CommandHandle lSub(const QString &reference, const QString &mailbox);
 
@@ -143,6 +182,16 @@ public slots:
     CommandHandle append(const QString &mailbox, const QByteArray &message,
                          const QStringList &flags = QStringList(), const QDateTime &timestamp = QDateTime());
 
+    /** @short APPEND, RFC3501 section 6.3.11, with the message data streamed from a random-access device */
+    CommandHandle append(const QString &mailbox, const QSharedPointer<QIODevice> &message,
+                         const QStringList &flags = QStringList(), const QDateTime &timestamp = QDateTime());
+
+    /** @short APPEND of several messages at once, RFC 3502 MULTIAPPEND
+
+    The data of each message are streamed from its already opened random-access device.
+    */
+    CommandHandle multiAppend(const QString &mailbox, const QList<Imap::Mailbox::AppendItem> &messages);
+
     /** @short APPEND CATENATE, RFC 4469 */
     CommandHandle appendCatenate(const QString &mailbox, const QList<Imap::Mailbox::CatenatePair> &data,
                                  const QStringList &flags = QStringList(), const QDateTime &timestamp = QDateTime());
@@ -263,6 +312,12 @@ public slots:
     /** @short ENABLE command, RFC 6151 */
     CommandHandle enable(const QList<QByteArray> &extensions);
 
+    /** @short NOTIFY SET, RFC 5465 section 3.1
+
+    Each item of the @arg eventGroups is a complete event group, including the enclosing parentheses.
+    */
+    CommandHandle notifySet(const QList<QByteArray> &eventGroups);
+
     /** @short COMPRESS DEFLATE, RFC 4978 */
     CommandHandle compressDeflate();
 
@@ -314,6 +369,7 @@ private slots:
     void finishStartTls();
     void handleSocketEncrypted();
     void handleCompressionPossibleActivated();
+    void handleSocketBytesWritten();
 
 private:
     /** @short Private copy constructor */
@@ -342,6 +398,8 @@ private:
     /** @short Generate tag for next command */
     QByteArray generateTag();
 
+    bool sendLiteralChunks();
+
     void processLine(QByteArray line);
 
     /** @short Parse line for untagged reply */
@@ -358,6 +416,9 @@ private:
     QSharedPointer<Responses::AbstractResponse> parseUntaggedText(
         const QByteArray &line, int &start);
 
+    /** @short Make the flags share their data with an identical list from one of the recent FETCH responses */
+    void shareFlags(QStringList &flags);
+
     /** @short Add parsed response to the internal queue, emit notification signal */
     void queueResponse(const QSharedPointer<Responses::AbstractResponse> &resp);
 
@@ -370,13 +431,42 @@ private:
     /** @short Queue storing commands that are about to be executed */
     QLinkedList<Commands::Command> cmdQueue;
 
-    /** @short Queue storing parsed replies from the IMAP server */
-    QLinkedList<QSharedPointer<Responses::AbstractResponse> > respQueue;
+    /** @short Data produced by executeACommand() which is written to the socket at once by executeCommands() */
+    QByteArray m_pendingWrite;
+    /** @short Has the executeCommands() been scheduled by queueCommand() already? */
+    bool m_executeCommandsScheduled;
+    /** @short See commandsInFlight() */
+    int m_commandsInFlight;
+
+    /** @short Device providing the data of a literal which is being sent right now
+
+    The data are passed to the socket in chunks as the socket's buffer gets drained, and the command queue is frozen
+    until the whole literal is out.
+    */
+    QSharedPointer<QIODevice> m_literalSource;
+    /** @short How many bytes of m_literalSource's data have yet to be sent */
+    qint64 m_literalBytesLeft;
+
+    /** @short Queue storing parsed replies from the IMAP server
+
+    All responses which arrive in a single burst are appended to this vector. The items are handed over to the Model
+    by advancing the respQueueHead, and the whole batch is released at once when the Model has consumed all of them.
+    The storage of the vector is never shrunk, so the steady state does not involve any reallocation of the queue.
+    */
+    QVector<QSharedPointer<Responses::AbstractResponse> > respQueue;
+    /** @short Index of the first response in respQueue which hasn't been handed over to the Model yet */
+    int respQueueHead;
+    ResponseQueueStatistics m_respQueueStats;
+    /** @short Memory for the FETCH, EXISTS, RECENT, EXPUNGE and OK/NO/BAD responses */
+    ResponseAllocator *m_responseAllocator;
+    /** @short Distinct lists of flags from the recent FETCH responses, the most recently used one goes first */
+    QList<QStringList> m_recentFlagLists;
 
     bool idling;
     bool waitForInitialIdle;
 
     bool literalPlus;
+    bool literalMinus;
     bool waitingForContinuation;
     bool startTlsInProgress;
     bool compressDeflateInProgress;
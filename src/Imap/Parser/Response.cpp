@@ -495,7 +495,6 @@ State::State(const QByteArray &tag, const Kind kind, const QByteArray &line, int
             break;
         case Responses::APPENDUID:
         {
-            // FIXME: this is broken with MULTIAPPEND
             if (originalList.size() != 3)
                 throw InvalidResponseCode("Malformed APPENDUID: wrong number of arguments", line, start);
             bool ok;
@@ -514,8 +513,6 @@ State::State(const QByteArray &tag, const Kind kind, const QByteArray &line, int
         }
         case Responses::COPYUID:
         {
-            // FIXME: don't return anything, this is broken with multiple messages, unfortunately
-            break;
             if (originalList.size() != 4)
                 throw InvalidResponseCode("Malformed COPYUID: wrong number of arguments", line, start);
             bool ok;
@@ -865,7 +862,8 @@ QDateTime Fetch::dateify(QByteArray str, const QByteArray &line, const int start
     return date;
 }
 
-Fetch::Fetch(const uint number, const QByteArray &line, int &start): number(number)
+Fetch::Fetch(const uint number, const QByteArray &line, int &start):
+    number(number), attributes(0), uid(0), rfc822Size(0), modSeq(0)
 {
     ++start;
 
@@ -887,56 +885,68 @@ Fetch::Fetch(const uint number, const QByteArray &line, int &start): number(numb
             start = pos + 1;
         }
 
-        if (data.contains(identifier))
-            throw UnexpectedHere("FETCH response contains duplicate data", line, start);
-
         if (start >= line.size())
             throw NoData(line, start);
 
         LowLevelParser::eatSpaces(line, start);
 
         if (identifier == "MODSEQ") {
+            checkDuplicate(MODSEQ, line, start);
             if (line[start++] != '(')
                 throw UnexpectedHere("FETCH MODSEQ must be a list");
-            data[identifier] = QSharedPointer<AbstractData>(new RespData<quint64>(LowLevelParser::getUInt64(line, start)));
+            modSeq = LowLevelParser::getUInt64(line, start);
             if (start >= line.size())
                 throw NoData(line, start);
             if (line[start++] != ')')
                 throw UnexpectedHere("FETCH MODSEQ must be a list");
         } else if (identifier == "FLAGS") {
+            checkDuplicate(FLAGS, line, start);
             if (line[start++] != '(')
                 throw UnexpectedHere("FETCH FLAGS must be a list");
-            QStringList flags;
             while (start < line.size() && line[start] != ')') {
                 flags << QString::fromUtf8(LowLevelParser::getPossiblyBackslashedAtom(line, start));
                 LowLevelParser::eatSpaces(line, start);
             }
-            data[identifier] = QSharedPointer<AbstractData>(new RespData<QStringList>(flags));
             if (start >= line.size())
                 throw NoData(line, start);
             if (line[start++] != ')')
                 throw UnexpectedHere("FETCH FLAGS must be a list");
-        } else if (identifier == "UID" || identifier == "RFC822.SIZE") {
-            data[identifier] = QSharedPointer<AbstractData>(new RespData<uint>(LowLevelParser::getUInt(line, start)));
-        } else if (identifier.startsWith("BODY[") || identifier.startsWith("BINARY[") || identifier.startsWith("RFC822")) {
-            data[identifier] = QSharedPointer<AbstractData>(new RespData<QByteArray>(LowLevelParser::getNString(line, start).first));
+        } else if (identifier == "UID") {
+            checkDuplicate(UID, line, start);
+            uid = LowLevelParser::getUInt(line, start);
+        } else if (identifier == "RFC822.SIZE") {
+            checkDuplicate(RFC822_SIZE, line, start);
+            rfc822Size = LowLevelParser::getUInt(line, start);
         } else if (identifier == "ENVELOPE") {
+            checkDuplicate(ENVELOPE, line, start);
             QVariantList list = LowLevelParser::parseList('(', ')', line, start);
-            data[identifier] = QSharedPointer<AbstractData>(new RespData<Message::Envelope>(Message::Envelope::fromList(list, line, start)));
+            metadata().envelope = Message::Envelope::fromList(list, line, start);
         } else if (identifier == "INTERNALDATE") {
+            checkDuplicate(INTERNALDATE, line, start);
             QByteArray buf = LowLevelParser::getNString(line, start).first;
-            data[identifier] = QSharedPointer<AbstractData>(new RespData<QDateTime>(dateify(buf, line, start)));
-        } else if (identifier == "BODY" || identifier == "BODYSTRUCTURE") {
+            metadata().internalDate = dateify(buf, line, start);
+        } else if (identifier == "BODYSTRUCTURE") {
+            checkDuplicate(BODYSTRUCTURE, line, start);
             QVariantList list = LowLevelParser::parseList('(', ')', line, start);
-            data[identifier] = Message::AbstractMessage::fromList(list, line, start);
+            metadata().bodyStructure = Message::AbstractMessage::fromList(list, line, start);
             QByteArray buffer;
             QDataStream stream(&buffer, QIODevice::WriteOnly);
             stream.setVersion(QDataStream::Qt_4_6);
             stream << list;
-            data["x-trojita-bodystructure"] = QSharedPointer<AbstractData>(new RespData<QByteArray>(buffer));
+            metadata().serializedBodyStructure = buffer;
         } else {
-            // Unrecognized identifier, let's treat it as QByteArray so that we don't break needlessly
-            data[identifier] = QSharedPointer<AbstractData>(new RespData<QByteArray>(LowLevelParser::getNString(line, start).first));
+            if (data.contains(identifier))
+                throw UnexpectedHere("FETCH response contains duplicate data", line, start);
+
+            if (identifier.startsWith("BODY[") || identifier.startsWith("BINARY[") || identifier.startsWith("RFC822")) {
+                data[identifier] = QSharedPointer<AbstractData>(new RespData<QByteArray>(LowLevelParser::getNString(line, start).first));
+            } else if (identifier == "BODY") {
+                QVariantList list = LowLevelParser::parseList('(', ')', line, start);
+                data[identifier] = Message::AbstractMessage::fromList(list, line, start);
+            } else {
+                // Unrecognized identifier, let's treat it as QByteArray so that we don't break needlessly
+                data[identifier] = QSharedPointer<AbstractData>(new RespData<QByteArray>(LowLevelParser::getNString(line, start).first));
+            }
         }
 
         if (start >= line.size())
@@ -953,8 +963,74 @@ Fetch::Fetch(const uint number, const QByteArray &line, int &start): number(numb
         throw TooMuchData(line, start);
 }
 
-Fetch::Fetch(const uint number, const Fetch::dataType &data): number(number), data(data)
+/** @short Construct the response from the generic representation where each item is stored in a map */
+Fetch::Fetch(const uint number, const Fetch::dataType &items):
+    number(number), attributes(0), uid(0), rfc822Size(0), modSeq(0)
+{
+    for (dataType::const_iterator it = items.constBegin(); it != items.constEnd(); ++it) {
+        if (it.key() == "UID") {
+            attributes |= UID;
+            uid = dynamic_cast<const RespData<uint>&>(*it.value()).data;
+        } else if (it.key() == "FLAGS") {
+            attributes |= FLAGS;
+            flags = dynamic_cast<const RespData<QStringList>&>(*it.value()).data;
+        } else if (it.key() == "MODSEQ") {
+            attributes |= MODSEQ;
+            modSeq = dynamic_cast<const RespData<quint64>&>(*it.value()).data;
+        } else if (it.key() == "RFC822.SIZE") {
+            attributes |= RFC822_SIZE;
+            rfc822Size = dynamic_cast<const RespData<uint>&>(*it.value()).data;
+        } else if (it.key() == "INTERNALDATE") {
+            attributes |= INTERNALDATE;
+            metadata().internalDate = dynamic_cast<const RespData<QDateTime>&>(*it.value()).data;
+        } else if (it.key() == "ENVELOPE") {
+            attributes |= ENVELOPE;
+            metadata().envelope = dynamic_cast<const RespData<Message::Envelope>&>(*it.value()).data;
+        } else if (it.key() == "BODYSTRUCTURE") {
+            attributes |= BODYSTRUCTURE;
+            metadata().bodyStructure = it.value().dynamicCast<Message::AbstractMessage>();
+            Q_ASSERT(metadata().bodyStructure);
+        } else if (it.key() == "x-trojita-bodystructure") {
+            metadata().serializedBodyStructure = dynamic_cast<const RespData<QByteArray>&>(*it.value()).data;
+        } else {
+            data[it.key()] = it.value();
+        }
+    }
+}
+
+/** @short Make sure that an item is not present multiple times, and remember that it's there */
+void Fetch::checkDuplicate(const Attribute attribute, const QByteArray &line, const int start)
+{
+    if (has(attribute))
+        throw UnexpectedHere("FETCH response contains duplicate data", line, start);
+    attributes |= attribute;
+}
+
+Fetch::Metadata &Fetch::metadata()
 {
+    if (!m_metadata)
+        m_metadata = QSharedPointer<Metadata>(new Metadata());
+    return *m_metadata;
+}
+
+QDateTime Fetch::internalDate() const
+{
+    return m_metadata ? m_metadata->internalDate : QDateTime();
+}
+
+Message::Envelope Fetch::envelope() const
+{
+    return m_metadata ? m_metadata->envelope : Message::Envelope();
+}
+
+QSharedPointer<Message::AbstractMessage> Fetch::bodyStructure() const
+{
+    return m_metadata ? m_metadata->bodyStructure : QSharedPointer<Message::AbstractMessage>();
+}
+
+QByteArray Fetch::serializedBodyStructure() const
+{
+    return m_metadata ? m_metadata->serializedBodyStructure : QByteArray();
 }
 
 QList<NamespaceData> NamespaceData::listFromLine(const QByteArray &line, int &start)
@@ -1213,6 +1289,20 @@ QTextStream &Status::dump(QTextStream &stream) const
 QTextStream &Fetch::dump(QTextStream &stream) const
 {
     stream << "FETCH " << number << " (";
+    if (has(UID))
+        stream << " UID \"" << uid << '"';
+    if (has(FLAGS))
+        stream << " FLAGS \"" << flags.join(QLatin1String(" ")) << '"';
+    if (has(MODSEQ))
+        stream << " MODSEQ \"" << modSeq << '"';
+    if (has(RFC822_SIZE))
+        stream << " RFC822.SIZE \"" << rfc822Size << '"';
+    if (has(INTERNALDATE))
+        stream << " INTERNALDATE \"" << internalDate().toString() << '"';
+    if (has(ENVELOPE))
+        stream << " ENVELOPE \"" << envelope() << '"';
+    if (has(BODYSTRUCTURE))
+        stream << " BODYSTRUCTURE \"" << *bodyStructure() << '"';
     for (dataType::const_iterator it = data.begin();
          it != data.end(); ++it)
         stream << ' ' << it.key() << " \"" << *it.value() << '"';
@@ -1474,8 +1564,15 @@ bool Fetch::eq(const AbstractResponse &other) const
 {
     try {
         const Fetch &f = dynamic_cast<const Fetch &>(other);
-        if (number != f.number)
+        if (number != f.number || attributes != f.attributes)
+            return false;
+        if ((has(UID) && uid != f.uid) || (has(FLAGS) && flags != f.flags) || (has(MODSEQ) && modSeq != f.modSeq)
+                || (has(RFC822_SIZE) && rfc822Size != f.rfc822Size)
+                || (has(INTERNALDATE) && internalDate() != f.internalDate())
+                || (has(ENVELOPE) && !(envelope() == f.envelope()))
+                || (has(BODYSTRUCTURE) && *bodyStructure() != *f.bodyStructure()))
             return false;
+        // The serialized BODYSTRUCTURE is just another representation of the bodyStructure(), so it isn't compared
         if (data.keys() != f.data.keys())
             return false;
         for (dataType::const_iterator it = data.begin();
@@ -32,6 +32,7 @@
 #include "Command.h"
 #include "../Exceptions.h"
 #include "Data.h"
+#include "Message.h"
 #include "ThreadingNode.h"
 #include "Uids.h"
 
@@ -259,6 +260,12 @@ public:
      *  BADCHARSET, PERMANENTFLAGS:
      *      List of strings, ie. QStringList
      *
+     *  APPENDUID:
+     *      UIDVALIDITY and the new UIDs, ie. QPair<uint, Sequence>
+     *
+     *  COPYUID:
+     *      UIDVALIDITY, the source UIDs and the new UIDs, ie. QPair<uint, QPair<Sequence, Sequence> >
+     *
      *  default:
      *      Any data, ie. QString
      * */
@@ -551,16 +558,41 @@ public:
     virtual bool plug(Imap::Mailbox::ImapTask *task) const;
 };
 
-/** @short FETCH response */
+/** @short FETCH response
+
+The data items which are present in almost every FETCH response are stored in dedicated typed members. Their presence
+is tracked by the attributes bitmask, which means that the usual "* 123 FETCH (UID 456 FLAGS (\Seen))" does not need
+any per-item map nodes or shared pointers. Everything else, like the BODY[...] sections, goes into the generic data
+map.
+*/
 class Fetch : public AbstractResponse
 {
 public:
     typedef QMap<QByteArray,QSharedPointer<AbstractData> > dataType;
 
+    /** @short Data items which are stored in dedicated members */
+    typedef enum {
+        UID = 1 << 0,
+        FLAGS = 1 << 1,
+        MODSEQ = 1 << 2,
+        RFC822_SIZE = 1 << 3,
+        INTERNALDATE = 1 << 4,
+        ENVELOPE = 1 << 5,
+        BODYSTRUCTURE = 1 << 6
+    } Attribute;
+
     /** @short Sequence number of message that we're working with */
     uint number;
 
-    /** @short Fetched items */
+    /** @short Bitmask of the Attribute items present in this response */
+    uint attributes;
+
+    uint uid;
+    uint rfc822Size;
+    quint64 modSeq;
+    QStringList flags;
+
+    /** @short Fetched items which do not have a dedicated member */
     dataType data;
 
     Fetch(const uint number, const QByteArray &line, int &start);
@@ -569,7 +601,26 @@ public:
     virtual bool eq(const AbstractResponse &other) const;
     virtual void plug(Imap::Parser *parser, Imap::Mailbox::Model *model) const;
     virtual bool plug(Imap::Mailbox::ImapTask *task) const;
+
+    bool has(const Attribute attribute) const { return attributes & attribute; }
+    QDateTime internalDate() const;
+    Message::Envelope envelope() const;
+    QSharedPointer<Message::AbstractMessage> bodyStructure() const;
+    /** @short The BODYSTRUCTURE in the form which is suitable for AbstractCache::MessageDataBundle */
+    QByteArray serializedBodyStructure() const;
+
 private:
+    /** @short The bulky items which are only present when fetching the message metadata */
+    struct Metadata {
+        QDateTime internalDate;
+        Message::Envelope envelope;
+        QSharedPointer<Message::AbstractMessage> bodyStructure;
+        QByteArray serializedBodyStructure;
+    };
+    QSharedPointer<Metadata> m_metadata;
+
+    Metadata &metadata();
+    void checkDuplicate(const Attribute attribute, const QByteArray &line, const int start);
     static QDateTime dateify(QByteArray str, const QByteArray &line, const int start);
 };
 
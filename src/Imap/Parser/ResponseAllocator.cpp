@@ -0,0 +1,97 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ResponseAllocator.h"
+
+namespace {
+
+/** @short Number of slots which get allocated together */
+const int slotsPerSlab = 64;
+
+/** @short Each slot is padded so that any response type is suitably aligned within the slab */
+const size_t slotStride = (Imap::ResponseAllocator::SlotSize + sizeof(double) * 2 - 1) / (sizeof(double) * 2) * (sizeof(double) * 2);
+
+}
+
+namespace Imap
+{
+
+ResponseAllocator::ResponseAllocator(): m_freeList(0), m_detached(false)
+{
+}
+
+ResponseAllocator::~ResponseAllocator()
+{
+    Q_ASSERT(m_stats.inUse == 0);
+    Q_FOREACH(char *slab, m_slabs) {
+        ::operator delete(slab);
+    }
+}
+
+void ResponseAllocator::detach()
+{
+    m_detached = true;
+    if (m_stats.inUse == 0)
+        delete this;
+}
+
+void *ResponseAllocator::allocate()
+{
+    if (m_freeList) {
+        ++m_stats.recycled;
+    } else {
+        char *slab = static_cast<char *>(::operator new(slotStride * slotsPerSlab));
+        m_slabs.append(slab);
+        ++m_stats.slabs;
+        // Link the slots in the order of their addresses so that the responses of a burst end up next to each other
+        for (int i = slotsPerSlab - 1; i >= 0; --i) {
+            FreeSlot *slot = reinterpret_cast<FreeSlot *>(slab + i * slotStride);
+            slot->next = m_freeList;
+            m_freeList = slot;
+        }
+    }
+
+    FreeSlot *slot = m_freeList;
+    m_freeList = slot->next;
+    ++m_stats.allocations;
+    ++m_stats.inUse;
+    if (m_stats.inUse > m_stats.peakInUse)
+        m_stats.peakInUse = m_stats.inUse;
+    return slot;
+}
+
+void ResponseAllocator::release(void *ptr)
+{
+    FreeSlot *slot = static_cast<FreeSlot *>(ptr);
+    slot->next = m_freeList;
+    m_freeList = slot;
+    --m_stats.inUse;
+    if (m_detached && m_stats.inUse == 0)
+        delete this;
+}
+
+ResponseAllocatorStatistics ResponseAllocator::statistics() const
+{
+    return m_stats;
+}
+
+}
@@ -0,0 +1,138 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAP_PARSER_RESPONSEALLOCATOR_H
+#define IMAP_PARSER_RESPONSEALLOCATOR_H
+
+#include <new>
+#include <utility>
+#include <QSharedPointer>
+#include <QVector>
+#include "Response.h"
+
+namespace Imap
+{
+
+/** @short Counters describing the work of the ResponseAllocator, for debugging purposes */
+struct ResponseAllocatorStatistics {
+    /** @short Number of responses which were constructed in the pooled memory */
+    quint64 allocations;
+    /** @short How many of these allocations were served from the already allocated slabs */
+    quint64 recycled;
+    /** @short Number of slabs which the allocator has obtained from the system */
+    int slabs;
+    /** @short Number of responses which are alive right now */
+    int inUse;
+    /** @short Largest number of responses which were alive at the same time */
+    int peakInUse;
+
+    ResponseAllocatorStatistics(): allocations(0), recycled(0), slabs(0), inUse(0), peakInUse(0) {}
+};
+
+/** @short Recycle memory of the short-lived responses which the Parser creates in bulk
+
+A synchronization of a big mailbox results in a flood of FETCH, EXISTS and tagged responses. These are created by the
+parser, consumed by the Model and thrown away right afterwards. Instead of going through the general-purpose heap for
+each of them, their memory is carved from slabs of equally sized slots. Released slots are kept on a free list and
+reused for the next burst of responses, so the steady state does not allocate any memory for the response objects.
+
+The allocator has to outlive all responses it has created. Its owner shall therefore call detach() instead of
+deleting it; the allocator deletes itself once the last of its responses is gone.
+
+This class is not thread-safe; all responses have to be created and destroyed from the thread of the Parser.
+*/
+class ResponseAllocator
+{
+    template <size_t A, size_t B>
+    struct MaxSize {
+        enum { value = A > B ? A : B };
+    };
+
+    template <typename T>
+    class Deleter
+    {
+    public:
+        explicit Deleter(ResponseAllocator *allocator): m_allocator(allocator) {}
+        void operator()(T *resp) const
+        {
+            resp->~T();
+            m_allocator->release(resp);
+        }
+    private:
+        ResponseAllocator *m_allocator;
+    };
+
+public:
+    /** @short Size of each slot, which is enough for any of the response types which are worth pooling */
+    enum {
+        SlotSize = MaxSize<MaxSize<sizeof(Responses::Fetch), sizeof(Responses::State)>::value,
+                           sizeof(Responses::NumberResponse)>::value
+    };
+
+    ResponseAllocator();
+
+    /** @short Create a new response of type T in the pooled memory
+
+    Exceptions thrown by the response's constructor are propagated; the memory is returned to the pool in that case.
+    */
+    template <typename T, typename... Args>
+    QSharedPointer<Responses::AbstractResponse> create(Args&&... args)
+    {
+        static_assert(sizeof(T) <= SlotSize, "The response type does not fit into the slots of the ResponseAllocator");
+        void *slot = allocate();
+        T *resp;
+        try {
+            resp = new (slot) T(std::forward<Args>(args)...);
+        } catch (...) {
+            release(slot);
+            throw;
+        }
+        return QSharedPointer<T>(resp, Deleter<T>(this));
+    }
+
+    /** @short The owner no longer needs this allocator; it will be deleted as soon as it is not in use */
+    void detach();
+
+    ResponseAllocatorStatistics statistics() const;
+
+private:
+    ~ResponseAllocator();
+    ResponseAllocator(const ResponseAllocator &); // don't implement
+    ResponseAllocator &operator=(const ResponseAllocator &); // don't implement
+
+    void *allocate();
+    void release(void *slot);
+
+    /** @short A slot which is not in use holds a link to the next free one */
+    struct FreeSlot {
+        FreeSlot *next;
+    };
+
+    QVector<char *> m_slabs;
+    FreeSlot *m_freeList;
+    bool m_detached;
+    ResponseAllocatorStatistics m_stats;
+};
+
+}
+
+#endif // IMAP_PARSER_RESPONSEALLOCATOR_H
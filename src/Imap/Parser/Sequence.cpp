@@ -92,6 +92,8 @@ Imap::Uids Sequence::toVector() const
             Imap::Uids res;
             for (uint i = lo; i < hi; ++i)
                 res << i;
+            // The range is inclusive, but looping till hi could overflow
+            res << hi;
             return res;
         }
     case UNLIMITED:
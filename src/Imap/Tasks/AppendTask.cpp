@@ -39,6 +39,14 @@ AppendTask::AppendTask(Model *model, const QString &targetMailbox, const QByteAr
     conn->addDependentTask(this);
 }
 
+AppendTask::AppendTask(Model *model, const QString &targetMailbox, const QSharedPointer<QIODevice> &rawMessageStream,
+                       const QStringList &flags, const QDateTime &timestamp):
+    ImapTask(model), targetMailbox(targetMailbox), rawMessageStream(rawMessageStream), flags(flags), timestamp(timestamp)
+{
+    conn = model->m_taskFactory->createGetAnyConnectionTask(model);
+    conn->addDependentTask(this);
+}
+
 AppendTask::AppendTask(Model *model, const QString &targetMailbox, const QList<CatenatePair> &data, const QStringList &flags,
                        const QDateTime &timestamp):
     ImapTask(model), targetMailbox(targetMailbox), data(data), flags(flags), timestamp(timestamp)
@@ -55,7 +63,9 @@ void AppendTask::perform()
 
     IMAP_TASK_CHECK_ABORT_DIE;
 
-    if (data.isEmpty()) {
+    if (rawMessageStream) {
+        tag = parser->append(targetMailbox, rawMessageStream, flags, timestamp);
+    } else if (data.isEmpty()) {
         tag = parser->append(targetMailbox, rawMessageData, flags, timestamp);
     } else {
         tag = parser->appendCatenate(targetMailbox, data, flags, timestamp);
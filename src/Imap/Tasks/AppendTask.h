@@ -38,6 +38,8 @@ class AppendTask : public ImapTask
 public:
     AppendTask(Model *model, const QString &targetMailbox, const QByteArray &rawMessageData, const QStringList &flags,
                const QDateTime &timestamp);
+    AppendTask(Model *model, const QString &targetMailbox, const QSharedPointer<QIODevice> &rawMessageStream,
+               const QStringList &flags, const QDateTime &timestamp);
     AppendTask(Model *model, const QString &targetMailbox, const QList<CatenatePair> &data, const QStringList &flags,
                const QDateTime &timestamp);
     virtual void perform();
@@ -55,6 +57,7 @@ private:
     CommandHandle tag;
     QString targetMailbox;
     QByteArray rawMessageData;
+    QSharedPointer<QIODevice> rawMessageStream;
     QList<CatenatePair> data;
     QStringList flags;
     QDateTime timestamp;
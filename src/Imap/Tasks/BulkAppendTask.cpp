@@ -0,0 +1,235 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QFile>
+#include "BulkAppendTask.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/Model.h"
+#include "Imap/Model/TaskPresentationModel.h"
+#include "GetAnyConnectionTask.h"
+
+namespace {
+
+/** @short How many messages go into a single MULTIAPPEND command */
+const int messagesPerMultiAppend = 50;
+/** @short Upper bound on the amount of data transferred by a single MULTIAPPEND command */
+const qint64 bytesPerMultiAppend = 16 * 1024 * 1024;
+/** @short How many plain APPEND commands can be in flight at the same time */
+const int maxAppendsInFlight = 16;
+
+}
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+BulkAppendTask::BulkAppendTask(Model *model, const QString &targetMailbox, const QList<AppendItem> &items):
+    ImapTask(model), targetMailbox(targetMailbox), items(items), nextItem(0), succeeded(0), failedCount(0),
+    multiAppend(false)
+{
+    conn = model->m_taskFactory->createGetAnyConnectionTask(model);
+    conn->addDependentTask(this);
+}
+
+void BulkAppendTask::perform()
+{
+    parser = conn->parser;
+    Q_ASSERT(parser);
+    markAsActiveTask();
+
+    IMAP_TASK_CHECK_ABORT_DIE;
+
+    multiAppend = model->accessParser(parser).capabilities.contains(QLatin1String("MULTIAPPEND"));
+    sendMore();
+    finishIfDone();
+}
+
+void BulkAppendTask::abort()
+{
+    ImapTask::abort();
+    // The commands which are in flight have to finish, but nothing new gets queued
+    if (parser && !_finished)
+        finishIfDone();
+}
+
+/** @short Make sure that the message data are available, and report a failure if they are not */
+bool BulkAppendTask::openItem(const int index)
+{
+    AppendItem &item = items[index];
+    if (!item.data) {
+        QFile *file = new QFile(item.fileName);
+        if (!file->open(QIODevice::ReadOnly)) {
+            itemDone(index, false, tr("Cannot read %1: %2").arg(item.fileName, file->errorString()));
+            delete file;
+            return false;
+        }
+        item.data = QSharedPointer<QIODevice>(file);
+    } else if (!item.data->isOpen() || !item.data->seek(0)) {
+        itemDone(index, false, tr("Message data are not available"));
+        return false;
+    }
+    return true;
+}
+
+/** @short Queue a plain APPEND for the item at @arg index */
+bool BulkAppendTask::sendSingle(const int index)
+{
+    if (!openItem(index))
+        return false;
+    const AppendItem &item = items[index];
+    inFlight[parser->append(targetMailbox, item.data, item.flags, item.timestamp)] = QList<int>() << index;
+    return true;
+}
+
+/** @short Queue as many commands as the current mode allows */
+void BulkAppendTask::sendMore()
+{
+    if (_dead || _aborted)
+        return;
+
+    // Messages of a rejected batch go first, one command each, so that the culprit can be identified
+    while (!singleRetries.isEmpty() && inFlight.size() < maxAppendsInFlight) {
+        sendSingle(singleRetries.takeFirst());
+    }
+
+    if (multiAppend) {
+        // Only one batch is in flight at a time. The messages are read only when they are needed, and a rejected batch
+        // is retried message by message before the upload continues.
+        if (!inFlight.isEmpty() || !singleRetries.isEmpty()) {
+            model->m_taskModel->slotTaskMighHaveChanged(this);
+            return;
+        }
+        QList<AppendItem> batch;
+        QList<int> indexes;
+        qint64 batchSize = 0;
+        while (nextItem < items.size() && batch.size() < messagesPerMultiAppend && batchSize < bytesPerMultiAppend) {
+            const int index = nextItem++;
+            if (!openItem(index))
+                continue;
+            batch << items[index];
+            indexes << index;
+            batchSize += items[index].data->size();
+        }
+        if (!batch.isEmpty())
+            inFlight[parser->multiAppend(targetMailbox, batch)] = indexes;
+    } else {
+        while (nextItem < items.size() && inFlight.size() < maxAppendsInFlight) {
+            sendSingle(nextItem++);
+        }
+    }
+
+    model->m_taskModel->slotTaskMighHaveChanged(this);
+}
+
+/** @short Record the result of uploading a single message and release its data */
+void BulkAppendTask::itemDone(const int index, const bool ok, const QString &message)
+{
+    items[index].data.clear();
+    if (ok) {
+        ++succeeded;
+        emit itemAppended(index);
+    } else {
+        ++failedCount;
+        lastError = message;
+        log(tr("Cannot upload message #%1: %2").arg(QString::number(index), message));
+        emit itemFailed(index, message);
+    }
+}
+
+/** @short Finish the task once there is nothing else to wait for */
+void BulkAppendTask::finishIfDone()
+{
+    if (_finished || !inFlight.isEmpty())
+        return;
+
+    if (nextItem < items.size() || !singleRetries.isEmpty()) {
+        if (!_dead && !_aborted)
+            return;
+        // These will never be sent
+        failedCount += items.size() - nextItem + singleRetries.size();
+        nextItem = items.size();
+        singleRetries.clear();
+    }
+
+    if (_dead) {
+        _failed(tr("Asked to die"));
+    } else if (_aborted) {
+        _failed(tr("Aborted"));
+    } else if (failedCount) {
+        _failed(tr("%n message(s) could not be uploaded: %1", 0, failedCount).arg(lastError));
+    } else {
+        _completed();
+    }
+}
+
+bool BulkAppendTask::handleStateHelper(const Imap::Responses::State *const resp)
+{
+    if (resp->tag.isEmpty())
+        return false;
+
+    QMap<CommandHandle, QList<int> >::iterator it = inFlight.find(resp->tag);
+    if (it == inFlight.end())
+        return false;
+
+    const QList<int> indexes = *it;
+    inFlight.erase(it);
+    if (resp->kind != Responses::OK && indexes.size() > 1 && resp->respCode != Responses::TRYCREATE) {
+        // A MULTIAPPEND is atomic, so nothing from this batch got saved. The failure might have been caused by a single
+        // message, so let's find out which one by trying again with each of them individually.
+        log(tr("MULTIAPPEND of %n message(s) failed, uploading them one by one: %1", 0, indexes.size()).arg(resp->message));
+        singleRetries = indexes + singleRetries;
+    } else {
+        Q_FOREACH(const int index, indexes) {
+            itemDone(index, resp->kind == Responses::OK, resp->message);
+        }
+    }
+
+    sendMore();
+    finishIfDone();
+    return true;
+}
+
+QString BulkAppendTask::debugIdentification() const
+{
+    return QString::fromUtf8("%1: %2/%3 messages, %4 in flight%5").arg(targetMailbox, QString::number(succeeded + failedCount),
+                                                                      QString::number(items.size()),
+                                                                      QString::number(inFlight.size()),
+                                                                      multiAppend ? QLatin1String(", MULTIAPPEND") : QLatin1String(""));
+}
+
+QVariant BulkAppendTask::taskData(const int role) const
+{
+    switch (role) {
+    case RoleTaskCompactName:
+        return tr("Uploading messages (%1 of %2)").arg(QString::number(succeeded + failedCount), QString::number(items.size()));
+    case RoleTaskProgress:
+        return succeeded + failedCount;
+    case RoleTaskProgressMax:
+        return items.size();
+    default:
+        return QVariant();
+    }
+}
+
+}
+}
@@ -0,0 +1,91 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef IMAP_BULKAPPENDTASK_H
+#define IMAP_BULKAPPENDTASK_H
+
+#include <QMap>
+#include "Imap/Model/AppendData.h"
+#include "ImapTask.h"
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+/** @short Upload many messages into a single mailbox
+
+When the server supports MULTIAPPEND (RFC 3502), the messages are uploaded in batches, each of them as a single APPEND
+command. Otherwise, a bounded number of individual APPEND commands is kept in flight so that the server's responses
+do not have to be waited for one at a time; that works best with LITERAL+.
+
+The message data are only read as they get sent. Messages which come from files are opened just before their command is
+queued, so the number of open files stays bounded, too.
+
+A failure to upload some messages does not prevent the rest of them from being uploaded; the task fails at the end if
+any of the messages could not be saved. Because a MULTIAPPEND is atomic, the messages of a rejected batch are uploaded
+again through individual APPEND commands, so that a single bad message does not take the whole batch down with it.
+*/
+class BulkAppendTask : public ImapTask
+{
+    Q_OBJECT
+public:
+    BulkAppendTask(Model *model, const QString &targetMailbox, const QList<AppendItem> &items);
+    virtual void perform();
+    virtual void abort();
+
+    virtual bool handleStateHelper(const Imap::Responses::State *const resp);
+    virtual bool needsMailbox() const {return false;}
+    virtual QString debugIdentification() const;
+    virtual QVariant taskData(const int role) const;
+
+signals:
+    /** @short The message at the given position in the original list has been saved */
+    void itemAppended(const int index);
+    /** @short The message at the given position in the original list could not be saved */
+    void itemFailed(const int index, const QString &message);
+
+private:
+    void sendMore();
+    bool sendSingle(const int index);
+    bool openItem(const int index);
+    void itemDone(const int index, const bool ok, const QString &message);
+    void finishIfDone();
+
+    ImapTask *conn;
+    QString targetMailbox;
+    QList<AppendItem> items;
+    /** @short Position of the first item which has not been queued yet */
+    int nextItem;
+    /** @short Items of the rejected MULTIAPPEND batches which are waiting to be uploaded one by one */
+    QList<int> singleRetries;
+    /** @short Which items are transferred by each of the commands in flight */
+    QMap<CommandHandle, QList<int> > inFlight;
+    int succeeded;
+    int failedCount;
+    QString lastError;
+    bool multiAppend;
+};
+
+}
+}
+
+#endif // IMAP_BULKAPPENDTASK_H
@@ -25,6 +25,7 @@
 #include "Imap/Model/ItemRoles.h"
 #include "Imap/Model/Model.h"
 #include "Imap/Model/MailboxTree.h"
+#include "Imap/Model/SpecialFlagNames.h"
 #include "ExpungeMessagesTask.h"
 #include "KeepMailboxOpenTask.h"
 #include "UpdateFlagsTask.h"
@@ -46,6 +47,7 @@ CopyMoveMessagesTask::CopyMoveMessagesTask(Model *model, const QModelIndexList &
         messages << index;
     }
     QModelIndex mailboxIndex = model->findMailboxForItems(messages_);
+    sourceMailbox = mailboxIndex.data(RoleMailboxName).toString();
     conn = model->findTaskResponsibleFor(mailboxIndex);
     conn->addDependentTask(this);
 }
@@ -93,11 +95,16 @@ void CopyMoveMessagesTask::perform()
 
 bool CopyMoveMessagesTask::handleStateHelper(const Imap::Responses::State *const resp)
 {
-    if (resp->tag.isEmpty())
+    if (resp->tag.isEmpty()) {
+        // The UID MOVE reports the new UIDs in an untagged OK
+        if (!moveTag.isEmpty() && resp->kind == Responses::OK)
+            copyCachedMessages(resp);
         return false;
+    }
 
     if (resp->tag == copyTag) {
         if (resp->kind == Responses::OK) {
+            copyCachedMessages(resp);
             if (shouldDelete) {
                 if (_dead) {
                     // Yeah, that's bad -- the COPY has succeeded, yet we cannot update the flags :(
@@ -128,6 +135,77 @@ bool CopyMoveMessagesTask::handleStateHelper(const Imap::Responses::State *const
     }
 }
 
+/** @short Make the cached data of the original messages available for their copies
+
+Thanks to the COPYUID response code we know the UIDs of the new messages, so there's no need to download their
+metadata and parts once again when the user opens the target mailbox.
+*/
+void CopyMoveMessagesTask::copyCachedMessages(const Imap::Responses::State *const resp)
+{
+    if (resp->respCode != Responses::COPYUID)
+        return;
+
+    const Responses::RespData<QPair<uint, QPair<Sequence, Sequence> > > *const respData =
+            dynamic_cast<const Responses::RespData<QPair<uint, QPair<Sequence, Sequence> > >* const>(resp->respCodeData.data());
+    Q_ASSERT(respData);
+    Imap::Uids sourceUids = respData->data.second.first.toVector();
+    Imap::Uids targetUids = respData->data.second.second.toVector();
+    if (sourceUids.size() != targetUids.size()) {
+        log(QLatin1String("COPYUID: the number of the source and the target UIDs does not match"));
+        return;
+    }
+    // A cached state with a different UIDVALIDITY would get thrown away anyway; the same applies to a mailbox which we
+    // have not synced yet
+    if (model->cache()->mailboxSyncState(targetMailbox).uidValidity() != respData->data.first)
+        return;
+    model->cache()->copyMessages(sourceMailbox, sourceUids, targetMailbox, targetUids);
+    primeTargetUidMap(targetUids);
+}
+
+/** @short Append the new messages to the cached UID map of the target mailbox
+
+When the target mailbox gets opened later on, it will look like nothing but a flag change has happened since we synced
+it the last time. Any unexpected changes on the server side are caught by the regular resync anyway because they show up
+as a mismatch of EXISTS or UIDNEXT.
+*/
+void CopyMoveMessagesTask::primeTargetUidMap(const Imap::Uids &targetUids)
+{
+    if (TreeItemMailbox *mailbox = model->findMailboxByName(targetMailbox)) {
+        // The target is loaded and it will save its own state when synced; the server will tell us about the new arrivals
+        TreeItemMsgList *list = dynamic_cast<TreeItemMsgList *>(mailbox->m_children[0]);
+        Q_ASSERT(list);
+        if (list->fetched() || list->loading() || !list->m_children.isEmpty())
+            return;
+    }
+
+    SyncState syncState = model->cache()->mailboxSyncState(targetMailbox);
+    Imap::Uids uidMap = model->cache()->uidMapping(targetMailbox);
+    if (!syncState.isUsableForSyncing() || static_cast<uint>(uidMap.size()) != syncState.exists())
+        return;
+
+    Imap::Uids newUids = targetUids;
+    qSort(newUids);
+    if (newUids.front() < syncState.uidNext() || (!uidMap.isEmpty() && newUids.front() <= uidMap.last())) {
+        // Either the cache is out of date, or the server does not allocate the UIDs in an ascending order
+        log(QLatin1String("COPYUID: not priming the UID map of the target mailbox"));
+        return;
+    }
+
+    uint unseen = 0;
+    Q_FOREACH(const uint uid, newUids) {
+        if (!model->cache()->msgFlags(targetMailbox, uid).contains(FlagNames::seen))
+            ++unseen;
+    }
+
+    uidMap += newUids;
+    syncState.setExists(uidMap.size());
+    syncState.setUidNext(newUids.last() + 1);
+    if (syncState.isUsableForNumbers())
+        syncState.setUnSeenCount(syncState.unSeenCount() + unseen);
+    model->cache()->setUidMapping(targetMailbox, uidMap);
+    model->cache()->setMailboxSyncState(targetMailbox, syncState);
+}
+
 QVariant CopyMoveMessagesTask::taskData(const int role) const
 {
     return role == RoleTaskCompactName ? QVariant(tr("Copying messages")) : QVariant();
@@ -44,10 +44,14 @@ public:
     virtual QVariant taskData(const int role) const;
     virtual bool needsMailbox() const {return true;}
 private:
+    void copyCachedMessages(const Imap::Responses::State *const resp);
+    void primeTargetUidMap(const Imap::Uids &targetUids);
+
     CommandHandle copyTag;
     CommandHandle moveTag;
     ImapTask *conn;
     QList<QPersistentModelIndex> messages;
+    QString sourceMailbox;
     QString targetMailbox;
     bool shouldDelete;
 };
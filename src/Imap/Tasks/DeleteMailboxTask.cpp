@@ -83,6 +83,7 @@ bool DeleteMailboxTask::handleStateHelper(const Imap::Responses::State *const re
                 model->beginRemoveRows(parentIndex, mailboxPtr->row(), mailboxPtr->row());
                 mailboxPtr->parent()->m_children.erase(mailboxPtr->parent()->m_children.begin() + mailboxPtr->row());
                 model->endRemoveRows();
+                model->unindexMailboxSubtree(mailboxPtr);
                 delete mailboxPtr;
             } else {
                 QString buf;
@@ -65,6 +65,7 @@ void ImapTask::updateParentTask(ImapTask *newParent)
     parentTask = newParent;
     CHECK_TASK_TREE
     model->m_taskModel->slotTaskGotReparented(this);
+    model->scheduleTaskRecheck(this);
     if (parser) {
         Q_ASSERT(!model->accessParser(parser).activeTasks.contains(this));
         //log(tr("Reparented to %1").arg(newParent->debugIdentification()));
@@ -97,6 +98,9 @@ void ImapTask::markAsActiveTask(const TaskActivatingPosition place)
         connect(this, SIGNAL(destroyed(QObject*)), model->accessParser(parser).maintainingTask, SLOT(slotTaskDeleted(QObject*)));
     }
 
+    // Tasks which get activated outside of their perform(), like the GetAnyConnectionTask, still have to get a go
+    model->scheduleTaskRecheck(this);
+
     log(QLatin1String("Activated"));
     CHECK_TASK_TREE
 }
@@ -224,6 +228,8 @@ bool ImapTask::handleParseErrorResponse(const Imap::Responses::ParseErrorRespons
 void ImapTask::_completed()
 {
     _finished = true;
+    if (model)
+        model->scheduleTaskRecheck(this);
     log(QLatin1String("Completed"));
     Q_FOREACH(ImapTask* task, dependentTasks) {
         if (!task->isFinished())
@@ -235,6 +241,8 @@ void ImapTask::_completed()
 void ImapTask::_failed(const QString &errorMessage)
 {
     _finished = true;
+    if (model)
+        model->scheduleTaskRecheck(this);
     killAllPendingTasks(errorMessage);
     log(QString::fromUtf8("Failed: %1").arg(errorMessage));
     emit failed(errorMessage);
@@ -23,6 +23,7 @@
 #include <sstream>
 #include "KeepMailboxOpenTask.h"
 #include "Common/InvokeMethod.h"
+#include "Common/Metrics.h"
 #include "Imap/Model/ItemRoles.h"
 #include "Imap/Model/MailboxTree.h"
 #include "Imap/Model/Model.h"
@@ -441,8 +442,20 @@ bool KeepMailboxOpenTask::handleNumberResponse(const Imap::Responses::NumberResp
     Q_ASSERT(list);
     // FIXME: tests!
     if (resp->kind == Imap::Responses::EXPUNGE) {
-        mailbox->handleExpunge(model, *resp);
-        mailbox->syncState.setExists(mailbox->syncState.exists() - 1);
+        // A bulk expunge typically arrives as a long run of EXPUNGE responses within a single read from the socket.
+        // Consuming all of them at once means that the message list is updated and the cache is written just once.
+        QList<uint> seqNumbers;
+        seqNumbers << resp->number;
+        while (true) {
+            const Responses::NumberResponse *next =
+                    dynamic_cast<const Responses::NumberResponse *>(parser->peekResponse().data());
+            if (!next || next->kind != Imap::Responses::EXPUNGE)
+                break;
+            seqNumbers << next->number;
+            parser->getResponse();
+        }
+        mailbox->handleExpunges(model, seqNumbers);
+        mailbox->syncState.setExists(mailbox->syncState.exists() - seqNumbers.size());
         saveSyncStateNowOrLater(mailbox);
         return true;
     } else if (resp->kind == Imap::Responses::EXISTS) {
@@ -668,6 +681,7 @@ void KeepMailboxOpenTask::die(const QString &message)
         // This is a speciality of the KeepMailboxOpenTask because it's the only task
         // this has a very long life.
         _finished = true;
+        model->scheduleTaskRecheck(this);
     }
     ImapTask::die(message);
     detachFromMailbox();
@@ -756,13 +770,17 @@ void KeepMailboxOpenTask::activateTasks()
         ImapTask *task = dependingTasksForThisMailbox.takeFirst();
         runningTasksForThisMailbox.append(task);
         dependentTasks.removeOne(task);
+        const uint firstCommand = parser->commandCounter();
         task->perform();
+        model->rememberCommandOwner(parser, firstCommand, task);
     }
     while (!dependingTasksNoMailbox.isEmpty() && model->accessParser(parser).activeTasks.size() < limitActiveTasks) {
         breakOrCancelPossibleIdle();
         ImapTask *task = dependingTasksNoMailbox.takeFirst();
         dependentTasks.removeOne(task);
+        const uint firstCommand = parser->commandCounter();
         task->perform();
+        model->rememberCommandOwner(parser, firstCommand, task);
     }
 
     if (idleLauncher && canRunIdleRightNow())
@@ -813,6 +831,9 @@ void KeepMailboxOpenTask::slotFetchRequestedParts()
         if (uids.isEmpty())
             return;
 
+        static Common::MetricsHistogram *const batchSizes =
+                Common::MetricsRegistry::instance()->histogram(QLatin1String("keepMailboxOpen.partFetchBatch.uids"));
+        batchSizes->record(uids.size());
         fetchPartTasks << model->m_taskFactory->createFetchMsgPartTask(model, mailboxIndex, uids, parts.toList());
     }
 }
@@ -835,6 +856,9 @@ void KeepMailboxOpenTask::slotFetchRequestedEnvelopes()
         fetchNow = requestedEnvelopes.mid(0, amount);
         requestedEnvelopes.erase(requestedEnvelopes.begin(), requestedEnvelopes.begin() + amount);
     }
+    static Common::MetricsHistogram *const batchSizes =
+            Common::MetricsRegistry::instance()->histogram(QLatin1String("keepMailboxOpen.envelopeFetchBatch.uids"));
+    batchSizes->record(fetchNow.size());
     fetchMetadataTasks << model->m_taskFactory->createFetchMsgMetadataTask(model, mailboxIndex, fetchNow);
 }
 
@@ -1141,6 +1165,7 @@ void KeepMailboxOpenTask::finalizeTermination()
 {
     if (!_finished) {
         _finished = true;
+        model->scheduleTaskRecheck(this);
         emit completed(this);
     }
     CHECK_TASK_TREE;
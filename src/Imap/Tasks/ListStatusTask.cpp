@@ -0,0 +1,113 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ListStatusTask.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/Model.h"
+#include "Imap/Model/MailboxTree.h"
+#include "GetAnyConnectionTask.h"
+#include "ListChildMailboxesTask.h"
+#include "NumberOfMessagesTask.h"
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+ListStatusTask::ListStatusTask(Model *model, const QStringList &mailboxes):
+    ImapTask(model), m_mailboxes(mailboxes)
+{
+    conn = model->m_taskFactory->createGetAnyConnectionTask(model);
+    conn->addDependentTask(this);
+}
+
+void ListStatusTask::perform()
+{
+    parser = conn->parser;
+    markAsActiveTask();
+
+    IMAP_TASK_CHECK_ABORT_DIE;
+
+    Q_FOREACH(ImapTask *task, model->accessParser(parser).activeTasks) {
+        if (dynamic_cast<ListChildMailboxesTask*>(task)) {
+            // We cannot tell our LIST responses from those which are going to rebuild the mailbox tree, so let's
+            // just ask for the numbers the old-fashioned way instead
+            log(QLatin1String("Another LIST is in progress, falling back to STATUS"));
+            forgetMessageCounts();
+            _completed();
+            return;
+        }
+    }
+
+    m_pendingListResponses = m_mailboxes.toSet();
+    tag = parser->listMultiple(QLatin1String(""), m_mailboxes, QStringList() <<
+                               QString::fromUtf8("STATUS (%1)").arg(NumberOfMessagesTask::requestedStatusOptions().join(QLatin1String(" "))));
+}
+
+bool ListStatusTask::handleList(const Imap::Responses::List *const resp)
+{
+    // The responses for the mailboxes we've asked for do not carry anything new, they are only here to accompany the STATUS
+    return m_pendingListResponses.remove(resp->mailbox);
+}
+
+bool ListStatusTask::handleStateHelper(const Imap::Responses::State *const resp)
+{
+    if (resp->tag.isEmpty())
+        return false;
+
+    if (resp->tag == tag) {
+        m_pendingListResponses.clear();
+        if (resp->kind == Responses::OK) {
+            _completed();
+        } else {
+            forgetMessageCounts();
+            _failed(tr("LIST-STATUS has failed"));
+        }
+        return true;
+    } else {
+        return false;
+    }
+}
+
+/** @short Make sure that the Model asks for the numbers of messages through the STATUS command once they are needed */
+void ListStatusTask::forgetMessageCounts()
+{
+    Q_FOREACH(const QString &name, m_mailboxes) {
+        if (TreeItemMailbox *mailbox = model->findMailboxByName(name)) {
+            model->forgetMessageCounts(mailbox);
+        }
+    }
+}
+
+QString ListStatusTask::debugIdentification() const
+{
+    return QString::fromUtf8("%1 mailboxes").arg(QString::number(m_mailboxes.size()));
+}
+
+QVariant ListStatusTask::taskData(const int role) const
+{
+    return role == RoleTaskCompactName ? QVariant(tr("Looking for messages")) : QVariant();
+}
+
+}
+}
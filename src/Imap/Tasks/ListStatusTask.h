@@ -0,0 +1,65 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAP_LISTSTATUS_TASK_H
+#define IMAP_LISTSTATUS_TASK_H
+
+#include <QSet>
+#include "ImapTask.h"
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+/** @short Refresh the message counters of many mailboxes at once through the LIST-STATUS extension from RFC 5819
+
+A single LIST command which enumerates all of the mailboxes is used instead of one STATUS command per mailbox. The LIST
+responses are consumed here so that they do not interfere with the mailbox tree; the STATUS responses are processed by
+the Model as usual.
+*/
+class ListStatusTask : public ImapTask
+{
+    Q_OBJECT
+public:
+    ListStatusTask(Model *model, const QStringList &mailboxes);
+    virtual void perform();
+
+    virtual bool handleStateHelper(const Imap::Responses::State *const resp);
+    virtual bool handleList(const Imap::Responses::List *const resp);
+
+    virtual QString debugIdentification() const;
+    virtual QVariant taskData(const int role) const;
+    virtual bool needsMailbox() const {return false;}
+private:
+    void forgetMessageCounts();
+
+    CommandHandle tag;
+    ImapTask *conn;
+    QStringList m_mailboxes;
+    QSet<QString> m_pendingListResponses;
+};
+
+}
+}
+
+#endif // IMAP_LISTSTATUS_TASK_H
@@ -0,0 +1,95 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "NotifyTask.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/Model.h"
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+NotifyTask::NotifyTask(Model *model, ImapTask *parentTask) :
+    ImapTask(model), notifyAccepted(false)
+{
+    parentTask->addDependentTask(this);
+}
+
+void NotifyTask::perform()
+{
+    parser = parentTask->parser;
+    markAsActiveTask();
+
+    IMAP_TASK_CHECK_ABORT_DIE;
+
+    if (model->accessParser(parser).capabilities.contains(QLatin1String("NAMESPACE")))
+        namespaceTag = parser->namespaceCommand();
+    // FlagChange requires both MessageNew and MessageExpunge, see RFC 5465 section 5
+    tag = parser->notifySet(QList<QByteArray>() << "(personal (MessageNew MessageExpunge FlagChange))");
+}
+
+bool NotifyTask::handleStateHelper(const Imap::Responses::State *const resp)
+{
+    if (resp->tag.isEmpty())
+        return false;
+
+    if (resp->tag == namespaceTag) {
+        if (resp->kind != Responses::OK)
+            log(QLatin1String("NAMESPACE failed, will poll for the message counts outside of INBOX"));
+        namespaceTag.clear();
+        finishIfDone();
+        return true;
+    } else if (resp->tag == tag) {
+        notifyAccepted = resp->kind == Responses::OK;
+        if (notifyAccepted)
+            model->accessParser(parser).notifyActive = true;
+        tag.clear();
+        finishIfDone();
+        return true;
+    } else {
+        return false;
+    }
+}
+
+void NotifyTask::finishIfDone()
+{
+    if (!tag.isEmpty() || !namespaceTag.isEmpty())
+        return;
+
+    if (notifyAccepted) {
+        _completed();
+    } else {
+        // Not fatal at all, we will just keep polling for the updated message counts
+        log(QLatin1String("NOTIFY failed, will poll for the message counts"));
+        _failed(tr("NOTIFY failed"));
+    }
+}
+
+QVariant NotifyTask::taskData(const int role) const
+{
+    return role == RoleTaskCompactName ? QVariant(tr("Subscribing to mailbox changes")) : QVariant();
+}
+
+}
+}
@@ -0,0 +1,61 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAP_TASK_NOTIFYTASK_H
+#define IMAP_TASK_NOTIFYTASK_H
+
+#include "ImapTask.h"
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+/** @short Ask the server to push changes of the message counters through the NOTIFY command from RFC 5465
+
+The selected mailbox is deliberately left out of the event specification so that it keeps being maintained by the
+regular RFC 3501 responses. All other mailboxes from the personal namespace report their changes through untagged
+STATUS responses which are processed by the Model as usual. The NAMESPACE command goes along so that the Model knows
+which mailboxes are covered, and which ones it still has to poll.
+*/
+class NotifyTask : public ImapTask
+{
+    Q_OBJECT
+public:
+    NotifyTask(Model *model, ImapTask *parentTask);
+    virtual void perform();
+
+    virtual bool handleStateHelper(const Imap::Responses::State *const resp);
+    virtual QVariant taskData(const int role) const;
+    virtual bool needsMailbox() const {return false;}
+private:
+    void finishIfDone();
+
+    CommandHandle tag;
+    CommandHandle namespaceTag;
+    bool notifyAccepted;
+};
+
+}
+}
+
+#endif // IMAP_TASK_NOTIFYTASK_H
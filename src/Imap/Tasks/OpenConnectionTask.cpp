@@ -28,6 +28,7 @@
 #include "Imap/Model/TaskPresentationModel.h"
 #include "Imap/Tasks/EnableTask.h"
 #include "Imap/Tasks/IdTask.h"
+#include "Imap/Tasks/NotifyTask.h"
 #include "Streams/SocketFactory.h"
 #include "Streams/TrojitaZlibStatus.h"
 
@@ -43,6 +44,7 @@ OpenConnectionTask::OpenConnectionTask(Model *model) :
     Q_ASSERT(model->networkPolicy() != NETWORK_OFFLINE);
     parser = new Parser(model, model->m_socketFactory->create(), Common::ConnectionId::next());
     ParserState parserState(parser);
+    parserState.connectionTimer.start();
     connect(parser, SIGNAL(responseReceived(Imap::Parser *)), model, SLOT(responseReceived(Imap::Parser*)), Qt::QueuedConnection);
     connect(parser, SIGNAL(connectionStateChanged(Imap::Parser *,Imap::ConnectionState)), model, SLOT(handleSocketStateChanged(Imap::Parser *,Imap::ConnectionState)));
     connect(parser, SIGNAL(lineReceived(Imap::Parser *,QByteArray)), model, SLOT(slotParserLineReceived(Imap::Parser *,QByteArray)));
@@ -168,14 +170,7 @@ bool OpenConnectionTask::handleStateHelper(const Imap::Responses::State *const r
             // Cool, we're already authenticated. Now, let's see if we have to issue CAPABILITY or if we already know that
             if (model->accessParser(parser).capabilitiesFresh) {
                 // We're alsmost done here, apart from compression
-                if (TROJITA_COMPRESS_DEFLATE && model->accessParser(parser).capabilities.contains(QLatin1String("COMPRESS=DEFLATE"))) {
-                    compressCmd = parser->compressDeflate();
-                    model->changeConnectionState(parser, CONN_STATE_COMPRESS_DEFLATE);
-                } else {
-                    // really done
-                    model->changeConnectionState(parser, CONN_STATE_AUTHENTICATED);
-                    onComplete();
-                }
+                compressOrComplete();
             } else {
                 model->changeConnectionState(parser, CONN_STATE_POSTAUTH_PRECAPS);
                 capabilityCmd = parser->capability();
@@ -281,13 +276,16 @@ bool OpenConnectionTask::handleStateHelper(const Imap::Responses::State *const r
                 model->setImapAuthError(QString());
                 if (resp->respCode == CAPABILITIES || model->accessParser(parser).capabilitiesFresh) {
                     // Capabilities are already known
-                    if (TROJITA_COMPRESS_DEFLATE && model->accessParser(parser).capabilities.contains(QLatin1String("COMPRESS=DEFLATE"))) {
-                        compressCmd = parser->compressDeflate();
-                        model->changeConnectionState(parser, CONN_STATE_COMPRESS_DEFLATE);
-                    } else {
-                        model->changeConnectionState(parser, CONN_STATE_AUTHENTICATED);
-                        onComplete();
-                    }
+                    rememberPostAuthCapabilities();
+                    compressOrComplete();
+                } else if (!model->m_postAuthCapabilitiesCache.isEmpty() && m_preAuthCapabilities == model->m_preAuthCapabilitiesCache) {
+                    // The server looks exactly the same as the last time, so let's assume that the post-login capabilities
+                    // have not changed either. They get verified by a CAPABILITY which is pipelined with whatever follows.
+                    model->logTrace(parser->parserId(), Common::LOG_OTHER, QLatin1String("OpenConnectionTask"),
+                                    QLatin1String("Using cached capabilities"));
+                    model->accessParser(parser).capabilityRevalidationCmd = parser->capability();
+                    model->updateCapabilities(parser, model->m_postAuthCapabilitiesCache);
+                    compressOrComplete();
                 } else {
                     // Got to ask for the capabilities
                     model->changeConnectionState(parser, CONN_STATE_POSTAUTH_PRECAPS);
@@ -350,6 +348,7 @@ bool OpenConnectionTask::handleStateHelper(const Imap::Responses::State *const r
     {
         bool wasCaps = checkCapabilitiesResult(resp);
         if (wasCaps && !_finished) {
+            rememberPostAuthCapabilities();
             model->changeConnectionState(parser, CONN_STATE_AUTHENTICATED);
             onComplete();
         }
@@ -412,6 +411,28 @@ bool OpenConnectionTask::checkCapabilitiesResult(const Responses::State *const r
     return false;
 }
 
+void OpenConnectionTask::compressOrComplete()
+{
+    if (TROJITA_COMPRESS_DEFLATE && model->accessParser(parser).capabilities.contains(QLatin1String("COMPRESS=DEFLATE"))) {
+        compressCmd = parser->compressDeflate();
+        model->changeConnectionState(parser, CONN_STATE_COMPRESS_DEFLATE);
+    } else {
+        model->changeConnectionState(parser, CONN_STATE_AUTHENTICATED);
+        onComplete();
+    }
+}
+
+/** @short Remember the capabilities which the server has advertised after a successful LOGIN for future reconnects */
+void OpenConnectionTask::rememberPostAuthCapabilities()
+{
+    if (m_preAuthCapabilities.isEmpty()) {
+        // There was no LOGIN (PREAUTH), so there's nothing to compare the next greeting with
+        return;
+    }
+    model->m_preAuthCapabilitiesCache = m_preAuthCapabilities;
+    model->m_postAuthCapabilitiesCache = model->accessParser(parser).capabilities;
+}
+
 void OpenConnectionTask::onComplete()
 {
     // Optionally issue the ID command
@@ -431,6 +452,15 @@ void OpenConnectionTask::onComplete()
             model->m_taskFactory->createEnableTask(model, this, extensions)->perform();
         }
     }
+    if (model->accessParser(parser).watchedMailbox.isEmpty()) {
+        if (model->accessParser(parser).capabilities.contains(QLatin1String("NOTIFY"))) {
+            // Let the server push the changes in the other mailboxes instead of polling for them
+            model->m_taskFactory->createNotifyTask(model, this)->perform();
+        } else {
+            // ...or keep an eye on the interesting ones through additional connections
+            model->updateMailboxWatchers();
+        }
+    }
 
     // But do terminate this task
     _completed();
@@ -447,6 +477,7 @@ void OpenConnectionTask::askForAuth()
 {
     if (model->m_hasImapPassword) {
         Q_ASSERT(loginCmd.isEmpty());
+        m_preAuthCapabilities = model->accessParser(parser).capabilities;
         loginCmd = parser->login(model->m_imapUser, model->m_imapPassword);
         model->accessParser(parser).capabilitiesFresh = false;
     } else {
@@ -458,6 +489,7 @@ void OpenConnectionTask::authCredentialsNowAvailable()
 {
     if (model->accessParser(parser).connState == CONN_STATE_LOGIN && loginCmd.isEmpty()) {
         if (model->m_hasImapPassword) {
+            m_preAuthCapabilities = model->accessParser(parser).capabilities;
             loginCmd = parser->login(model->m_imapUser, model->m_imapPassword);
             model->accessParser(parser).capabilitiesFresh = false;
         } else {
@@ -78,9 +78,14 @@ private:
 
     bool checkCapabilitiesResult(const Imap::Responses::State *const resp);
 
+    /** @short Enable compression if possible, or just finish the login */
+    void compressOrComplete();
+
     /** @short Wrapper around the _completed() call for optionally launching the ID command */
     void onComplete();
 
+    void rememberPostAuthCapabilities();
+
     void abortConnection(const QString &message);
 
     void askForAuth();
@@ -90,6 +95,8 @@ private:
     CommandHandle capabilityCmd;
     CommandHandle loginCmd;
     CommandHandle compressCmd;
+    /** @short Capabilities which were in effect when the LOGIN was sent */
+    QStringList m_preAuthCapabilities;
     QList<QSslCertificate> m_sslChain;
     QList<QSslError> m_sslErrors;
 };
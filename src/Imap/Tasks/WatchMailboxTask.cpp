@@ -0,0 +1,264 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <QTimer>
+#include "WatchMailboxTask.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/MailboxTree.h"
+#include "Imap/Model/Model.h"
+#include "Imap/Model/TaskFactory.h"
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+WatchMailboxTask::WatchMailboxTask(Model *model, const QString &mailbox) :
+    ImapTask(model), m_mailbox(mailbox), m_exists(0), m_recent(0), m_unseen(0), m_synced(false), m_idling(false),
+    m_needsRecount(false)
+{
+    conn = model->m_taskFactory->createOpenConnectionTask(model);
+    ParserState &parserState = model->accessParser(conn->parser);
+    parserState.watchedMailbox = mailbox;
+    parserState.watchingTask = this;
+    conn->addDependentTask(this);
+
+    m_renewal = new QTimer(this);
+    m_renewal->setSingleShot(true);
+    bool ok;
+    int timeout = model->property("trojita-imap-idle-renewal").toUInt(&ok);
+    if (!ok)
+        timeout = 1000 * 29 * 60; // 29 minutes -- that's the longest allowed time to IDLE
+    m_renewal->setInterval(timeout);
+    connect(m_renewal, SIGNAL(timeout()), this, SLOT(slotTerminateLongIdle()));
+}
+
+void WatchMailboxTask::perform()
+{
+    parser = conn->parser;
+    markAsActiveTask();
+
+    IMAP_TASK_CHECK_ABORT_DIE;
+
+    tagExamine = parser->examine(m_mailbox);
+}
+
+void WatchMailboxTask::die(const QString &message)
+{
+    m_renewal->stop();
+    ImapTask::die(message);
+}
+
+void WatchMailboxTask::stopForLogout()
+{
+    finishIdle();
+}
+
+void WatchMailboxTask::slotTerminateLongIdle()
+{
+    finishIdle();
+}
+
+bool WatchMailboxTask::handleStateHelper(const Imap::Responses::State *const resp)
+{
+    if (resp->tag.isEmpty()) {
+        // The response codes like UIDVALIDITY or PERMANENTFLAGS are of no use here
+        return resp->kind == Responses::OK;
+    }
+
+    if (resp->tag == tagExamine) {
+        tagExamine.clear();
+        if (_dead)
+            return true;
+        if (resp->kind == Responses::OK) {
+            countUnseen();
+        } else {
+            log(QString::fromUtf8("Cannot open mailbox %1 for watching").arg(m_mailbox));
+            _failed(tr("Cannot watch mailbox %1").arg(m_mailbox));
+            model->releaseWatcherConnection(parser);
+        }
+        return true;
+    } else if (resp->tag == tagSearch) {
+        tagSearch.clear();
+        if (_dead)
+            return true;
+        if (resp->kind != Responses::OK) {
+            // Not fatal, the total number of messages is still worth reporting
+            log(QLatin1String("Cannot count the unread messages"));
+        }
+        m_synced = true;
+        publishNumbers();
+        if (m_needsRecount)
+            countUnseen();
+        else
+            enterIdle();
+        return true;
+    } else if (resp->tag == tagIdle) {
+        tagIdle.clear();
+        m_renewal->stop();
+        if (m_idling) {
+            // The server has terminated the IDLE without waiting for our DONE
+            m_idling = false;
+            if (resp->kind == Responses::OK)
+                parser->idleMagicallyTerminatedByServer();
+            else
+                parser->idleContinuationWontCome();
+        }
+        if (_dead)
+            return true;
+        if (resp->kind == Responses::OK) {
+            if (m_needsRecount)
+                countUnseen();
+            else
+                enterIdle();
+        } else {
+            log(QLatin1String("IDLE failed, cannot watch the mailbox"));
+            _failed(tr("Cannot watch mailbox %1").arg(m_mailbox));
+            model->releaseWatcherConnection(parser);
+        }
+        return true;
+    } else {
+        return false;
+    }
+}
+
+bool WatchMailboxTask::handleNumberResponse(const Imap::Responses::NumberResponse *const resp)
+{
+    switch (resp->kind) {
+    case Responses::EXISTS:
+        m_exists = resp->number;
+        messagesChanged();
+        return true;
+    case Responses::EXPUNGE:
+        if (m_exists)
+            --m_exists;
+        messagesChanged();
+        return true;
+    case Responses::RECENT:
+        m_recent = resp->number;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool WatchMailboxTask::handleFlags(const Imap::Responses::Flags *const resp)
+{
+    // The list of available flags is of no interest here
+    Q_UNUSED(resp);
+    return true;
+}
+
+bool WatchMailboxTask::handleSearch(const Imap::Responses::Search *const resp)
+{
+    if (tagSearch.isEmpty())
+        return false;
+
+    m_unseen = resp->items.size();
+    return true;
+}
+
+bool WatchMailboxTask::handleFetch(const Imap::Responses::Fetch *const resp)
+{
+    // Somebody has changed the flags, so the number of unread messages might be different now
+    Q_UNUSED(resp);
+    messagesChanged();
+    return true;
+}
+
+bool WatchMailboxTask::handleVanished(const Imap::Responses::Vanished *const resp)
+{
+    if (resp->earlier == Responses::Vanished::NOT_EARLIER)
+        m_exists -= qMin(m_exists, static_cast<uint>(resp->uids.size()));
+    messagesChanged();
+    return true;
+}
+
+/** @short Ask the server for the number of unread messages */
+void WatchMailboxTask::countUnseen()
+{
+    Q_ASSERT(tagSearch.isEmpty());
+    m_needsRecount = false;
+    tagSearch = parser->search(QStringList() << QLatin1String("UNSEEN"));
+}
+
+void WatchMailboxTask::enterIdle()
+{
+    Q_ASSERT(tagIdle.isEmpty());
+    Q_ASSERT(!m_idling);
+    tagIdle = parser->idle();
+    m_idling = true;
+    m_renewal->start();
+}
+
+void WatchMailboxTask::finishIdle()
+{
+    if (!m_idling)
+        return;
+    m_renewal->stop();
+    parser->idleDone();
+    m_idling = false;
+}
+
+/** @short The mailbox has changed; report what we know already and get out of IDLE to find out the rest */
+void WatchMailboxTask::messagesChanged()
+{
+    m_needsRecount = true;
+    if (!m_synced || _dead)
+        return;
+    publishNumbers();
+    finishIdle();
+}
+
+/** @short Update the mailbox tree the same way an unsolicited STATUS would */
+void WatchMailboxTask::publishNumbers()
+{
+    TreeItemMailbox *mailbox = model->findMailboxByName(m_mailbox);
+    if (!mailbox || mailbox->maintainingTask) {
+        // Either it's not in the tree at all, or it's selected and maintained by its KeepMailboxOpenTask
+        return;
+    }
+
+    Responses::Status::stateDataType states;
+    states[Responses::Status::MESSAGES] = m_exists;
+    states[Responses::Status::RECENT] = m_recent;
+    if (!m_needsRecount) {
+        // The number of unread messages is only reported when it matches the total
+        states[Responses::Status::UNSEEN] = m_unseen;
+    }
+    Responses::Status status(m_mailbox, states);
+    model->handleStatus(parser, &status);
+}
+
+QString WatchMailboxTask::debugIdentification() const
+{
+    return QString::fromUtf8("WatchMailboxTask: %1").arg(m_mailbox);
+}
+
+QVariant WatchMailboxTask::taskData(const int role) const
+{
+    return role == RoleTaskCompactName ? QVariant(tr("Watching mailbox %1").arg(m_mailbox)) : QVariant();
+}
+
+}
+}
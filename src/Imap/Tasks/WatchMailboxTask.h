@@ -0,0 +1,95 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef IMAP_TASK_WATCHMAILBOXTASK_H
+#define IMAP_TASK_WATCHMAILBOXTASK_H
+
+#include "ImapTask.h"
+
+class QTimer;
+
+namespace Imap
+{
+namespace Mailbox
+{
+
+/** @short Keep a mailbox open in IDLE on a dedicated connection and report the changes of its message counters
+
+This task owns a whole connection of its own. It EXAMINEs the watched mailbox, counts the unread messages and waits in
+IDLE for the server to tell about new arrivals or removals. The counters are then pushed into the mailbox tree as if
+an unsolicited STATUS response arrived for that mailbox, so the selected mailbox, which is maintained by its
+KeepMailboxOpenTask, is never touched.
+
+The task never finishes on its own; it is stopped by the Model when the mailbox is no longer watched or when the
+network goes away.
+*/
+class WatchMailboxTask : public ImapTask
+{
+    Q_OBJECT
+public:
+    WatchMailboxTask(Model *model, const QString &mailbox);
+    virtual void perform();
+    virtual void die(const QString &message);
+
+    /** @short Leave the IDLE so that the connection can be logged out */
+    void stopForLogout();
+
+    virtual bool handleStateHelper(const Imap::Responses::State *const resp);
+    virtual bool handleNumberResponse(const Imap::Responses::NumberResponse *const resp);
+    virtual bool handleFlags(const Imap::Responses::Flags *const resp);
+    virtual bool handleSearch(const Imap::Responses::Search *const resp);
+    virtual bool handleFetch(const Imap::Responses::Fetch *const resp);
+    virtual bool handleVanished(const Imap::Responses::Vanished *const resp);
+    virtual QString debugIdentification() const;
+    virtual QVariant taskData(const int role) const;
+    virtual bool needsMailbox() const {return false;}
+
+private slots:
+    void slotTerminateLongIdle();
+
+private:
+    void countUnseen();
+    void enterIdle();
+    void finishIdle();
+    void messagesChanged();
+    void publishNumbers();
+
+    ImapTask *conn;
+    QString m_mailbox;
+    CommandHandle tagExamine, tagSearch, tagIdle;
+    uint m_exists;
+    uint m_recent;
+    uint m_unseen;
+    /** @short Have the counters been determined at least once? */
+    bool m_synced;
+    /** @short Are we between sending the IDLE and the DONE? */
+    bool m_idling;
+    /** @short Has anything changed which requires counting the unread messages again? */
+    bool m_needsRecount;
+    QTimer *m_renewal;
+};
+
+}
+}
+
+#endif // IMAP_TASK_WATCHMAILBOXTASK_H
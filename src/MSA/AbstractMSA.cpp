@@ -43,7 +43,7 @@ bool AbstractMSA::supportsImapSending() const
     return false;
 }
 
-void AbstractMSA::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &data)
+void AbstractMSA::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QSharedPointer<QIODevice> &data)
 {
     Q_UNUSED(from);
     Q_UNUSED(to);
@@ -68,6 +68,20 @@ void AbstractMSA::sendImap(const QString &mailbox, const int uidValidity, const
     emit error(tr("IMAP sending is not supported by %1").arg(QString::fromUtf8(metaObject()->className())));
 }
 
+/** @short Several messages are about to be submitted through this instance
+
+Implementations which can do so should keep their connection open across the subsequent sendMail() calls. Each of
+them is still reported through its own sent() or error() signal.
+*/
+void AbstractMSA::beginSession()
+{
+}
+
+/** @short No more messages will be submitted in the current session */
+void AbstractMSA::endSession()
+{
+}
+
 void AbstractMSA::setPassword(const QString &password)
 {
     Q_UNUSED(password);
@@ -24,8 +24,11 @@
 
 #include <QByteArray>
 #include <QObject>
+#include <QSharedPointer>
 #include "Imap/Model/UidSubmitData.h"
 
+class QIODevice;
+
 namespace MSA
 {
 
@@ -37,10 +40,13 @@ public:
     virtual ~AbstractMSA();
     virtual bool supportsBurl() const;
     virtual bool supportsImapSending() const;
-    virtual void sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &data);
+    /** @short Submit a message, reading its data from an open device as they are needed */
+    virtual void sendMail(const QByteArray &from, const QList<QByteArray> &to, const QSharedPointer<QIODevice> &data);
     virtual void sendBurl(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &imapUrl);
     virtual void sendImap(const QString &mailbox, const int uidValidity, const int uid,
                           const Imap::Mailbox::UidSubmitOptionsList options);
+    virtual void beginSession();
+    virtual void endSession();
 public slots:
     virtual void cancel() = 0;
     virtual void setPassword(const QString &password);
@@ -19,6 +19,7 @@
    You should have received a copy of the GNU General Public License
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <QIODevice>
 #include "FakeMSA.h"
 
 namespace MSA
@@ -33,9 +34,9 @@ Fake::~Fake()
 {
 }
 
-void Fake::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &data)
+void Fake::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QSharedPointer<QIODevice> &data)
 {
-    emit m_factory->requestedSending(from, to, data);
+    emit m_factory->requestedSending(from, to, data->readAll());
 }
 
 void Fake::sendBurl(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &imapUrl)
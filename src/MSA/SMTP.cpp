@@ -29,13 +29,16 @@ SMTP::SMTP(QObject *parent, const QString &host, quint16 port, bool encryptedCon
            const QString &user):
     AbstractMSA(parent), host(host), port(port),
     encryptedConnect(encryptedConnect), startTls(startTls), auth(auth),
-    user(user), failed(false), isWaitingForPassword(false), sendingMode(MODE_SMTP_INVALID)
+    user(user), failed(false), isWaitingForPassword(false), sendingMode(MODE_SMTP_INVALID),
+    inSession(false), closingSession(false), connectionOpen(false), mailCommandId(0)
 {
     qwwSmtp = new QwwSmtpClient(this);
     // FIXME: handle SSL errors properly
     connect(qwwSmtp, SIGNAL(sslErrors(QList<QSslError>)), qwwSmtp, SLOT(ignoreSslErrors()));
     connect(qwwSmtp, SIGNAL(connected()), this, SIGNAL(sending()));
     connect(qwwSmtp, SIGNAL(done(bool)), this, SLOT(handleDone(bool)));
+    connect(qwwSmtp, SIGNAL(commandFinished(int,bool)), this, SLOT(handleCommandFinished(int,bool)));
+    connect(qwwSmtp, SIGNAL(disconnected()), this, SLOT(handleDisconnected()));
     connect(qwwSmtp, SIGNAL(socketError(QAbstractSocket::SocketError,QString)),
             this, SLOT(handleError(QAbstractSocket::SocketError,QString)));
 }
@@ -51,6 +54,15 @@ void SMTP::cancel()
 
 void SMTP::handleDone(bool ok)
 {
+    if (inSession || closingSession) {
+        // Within a session, the individual messages are tracked by handleCommandFinished(). A failure reported here
+        // means that the connection went away while a message was being sent.
+        if (!ok && mailCommandId) {
+            mailCommandId = 0;
+            reportFailure();
+        }
+        return;
+    }
     if (failed) {
         // This is a duplicate notification. The QwwSmtpClient is known to send contradicting results, see e.g. bug 321272.
         return;
@@ -58,17 +70,44 @@ void SMTP::handleDone(bool ok)
     if (ok) {
         emit sent();
     } else {
-        failed = true;
-        if (qwwSmtp->errorString().isEmpty())
-            emit error(tr("Sending of the message failed."));
-        else
-            emit error(tr("Sending of the message failed with the following error: %1").arg(qwwSmtp->errorString()));
+        reportFailure();
     }
 }
 
+void SMTP::reportFailure()
+{
+    failed = true;
+    if (qwwSmtp->errorString().isEmpty())
+        emit error(tr("Sending of the message failed."));
+    else
+        emit error(tr("Sending of the message failed with the following error: %1").arg(qwwSmtp->errorString()));
+}
+
+void SMTP::handleCommandFinished(int id, bool error)
+{
+    if (!inSession || id != mailCommandId)
+        return;
+    mailCommandId = 0;
+    if (error)
+        reportFailure();
+    else
+        emit sent();
+}
+
+void SMTP::handleDisconnected()
+{
+    connectionOpen = false;
+}
+
 void SMTP::handleError(QAbstractSocket::SocketError err, const QString &msg)
 {
     Q_UNUSED(err);
+    if (inSession || closingSession) {
+        // an idle connection which has died is not a reason for reporting anything
+        if (!mailCommandId)
+            return;
+        mailCommandId = 0;
+    }
     failed = true;
     emit error(msg);
 }
@@ -80,15 +119,22 @@ void SMTP::setPassword(const QString &password)
         sendContinueGotPassword();
 }
 
-void SMTP::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &data)
+void SMTP::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QSharedPointer<QIODevice> &data)
 {
     this->from = from;
     this->to = to;
-    this->data = data;
+    this->dataStream = data;
     this->sendingMode = MODE_SMTP_DATA;
-    this->isWaitingForPassword = true;
-    emit progressMax(data.size());
+    this->failed = false;
+    emit progressMax(data->size());
     emit progress(0);
+    if (inSession && connectionOpen) {
+        // The connection from the previous message of this session is still usable
+        emit sending();
+        mailCommandId = qwwSmtp->sendMail(from, to, dataStream.data());
+        return;
+    }
+    this->isWaitingForPassword = true;
     emit connecting();
     if (!auth || !pass.isEmpty()) {
         sendContinueGotPassword();
@@ -108,26 +154,23 @@ void SMTP::sendContinueGotPassword()
         qwwSmtp->startTls();
     if (auth)
         qwwSmtp->authenticate(user, pass, QwwSmtpClient::AuthAny);
+    connectionOpen = true;
     emit sending(); // FIXME: later
     switch (sendingMode) {
     case MODE_SMTP_DATA:
-        {
-            //RFC5321 specifies to prepend a period to lines starting with a period in section 4.5.2
-            if (data.startsWith('.'))
-                data.prepend('.');
-            data.replace("\n.", "\n..");
-            qwwSmtp->sendMail(from, to, data);
-        }
+        // The dot-stuffing required by RFC 5321 is performed by QwwSmtpClient as the data get sent
+        mailCommandId = qwwSmtp->sendMail(from, to, dataStream.data());
         break;
     case MODE_SMTP_BURL:
-        qwwSmtp->sendMailBurl(from, to, data);
+        mailCommandId = qwwSmtp->sendMailBurl(from, to, data);
         break;
     default:
         failed = true;
         emit error(tr("Unknown SMTP mode"));
         break;
     }
-    qwwSmtp->disconnectFromHost();
+    if (!inSession)
+        qwwSmtp->disconnectFromHost();
 }
 
 bool SMTP::supportsBurl() const
@@ -152,6 +195,21 @@ void SMTP::sendBurl(const QByteArray &from, const QList<QByteArray> &to, const Q
     emit passwordRequested(user, host);
 }
 
+/** @short Keep the connection open after each message so that it can be reused by the next one */
+void SMTP::beginSession()
+{
+    inSession = true;
+}
+
+void SMTP::endSession()
+{
+    inSession = false;
+    if (connectionOpen) {
+        closingSession = true;
+        qwwSmtp->disconnectFromHost();
+    }
+}
+
 SMTPFactory::SMTPFactory(const QString &host, quint16 port, bool encryptedConnect, bool startTls,
                          bool auth, const QString &user):
     m_host(host), m_port(port), m_encryptedConnect(encryptedConnect), m_startTls(startTls),
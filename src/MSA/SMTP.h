@@ -34,15 +34,20 @@ class SMTP : public AbstractMSA
 public:
     SMTP(QObject *parent, const QString &host, quint16 port, bool encryptedConnect, bool startTls, bool auth,
          const QString &user);
-    virtual void sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &data);
+    virtual void sendMail(const QByteArray &from, const QList<QByteArray> &to, const QSharedPointer<QIODevice> &data);
 
     virtual bool supportsBurl() const;
     virtual void sendBurl(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &imapUrl);
+    virtual void beginSession();
+    virtual void endSession();
 public slots:
     virtual void cancel();
     virtual void setPassword(const QString &password);
     void handleDone(bool ok);
     void handleError(QAbstractSocket::SocketError err, const QString &msg);
+private slots:
+    void handleCommandFinished(int id, bool error);
+    void handleDisconnected();
 private:
     QwwSmtpClient *qwwSmtp;
     QString host;
@@ -56,10 +61,16 @@ private:
     QByteArray from;
     QList<QByteArray> to;
     QByteArray data;
+    QSharedPointer<QIODevice> dataStream;
     bool isWaitingForPassword;
     enum { MODE_SMTP_INVALID, MODE_SMTP_DATA, MODE_SMTP_BURL } sendingMode;
+    bool inSession;
+    bool closingSession;
+    bool connectionOpen;
+    int mailCommandId;
 
     void sendContinueGotPassword();
+    void reportFailure();
 
     SMTP(const SMTP &); // don't implement
     SMTP &operator=(const SMTP &); // don't implement
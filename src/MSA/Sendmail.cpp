@@ -19,13 +19,14 @@
    You should have received a copy of the GNU General Public License
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <QIODevice>
 #include "Sendmail.h"
 
 namespace MSA
 {
 
 Sendmail::Sendmail(QObject *parent, const QString &command, const QStringList &args):
-    AbstractMSA(parent), command(command), args(args)
+    AbstractMSA(parent), command(command), args(args), sizeToSend(0), writtenSoFar(0)
 {
     proc = new QProcess(this);
     connect(proc, SIGNAL(started()), this, SLOT(handleStarted()));
@@ -41,11 +42,12 @@ Sendmail::~Sendmail()
     proc->waitForFinished();
 }
 
-void Sendmail::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &data)
+void Sendmail::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QSharedPointer<QIODevice> &data)
 {
+    sizeToSend = data->size();
     // first +1 for the process startup
     // second +1 for waiting for the result
-    emit progressMax(data.size() + 2);
+    emit progressMax(sizeToSend + 2);
     emit progress(0);
     QStringList myArgs = args;
     myArgs << QLatin1String("-f") << QString::fromUtf8(from);
@@ -71,8 +73,23 @@ void Sendmail::handleStarted()
     emit progress(1);
 
     emit sending();
-    proc->write(dataToSend);
-    proc->closeWriteChannel();
+    writeMoreData();
+}
+
+/** @short Feed the process with the next chunks of the message, keeping the amount of buffered data bounded */
+void Sendmail::writeMoreData()
+{
+    enum { CHUNK_SIZE = 64 * 1024, HIGH_WATER_MARK = 4 * CHUNK_SIZE };
+
+    while (dataToSend && proc->bytesToWrite() < HIGH_WATER_MARK) {
+        QByteArray chunk = dataToSend->read(CHUNK_SIZE);
+        if (chunk.isEmpty()) {
+            dataToSend.clear();
+            proc->closeWriteChannel();
+            break;
+        }
+        proc->write(chunk);
+    }
 }
 
 void Sendmail::handleError(QProcess::ProcessError e)
@@ -86,12 +103,13 @@ void Sendmail::handleBytesWritten(qint64 bytes)
     writtenSoFar += bytes;
     // +1 due to starting at one
     emit progress(writtenSoFar + 1);
+    writeMoreData();
 }
 
 void Sendmail::handleFinished(const int exitCode)
 {
     // that's the last one
-    emit progressMax(dataToSend.size() + 2);
+    emit progressMax(sizeToSend + 2);
 
     if (exitCode == 0) {
         emit sent();
@@ -36,19 +36,21 @@ class Sendmail : public AbstractMSA
 public:
     Sendmail(QObject *parent, const QString &command, const QStringList &args);
     virtual ~Sendmail();
-    virtual void sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &data);
+    virtual void sendMail(const QByteArray &from, const QList<QByteArray> &to, const QSharedPointer<QIODevice> &data);
 private slots:
     void handleError(QProcess::ProcessError e);
     void handleBytesWritten(qint64 bytes);
     void handleStarted();
     void handleFinished(const int exitCode);
+    void writeMoreData();
 public slots:
     virtual void cancel();
 private:
     QProcess *proc;
     QString command;
     QStringList args;
-    QByteArray dataToSend;
+    QSharedPointer<QIODevice> dataToSend;
+    int sizeToSend;
     int writtenSoFar;
 
     Sendmail(const Sendmail &); // don't implement
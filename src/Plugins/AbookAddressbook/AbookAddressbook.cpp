@@ -27,6 +27,8 @@
 #include "be-contacts.h"
 
 #include <QDir>
+#include <QFile>
+#include <QFileInfo>
 #include <QFileSystemWatcher>
 #include <QSettings>
 #include <QStandardItemModel>
@@ -88,7 +90,26 @@ private:
 
 };
 
-AbookAddressbook::AbookAddressbook(QObject *parent): AddressbookPlugin(parent), m_updateTimer(0)
+namespace {
+
+/** @short How long to wait before saving the list of recipients */
+const int saveRecipientsDelay = 5 * 1000;
+
+QString abookFileName()
+{
+    return QDir::homePath() + QLatin1String("/.abook/addressbook");
+}
+
+/** @short File with the addresses of recipients of sent mail, which is not a part of the abook's own format */
+QString recipientsFileName()
+{
+    return QDir::homePath() + QLatin1String("/.abook/trojita_recipients");
+}
+
+}
+
+AbookAddressbook::AbookAddressbook(QObject *parent): AddressbookPlugin(parent), m_updateTimer(0), m_saveRecipientsTimer(0),
+    m_abookSize(-1)
 {
 #define ADD(TYPE, KEY) \
     m_fields << qMakePair<Type,QString>(TYPE, QLatin1String(KEY))
@@ -111,19 +132,27 @@ AbookAddressbook::AbookAddressbook(QObject *parent): AddressbookPlugin(parent),
 #undef ADD
 
     m_contacts = new QStandardItemModel(this);
+    // The completion index follows all changes, including those made through the BE::Contacts window
+    connect(m_contacts, SIGNAL(rowsInserted(QModelIndex,int,int)), SLOT(slotContactsInserted(QModelIndex,int,int)));
+    connect(m_contacts, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)), SLOT(slotContactsAboutToBeRemoved(QModelIndex,int,int)));
+    connect(m_contacts, SIGNAL(dataChanged(QModelIndex,QModelIndex)), SLOT(slotContactsChanged(QModelIndex,QModelIndex)));
+    connect(m_contacts, SIGNAL(modelReset()), SLOT(reindexContacts()));
 
     ensureAbookPath();
 
     // read abook
     readAbook(false);
+    loadRecipients();
 
     m_filesystemWatcher = new QFileSystemWatcher(this);
-    m_filesystemWatcher->addPath(QDir::homePath() + QLatin1String("/.abook/addressbook"));
+    m_filesystemWatcher->addPath(abookFileName());
     connect (m_filesystemWatcher, SIGNAL(fileChanged(QString)), SLOT(scheduleAbookUpdate()));
 }
 
 AbookAddressbook::~AbookAddressbook()
 {
+    if (m_saveRecipientsTimer && m_saveRecipientsTimer->isActive())
+        saveRecipients();
 }
 
 AddressbookPlugin::Features AbookAddressbook::features() const
@@ -166,7 +195,7 @@ QStandardItemModel *AbookAddressbook::model() const
 
 void AbookAddressbook::remonitorAdressbook()
 {
-    m_filesystemWatcher->addPath(QDir::homePath() + QLatin1String("/.abook/addressbook"));
+    m_filesystemWatcher->addPath(abookFileName());
 }
 
 void AbookAddressbook::ensureAbookPath()
@@ -220,14 +249,31 @@ void AbookAddressbook::updateAbook()
 {
     readAbook(true);
     // QFileSystemWatcher will usually unhook from the file when it's re/written - the entire watcher ain't so great :-(
-    m_filesystemWatcher->addPath(QDir::homePath() + QLatin1String("/.abook/addressbook"));
+    m_filesystemWatcher->addPath(abookFileName());
 }
 
 void AbookAddressbook::readAbook(bool update)
 {
 //     QElapsedTimer profile;
 //     profile.start();
-    QSettings abook(QDir::homePath() + QLatin1String("/.abook/addressbook"), QSettings::IniFormat);
+    QFileInfo abookInfo(abookFileName());
+    if (update && abookInfo.lastModified() == m_abookLastModified && abookInfo.size() == m_abookSize) {
+        // The watcher fires for our own writes, too
+        return;
+    }
+    m_abookLastModified = abookInfo.lastModified();
+    m_abookSize = abookInfo.size();
+
+    // Looking the items up one by one would be quadratic
+    QHash<QString, QList<QStandardItem*> > itemsByName;
+    if (update) {
+        for (int i = 0; i < m_contacts->rowCount(); ++i) {
+            QStandardItem *item = m_contacts->item(i);
+            itemsByName[item->data(Name).toString()] << item;
+        }
+    }
+
+    QSettings abook(abookFileName(), QSettings::IniFormat);
     abook.setIniCodec("UTF-8");
     QStringList contacts = abook.childGroups();
     foreach (const QString &contact, contacts) {
@@ -235,7 +281,7 @@ void AbookAddressbook::readAbook(bool update)
         QStandardItem *item = 0;
         QStringList mails;
         if (update) {
-            QList<QStandardItem*> list = m_contacts->findItems(abook.value(QLatin1String("name")).toString());
+            QList<QStandardItem*> list = itemsByName.value(abook.value(QLatin1String("name")).toString());
             if (list.count() == 1)
                 item = list.at(0);
             else if (list.count() > 1) {
@@ -298,7 +344,7 @@ void AbookAddressbook::readAbook(bool update)
 void AbookAddressbook::saveContacts()
 {
     m_filesystemWatcher->blockSignals(true);
-    QSettings abook(QDir::homePath() + QLatin1String("/.abook/addressbook"), QSettings::IniFormat);
+    QSettings abook(abookFileName(), QSettings::IniFormat);
     abook.setIniCodec("UTF-8");
     abook.clear();
     for (int i = 0; i < m_contacts->rowCount(); ++i) {
@@ -321,70 +367,101 @@ void AbookAddressbook::saveContacts()
         }
     }
     abook.sync();
+    QFileInfo abookInfo(abookFileName());
+    m_abookLastModified = abookInfo.lastModified();
+    m_abookSize = abookInfo.size();
     m_filesystemWatcher->blockSignals(false);
 }
 
-static inline bool ignore(const QString &string, const QStringList &ignores)
+NameEmailList AbookAddressbook::complete(const QString &string, const QStringList &ignores, int max) const
+{
+    return m_index.complete(string, ignores, max);
+}
+
+QStringList AbookAddressbook::prettyNamesForAddress(const QString &mail) const
+{
+    return m_index.namesForAddress(mail);
+}
+
+void AbookAddressbook::learnRecipients(const NameEmailList &recipients)
 {
-    Q_FOREACH (const QString &ignore, ignores) {
-        if (ignore.contains(string, Qt::CaseInsensitive))
-            return true;
+    Q_FOREACH(const NameEmail &recipient, recipients) {
+        m_index.addUsage(recipient.name, recipient.email);
     }
-    return false;
+    if (!m_saveRecipientsTimer) {
+        m_saveRecipientsTimer = new QTimer(this);
+        m_saveRecipientsTimer->setSingleShot(true);
+        connect(m_saveRecipientsTimer, SIGNAL(timeout()), SLOT(saveRecipients()));
+    }
+    m_saveRecipientsTimer->start(saveRecipientsDelay);
 }
 
-NameEmailList AbookAddressbook::complete(const QString &string, const QStringList &ignores, int max) const
+void AbookAddressbook::indexContact(QStandardItem *item)
 {
-    NameEmailList list;
-    if (string.isEmpty())
-        return list;
-    // In e-mail addresses, dot, dash, _ and @ shall be treated as delimiters
-    QRegExp mailMatch = QRegExp(QString::fromUtf8("[\\.\\-_@]%1").arg(QRegExp::escape(string)), Qt::CaseInsensitive);
-    // In human readable names, match on word boundaries
-    QRegExp nameMatch = QRegExp(QString::fromUtf8("\\b%1").arg(QRegExp::escape(string)), Qt::CaseInsensitive);
-    // These REs are still not perfect, they won't match on e.g. ".net" or "-project", but screw these I say
-    for (int i = 0; i < m_contacts->rowCount(); ++i) {
-        QStandardItem *item = m_contacts->item(i);
-        QString contactName = item->data(Name).toString();
-        // several mail addresses per contact are stored newline delimited
-        QStringList contactMails(item->data(Mail).toString().split(QLatin1Char('\n'), QString::SkipEmptyParts));
-        if (contactName.contains(nameMatch)) {
-            Q_FOREACH (const QString &mail, contactMails) {
-                if (ignore(mail, ignores))
-                    continue;
-                list << NameEmail(contactName, mail);
-                if (list.count() == max)
-                    return list;
-            }
+    // several mail addresses per contact are stored newline delimited
+    m_index.setContact(reinterpret_cast<ContactIndex::Key>(item), item->data(Name).toString(),
+                       item->data(Mail).toString().split(QLatin1Char('\n'), QString::SkipEmptyParts));
+}
+
+void AbookAddressbook::slotContactsInserted(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid())
+        return;
+    for (int i = first; i <= last; ++i)
+        indexContact(m_contacts->item(i));
+}
+
+void AbookAddressbook::slotContactsAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid())
+        return;
+    for (int i = first; i <= last; ++i)
+        m_index.removeContact(reinterpret_cast<ContactIndex::Key>(m_contacts->item(i)));
+}
+
+void AbookAddressbook::slotContactsChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    if (topLeft.parent().isValid())
+        return;
+    for (int i = topLeft.row(); i <= bottomRight.row(); ++i)
+        indexContact(m_contacts->item(i));
+}
+
+void AbookAddressbook::reindexContacts()
+{
+    m_index.clearContacts();
+    for (int i = 0; i < m_contacts->rowCount(); ++i)
+        indexContact(m_contacts->item(i));
+}
+
+void AbookAddressbook::loadRecipients()
+{
+    QFile file(recipientsFileName());
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+    // Each line contains the usage count, the address and the name, separated by tabs
+    while (!file.atEnd()) {
+        const QStringList fields = QString::fromUtf8(file.readLine()).trimmed().split(QLatin1Char('\t'));
+        bool ok;
+        const int count = fields[0].toInt(&ok);
+        if (!ok || fields.size() < 2)
             continue;
-        }
-        Q_FOREACH (const QString &mail, contactMails) {
-            if (mail.startsWith(string, Qt::CaseInsensitive) ||
-                    // don't match on the TLD
-                    mail.section(QLatin1Char('.'), 0, -2).contains(mailMatch)) {
-                if (ignore(mail, ignores))
-                    continue;
-                list << NameEmail(contactName, mail);
-                if (list.count() == max)
-                    return list;
-            }
-        }
+        m_index.addUsage(fields.value(2), fields[1], count);
     }
-    return list;
 }
 
-QStringList AbookAddressbook::prettyNamesForAddress(const QString &mail) const
+void AbookAddressbook::saveRecipients()
 {
-    QStringList res;
-    for (int i = 0; i < m_contacts->rowCount(); ++i) {
-        QStandardItem *item = m_contacts->item(i);
-        if (QString::compare(item->data(Mail).toString(), mail, Qt::CaseInsensitive) == 0)
-            res << item->data(Name).toString();
+    QFile file(recipientsFileName());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return;
+    Q_FOREACH(const NameEmail &recipient, m_index.usedAddresses()) {
+        QString name = recipient.name;
+        name.replace(QLatin1Char('\t'), QLatin1Char(' ')).replace(QLatin1Char('\n'), QLatin1Char(' '));
+        file.write(QString::fromUtf8("%1\t%2\t%3\n").arg(QString::number(m_index.usage(recipient.email)), recipient.email, name).toUtf8());
     }
-    return res;
 }
 
-
 QString trojita_plugin_AbookAddressbookPlugin::name() const
 {
     return QLatin1String("abookaddressbook");
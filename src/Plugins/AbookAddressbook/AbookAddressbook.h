@@ -26,13 +26,17 @@
 #ifndef ABOOK_ADDRESSBOOK
 #define ABOOK_ADDRESSBOOK
 
+#include <QDateTime>
 #include <QObject>
 #include <QPair>
 
 #include "Plugins/AddressbookPlugin.h"
+#include "Plugins/ContactIndex.h"
 #include "Plugins/PluginInterface.h"
 
 class QFileSystemWatcher;
+class QModelIndex;
+class QStandardItem;
 class QStandardItemModel;
 class QTimer;
 
@@ -63,6 +67,7 @@ public slots:
     virtual AddressbookNamesJob *requestPrettyNamesForAddress(const QString &email);
     virtual void openAddressbookWindow();
     virtual void openContactWindow(const QString &email, const QString &displayName);
+    virtual void learnRecipients(const Plugins::NameEmailList &recipients);
 
     void saveContacts();
     void readAbook(bool update = false);
@@ -70,14 +75,27 @@ public slots:
 
 private slots:
     void scheduleAbookUpdate();
+    void slotContactsInserted(const QModelIndex &parent, int first, int last);
+    void slotContactsAboutToBeRemoved(const QModelIndex &parent, int first, int last);
+    void slotContactsChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+    void reindexContacts();
+    void saveRecipients();
 
 private:
     void ensureAbookPath();
     void remonitorAdressbook();
+    void indexContact(QStandardItem *item);
+    void loadRecipients();
 
     QFileSystemWatcher *m_filesystemWatcher;
     QTimer *m_updateTimer;
+    QTimer *m_saveRecipientsTimer;
     QStandardItemModel *m_contacts;
+    /** @short Completion index following the contents of m_contacts and the recipients of sent mail */
+    ContactIndex m_index;
+    /** @short State of the addressbook file when it was read the last time */
+    QDateTime m_abookLastModified;
+    qint64 m_abookSize;
 
     QList<QPair<Type,QString> > m_fields;
 };
@@ -43,6 +43,11 @@ AddressbookPlugin::AddressbookPlugin(QObject *parent) : QObject(parent)
 {
 }
 
+void AddressbookPlugin::learnRecipients(const NameEmailList &recipients)
+{
+    Q_UNUSED(recipients);
+}
+
 }
 
 // vim: set et ts=4 sts=4 sw=4
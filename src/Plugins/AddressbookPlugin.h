@@ -128,6 +128,11 @@ public slots:
      */
     virtual void openContactWindow(const QString &email, const QString &displayName) = 0;
 
+    /** @short Let the addressbook know that a mail has been sent to these recipients
+     *  This can be used for ranking the completions. The default implementation does nothing.
+     */
+    virtual void learnRecipients(const Plugins::NameEmailList &recipients);
+
 protected:
     AddressbookPlugin(QObject *parent);
 };
@@ -0,0 +1,238 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QSet>
+#include <QVector>
+
+#include "ContactIndex.h"
+
+namespace
+{
+
+/** @short The key of the entries which are known only because they have been used */
+const Plugins::ContactIndex::Key usedAddressKey = 0;
+
+bool isWordCharacter(const QChar c)
+{
+    return c.isLetterOrNumber() || c == QLatin1Char('_');
+}
+
+bool isMailDelimiter(const QChar c)
+{
+    return c == QLatin1Char('.') || c == QLatin1Char('-') || c == QLatin1Char('_') || c == QLatin1Char('@');
+}
+
+bool ignore(const QString &string, const QStringList &ignores)
+{
+    Q_FOREACH (const QString &ignore, ignores) {
+        if (ignore.contains(string, Qt::CaseInsensitive))
+            return true;
+    }
+    return false;
+}
+
+}
+
+namespace Plugins
+{
+
+ContactIndex::ContactIndex(): m_nextId(0)
+{
+}
+
+void ContactIndex::setContact(const Key key, const QString &name, const QStringList &mails)
+{
+    Q_ASSERT(key != usedAddressKey);
+    QHash<Key, QList<int> >::iterator contact = m_contacts.find(key);
+    if (contact != m_contacts.end()) {
+        // Address books tend to get re-read as a whole, so don't touch what hasn't changed
+        bool same = contact->size() == mails.size();
+        for (int i = 0; same && i < mails.size(); ++i) {
+            const Entry &entry = m_entries[(*contact)[i]];
+            same = entry.name == name && entry.mail == mails[i];
+        }
+        if (same)
+            return;
+        removeContact(key);
+    }
+
+    QList<int> ids;
+    Q_FOREACH(const QString &mail, mails) {
+        ids << addEntry(key, name, mail);
+    }
+    m_contacts.insert(key, ids);
+}
+
+void ContactIndex::removeContact(const Key key)
+{
+    Q_FOREACH(const int id, m_contacts.take(key)) {
+        removeEntry(id);
+    }
+}
+
+void ContactIndex::clearContacts()
+{
+    Q_FOREACH(const Key key, m_contacts.keys()) {
+        removeContact(key);
+    }
+}
+
+void ContactIndex::addUsage(const QString &name, const QString &mail, const int count)
+{
+    const QString folded = mail.toCaseFolded();
+    if (folded.isEmpty())
+        return;
+    m_usage[folded] += count;
+
+    QHash<QString, int>::const_iterator it = m_usedEntries.constFind(folded);
+    if (it != m_usedEntries.constEnd()) {
+        if (name.isEmpty() || m_entries[*it].name == name)
+            return;
+        // Remember the most recent name
+        removeEntry(*it);
+    }
+    m_usedEntries[folded] = addEntry(usedAddressKey, name, mail);
+}
+
+int ContactIndex::usage(const QString &mail) const
+{
+    return m_usage.value(mail.toCaseFolded());
+}
+
+NameEmailList ContactIndex::usedAddresses() const
+{
+    NameEmailList res;
+    Q_FOREACH(const int id, m_usedEntries) {
+        const Entry &entry = m_entries[id];
+        res << NameEmail(entry.name, entry.mail);
+    }
+    return res;
+}
+
+NameEmailList ContactIndex::complete(const QString &input, const QStringList &ignores, int max) const
+{
+    NameEmailList res;
+    const QString folded = input.toCaseFolded();
+    if (folded.isEmpty() || max == 0)
+        return res;
+
+    QSet<int> matching;
+    for (QMultiMap<QString, int>::const_iterator it = m_tokens.lowerBound(folded);
+         it != m_tokens.constEnd() && it.key().startsWith(folded); ++it) {
+        matching.insert(*it);
+    }
+
+    // The most frequently used addresses go first, otherwise keep the order in which the entries were added
+    QVector<QPair<int, int> > ranked;
+    ranked.reserve(matching.size());
+    Q_FOREACH(const int id, matching) {
+        const Entry &entry = m_entries[id];
+        if (entry.key == usedAddressKey && m_contactMails.contains(entry.foldedMail)) {
+            // The address book knows better
+            continue;
+        }
+        ranked << qMakePair(-m_usage.value(entry.foldedMail), id);
+    }
+    qSort(ranked);
+
+    for (int i = 0; i < ranked.size() && res.size() != max; ++i) {
+        const Entry &entry = m_entries[ranked[i].second];
+        if (ignore(entry.mail, ignores))
+            continue;
+        res << NameEmail(entry.name, entry.mail);
+    }
+    return res;
+}
+
+QStringList ContactIndex::namesForAddress(const QString &mail) const
+{
+    QList<int> ids = m_contactMails.values(mail.toCaseFolded());
+    qSort(ids);
+    QStringList res;
+    Q_FOREACH(const int id, ids) {
+        res << m_entries[id].name;
+    }
+    return res;
+}
+
+int ContactIndex::addEntry(const Key key, const QString &name, const QString &mail)
+{
+    const int id = m_nextId++;
+    Entry entry;
+    entry.key = key;
+    entry.name = name;
+    entry.mail = mail;
+    entry.foldedMail = mail.toCaseFolded();
+    m_entries.insert(id, entry);
+
+    QSet<QString> tokens = (nameTokens(name) + mailTokens(mail)).toSet();
+    Q_FOREACH(const QString &token, tokens) {
+        m_tokens.insert(token, id);
+    }
+    if (key != usedAddressKey)
+        m_contactMails.insert(entry.foldedMail, id);
+    return id;
+}
+
+void ContactIndex::removeEntry(const int id)
+{
+    const Entry entry = m_entries.take(id);
+    QSet<QString> tokens = (nameTokens(entry.name) + mailTokens(entry.mail)).toSet();
+    Q_FOREACH(const QString &token, tokens) {
+        m_tokens.remove(token, id);
+    }
+    if (entry.key != usedAddressKey)
+        m_contactMails.remove(entry.foldedMail, id);
+}
+
+/** @short Each word of the name can be completed along with the rest of the name following it */
+QStringList ContactIndex::nameTokens(const QString &name)
+{
+    QStringList res;
+    const QString folded = name.toCaseFolded();
+    for (int i = 0; i < folded.size(); ++i) {
+        if (isWordCharacter(folded[i]) && (i == 0 || !isWordCharacter(folded[i - 1])))
+            res << folded.mid(i);
+    }
+    return res;
+}
+
+/** @short The whole address can be completed, and so can its delimited parts except for the TLD */
+QStringList ContactIndex::mailTokens(const QString &mail)
+{
+    QStringList res;
+    const QString folded = mail.toCaseFolded();
+    if (folded.isEmpty())
+        return res;
+    res << folded;
+    // Matching on the TLD would just add noise
+    const QString withoutTld = folded.section(QLatin1Char('.'), 0, -2);
+    for (int i = 0; i < withoutTld.size() - 1; ++i) {
+        if (isMailDelimiter(withoutTld[i]))
+            res << withoutTld.mid(i + 1);
+    }
+    return res;
+}
+
+}
+
+// vim: set et ts=4 sts=4 sw=4
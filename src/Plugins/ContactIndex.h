@@ -0,0 +1,106 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TROJITA_PLUGINS_CONTACT_INDEX
+#define TROJITA_PLUGINS_CONTACT_INDEX
+
+#include <QHash>
+#include <QMap>
+#include <QStringList>
+
+#include "AddressbookPlugin.h"
+
+namespace Plugins
+{
+
+/** @short In-memory index for completing names and e-mail addresses
+
+Contacts are identified by an opaque key chosen by the caller. They can be added, updated and removed one by one, so
+that the index can follow the changes of an address book without being rebuilt from scratch.
+
+Completion works on word boundaries in the names, and on the whole e-mail addresses as well as on those of their parts
+which follow a ".", "-", "_" or "@" -- except for the top-level domain. The results are ranked by how many times the
+address has been used, see addUsage().
+*/
+class PLUGINS_EXPORT ContactIndex
+{
+public:
+    /** @short Identification of a contact; zero is reserved */
+    typedef quintptr Key;
+
+    ContactIndex();
+
+    /** @short Add a contact with the given @arg name and e-mail addresses, or update an existing one */
+    void setContact(const Key key, const QString &name, const QStringList &mails);
+    /** @short Remove a contact from the index */
+    void removeContact(const Key key);
+    /** @short Remove all contacts, but keep the usage statistics */
+    void clearContacts();
+
+    /** @short Record that mail was sent to the given address
+
+    Addresses which are not part of any contact are offered for completion as well.
+    */
+    void addUsage(const QString &name, const QString &mail, const int count = 1);
+    /** @short How many times was the given address used? */
+    int usage(const QString &mail) const;
+    /** @short Return all addresses with a usage record, along with the most recently used names */
+    NameEmailList usedAddresses() const;
+
+    /** @short Return at most @arg max (or all, if negative) matches for the @arg input, skipping the @arg ignores */
+    NameEmailList complete(const QString &input, const QStringList &ignores, int max = -1) const;
+    /** @short Return names of all contacts which use the given e-mail address */
+    QStringList namesForAddress(const QString &mail) const;
+
+private:
+    struct Entry {
+        Key key;
+        QString name;
+        QString mail;
+        QString foldedMail;
+    };
+
+    int addEntry(const Key key, const QString &name, const QString &mail);
+    void removeEntry(const int id);
+    static QStringList nameTokens(const QString &name);
+    static QStringList mailTokens(const QString &mail);
+
+    /** @short All (name, address) pairs, indexed by an ID which reflects the order in which they were added */
+    QHash<int, Entry> m_entries;
+    /** @short IDs of entries which belong to a particular contact */
+    QHash<Key, QList<int> > m_contacts;
+    /** @short Case-folded strings which can be completed, pointing to the IDs of matching entries */
+    QMultiMap<QString, int> m_tokens;
+    /** @short Case-folded e-mail addresses of contacts, pointing to the IDs of matching entries */
+    QMultiHash<QString, int> m_contactMails;
+    /** @short Entries for those addresses which have been used, indexed by the case-folded address */
+    QHash<QString, int> m_usedEntries;
+    /** @short Usage count of case-folded e-mail addresses */
+    QHash<QString, int> m_usage;
+    int m_nextId;
+};
+
+}
+
+#endif // TROJITA_PLUGINS_CONTACT_INDEX
+
+// vim: set et ts=4 sts=4 sw=4
@@ -39,6 +39,7 @@ IODeviceSocket::IODeviceSocket(QIODevice *device): d(device), m_compressor(0), m
 {
     connect(d, SIGNAL(readyRead()), this, SLOT(handleReadyRead()));
     connect(d, SIGNAL(readChannelFinished()), this, SLOT(handleStateChanged()));
+    connect(d, SIGNAL(bytesWritten(qint64)), this, SIGNAL(bytesWritten(qint64)));
     delayedDisconnect = new QTimer();
     delayedDisconnect->setSingleShot(true);
     connect(delayedDisconnect, SIGNAL(timeout()), this, SLOT(emitError()));
@@ -96,6 +97,11 @@ qint64 IODeviceSocket::write(const QByteArray &byteArray)
     return d->write(byteArray);
 }
 
+qint64 IODeviceSocket::bytesToWrite() const
+{
+    return d->bytesToWrite();
+}
+
 void IODeviceSocket::startTls()
 {
     QSslSocket *sock = qobject_cast<QSslSocket *>(d);
@@ -240,6 +246,13 @@ SslTlsSocket::SslTlsSocket(QSslSocket *sock, const QString &host, const quint16
     sock->setSslConfiguration(sslConf);
 #endif
 
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+    // Reconnecting is much faster when the TLS session can be resumed, see setSessionTicket()
+    sslConf = sock->sslConfiguration();
+    sslConf.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    sock->setSslConfiguration(sslConf);
+#endif
+
     connect(sock, SIGNAL(encrypted()), this, SIGNAL(encrypted()));
     connect(sock, SIGNAL(stateChanged(QAbstractSocket::SocketState)), this, SLOT(handleStateChanged()));
     connect(sock, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(handleSocketError(QAbstractSocket::SocketError)));
@@ -413,4 +426,34 @@ bool SslTlsSocket::isConnectingEncryptedSinceStart() const
     return startEncrypted;
 }
 
+/** @short Return the ticket for resuming the TLS session, or an empty byte array if it is not available */
+QByteArray SslTlsSocket::sessionTicket() const
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+    QSslSocket *sock = qobject_cast<QSslSocket *>(d);
+    Q_ASSERT(sock);
+    return sock->sslConfiguration().sessionTicket();
+#else
+    return QByteArray();
+#endif
+}
+
+/** @short Try to resume a previous TLS session instead of doing the full handshake
+
+This has to be called before the connection is established. The server is free to ignore the ticket, in which case
+the full handshake is performed as usual.
+*/
+void SslTlsSocket::setSessionTicket(const QByteArray &ticket)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+    QSslSocket *sock = qobject_cast<QSslSocket *>(d);
+    Q_ASSERT(sock);
+    QSslConfiguration sslConf = sock->sslConfiguration();
+    sslConf.setSessionTicket(ticket);
+    sock->setSslConfiguration(sslConf);
+#else
+    Q_UNUSED(ticket);
+#endif
+}
+
 }
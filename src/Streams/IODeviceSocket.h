@@ -47,6 +47,7 @@ public:
     virtual QByteArray read(qint64 maxSize);
     virtual QByteArray readLine(qint64 maxSize = 0);
     virtual qint64 write(const QByteArray &byteArray);
+    virtual qint64 bytesToWrite() const;
     virtual void startTls();
     virtual void startDeflate();
     virtual bool isDead() = 0;
@@ -97,6 +98,8 @@ public:
     virtual QList<QSslError> sslErrors() const;
     bool isConnectingEncryptedSinceStart() const;
     virtual void close();
+    QByteArray sessionTicket() const;
+    void setSessionTicket(const QByteArray &ticket);
 private slots:
     void handleStateChanged();
     void handleSocketError(QAbstractSocket::SocketError);
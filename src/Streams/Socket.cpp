@@ -33,6 +33,11 @@ bool Socket::isConnectingEncryptedSinceStart() const
     return false;
 }
 
+qint64 Socket::bytesToWrite() const
+{
+    return 0;
+}
+
 
 QList<QSslCertificate> Socket::sslChain() const
 {
@@ -52,6 +52,9 @@ public:
     /** @short Write the contents of the @arg byteArray buffer to the socket */
     virtual qint64 write(const QByteArray &byteArray) = 0;
 
+    /** @short Return the number of bytes which were passed to write(), but which haven't been sent yet */
+    virtual qint64 bytesToWrite() const;
+
     /** @short Negotiate and start encryption with the remote peer
 
       Please note that this function can throw an exception if the
@@ -89,6 +92,9 @@ signals:
 
     /** @short The socket is now encrypted */
     void encrypted();
+
+    /** @short Some of the buffered outgoing data have been sent */
+    void bytesWritten(qint64 bytes);
 };
 
 }
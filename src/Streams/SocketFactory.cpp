@@ -43,6 +43,17 @@ bool SocketFactory::startTlsRequired()
     return m_startTls;
 }
 
+/** @short Keep the ticket of a freshly established TLS session so that the next connection can resume it */
+void SocketFactory::rememberTlsSessionTicket()
+{
+    SslTlsSocket *sock = qobject_cast<SslTlsSocket *>(sender());
+    if (!sock)
+        return;
+    QByteArray ticket = sock->sessionTicket();
+    if (!ticket.isEmpty())
+        m_tlsSessionTicket = ticket;
+}
+
 ProcessSocketFactory::ProcessSocketFactory(
     const QString &executable, const QStringList &args):
     executable(executable), args(args)
@@ -77,6 +88,8 @@ Socket *SslSocketFactory::create()
     QSslSocket *sslSock = new QSslSocket();
     SslTlsSocket *sock = new SslTlsSocket(sslSock, host, port, true);
     sock->setProxySettings(m_proxySettings, m_protocolTag);
+    sock->setSessionTicket(m_tlsSessionTicket);
+    connect(sock, SIGNAL(encrypted()), this, SLOT(rememberTlsSessionTicket()));
     return sock;
 }
 
@@ -97,6 +110,8 @@ Socket *TlsAbleSocketFactory::create()
     QSslSocket *sslSock = new QSslSocket();
     SslTlsSocket *sock = new SslTlsSocket(sslSock, host, port);
     sock->setProxySettings(m_proxySettings, m_protocolTag);
+    sock->setSessionTicket(m_tlsSessionTicket);
+    connect(sock, SIGNAL(encrypted()), this, SLOT(rememberTlsSessionTicket()));
     return sock;
 }
 
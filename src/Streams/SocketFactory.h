@@ -52,6 +52,11 @@ public:
     bool startTlsRequired();
 signals:
     void error(const QString &);
+protected slots:
+    void rememberTlsSessionTicket();
+protected:
+    /** @short Ticket of the last TLS session to be offered for resumption by the new connections */
+    QByteArray m_tlsSessionTicket;
 };
 
 /** @short Manufacture sockets based on QProcess */
@@ -0,0 +1,244 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QRegExp>
+#include <QThread>
+#include <QTimer>
+#include "IncrementalPlainTextFormatter.h"
+
+namespace UiUtils {
+
+/** @short Roughly one screenful of text which gets formatted synchronously */
+static const int defaultFirstChunkSize = 8 * 1024;
+/** @short Size of the chunks which are formatted by the worker thread */
+static const int defaultChunkSize = 256 * 1024;
+
+const int IncrementalPlainTextFormatter::minimalIncrementalSize = 64 * 1024;
+
+/** @short Split the text into pieces which can be passed to plainTextToHtml independently
+
+The split only happens between two unquoted lines, never inside a format=flowed paragraph and never after the
+signature separator, so that the concatenation of the formatted chunks looks the same as if the whole text was
+formatted at once. Each chunk (except the last one) is at least as big as the requested size, and all of them
+except the last one end with a newline.
+*/
+QStringList splitPlainTextForIncrementalFormatting(const QString &plaintext, const FlowedFormat flowed,
+                                                   const int firstChunkSize, const int chunkSize)
+{
+    QStringList res;
+    const QRegExp signatureSeparatorRe = signatureSeparator();
+    int chunkStart = 0;
+    int lineStart = 0;
+    bool previousCanEndChunk = false;
+
+    while (lineStart < plaintext.size()) {
+        int lineEnd = plaintext.indexOf(QLatin1Char('\n'), lineStart);
+        if (lineEnd == -1)
+            lineEnd = plaintext.size();
+        int contentEnd = lineEnd;
+        if (contentEnd > lineStart && plaintext.at(contentEnd - 1) == QLatin1Char('\r'))
+            --contentEnd;
+
+        const QChar firstChar = contentEnd > lineStart ? plaintext.at(lineStart) : QChar();
+        const bool quoted = firstChar == QLatin1Char('>') ||
+                (flowed == FlowedFormat::PLAIN && firstChar == QLatin1Char(' ') && lineStart + 1 < contentEnd
+                 && plaintext.at(lineStart + 1) == QLatin1Char('>'));
+
+        if (previousCanEndChunk && !quoted && lineStart - chunkStart >= (res.isEmpty() ? firstChunkSize : chunkSize)) {
+            res << plaintext.mid(chunkStart, lineStart - chunkStart);
+            chunkStart = lineStart;
+        }
+
+        if ((firstChar == QLatin1Char('-') || firstChar == QLatin1Char('_'))
+                && signatureSeparatorRe.exactMatch(plaintext.mid(lineStart, lineEnd - lineStart))) {
+            // Everything till the end is a signature which is formatted as a single block
+            break;
+        }
+
+        // A line with a trailing space is continued on the next one when format=flowed is in effect
+        previousCanEndChunk = !quoted && (flowed == FlowedFormat::PLAIN || contentEnd == lineStart
+                                          || plaintext.at(contentEnd - 1) != QLatin1Char(' '));
+        lineStart = lineEnd + 1;
+    }
+
+    res << plaintext.mid(chunkStart);
+    return res;
+}
+
+/** @short Split the formatted markup into pieces which can be appended to the document one by one
+
+The split only happens after a newline which is not enclosed in any element, so that each piece is a well-formed
+fragment. The size requirements are the same as in splitPlainTextForIncrementalFormatting().
+*/
+QStringList splitMarkupForIncrementalDisplay(const QString &markup, const int firstChunkSize, const int chunkSize)
+{
+    QStringList res;
+    int chunkStart = 0;
+    int depth = 0;
+
+    for (int i = 0; i < markup.size(); ++i) {
+        const QChar c = markup.at(i);
+        if (c == QLatin1Char('<')) {
+            // The text itself is escaped, so this is always a tag
+            const int tagEnd = markup.indexOf(QLatin1Char('>'), i);
+            if (tagEnd == -1)
+                break;
+            if (markup.at(i + 1) == QLatin1Char('/'))
+                --depth;
+            else if (markup.at(tagEnd - 1) != QLatin1Char('/') && markup.at(i + 1) != QLatin1Char('!'))
+                ++depth;
+            i = tagEnd;
+        } else if (c == QLatin1Char('\n') && depth == 0
+                   && i + 1 - chunkStart >= (res.isEmpty() ? firstChunkSize : chunkSize)) {
+            res << markup.mid(chunkStart, i + 1 - chunkStart);
+            chunkStart = i + 1;
+        }
+    }
+
+    if (res.isEmpty() || chunkStart < markup.size())
+        res << markup.mid(chunkStart);
+    return res;
+}
+
+IncrementalPlainTextFormatter::IncrementalPlainTextFormatter(QObject *parent):
+    QObject(parent), m_thread(0), m_worker(0)
+{
+}
+
+IncrementalPlainTextFormatter::~IncrementalPlainTextFormatter()
+{
+    cancel();
+}
+
+/** @short Format the first screenful of text and start processing the rest in the background
+
+This function can only be called once for each instance.
+*/
+QString IncrementalPlainTextFormatter::start(const QString &plaintext, const FlowedFormat flowed)
+{
+    Q_ASSERT(!m_thread);
+
+    QStringList chunks = splitPlainTextForIncrementalFormatting(plaintext, flowed,
+                                                                defaultFirstChunkSize, defaultChunkSize);
+    Q_ASSERT(!chunks.isEmpty());
+    int interactiveControlsId = 0;
+    QString firstScreen = plainTextToHtml(chunks.takeFirst(), flowed, &interactiveControlsId);
+    m_markup = firstScreen;
+
+    if (chunks.isEmpty()) {
+        QTimer::singleShot(0, this, SIGNAL(finished()));
+        return firstScreen;
+    }
+
+    m_thread = new QThread(this);
+    m_worker = new PlainTextFormatterWorker(chunks, flowed, interactiveControlsId);
+    m_worker->moveToThread(m_thread);
+    connect(m_thread, SIGNAL(started()), m_worker, SLOT(run()));
+    connect(m_worker, SIGNAL(chunkReady(QString)), this, SLOT(slotChunkFormatted(QString)));
+    connect(m_worker, SIGNAL(finished()), this, SIGNAL(finished()));
+    connect(m_worker, SIGNAL(finished()), m_thread, SLOT(quit()));
+    m_thread->start(QThread::LowPriority);
+    return firstScreen;
+}
+
+void IncrementalPlainTextFormatter::slotChunkFormatted(const QString &html)
+{
+    m_markup += html;
+    emit chunkReady(html);
+}
+
+/** @short Return the complete markup of the text passed to start()
+
+The result is only complete after finished() has been emitted.
+*/
+QString IncrementalPlainTextFormatter::markup() const
+{
+    return m_markup;
+}
+
+/** @short Return the first screenful of already formatted @arg markup and deliver the rest through chunkReady()
+
+This function can only be called once for each instance, and not after start().
+*/
+QString IncrementalPlainTextFormatter::replay(const QString &markup)
+{
+    Q_ASSERT(!m_thread);
+    Q_ASSERT(m_replayedChunks.isEmpty());
+
+    m_replayedChunks = splitMarkupForIncrementalDisplay(markup, defaultFirstChunkSize, defaultChunkSize);
+    const QString firstScreen = m_replayedChunks.takeFirst();
+    QTimer::singleShot(0, this, m_replayedChunks.isEmpty() ? SIGNAL(finished()) : SLOT(slotReplayNextChunk()));
+    return firstScreen;
+}
+
+void IncrementalPlainTextFormatter::slotReplayNextChunk()
+{
+    if (m_replayedChunks.isEmpty())
+        return;
+    emit chunkReady(m_replayedChunks.takeFirst());
+    if (m_replayedChunks.isEmpty())
+        emit finished();
+    else
+        QTimer::singleShot(0, this, SLOT(slotReplayNextChunk()));
+}
+
+/** @short Stop the worker thread and discard any data which were not formatted yet */
+void IncrementalPlainTextFormatter::cancel()
+{
+    m_replayedChunks.clear();
+    if (!m_thread)
+        return;
+
+    m_worker->cancel();
+    m_thread->quit();
+    m_thread->wait();
+    delete m_worker;
+    m_worker = 0;
+    delete m_thread;
+    m_thread = 0;
+}
+
+PlainTextFormatterWorker::PlainTextFormatterWorker(const QStringList &chunks, const FlowedFormat flowed,
+                                                   const int interactiveControlsId):
+    QObject(0), m_chunks(chunks), m_flowed(flowed), m_interactiveControlsId(interactiveControlsId), m_cancelled(0)
+{
+}
+
+/** @short Request the processing to stop as soon as possible; this is safe to call from any thread */
+void PlainTextFormatterWorker::cancel()
+{
+    m_cancelled.fetchAndStoreOrdered(1);
+}
+
+void PlainTextFormatterWorker::run()
+{
+    Q_FOREACH(const QString &chunk, m_chunks) {
+        // testAndSet is used as a plain read which works with both Qt4 and Qt5
+        if (m_cancelled.testAndSetOrdered(1, 1))
+            break;
+        emit chunkReady(plainTextToHtml(chunk, m_flowed, &m_interactiveControlsId));
+    }
+    m_chunks.clear();
+    emit finished();
+}
+
+}
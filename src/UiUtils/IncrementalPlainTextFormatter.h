@@ -0,0 +1,112 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TROJITA_UIUTILS_INCREMENTALPLAINTEXTFORMATTER_H
+#define TROJITA_UIUTILS_INCREMENTALPLAINTEXTFORMATTER_H
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QStringList>
+#include "UiUtils/PlainTextFormatter.h"
+
+class QThread;
+
+namespace UiUtils {
+
+QStringList splitPlainTextForIncrementalFormatting(const QString &plaintext, const FlowedFormat flowed,
+                                                   const int firstChunkSize, const int chunkSize);
+QStringList splitMarkupForIncrementalDisplay(const QString &markup, const int firstChunkSize, const int chunkSize);
+
+class PlainTextFormatterWorker;
+
+/** @short Convert a huge text/plain part to HTML in a background thread
+
+The first screenful of data is converted synchronously by start() so that there is something to show right away. The
+rest of the text is split into chunks at places where no quotation or format=flowed paragraph spans the boundary,
+and these chunks are formatted by a worker thread. Each of them is delivered through the chunkReady() signal, in
+order, and it is safe to just append them to the markup which was returned from start(). The complete markup is
+collected by the formatter itself and is available from markup() once finished() has been emitted, no matter what
+the receivers of chunkReady() did with the individual pieces.
+
+The markup which was formatted before can be shown the same way through replay(), which hands it over in chunks
+from the event loop so that feeding a huge document to the web view does not block the UI either.
+
+Destroying this object cancels any pending work.
+*/
+class IncrementalPlainTextFormatter: public QObject
+{
+    Q_OBJECT
+public:
+    explicit IncrementalPlainTextFormatter(QObject *parent);
+    virtual ~IncrementalPlainTextFormatter();
+
+    QString start(const QString &plaintext, const FlowedFormat flowed);
+    QString replay(const QString &markup);
+    QString markup() const;
+
+    /** @short Texts smaller than this are not worth the overhead of a worker thread */
+    static const int minimalIncrementalSize;
+
+signals:
+    void chunkReady(const QString &html);
+    void finished();
+
+private slots:
+    void slotChunkFormatted(const QString &html);
+    void slotReplayNextChunk();
+
+private:
+    void cancel();
+
+    QThread *m_thread;
+    PlainTextFormatterWorker *m_worker;
+    /** @short Already formatted chunks which are waiting for replay() to deliver them */
+    QStringList m_replayedChunks;
+    /** @short Markup of the text passed to start() which has been formatted so far */
+    QString m_markup;
+};
+
+/** @short Internal helper of IncrementalPlainTextFormatter living in the worker thread */
+class PlainTextFormatterWorker: public QObject
+{
+    Q_OBJECT
+public:
+    PlainTextFormatterWorker(const QStringList &chunks, const FlowedFormat flowed, const int interactiveControlsId);
+    void cancel();
+
+public slots:
+    void run();
+
+signals:
+    void chunkReady(const QString &html);
+    void finished();
+
+private:
+    QStringList m_chunks;
+    FlowedFormat m_flowed;
+    int m_interactiveControlsId;
+    QAtomicInt m_cancelled;
+};
+
+}
+
+#endif // TROJITA_UIUTILS_INCREMENTALPLAINTEXTFORMATTER_H
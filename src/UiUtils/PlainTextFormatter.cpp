@@ -39,107 +39,292 @@
 
 namespace UiUtils {
 
-/** @short Helper for plainTextToHtml for applying the HTML formatting
+namespace {
 
-This function recognizes http and https links, e-mail addresses, *bold*, /italic/ and _underline_ text.
+/** @short Is there an escaped ampersand ("&amp;") at the given position? */
+inline bool isEscapedAmpersandAt(const QString &line, const int pos)
+{
+    return pos + 4 < line.size() && line.at(pos) == QLatin1Char('&') && line.at(pos + 1) == QLatin1Char('a')
+            && line.at(pos + 2) == QLatin1Char('m') && line.at(pos + 3) == QLatin1Char('p')
+            && line.at(pos + 4) == QLatin1Char(';');
+}
+
+/** @short Does the line contain the specified ASCII text at the given position? */
+inline bool hasLatin1At(const QString &line, const int pos, const char *what)
+{
+    for (int i = 0; what[i]; ++i) {
+        if (pos + i >= line.size() || line.at(pos + i) != QLatin1Char(what[i]))
+            return false;
+    }
+    return true;
+}
+
+inline bool isAsciiAlnum(const ushort c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+/** @short Characters which can appear anywhere in a hyperlink */
+inline bool isUrlChar(const QChar ch)
+{
+    const ushort c = ch.unicode();
+    if (isAsciiAlnum(c))
+        return true;
+    switch (c) {
+    case ';': case '/': case '?': case ':': case '@': case '=': case '$': case '-': case '_': case '.': case '+':
+    case '!': case '\'': case ',': case '%': case '#': case '~': case '[': case ']': case '(': case ')': case '*':
+        return true;
+    default:
+        return false;
+    }
+}
+
+/** @short Characters which can terminate a hyperlink
+
+The punctuation which is likely part of the surrounding sentence is not included.
 */
-QString helperHtmlifySingleLine(QString line)
+inline bool isUrlTerminator(const QChar ch)
 {
-    // Static regexps for the engine construction.
-    // Warning, these operate on the *escaped* HTML!
-#define HTML_RE_INTRO "(^|[\\s\\(\\[\\{])"
-#define HTML_RE_EXTRO "($|[\\s\\),;.\\]\\}])"
-    static const QRegExp patternRe(QLatin1String(
-                // hyperlinks
-                "(" // cap(1)
-                "https?://" // scheme prefix
-                "(?:[;/?:@=$\\-_.+!',0-9a-zA-Z%#~\\[\\]\\(\\)\\*]|&amp;)+" // allowed characters
-                "(?:[/@=$\\-_+'0-9a-zA-Z%#~]|&amp;)" // termination
-                ")"
-                // end of hyperlink
-                "|"
-                // e-mail pattern
-                "((?:[a-zA-Z0-9_\\.!#$%'\\*\\+\\-/=?^`\\{|\\}~]|&amp;)+@[a-zA-Z0-9\\.\\-_]+)" // cap(2)
-                // end of e-mail pattern
-                "|"
-                // formatting markup
-                "(" // cap(3)
-                // bold text
-                HTML_RE_INTRO /* cap(4) */ "\\*((?!\\*)\\S+)\\*" /* cap(5) */ HTML_RE_EXTRO /* cap(6) */
-                "|"
-                // italics
-                HTML_RE_INTRO /* cap(7) */ "/((?!/)\\S+)/" /* cap(8) */ HTML_RE_EXTRO /* cap(9) */
-                "|"
-                // underline
-                HTML_RE_INTRO /* cap(10) */ "_((?!_)\\S+)_" /* cap(11) */ HTML_RE_EXTRO /* cap(12) */
-                ")"
-                // end of the formatting markup
-                ), Qt::CaseSensitive, QRegExp::RegExp2
-                );
-
-    // RE instances to work on
-    QRegExp pattern(patternRe);
+    const ushort c = ch.unicode();
+    if (isAsciiAlnum(c))
+        return true;
+    switch (c) {
+    case '/': case '@': case '=': case '$': case '-': case '_': case '+': case '\'': case '%': case '#': case '~':
+        return true;
+    default:
+        return false;
+    }
+}
 
-    // Escape the HTML entities
-#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
-    line = Qt::escape(line);
-#else
-    line = line.toHtmlEscaped();
-#endif
+/** @short Characters allowed in the local part of an e-mail address */
+inline bool isMailLocalChar(const QChar ch)
+{
+    const ushort c = ch.unicode();
+    if (isAsciiAlnum(c))
+        return true;
+    switch (c) {
+    case '_': case '.': case '!': case '#': case '$': case '%': case '\'': case '*': case '+': case '-': case '/':
+    case '=': case '?': case '^': case '`': case '{': case '|': case '}': case '~':
+        return true;
+    default:
+        return false;
+    }
+}
 
-    // Now prepare markup *bold*, /italic/ and _underline_ and also turn links into HTML.
-    // This is a bit more involved because we want to apply the regular expressions in a certain order and also at the same
-    // time prevent the lower-priority regexps from clobbering the output of the previous stages.
-    int start = 0;
-    while (start < line.size()) {
-        // Find the position of the first thing which matches
-        int pos = pattern.indexIn(line, start, QRegExp::CaretAtOffset);
-        if (pos == -1 || pos == line.size()) {
-            // No further matches for this line -> we're done
+/** @short Characters allowed in the domain part of an e-mail address */
+inline bool isMailDomainChar(const QChar ch)
+{
+    const ushort c = ch.unicode();
+    return isAsciiAlnum(c) || c == '.' || c == '-' || c == '_';
+}
+
+inline bool isMarkupChar(const QChar ch)
+{
+    return ch == QLatin1Char('*') || ch == QLatin1Char('/') || ch == QLatin1Char('_');
+}
+
+/** @short Characters which can precede the *bold*, /italic/ and _underline_ markup */
+inline bool isMarkupIntro(const QChar ch)
+{
+    return ch.isSpace() || ch == QLatin1Char('(') || ch == QLatin1Char('[') || ch == QLatin1Char('{');
+}
+
+/** @short Characters which can follow the *bold*, /italic/ and _underline_ markup */
+inline bool isMarkupExtro(const QChar ch)
+{
+    return ch.isSpace() || ch == QLatin1Char(')') || ch == QLatin1Char(',') || ch == QLatin1Char(';')
+            || ch == QLatin1Char('.') || ch == QLatin1Char(']') || ch == QLatin1Char('}');
+}
+
+/** @short Return the length of a http or https link which starts at @arg pos, or zero if there's none */
+int urlLengthAt(const QString &line, const int pos)
+{
+    int i;
+    if (hasLatin1At(line, pos, "http://")) {
+        i = pos + 7;
+    } else if (hasLatin1At(line, pos, "https://")) {
+        i = pos + 8;
+    } else {
+        return 0;
+    }
+
+    // The link has to contain at least one character before the one which terminates it
+    const int bodyStart = i;
+    int end = -1;
+    while (i < line.size()) {
+        int unitLength = 1;
+        bool canTerminate;
+        if (isEscapedAmpersandAt(line, i)) {
+            unitLength = 5;
+            canTerminate = true;
+        } else if (isUrlChar(line.at(i))) {
+            canTerminate = isUrlTerminator(line.at(i));
+        } else {
             break;
         }
+        if (canTerminate && i > bodyStart)
+            end = i + unitLength;
+        i += unitLength;
+    }
+    return end == -1 ? 0 : end - pos;
+}
 
-        const QString &linkText = pattern.cap(1);
-        const QString &mailText = pattern.cap(2);
-        const QString &boldText = pattern.cap(5);
-        const QString &italicText = pattern.cap(8);
-        const QString &underlineText = pattern.cap(11);
-        bool isSpecialFormat = !boldText.isEmpty() || !italicText.isEmpty() || !underlineText.isEmpty();
-        QString replacement;
-
-        if (!linkText.isEmpty()) {
-            replacement = QString::fromUtf8("<a href=\"%1\">%1</a>").arg(linkText);
-        } else if (!mailText.isEmpty()) {
-            replacement = QString::fromUtf8("<a href=\"mailto:%1\">%1</a>").arg(mailText);
-        } else if (isSpecialFormat) {
-            // Careful here; the inner contents of the current match shall be formatted as well which is why we need recursion
-            QChar elementName;
-            QChar markupChar;
-            int whichOne = 0;
+/** @short Find the end of a run of characters which are permitted in the local part of an e-mail address */
+int mailLocalPartEnd(const QString &line, int pos)
+{
+    while (pos < line.size()) {
+        if (isEscapedAmpersandAt(line, pos))
+            pos += 5;
+        else if (isMailLocalChar(line.at(pos)))
+            ++pos;
+        else
+            break;
+    }
+    return pos;
+}
+
+/** @short Check whether there's a *bold*, /italic/ or _underline_ markup whose opening character is at @arg pos
+
+The markup is nongreedy in the sense that a doubled markup character at the beginning is not recognized, but the
+position of the closing character is chosen greedily within the current word.
+*/
+bool markupAt(const QString &line, const int pos, int *closingPos)
+{
+    const QChar markupChar = line.at(pos);
+    if (!isMarkupChar(markupChar) || pos + 1 >= line.size())
+        return false;
+    const QChar first = line.at(pos + 1);
+    if (first == markupChar || first.isSpace())
+        return false;
+
+    int wordEnd = pos + 1;
+    while (wordEnd < line.size() && !line.at(wordEnd).isSpace())
+        ++wordEnd;
+
+    for (int k = wordEnd - 1; k >= pos + 2; --k) {
+        if (line.at(k) == markupChar && (k + 1 == line.size() || isMarkupExtro(line.at(k + 1)))) {
+            *closingPos = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+/** @short Apply the links and the formatting markup to an already escaped HTML text
 
-            if (!boldText.isEmpty()) {
+This is a hand-written scanner which produces the same output as the regular expression which used to be used here,
+but in a single pass over the input and without allocating any temporaries for the parts which do not match. Matches
+are searched for from left to right; if several kinds of matches start at the same position, the longest one wins.
+*/
+QString htmlifyEscapedLine(const QString &line)
+{
+    QString out;
+    out.reserve(line.size());
+
+    // Data which were not copied to the output yet
+    int copied = 0;
+    // Position where the "beginning of line" matches for the purpose of markup recognition
+    int lineStart = 0;
+    // End of the run of the characters which can form the local part of an address
+    int mailRunEnd = 0;
+
+    int i = 0;
+    while (i < line.size()) {
+        int mailLength = 0;
+        if (i >= mailRunEnd) {
+            // A new run of characters which could start an e-mail address
+            mailRunEnd = mailLocalPartEnd(line, i);
+            if (mailRunEnd > i && mailRunEnd + 1 < line.size() && line.at(mailRunEnd) == QLatin1Char('@')
+                    && isMailDomainChar(line.at(mailRunEnd + 1))) {
+                int domainEnd = mailRunEnd + 1;
+                while (domainEnd < line.size() && isMailDomainChar(line.at(domainEnd)))
+                    ++domainEnd;
+                mailLength = domainEnd - i;
+            }
+        }
+
+        const int linkLength = urlLengthAt(line, i);
+
+        int markupLength = 0;
+        int markupPos = -1;
+        int closingPos = -1;
+        if (i == lineStart && isMarkupChar(line.at(i))) {
+            markupPos = i;
+        } else if (isMarkupIntro(line.at(i)) && i + 1 < line.size()) {
+            markupPos = i + 1;
+        }
+        if (markupPos != -1 && markupAt(line, markupPos, &closingPos)) {
+            markupLength = closingPos + 1 - i;
+            if (closingPos + 1 < line.size())
+                ++markupLength;
+        }
+
+        if (!linkLength && !mailLength && !markupLength) {
+            ++i;
+            continue;
+        }
+
+        out.append(line.midRef(copied, i - copied));
+
+        int length;
+        if (linkLength >= mailLength && linkLength >= markupLength) {
+            length = linkLength;
+            const QString link = line.mid(i, length);
+            out.append(QLatin1String("<a href=\"")).append(link).append(QLatin1String("\">"))
+                    .append(link).append(QLatin1String("</a>"));
+        } else if (mailLength >= markupLength) {
+            length = mailLength;
+            const QString mail = line.mid(i, length);
+            out.append(QLatin1String("<a href=\"mailto:")).append(mail).append(QLatin1String("\">"))
+                    .append(mail).append(QLatin1String("</a>"));
+        } else {
+            // The inner contents of the current match shall be formatted as well
+            length = markupLength;
+            const QChar markupChar = line.at(markupPos);
+            QChar elementName;
+            if (markupChar == QLatin1Char('*')) {
                 elementName = QLatin1Char('b');
-                markupChar = QLatin1Char('*');
-                whichOne = 3;
-            } else if (!italicText.isEmpty()) {
+            } else if (markupChar == QLatin1Char('/')) {
                 elementName = QLatin1Char('i');
-                markupChar = QLatin1Char('/');
-                whichOne = 6;
-            } else if (!underlineText.isEmpty()) {
+            } else {
                 elementName = QLatin1Char('u');
-                markupChar = QLatin1Char('_');
-                whichOne = 9;
             }
-            Q_ASSERT(whichOne);
-            replacement = QString::fromUtf8("%1<%2><span class=\"markup\">%3</span>%4<span class=\"markup\">%3</span></%2>%5")
-                    .arg(pattern.cap(whichOne + 1), elementName, markupChar,
-                         helperHtmlifySingleLine(pattern.cap(whichOne + 2)), pattern.cap(whichOne + 3));
+            out.append(line.midRef(i, markupPos - i));
+            out.append(QLatin1Char('<')).append(elementName).append(QLatin1String("><span class=\"markup\">"))
+                    .append(markupChar).append(QLatin1String("</span>"));
+            out.append(htmlifyEscapedLine(line.mid(markupPos + 1, closingPos - markupPos - 1)));
+            out.append(QLatin1String("<span class=\"markup\">")).append(markupChar).append(QLatin1String("</span></"))
+                    .append(elementName).append(QLatin1Char('>'));
+            out.append(line.midRef(closingPos + 1, i + length - closingPos - 1));
         }
-        Q_ASSERT(!replacement.isEmpty());
-        line = line.left(pos) + replacement + line.mid(pos + pattern.matchedLength());
-        start = pos + replacement.size();
+
+        i += length;
+        copied = i;
+        lineStart = i;
+        mailRunEnd = i;
     }
-    return line;
+
+    out.append(line.midRef(copied));
+    return out;
+}
+
+}
+
+/** @short Helper for plainTextToHtml for applying the HTML formatting
+
+This function recognizes http and https links, e-mail addresses, *bold*, /italic/ and _underline_ text.
+*/
+QString helperHtmlifySingleLine(QString line)
+{
+    // Escape the HTML entities
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
+    line = Qt::escape(line);
+#else
+    line = line.toHtmlEscaped();
+#endif
+
+    // Now prepare markup *bold*, /italic/ and _underline_ and also turn links into HTML.
+    return htmlifyEscapedLine(line);
 }
 
 
@@ -206,7 +391,32 @@ static QString lineWithoutTrailingCr(const QString &line)
     return line.endsWith(QLatin1Char('\r')) ? line.left(line.size() - 1) : line;
 }
 
+/** @short Identify the markup produced by plainTextToHtml() when storing it in a cache
+
+Bump the version whenever the generated markup changes so that the stale entries from the persistent cache are not
+reused.
+*/
+QByteArray plainTextToHtmlCacheVariant(const FlowedFormat flowed)
+{
+    switch (flowed) {
+    case FlowedFormat::PLAIN:
+        return "text/plain;v=1";
+    case FlowedFormat::FLOWED:
+        return "text/plain;v=1;format=flowed";
+    case FlowedFormat::FLOWED_DELSP:
+        return "text/plain;v=1;format=flowed;delsp=yes";
+    }
+    Q_ASSERT(false);
+    return QByteArray();
+}
+
 QString plainTextToHtml(const QString &plaintext, const FlowedFormat flowed)
+{
+    int interactiveControlsId = 0;
+    return plainTextToHtml(plaintext, flowed, &interactiveControlsId);
+}
+
+QString plainTextToHtml(const QString &plaintext, const FlowedFormat flowed, int *interactiveControlsIdCounter)
 {
     QRegExp quotemarks;
     switch (flowed) {
@@ -223,6 +433,7 @@ QString plainTextToHtml(const QString &plaintext, const FlowedFormat flowed)
     const int SIGNATURE_SEPARATOR = -2;
 
     QList<TextInfo> lineBuffer;
+    const QRegExp signatureSeparatorRe = signatureSeparator();
 
     // First pass: determine the quote level for each source line.
     // The quote level is ignored for the signature.
@@ -235,16 +446,19 @@ QString plainTextToHtml(const QString &plaintext, const FlowedFormat flowed)
             continue;
         }
 
+        const QChar firstChar = line.at(0);
+
         // Special marker for the signature separator
-        if (signatureSeparator().exactMatch(line)) {
+        if ((firstChar == QLatin1Char('-') || firstChar == QLatin1Char('_')) && signatureSeparatorRe.exactMatch(line)) {
             lineBuffer << TextInfo(SIGNATURE_SEPARATOR, lineWithoutTrailingCr(line));
             signatureSeparatorSeen = true;
             continue;
         }
 
-        // Determine the quoting level
+        // Determine the quoting level; the regexp is only consulted for lines which could possibly match
         int quoteLevel = 0;
-        if (!signatureSeparatorSeen && quotemarks.indexIn(line) == 0) {
+        if (!signatureSeparatorSeen && (firstChar == QLatin1Char('>') || firstChar == QLatin1Char(' '))
+                && quotemarks.indexIn(line) == 0) {
             quoteLevel = quotemarks.cap(0).count(QLatin1Char('>'));
         }
 
@@ -255,89 +469,94 @@ QString plainTextToHtml(const QString &plaintext, const FlowedFormat flowed)
     // - Remove the quotemarks for everything prior to the signature separator.
     // - Collapse the lines with the same quoting level into a single block
     //   (optionally into a single line if format=flowed is active)
-    auto it = lineBuffer.begin();
-    while (it < lineBuffer.end() && it->depth != SIGNATURE_SEPARATOR) {
+    // The collapsed blocks are compacted towards the beginning of the buffer; erasing the joined lines one by one
+    // would make this quadratic in the number of lines.
+    int joinedCount = 0;
+    int i = 0;
+    for (; i < lineBuffer.size() && lineBuffer[i].depth != SIGNATURE_SEPARATOR; ++i) {
+        TextInfo &current = lineBuffer[i];
 
-        // Remove the quotemarks
-        it->text.remove(quotemarks);
+        // Remove the quotemarks. Unquoted lines cannot start with any.
+        if (current.depth > 0)
+            current.text.remove(quotemarks);
 
         switch (flowed) {
         case FlowedFormat::FLOWED:
         case FlowedFormat::FLOWED_DELSP:
-            if (flowed == FlowedFormat::FLOWED || flowed == FlowedFormat::FLOWED_DELSP) {
-                // check for space-stuffing
-                if (it->text.startsWith(QLatin1Char(' '))) {
-                    it->text.remove(0, 1);
-                }
+            // check for space-stuffing
+            if (current.text.startsWith(QLatin1Char(' '))) {
+                current.text.remove(0, 1);
+            }
 
-                // quirk: fix a flowed line which actually isn't flowed
-                if (it->text.endsWith(QLatin1Char(' ')) && (
-                        it+1 == lineBuffer.end() || // end-of-document
-                        (it+1)->depth == SIGNATURE_SEPARATOR || // right in front of the separator
-                        (it+1)->depth != it->depth // end of paragraph
-                   )) {
-                    it->text.chop(1);
-                }
+            // quirk: fix a flowed line which actually isn't flowed
+            if (current.text.endsWith(QLatin1Char(' ')) && (
+                    i + 1 == lineBuffer.size() || // end-of-document
+                    lineBuffer[i + 1].depth == SIGNATURE_SEPARATOR || // right in front of the separator
+                    lineBuffer[i + 1].depth != current.depth // end of paragraph
+               )) {
+                current.text.chop(1);
             }
             break;
         case FlowedFormat::PLAIN:
-            if (it->depth > 0 && it->text.startsWith(QLatin1Char(' '))) {
+            if (current.depth > 0 && current.text.startsWith(QLatin1Char(' '))) {
                 // Because the space is re-added when we prepend the quotes. Adding that space is done
                 // in order to make it look nice, i.e. to prevent lines like ">>something".
-                it->text.remove(0, 1);
+                current.text.remove(0, 1);
             }
             break;
         }
 
-
-        if (it == lineBuffer.begin()) {
-            // No "previous line"
-            ++it;
+        if (joinedCount == 0 || lineBuffer[joinedCount - 1].depth != current.depth) {
+            // No "previous line" to join with
+            if (joinedCount != i)
+                lineBuffer[joinedCount] = current;
+            ++joinedCount;
             continue;
         }
 
-        // Check for the line joining
-        auto prev = it - 1;
-        if (prev->depth == it->depth) {
-
-            QString separator = QLatin1String("\n");
-            switch (flowed) {
-            case FlowedFormat::PLAIN:
-                // nothing fancy to do here, we cannot really join lines
-                break;
-            case FlowedFormat::FLOWED:
-            case FlowedFormat::FLOWED_DELSP:
-                // CR LF trailing is stripped already (LFs by the split into lines, CRs by lineWithoutTrailingCr in pass #1),
-                // so we only have to check for the trailing space
-                if (prev->text.endsWith(QLatin1Char(' '))) {
-
-                    // implement the DelSp thingy
-                    if (flowed == FlowedFormat::FLOWED_DELSP) {
-                        prev->text.chop(1);
-                    }
+        // Line joining
+        TextInfo &prev = lineBuffer[joinedCount - 1];
+        QString separator = QLatin1String("\n");
+        switch (flowed) {
+        case FlowedFormat::PLAIN:
+            // nothing fancy to do here, we cannot really join lines
+            break;
+        case FlowedFormat::FLOWED:
+        case FlowedFormat::FLOWED_DELSP:
+            // CR LF trailing is stripped already (LFs by the split into lines, CRs by lineWithoutTrailingCr in pass #1),
+            // so we only have to check for the trailing space
+            if (prev.text.endsWith(QLatin1Char(' '))) {
 
-                    if (it->text.isEmpty() || prev->text.isEmpty()) {
-                        // This one or the previous line is a blank one, so we cannot really join them
-                    } else {
-                        separator = QString();
-                    }
+                // implement the DelSp thingy
+                if (flowed == FlowedFormat::FLOWED_DELSP) {
+                    prev.text.chop(1);
+                }
+
+                if (current.text.isEmpty() || prev.text.isEmpty()) {
+                    // This one or the previous line is a blank one, so we cannot really join them
+                } else {
+                    separator = QString();
                 }
-                break;
             }
-            prev->text += separator + it->text;
-            it = lineBuffer.erase(it);
-        } else {
-            ++it;
+            break;
         }
+        prev.text += separator + current.text;
     }
+    // The signature is kept intact
+    for (; i < lineBuffer.size(); ++i) {
+        if (joinedCount != i)
+            lineBuffer[joinedCount] = lineBuffer[i];
+        ++joinedCount;
+    }
+    lineBuffer.erase(lineBuffer.begin() + joinedCount, lineBuffer.end());
 
     // Third pass: HTML escaping, formatting and adding fancy markup
     signatureSeparatorSeen = false;
     int quoteLevel = 0;
     QStringList markup;
-    int interactiveControlsId = 0;
+    int &interactiveControlsId = *interactiveControlsIdCounter;
     QStack<QPair<int,int> > controlStack;
-    for (it = lineBuffer.begin(); it != lineBuffer.end(); ++it) {
+    for (auto it = lineBuffer.begin(); it != lineBuffer.end(); ++it) {
 
         if (it->depth == SIGNATURE_SEPARATOR && !signatureSeparatorSeen) {
             // The first signature separator
@@ -556,8 +775,8 @@ QString plainTextToHtml(const QString &plaintext, const FlowedFormat flowed)
     return markup.join(QString());
 }
 
-QString htmlizedTextPart(const QModelIndex &partIndex, const QFontInfo &font, const QColor &backgroundColor, const QColor &textColor,
-                         const QColor &linkColor, const QColor &visitedLinkColor)
+QString htmlizedTextPartHeader(const QFontInfo &font, const QColor &backgroundColor, const QColor &textColor,
+                               const QColor &linkColor, const QColor &visitedLinkColor)
 {
     static const QString defaultStyle = QString::fromUtf8(
         "pre{word-wrap: break-word; white-space: pre-wrap;}"
@@ -624,15 +843,23 @@ QString htmlizedTextPart(const QModelIndex &partIndex, const QFontInfo &font, co
     // The dir="auto" is required for WebKit to treat all paragraphs as entities with possibly different text direction.
     // The individual paragraphs unfortunately share the same text alignment, though, as per
     // https://bugs.webkit.org/show_bug.cgi?id=71194 (fixed in Blink already).
-    QString htmlHeader(QLatin1String("<html><head><style type=\"text/css\"><!--") + textColors + fontSpecification + stylesheet +
-                       QLatin1String("--></style></head><body><pre dir=\"auto\">"));
-    static QString htmlFooter(QLatin1String("\n</pre></body></html>"));
+    return QLatin1String("<html><head><style type=\"text/css\"><!--") + textColors + fontSpecification + stylesheet +
+            QLatin1String("--></style></head><body><pre dir=\"auto\">");
+}
 
+QString htmlizedTextPartFooter()
+{
+    return QLatin1String("\n</pre></body></html>");
+}
 
+QString htmlizedTextPart(const QModelIndex &partIndex, const QFontInfo &font, const QColor &backgroundColor, const QColor &textColor,
+                         const QColor &linkColor, const QColor &visitedLinkColor)
+{
     // We cannot rely on the QWebFrame's toPlainText because of https://bugs.kde.org/show_bug.cgi?id=321160
     QString markup = plainTextToHtml(partIndex.data(Imap::Mailbox::RolePartUnicodeText).toString(), flowedFormatForPart(partIndex));
 
-    return htmlHeader + markup + htmlFooter;
+    return htmlizedTextPartHeader(font, backgroundColor, textColor, linkColor, visitedLinkColor) + markup
+            + htmlizedTextPartFooter();
 }
 
 FlowedFormat flowedFormatForPart(const QModelIndex &partIndex)
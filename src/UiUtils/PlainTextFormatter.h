@@ -39,6 +39,12 @@ enum class FlowedFormat {
 };
 
 QString plainTextToHtml(const QString &plaintext, const FlowedFormat flowed);
+QString plainTextToHtml(const QString &plaintext, const FlowedFormat flowed, int *interactiveControlsIdCounter);
+QByteArray plainTextToHtmlCacheVariant(const FlowedFormat flowed);
+
+QString htmlizedTextPartHeader(const QFontInfo &font, const QColor &backgroundColor, const QColor &textColor,
+                               const QColor &linkColor, const QColor &visitedLinkColor);
+QString htmlizedTextPartFooter();
 
 QString htmlizedTextPart(const QModelIndex &partIndex, const QFontInfo &font,
                          const QColor &backgroundColor, const QColor &textColor,
@@ -0,0 +1,152 @@
+/*
+    Certain enhancements (www.xtuple.com/trojita-enhancements)
+    are copyright © 2010 by OpenMFG LLC, dba xTuple.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+    - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    - Neither the name of xTuple nor the names of its contributors may be used to
+    endorse or promote products derived from this software without specific prior
+    written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+    ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include <QDataStream>
+#include "ArchiveWatermark.h"
+
+namespace XtConnect {
+
+ArchiveWatermark::ArchiveWatermark():
+    m_uidValidity(0), m_highestUid(0), m_highestModSeq(0), m_gapBase(0)
+{
+}
+
+void ArchiveWatermark::reset(const uint uidValidity)
+{
+    m_uidValidity = uidValidity;
+    m_highestUid = 0;
+    m_highestModSeq = 0;
+    m_gapBase = 0;
+    m_gaps.clear();
+}
+
+/** @short Shall the message with the given UID be looked at? */
+bool ArchiveWatermark::needsProcessing(const uint uid) const
+{
+    return uid > m_highestUid || isGap(uid);
+}
+
+bool ArchiveWatermark::isGap(const uint uid) const
+{
+    return uid >= m_gapBase && uid - m_gapBase < static_cast<uint>(m_gaps.size()) && m_gaps.testBit(uid - m_gapBase);
+}
+
+/** @short The message has been seen, but it has not been archived yet */
+void ArchiveWatermark::markPending(const uint uid)
+{
+    Q_ASSERT(uid);
+    if (m_gaps.isEmpty()) {
+        m_gapBase = uid;
+        m_gaps.resize(1);
+    } else if (uid < m_gapBase) {
+        QBitArray extended(m_gaps.size() + m_gapBase - uid);
+        const int offset = m_gapBase - uid;
+        for (int i = 0; i < m_gaps.size(); ++i) {
+            if (m_gaps.testBit(i))
+                extended.setBit(i + offset);
+        }
+        m_gaps = extended;
+        m_gapBase = uid;
+    } else if (uid - m_gapBase >= static_cast<uint>(m_gaps.size())) {
+        m_gaps.resize(uid - m_gapBase + 1);
+    }
+    m_gaps.setBit(uid - m_gapBase);
+    m_highestUid = qMax(m_highestUid, uid);
+}
+
+/** @short The message is safely stored in the database */
+void ArchiveWatermark::markArchived(const uint uid)
+{
+    m_highestUid = qMax(m_highestUid, uid);
+    if (!isGap(uid))
+        return;
+    m_gaps.clearBit(uid - m_gapBase);
+    if (uid == m_gapBase || uid - m_gapBase == static_cast<uint>(m_gaps.size()) - 1)
+        compact();
+}
+
+/** @short Shrink the bitmap so that it starts and ends with a gap */
+void ArchiveWatermark::compact()
+{
+    int first = 0;
+    while (first < m_gaps.size() && !m_gaps.testBit(first))
+        ++first;
+    if (first == m_gaps.size()) {
+        m_gaps.clear();
+        m_gapBase = 0;
+        return;
+    }
+    int last = m_gaps.size() - 1;
+    while (!m_gaps.testBit(last))
+        --last;
+
+    if (first == 0) {
+        m_gaps.truncate(last + 1);
+        return;
+    }
+    QBitArray shrunk(last - first + 1);
+    for (int i = first; i <= last; ++i) {
+        if (m_gaps.testBit(i))
+            shrunk.setBit(i - first);
+    }
+    m_gaps = shrunk;
+    m_gapBase += first;
+}
+
+bool ArchiveWatermark::hasPending() const
+{
+    // The bitmap is kept compacted, so any non-empty one contains at least one gap
+    return !m_gaps.isEmpty();
+}
+
+/** @short UIDs of all messages below the watermark which were not archived yet */
+QList<uint> ArchiveWatermark::pendingUids() const
+{
+    QList<uint> res;
+    for (int i = 0; i < m_gaps.size(); ++i) {
+        if (m_gaps.testBit(i))
+            res << m_gapBase + i;
+    }
+    return res;
+}
+
+QDataStream &operator<<(QDataStream &stream, const ArchiveWatermark &watermark)
+{
+    return stream << watermark.m_uidValidity << watermark.m_highestUid << watermark.m_highestModSeq
+                  << watermark.m_gapBase << watermark.m_gaps;
+}
+
+QDataStream &operator>>(QDataStream &stream, ArchiveWatermark &watermark)
+{
+    return stream >> watermark.m_uidValidity >> watermark.m_highestUid >> watermark.m_highestModSeq
+                  >> watermark.m_gapBase >> watermark.m_gaps;
+}
+
+}
@@ -0,0 +1,91 @@
+/*
+    Certain enhancements (www.xtuple.com/trojita-enhancements)
+    are copyright © 2010 by OpenMFG LLC, dba xTuple.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+    - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    - Neither the name of xTuple nor the names of its contributors may be used to
+    endorse or promote products derived from this software without specific prior
+    written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+    ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#ifndef XTCONNECT_ARCHIVEWATERMARK_H
+#define XTCONNECT_ARCHIVEWATERMARK_H
+
+#include <QBitArray>
+#include <QList>
+
+class QDataStream;
+
+namespace XtConnect {
+
+/** @short Remember which messages of a mailbox have been archived already
+
+Everything up to the highestUid() has been seen by the synchronizer before. Messages below that mark which were not
+archived yet (because their download is still in progress, or because saving them has failed) are remembered as
+"gaps" in a bitmap which only spans the range between the lowest and the highest gap. All of that is only valid for a
+particular UIDVALIDITY of the mailbox.
+
+The highest MODSEQ which was seen when the mailbox was processed for the last time makes it possible to find out that
+nothing has happened at all since then.
+*/
+class ArchiveWatermark
+{
+public:
+    ArchiveWatermark();
+
+    uint uidValidity() const { return m_uidValidity; }
+    uint highestUid() const { return m_highestUid; }
+    quint64 highestModSeq() const { return m_highestModSeq; }
+    void setHighestModSeq(const quint64 highestModSeq) { m_highestModSeq = highestModSeq; }
+
+    /** @short Forget everything and start afresh with a new UIDVALIDITY */
+    void reset(const uint uidValidity);
+
+    bool needsProcessing(const uint uid) const;
+    void markPending(const uint uid);
+    void markArchived(const uint uid);
+
+    bool hasPending() const;
+    QList<uint> pendingUids() const;
+
+private:
+    bool isGap(const uint uid) const;
+    void compact();
+
+    uint m_uidValidity;
+    uint m_highestUid;
+    quint64 m_highestModSeq;
+    /** @short UID which corresponds to the first bit of m_gaps */
+    uint m_gapBase;
+    QBitArray m_gaps;
+
+    friend QDataStream &operator<<(QDataStream &stream, const ArchiveWatermark &watermark);
+    friend QDataStream &operator>>(QDataStream &stream, ArchiveWatermark &watermark);
+};
+
+QDataStream &operator<<(QDataStream &stream, const ArchiveWatermark &watermark);
+QDataStream &operator>>(QDataStream &stream, ArchiveWatermark &watermark);
+
+}
+
+#endif // XTCONNECT_ARCHIVEWATERMARK_H
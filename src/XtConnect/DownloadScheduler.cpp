@@ -0,0 +1,176 @@
+/*
+    Certain enhancements (www.xtuple.com/trojita-enhancements)
+    are copyright © 2010 by OpenMFG LLC, dba xTuple.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+    - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    - Neither the name of xTuple nor the names of its contributors may be used to
+    endorse or promote products derived from this software without specific prior
+    written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+    ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "DownloadScheduler.h"
+#include <QTimer>
+#include "DownloadWorker.h"
+#include "MessageDownloader.h"
+
+namespace XtConnect {
+
+/** @short How many UIDs are handed out to a worker at once */
+const int uidsPerRange = 100;
+
+DownloadScheduler::DownloadScheduler(QObject *parent, const int connectionCapacity):
+    QObject(parent), m_connectionCapacity(qMax(1, connectionCapacity)), m_dispatchScheduled(false)
+{
+}
+
+bool DownloadScheduler::tryAcquire(const Imap::Mailbox::Model *model)
+{
+    int &count = m_inFlight[model];
+    if (count >= m_connectionCapacity)
+        return false;
+    ++count;
+    return true;
+}
+
+void DownloadScheduler::release(const Imap::Mailbox::Model *model)
+{
+    int &count = m_inFlight[model];
+    Q_ASSERT(count > 0);
+    --count;
+
+    // Don't wake up the waiters for each and every free slot; it's much better to let them request a bunch of messages at
+    // once, so that the Model can group the requests into a reasonable number of FETCH commands.
+    if (count <= m_connectionCapacity - qMax(1, m_connectionCapacity / 10))
+        scheduleDispatch();
+}
+
+int DownloadScheduler::inFlight() const
+{
+    int res = 0;
+    Q_FOREACH(const int count, m_inFlight) {
+        res += count;
+    }
+    return res;
+}
+
+void DownloadScheduler::waitForCapacity(MessageDownloader *downloader)
+{
+    Q_FOREACH(const QPointer<MessageDownloader> &item, m_waiters) {
+        if (item == downloader)
+            return;
+    }
+    m_waiters.enqueue(downloader);
+
+    if (freeSlots(downloader->model()) > 0)
+        scheduleDispatch();
+}
+
+void DownloadScheduler::registerWorker(DownloadWorker *worker)
+{
+    m_workers << worker;
+    scheduleDispatch();
+}
+
+void DownloadScheduler::enqueueDownloads(const QString &mailbox, const Imap::Uids &uids)
+{
+    for (int i = 0; i < uids.size(); i += uidsPerRange) {
+        Range range;
+        range.mailbox = mailbox;
+        range.uids = uids.mid(i, uidsPerRange);
+        m_ranges.enqueue(range);
+    }
+    if (!uids.isEmpty())
+        scheduleDispatch();
+}
+
+bool DownloadScheduler::takeRange(const QString &currentMailbox, const bool anyMailbox, QString *mailbox, Imap::Uids *uids)
+{
+    Q_ASSERT(mailbox);
+    Q_ASSERT(uids);
+    for (QQueue<Range>::iterator it = m_ranges.begin(); it != m_ranges.end(); ++it) {
+        if (it->mailbox != currentMailbox)
+            continue;
+        *mailbox = it->mailbox;
+        *uids = it->uids;
+        m_ranges.erase(it);
+        return true;
+    }
+    if (!anyMailbox || m_ranges.isEmpty())
+        return false;
+    Range range = m_ranges.dequeue();
+    *mailbox = range.mailbox;
+    *uids = range.uids;
+    return true;
+}
+
+void DownloadScheduler::abandonDownloads(const QString &mailbox, const Imap::Uids &uids)
+{
+    if (!uids.isEmpty())
+        emit downloadsAbandoned(mailbox, uids);
+    // The worker might be idle now
+    scheduleDispatch();
+}
+
+void DownloadScheduler::scheduleDispatch()
+{
+    if (m_dispatchScheduled)
+        return;
+    m_dispatchScheduled = true;
+    QTimer::singleShot(0, this, SLOT(slotDispatch()));
+}
+
+void DownloadScheduler::slotDispatch()
+{
+    m_dispatchScheduled = false;
+
+    // The downloaders which have queued messages already go first. Everybody who is waiting right now gets a fair share of
+    // the free slots of their connection. Those who still have queued messages afterwards will re-register themselves at
+    // the end of the queue.
+    QQueue<QPointer<MessageDownloader> > waiters = m_waiters;
+    m_waiters.clear();
+    QMap<const Imap::Mailbox::Model *, int> waitersPerConnection;
+    Q_FOREACH(const QPointer<MessageDownloader> &downloader, waiters) {
+        if (downloader)
+            ++waitersPerConnection[downloader->model()];
+    }
+    while (!waiters.isEmpty()) {
+        QPointer<MessageDownloader> downloader = waiters.dequeue();
+        if (!downloader)
+            continue;
+        const Imap::Mailbox::Model *model = downloader->model();
+        const int slots = freeSlots(model);
+        const int sharing = waitersPerConnection[model]--;
+        if (slots <= 0) {
+            m_waiters.enqueue(downloader);
+            continue;
+        }
+        downloader->fetchQueuedMessages(qMax(1, slots / sharing));
+    }
+
+    // Whoever has nothing to do can take some more work
+    Q_FOREACH(const QPointer<DownloadWorker> &worker, m_workers) {
+        if (worker)
+            worker->pickUpWork();
+    }
+}
+
+}
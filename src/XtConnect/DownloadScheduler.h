@@ -0,0 +1,122 @@
+/*
+    Certain enhancements (www.xtuple.com/trojita-enhancements)
+    are copyright © 2010 by OpenMFG LLC, dba xTuple.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+    - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    - Neither the name of xTuple nor the names of its contributors may be used to
+    endorse or promote products derived from this software without specific prior
+    written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+    ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef XTCONNECT_DOWNLOADSCHEDULER_H
+#define XTCONNECT_DOWNLOADSCHEDULER_H
+
+#include <QMap>
+#include <QObject>
+#include <QPointer>
+#include <QQueue>
+#include "Imap/Parser/Uids.h"
+
+namespace Imap {
+namespace Mailbox {
+class Model;
+}
+}
+
+namespace XtConnect {
+
+class DownloadWorker;
+class MessageDownloader;
+
+/** @short Share the work of downloading messages among all IMAP connections
+
+The MailSynchronizers do not download the messages themselves. They split the UIDs which have to be archived into
+ranges and put them into a queue which is shared by all connections. Each connection has a DownloadWorker which takes
+the next range as soon as it has nothing else to do, so that a big mailbox is not stuck with a single connection while
+the others are idle. A worker keeps working on the mailbox which it has opened as long as there are ranges for it;
+it only switches to another mailbox when none of its messages are in flight.
+
+Each connection can only have a limited number of messages in flight. A MessageDownloader has to acquire a slot before it
+asks the IMAP server for a message and releases it once the message has been handed over for saving. When all slots of
+its connection are taken, the downloader queues its requests and registers itself as waiting. As soon as enough slots
+become free again, the waiting downloaders of that connection are woken up in a round-robin fashion and each of them
+gets an equal share of the free capacity. This keeps the amount of data held in memory bounded for each connection,
+and no connection can starve the others.
+*/
+class DownloadScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    DownloadScheduler(QObject *parent, const int connectionCapacity);
+
+    /** @short Take one slot of the @arg model's connection if there's any left */
+    bool tryAcquire(const Imap::Mailbox::Model *model);
+    /** @short Return a slot taken previously by tryAcquire() */
+    void release(const Imap::Mailbox::Model *model);
+    /** @short Remember that the downloader has queued messages and would like to be woken up when there's room */
+    void waitForCapacity(MessageDownloader *downloader);
+
+    /** @short Make the worker pick up the queued ranges whenever it has nothing to do */
+    void registerWorker(DownloadWorker *worker);
+    /** @short Queue the messages with given UIDs for downloading */
+    void enqueueDownloads(const QString &mailbox, const Imap::Uids &uids);
+    /** @short Hand out the next range of UIDs for the worker
+
+Ranges for the @arg currentMailbox are preferred. Ranges of other mailboxes are only returned if @arg anyMailbox is set.
+*/
+    bool takeRange(const QString &currentMailbox, const bool anyMailbox, QString *mailbox, Imap::Uids *uids);
+    /** @short The worker won't download these messages, they're gone */
+    void abandonDownloads(const QString &mailbox, const Imap::Uids &uids);
+
+    int connectionCapacity() const { return m_connectionCapacity; }
+    int inFlight() const;
+    int inFlight(const Imap::Mailbox::Model *model) const { return m_inFlight.value(model); }
+    int freeSlots(const Imap::Mailbox::Model *model) const { return m_connectionCapacity - inFlight(model); }
+    int waitingDownloaders() const { return m_waiters.size(); }
+    int queuedRanges() const { return m_ranges.size(); }
+
+signals:
+    /** @short The messages were queued, but there's nothing to download for them anymore */
+    void downloadsAbandoned(const QString &mailbox, const Imap::Uids &uids);
+
+private slots:
+    void slotDispatch();
+
+private:
+    void scheduleDispatch();
+
+    struct Range {
+        QString mailbox;
+        Imap::Uids uids;
+    };
+
+    int m_connectionCapacity;
+    QMap<const Imap::Mailbox::Model *, int> m_inFlight;
+    QQueue<QPointer<MessageDownloader> > m_waiters;
+    QList<QPointer<DownloadWorker> > m_workers;
+    QQueue<Range> m_ranges;
+    bool m_dispatchScheduled;
+};
+
+}
+
+#endif // XTCONNECT_DOWNLOADSCHEDULER_H
@@ -0,0 +1,171 @@
+/*
+    Certain enhancements (www.xtuple.com/trojita-enhancements)
+    are copyright © 2010 by OpenMFG LLC, dba xTuple.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+    - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    - Neither the name of xTuple nor the names of its contributors may be used to
+    endorse or promote products derived from this software without specific prior
+    written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+    ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include "DownloadWorker.h"
+#include <climits>
+#include <QTimer>
+#include "DownloadScheduler.h"
+#include "MessageDownloader.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/MailboxFinder.h"
+#include "Imap/Model/Model.h"
+
+namespace XtConnect {
+
+namespace {
+
+/** @short Return the UID of a message, treating messages whose UID is not known yet as the newest ones */
+uint rowUid(const QAbstractItemModel *model, const QModelIndex &list, const int row)
+{
+    const uint uid = model->index(row, 0, list).data(Imap::Mailbox::RoleMessageUid).toUInt();
+    return uid ? uid : UINT_MAX;
+}
+
+/** @short Find the first row whose UID is not lower than @arg uid */
+int firstRowNotBelow(const QAbstractItemModel *model, const QModelIndex &list, const uint uid)
+{
+    int low = 0;
+    int high = model->rowCount(list);
+    while (low < high) {
+        const int middle = low + (high - low) / 2;
+        if (rowUid(model, list, middle) < uid)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+}
+
+DownloadWorker::DownloadWorker(QObject *parent, Imap::Mailbox::Model *model, Imap::Mailbox::MailboxFinder *finder,
+                               DownloadScheduler *scheduler):
+    QObject(parent), m_model(model), m_finder(finder), m_scheduler(scheduler)
+{
+    Q_ASSERT(m_model);
+    Q_ASSERT(m_finder);
+    Q_ASSERT(m_scheduler);
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    connect(m_timer, SIGNAL(timeout()), this, SLOT(slotRequestRange()));
+    connect(m_finder, SIGNAL(mailboxFound(QString,QModelIndex)), this, SLOT(slotMailboxFound(QString,QModelIndex)));
+    m_scheduler->registerWorker(this);
+}
+
+void DownloadWorker::addDownloader(const QString &mailbox, MessageDownloader *downloader)
+{
+    Q_ASSERT(downloader->model() == m_model);
+    m_downloaders[mailbox] = downloader;
+}
+
+bool DownloadWorker::isIdle() const
+{
+    if (!m_uids.isEmpty())
+        return false;
+    Q_FOREACH(const MessageDownloader *downloader, m_downloaders) {
+        if (downloader->pendingMessages())
+            return false;
+    }
+    return true;
+}
+
+void DownloadWorker::pickUpWork()
+{
+    if (!isIdle() || m_scheduler->freeSlots(m_model) <= 0)
+        return;
+
+    // Selecting another mailbox while some messages are still being downloaded would only slow things down
+    const bool canSwitch = m_scheduler->inFlight(m_model) == 0;
+    QString mailbox;
+    if (!m_scheduler->takeRange(m_mailbox, canSwitch, &mailbox, &m_uids))
+        return;
+
+    if (mailbox != m_mailbox || !m_mailboxIndex.isValid()) {
+        m_mailbox = mailbox;
+        m_mailboxIndex = QModelIndex();
+        m_finder->addMailbox(m_mailbox);
+        // The MailboxFinder doesn't report mailboxes which do not exist
+        m_timer->start(60 * 1000);
+    } else {
+        slotRequestRange();
+    }
+}
+
+void DownloadWorker::slotMailboxFound(const QString &mailbox, const QModelIndex &index)
+{
+    if (mailbox != m_mailbox || m_uids.isEmpty())
+        return;
+
+    m_mailboxIndex = index;
+    m_model->switchToMailbox(m_mailboxIndex);
+    // Give the synchronization a chance to start, otherwise the stale message list from the cache would be used
+    m_timer->start(1000);
+}
+
+/** @short Pass the messages of the current range to the downloader once their mailbox is synced */
+void DownloadWorker::slotRequestRange()
+{
+    if (m_uids.isEmpty())
+        return;
+
+    if (!m_mailboxIndex.isValid()) {
+        // The mailbox cannot be found or it got deleted; whoever enqueued the messages will try again later
+        Imap::Uids uids = m_uids;
+        m_uids.clear();
+        m_scheduler->abandonDownloads(m_mailbox, uids);
+        return;
+    }
+
+    QModelIndex list = m_mailboxIndex.child(0, 0);
+    if (m_mailboxIndex.data(Imap::Mailbox::RoleMailboxItemsAreLoading).toBool() || !list.isValid()) {
+        m_timer->start(1000);
+        return;
+    }
+
+    // Both the UIDs of a range and the messages are sorted
+    Imap::Uids missing;
+    MessageDownloader *downloader = m_downloaders.value(m_mailbox);
+    Q_ASSERT(downloader);
+    const int count = m_model->rowCount(list);
+    int row = firstRowNotBelow(m_model, list, m_uids.first());
+    Q_FOREACH(const uint uid, m_uids) {
+        while (row < count && rowUid(m_model, list, row) < uid)
+            ++row;
+        if (row < count && rowUid(m_model, list, row) == uid) {
+            downloader->requestDownload(m_model->index(row, 0, list));
+        } else {
+            missing << uid;
+        }
+    }
+    m_uids.clear();
+    // This also lets the scheduler know that there might be room for more work
+    m_scheduler->abandonDownloads(m_mailbox, missing);
+}
+
+}
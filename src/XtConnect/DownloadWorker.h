@@ -0,0 +1,91 @@
+/*
+    Certain enhancements (www.xtuple.com/trojita-enhancements)
+    are copyright © 2010 by OpenMFG LLC, dba xTuple.  All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    - Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+    - Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    - Neither the name of xTuple nor the names of its contributors may be used to
+    endorse or promote products derived from this software without specific prior
+    written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+    ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+    ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef XTCONNECT_DOWNLOADWORKER_H
+#define XTCONNECT_DOWNLOADWORKER_H
+
+#include <QMap>
+#include <QObject>
+#include <QPersistentModelIndex>
+#include "Imap/Parser/Uids.h"
+
+class QTimer;
+
+namespace Imap {
+namespace Mailbox {
+class MailboxFinder;
+class Model;
+}
+}
+
+namespace XtConnect {
+
+class DownloadScheduler;
+class MessageDownloader;
+
+/** @short Download the ranges of messages handed out by the DownloadScheduler over a single IMAP connection
+
+Whenever the worker has nothing to do, it takes the next range of UIDs from the shared queue, opens the corresponding
+mailbox in its own Model and passes the messages to the MessageDownloader for that mailbox. The results are delivered
+by the MessageDownloader to the MailSynchronizer which is responsible for the mailbox.
+*/
+class DownloadWorker : public QObject
+{
+    Q_OBJECT
+public:
+    DownloadWorker(QObject *parent, Imap::Mailbox::Model *model, Imap::Mailbox::MailboxFinder *finder, DownloadScheduler *scheduler);
+    /** @short Use @arg downloader for the messages of the @arg mailbox */
+    void addDownloader(const QString &mailbox, MessageDownloader *downloader);
+    Imap::Mailbox::Model *model() const { return m_model; }
+    /** @short Are all messages of the current range passed to the downloader, and is the downloader done with them? */
+    bool isIdle() const;
+    /** @short Take another range of messages if this worker has nothing to do */
+    void pickUpWork();
+
+private slots:
+    void slotMailboxFound(const QString &mailbox, const QModelIndex &index);
+    void slotRequestRange();
+
+private:
+    Imap::Mailbox::Model *m_model;
+    Imap::Mailbox::MailboxFinder *m_finder;
+    DownloadScheduler *m_scheduler;
+    QMap<QString, MessageDownloader*> m_downloaders;
+    /** @short Mailbox of the range which is being worked on, or of the last one */
+    QString m_mailbox;
+    QPersistentModelIndex m_mailboxIndex;
+    /** @short UIDs which were not passed to the downloader yet */
+    Imap::Uids m_uids;
+    /** @short Waiting for the mailbox to be found or to get synced */
+    QTimer *m_timer;
+};
+
+}
+
+#endif // XTCONNECT_DOWNLOADWORKER_H
@@ -27,34 +27,81 @@
 
 */
 
+#include <climits>
 #include <QDebug>
 #include "MailSynchronizer.h"
 #include "Imap/Model/ItemRoles.h"
 #include "Imap/Model/MailboxFinder.h"
+#include "DownloadScheduler.h"
 #include "MessageDownloader.h"
 #include "SqlStorage.h"
+#include "XtCache.h"
 
 namespace XtConnect {
 
-MailSynchronizer::MailSynchronizer( QObject *parent, Imap::Mailbox::Model *model, MailboxFinder *finder, MessageDownloader *downloader, SqlStorage *storage ) :
-    QObject(parent), m_model(model), m_finder(finder), m_downloader(downloader), m_storage(storage)
+/** @short How many messages to collect before saving them into the database */
+const int batchSize = 50;
+
+/** @short After how many seconds is a message which is still being downloaded given up on and retried later */
+const int inProgressTimeout = 15 * 60;
+
+MailSynchronizer::MailSynchronizer( QObject *parent, Imap::Mailbox::Model *model, MailboxFinder *finder, DownloadScheduler *scheduler,
+                                    SqlStorage *storage, XtCache *cache ) :
+    QObject(parent), m_model(model), m_finder(finder), m_scheduler(scheduler), m_storage(storage), m_cache(cache),
+    m_watermarkValid(false)
 {
     Q_ASSERT(m_model);
     Q_ASSERT(m_finder);
-    Q_ASSERT(m_downloader);
+    Q_ASSERT(m_scheduler);
     Q_ASSERT(m_storage);
     connect( m_model, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(slotRowsInserted(QModelIndex,int,int)) );
     connect( m_finder, SIGNAL(mailboxFound(QString,QModelIndex)), this, SLOT(slotMailboxFound(QString,QModelIndex)) );
-    connect( m_downloader, SIGNAL(messageDownloaded(QModelIndex,QByteArray,QByteArray,QString)),
-             this, SLOT(slotMessageDataReady(QModelIndex,QByteArray,QByteArray,QString)) );
+    connect( m_scheduler, SIGNAL(downloadsAbandoned(QString,Imap::Uids)), this, SLOT(slotDownloadsAbandoned(QString,Imap::Uids)) );
     m_deferredTimer = new QTimer(this);
     m_deferredTimer->setSingleShot(true);
     m_deferredTimer->setInterval(5000);
     connect(m_deferredTimer, SIGNAL(timeout()), this, SLOT(slotWalkDeferredMessages()));
+    m_watermarkTimer = new QTimer(this);
+    m_watermarkTimer->setSingleShot(true);
+    m_watermarkTimer->setInterval(10000);
+    connect(m_watermarkTimer, SIGNAL(timeout()), this, SLOT(slotSaveWatermark()));
+    m_batchTimer = new QTimer(this);
+    m_batchTimer->setSingleShot(true);
+    m_batchTimer->setInterval(1000);
+    connect(m_batchTimer, SIGNAL(timeout()), this, SLOT(slotFlushBatch()));
+    m_downloadTimer = new QTimer(this);
+    m_downloadTimer->setSingleShot(true);
+    m_downloadTimer->setInterval(0);
+    connect(m_downloadTimer, SIGNAL(timeout()), this, SLOT(slotEnqueueDownloads()));
+    m_inProgressTimer = new QTimer(this);
+    m_inProgressTimer->setInterval(60 * 1000);
+    connect(m_inProgressTimer, SIGNAL(timeout()), this, SLOT(slotExpireInProgress()));
+}
+
+MailSynchronizer::~MailSynchronizer()
+{
+    // Whatever has been downloaded already is stored. The messages which are still in progress remain pending in the
+    // watermark, so they will be retried by the next run.
+    slotFlushBatch();
+    m_inProgress.clear();
+    slotSaveWatermark();
+}
+
+void MailSynchronizer::addDownloader( MessageDownloader *downloader )
+{
+    m_downloaders << downloader;
+    connect( downloader, SIGNAL(messageDownloaded(QModelIndex,QByteArray,QByteArray,QString)),
+             this, SLOT(slotMessageDataReady(QModelIndex,QByteArray,QByteArray,QString)) );
+    connect( downloader, SIGNAL(messageDownloadFailed(QModelIndex)), this, SLOT(slotMessageDownloadFailed(QModelIndex)) );
 }
 
 void MailSynchronizer::setMailbox( const QString &mailbox )
 {
+    slotFlushBatch();
+    slotSaveWatermark();
+    m_watermarkValid = false;
+    m_inProgress.clear();
+    m_toDownload.clear();
     m_mailbox = mailbox;
     qDebug() << "Will watch mailbox" << mailbox;
     slotGetMailboxIndexAgain();
@@ -73,7 +120,7 @@ void MailSynchronizer::slotMailboxFound( const QString &mailbox, const QModelInd
 
     m_index = index;
     switchHere();
-    walkThroughMessages( -1, -1 );
+    walkNewMessages();
 }
 
 void MailSynchronizer::slotRowsInserted(const QModelIndex &parent, int start, int end)
@@ -107,11 +154,7 @@ void MailSynchronizer::walkThroughMessages( int start, int end )
         QVariant uid = m_model->data( message, Imap::Mailbox::RoleMessageUid );
 
         if ( uid.isValid() && uid.toUInt() != 0 ) {
-            bool shouldLoad = true;
-            emit aboutToRequestMessage( m_mailbox, message, &shouldLoad );
-            if ( shouldLoad ) {
-                m_downloader->requestDownload( message );
-            }
+            processMessage( message, uid.toUInt() );
         } else {
             m_deferredMessages << message;
             if ( ! m_deferredTimer->isActive() )
@@ -121,6 +164,201 @@ void MailSynchronizer::walkThroughMessages( int start, int end )
     }
 }
 
+void MailSynchronizer::walkNewMessages()
+{
+    if ( renewMailboxIndex() )
+        return;
+
+    if ( ! loadWatermark() ) {
+        // The mailbox has not been synced yet, there's no way of telling what is new
+        walkThroughMessages( -1, -1 );
+        return;
+    }
+
+    QModelIndex list = m_index.child( 0, 0 );
+    Q_ASSERT( list.isValid() );
+    const int count = m_model->rowCount( list );
+
+    const quint64 highestModSeq = m_cache ? m_cache->mailboxSyncState( m_mailbox ).highestModSeq() : 0;
+    if ( highestModSeq != 0 && highestModSeq == m_watermark.highestModSeq() && ! m_watermark.hasPending() &&
+         ( count == 0 || rowUid( list, count - 1 ) <= m_watermark.highestUid() ) ) {
+        // Nothing has changed since the last time
+        return;
+    }
+
+    walkThroughMessages( firstRowAbove( list, m_watermark.highestUid() ), count - 1 );
+
+    // Retry whatever has failed before
+    Q_FOREACH( const uint uid, m_watermark.pendingUids() ) {
+        if ( m_inProgress.contains( uid ) )
+            continue;
+        const int row = findRowByUid( list, uid );
+        if ( row == -1 ) {
+            // The message got expunged in the meanwhile, there's nothing to archive anymore
+            markArchived( uid );
+        } else {
+            processMessage( m_model->index( row, 0, list ), uid );
+        }
+    }
+
+    if ( highestModSeq != 0 && highestModSeq != m_watermark.highestModSeq() ) {
+        m_watermark.setHighestModSeq( highestModSeq );
+        if ( ! m_watermarkTimer->isActive() )
+            m_watermarkTimer->start();
+    }
+}
+
+bool MailSynchronizer::loadWatermark()
+{
+    const uint uidValidity = m_index.data( Imap::Mailbox::RoleMailboxUidValidity ).toUInt();
+    if ( uidValidity == 0 )
+        return false;
+
+    if ( m_watermarkValid && m_watermark.uidValidity() == uidValidity )
+        return true;
+
+    if ( ! m_watermarkValid && m_cache )
+        m_watermark = m_cache->archiveWatermark( m_mailbox );
+    m_watermarkValid = true;
+
+    if ( m_watermark.uidValidity() != uidValidity ) {
+        qDebug() << "Mailbox" << m_mailbox << ": UIDVALIDITY has changed, all messages will be checked again";
+        m_watermark.reset( uidValidity );
+        m_inProgress.clear();
+        if ( ! m_watermarkTimer->isActive() )
+            m_watermarkTimer->start();
+    }
+    return true;
+}
+
+void MailSynchronizer::processMessage( const QModelIndex &message, const uint uid )
+{
+    const bool useWatermark = loadWatermark();
+    if ( useWatermark && ( m_inProgress.contains( uid ) || ! m_watermark.needsProcessing( uid ) ) )
+        return;
+
+    bool shouldLoad = true;
+    emit aboutToRequestMessage( m_mailbox, message, &shouldLoad );
+    if ( ! useWatermark ) {
+        if ( shouldLoad )
+            queueDownload( uid );
+        return;
+    }
+
+    if ( shouldLoad ) {
+        m_watermark.markPending( uid );
+        m_inProgress.insert( uid, QDateTime::currentDateTimeUtc() );
+        if ( ! m_inProgressTimer->isActive() )
+            m_inProgressTimer->start();
+        queueDownload( uid );
+        if ( ! m_watermarkTimer->isActive() )
+            m_watermarkTimer->start();
+    } else {
+        // Saved by some previous run which predates the watermark
+        markArchived( uid );
+    }
+}
+
+/** @short Let the scheduler hand out the message to one of the connections
+
+The UIDs are collected first, so that they can be split into reasonable ranges.
+*/
+void MailSynchronizer::queueDownload( const uint uid )
+{
+    m_toDownload << uid;
+    if ( ! m_downloadTimer->isActive() )
+        m_downloadTimer->start();
+}
+
+void MailSynchronizer::slotEnqueueDownloads()
+{
+    // The workers expect the UIDs of each range in ascending order
+    qSort( m_toDownload );
+    m_scheduler->enqueueDownloads( m_mailbox, m_toDownload );
+    m_toDownload.clear();
+}
+
+void MailSynchronizer::slotDownloadsAbandoned( const QString &mailbox, const Imap::Uids &uids )
+{
+    if ( mailbox != m_mailbox )
+        return;
+    // The next walkNewMessages() will find out what has happened to them
+    Q_FOREACH( const uint uid, uids ) {
+        m_inProgress.remove( uid );
+    }
+}
+
+void MailSynchronizer::slotMessageDownloadFailed( const QModelIndex &message )
+{
+    // It stays pending in the watermark, so the next walkNewMessages() retries it
+    m_inProgress.remove( message.data( Imap::Mailbox::RoleMessageUid ).toUInt() );
+}
+
+/** @short Forget about messages whose download has not finished for too long, so that they can be retried */
+void MailSynchronizer::slotExpireInProgress()
+{
+    const QDateTime deadline = QDateTime::currentDateTimeUtc().addSecs( -inProgressTimeout );
+    QHash<uint, QDateTime>::iterator it = m_inProgress.begin();
+    while ( it != m_inProgress.end() ) {
+        if ( *it < deadline ) {
+            qDebug() << "Mailbox" << m_mailbox << ": giving up on UID" << it.key() << ", will retry later";
+            it = m_inProgress.erase( it );
+        } else {
+            ++it;
+        }
+    }
+    if ( m_inProgress.isEmpty() )
+        m_inProgressTimer->stop();
+}
+
+void MailSynchronizer::markArchived( const uint uid )
+{
+    m_inProgress.remove( uid );
+    if ( ! m_watermarkValid )
+        return;
+    m_watermark.markArchived( uid );
+    if ( ! m_watermarkTimer->isActive() )
+        m_watermarkTimer->start();
+}
+
+void MailSynchronizer::slotSaveWatermark()
+{
+    m_watermarkTimer->stop();
+    if ( m_cache && m_watermarkValid && m_watermark.uidValidity() != 0 )
+        m_cache->setArchiveWatermark( m_mailbox, m_watermark );
+}
+
+/** @short Return the UID of a message, treating messages whose UID is not known yet as the newest ones */
+uint MailSynchronizer::rowUid( const QModelIndex &list, const int row ) const
+{
+    const uint uid = m_model->index( row, 0, list ).data( Imap::Mailbox::RoleMessageUid ).toUInt();
+    return uid ? uid : UINT_MAX;
+}
+
+/** @short Find the first row whose UID is higher than @arg uid, or the number of rows if there's none */
+int MailSynchronizer::firstRowAbove( const QModelIndex &list, const uint uid ) const
+{
+    // UIDs are strictly ascending within a mailbox
+    int low = 0;
+    int high = m_model->rowCount( list );
+    while ( low < high ) {
+        const int middle = low + ( high - low ) / 2;
+        if ( rowUid( list, middle ) <= uid )
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+int MailSynchronizer::findRowByUid( const QModelIndex &list, const uint uid ) const
+{
+    const int row = firstRowAbove( list, uid - 1 );
+    if ( row < m_model->rowCount( list ) && rowUid( list, row ) == uid )
+        return row;
+    return -1;
+}
+
 bool MailSynchronizer::renewMailboxIndex()
 {
     if ( ! m_index.isValid() ) {
@@ -142,8 +380,6 @@ void MailSynchronizer::switchHere()
 
 void MailSynchronizer::slotMessageDataReady( const QModelIndex &message, const QByteArray &headers, const QByteArray &body, const QString &mainPart )
 {
-    Common::SqlTransactionAutoAborter guard = m_storage->transactionGuard();
-
     QVariant dateTimeVariant = message.data( Imap::Mailbox::RoleMessageDate );
     QVariant subject = message.data( Imap::Mailbox::RoleMessageSubject );
     Q_ASSERT(dateTimeVariant.isValid());
@@ -157,82 +393,103 @@ void MailSynchronizer::slotMessageDataReady( const QModelIndex &message, const Q
         dateTime = QDateTime::currentDateTimeUtc();
     }
 
-    quint64 emlId;
-    SqlStorage::ResultType res = m_storage->insertMail( dateTime, subject.toString(),
-                                                        mainPart, headers, body, emlId );
-
-    if ( res == SqlStorage::RESULT_DUPLICATE ) {
-        m_model->logTrace(message, Common::LOG_OTHER, QLatin1String("MailSynchronizer"), QLatin1String("Duplicate message"));
-        emit messageIsDuplicate( m_mailbox, message );
-        return;
-    }
-
-    if ( res == SqlStorage::RESULT_ERROR ) {
-        m_model->logTrace(message, Common::LOG_OTHER, QLatin1String("MailSynchronizer"), QLatin1String("Cannot store into Postgres"));
-        qWarning() << "Inserting failed";
-        return;
-    }
-
-    _saveAddrList( emlId, message.data( Imap::Mailbox::RoleMessageFrom ), QLatin1String("FROM") );
-    _saveAddrList( emlId, message.data( Imap::Mailbox::RoleMessageTo ), QLatin1String("TO") );
-    _saveAddrList( emlId, message.data( Imap::Mailbox::RoleMessageCc ), QLatin1String("CC") );
-    _saveAddrList( emlId, message.data( Imap::Mailbox::RoleMessageBcc ), QLatin1String("BCC") );
+    SqlStorage::MailData mail;
+    mail.dateTime = dateTime;
+    mail.subject = subject.toString();
+    mail.readableText = mainPart;
+    mail.headers = headers;
+    mail.body = body;
+    _appendAddrList( mail.addresses, message.data( Imap::Mailbox::RoleMessageFrom ), "FROM" );
+    _appendAddrList( mail.addresses, message.data( Imap::Mailbox::RoleMessageTo ), "TO" );
+    _appendAddrList( mail.addresses, message.data( Imap::Mailbox::RoleMessageCc ), "CC" );
+    _appendAddrList( mail.addresses, message.data( Imap::Mailbox::RoleMessageBcc ), "BCC" );
+
+    m_batch << mail;
+    m_batchMessages << message;
+    m_batchUids << message.data( Imap::Mailbox::RoleMessageUid ).toUInt();
+
+    if ( m_batch.size() >= batchSize )
+        slotFlushBatch();
+    else if ( ! m_batchTimer->isActive() )
+        m_batchTimer->start();
+}
 
-    if ( m_storage->markMailReady( emlId ) != SqlStorage::RESULT_OK ) {
-        m_model->logTrace(message, Common::LOG_OTHER, QLatin1String("MailSynchronizer"),
-                          QLatin1String("Failed to mark mail ready"));
-        qWarning() << "Failed to mark mail ready";
+void MailSynchronizer::slotFlushBatch()
+{
+    m_batchTimer->stop();
+    if ( m_batch.isEmpty() )
         return;
-    }
 
-    if ( ! guard.commit() ) {
-        m_model->logTrace(message, Common::LOG_OTHER, QLatin1String("MailSynchronizer"),
-                          QLatin1String("Failed to commit current transaction"));
-        m_storage->fail( QLatin1String("Failed to commit current transaction") );
-        return;
+    QList<SqlStorage::ResultType> results = m_storage->insertMails( m_batch );
+    Q_ASSERT( results.size() == m_batch.size() );
+    QList<QPersistentModelIndex> messages = m_batchMessages;
+    QList<uint> uids = m_batchUids;
+    m_batch.clear();
+    m_batchMessages.clear();
+    m_batchUids.clear();
+
+    for ( int i = 0; i < results.size(); ++i ) {
+        const QModelIndex message = messages[i];
+        const uint uid = uids[i];
+        switch ( results[i] ) {
+        case SqlStorage::RESULT_OK:
+            markArchived( uid );
+            emit messageSaved( m_mailbox, message );
+            break;
+        case SqlStorage::RESULT_DUPLICATE:
+            m_model->logTrace(message, Common::LOG_OTHER, QLatin1String("MailSynchronizer"), QLatin1String("Duplicate message"));
+            markArchived( uid );
+            emit messageIsDuplicate( m_mailbox, message );
+            break;
+        case SqlStorage::RESULT_ERROR:
+            // This leaves a gap in the watermark, so the message gets retried by the next walkNewMessages()
+            m_model->logTrace(message, Common::LOG_OTHER, QLatin1String("MailSynchronizer"), QLatin1String("Cannot store into Postgres"));
+            qWarning() << "Inserting failed";
+            m_inProgress.remove( uid );
+            break;
+        }
     }
-
-    emit messageSaved( m_mailbox, message );
 }
 
-void MailSynchronizer::_saveAddrList( const quint64 emlId, const QVariant &addresses, const QLatin1String kind )
+void MailSynchronizer::_appendAddrList( QList<SqlStorage::MailAddress> &target, const QVariant &addresses, const char *kind )
 {
-    // FIXME: batched updates would be great...
     Q_ASSERT( addresses.type() == QVariant::List );
     Q_FOREACH( const QVariant &item, addresses.toList() ) {
         Q_ASSERT( item.isValid() );
         Q_ASSERT( item.type() == QVariant::StringList );
         QStringList expanded = item.toStringList();
         Q_ASSERT( expanded.size() == 4 );
-        QString name = expanded[0];
+        SqlStorage::MailAddress res;
+        res.kind = kind;
+        res.name = expanded[0];
 
-        QString address;
         if ( expanded[2].isEmpty() && expanded[3].isEmpty() ) {
-            address = QLatin1String("undisclosed-recipients;");
+            res.address = QLatin1String("undisclosed-recipients;");
         } else if ( expanded[2].isEmpty() ) {
-            address = expanded[3];
+            res.address = expanded[3];
         } else if ( expanded[3].isEmpty() ) {
-            address = expanded[2];
+            res.address = expanded[2];
         } else {
-            address = expanded[2] + QLatin1Char('@') + expanded[3];
-        }
-
-        if ( m_storage->insertAddress( emlId, name, address, kind ) != SqlStorage::RESULT_OK ) {
-            m_model->logTrace(0, Common::LOG_OTHER, QLatin1String("MailSynchronizer"),
-                              QLatin1String("Failed to insert address"));
-            qWarning() << "Failed to insert address";
+            res.address = expanded[2] + QLatin1Char('@') + expanded[3];
         }
+        target << res;
     }
 }
 
 void MailSynchronizer::debugStats() const
 {
+    int active = 0;
+    int queued = 0;
+    Q_FOREACH( const MessageDownloader *downloader, m_downloaders ) {
+        active += downloader->activeMessages();
+        queued += downloader->pendingMessages();
+    }
     if ( m_index.isValid() ) {
         qDebug() << "Mailbox" << m_mailbox <<
                 ( m_index.data(Imap::Mailbox::RoleMailboxItemsAreLoading).toBool() ? "[loading]" : "" ) <<
                 "total" << m_index.data( Imap::Mailbox::RoleTotalMessageCount ).toUInt() <<
-                ", active" << m_downloader->activeMessages() << ", queued" << m_downloader->pendingMessages() <<
-                ", uid_wait" << m_deferredMessages.count();
+                ", in progress" << m_inProgress.count() << ", active" << active << ", queued" << queued <<
+                ", uid_wait" << m_deferredMessages.count() << ", batched" << m_batch.count();
     } else {
         qDebug() << "Mailbox" << m_mailbox << ": waiting for sync.";
     }
@@ -253,13 +510,9 @@ void MailSynchronizer::slotWalkDeferredMessages()
             qDebug() << m_mailbox << ": still no UID for message #" << it->row() + 1;
             ++it;
         } else {
-            bool shouldLoad = true;
             QModelIndex message = *it;
             it = m_deferredMessages.erase(it);
-            emit aboutToRequestMessage( m_mailbox, message, &shouldLoad );
-            if ( shouldLoad ) {
-                m_downloader->requestDownload(message);
-            }
+            processMessage( message, uid.toUInt() );
         }
     }
     if ( ! m_deferredMessages.isEmpty() )
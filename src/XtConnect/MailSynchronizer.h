@@ -30,10 +30,16 @@
 #ifndef MAILSYNCHRONIZER_H
 #define MAILSYNCHRONIZER_H
 
+#include <QDateTime>
+#include <QHash>
 #include <QObject>
 #include <QModelIndex>
+#include <QPointer>
 
 #include "Imap/Model/Model.h"
+#include "Imap/Parser/Uids.h"
+#include "ArchiveWatermark.h"
+#include "SqlStorage.h"
 
 namespace Imap {
 namespace Mailbox {
@@ -43,21 +49,38 @@ class MailboxFinder;
 
 namespace XtConnect {
 
+class DownloadScheduler;
 class MessageDownloader;
-class SqlStorage;
+class XtCache;
 
 /** @short Make sure that everything from a mailbox is eventually saved into the DB
 
 This class is responsible for checking all messages in a given mailbox, verifying if they were
 processed already, and if required, downloading them from the IMAP server and storing the data
 into the database.
+
+The progress is tracked through an ArchiveWatermark, so that the periodic checks only have to look at the messages
+which have arrived since the last time, and at those which could not be archived before.
+
+The messages are not downloaded by the synchronizer itself. They are queued in the DownloadScheduler, which lets any of
+the IMAP connections download them; the results are delivered by the MessageDownloaders registered through
+addDownloader().
+
+Downloaded messages are not stored one by one; they are collected and saved in batches to reduce the number of round
+trips to the database.
 */
 class MailSynchronizer : public QObject
 {
     Q_OBJECT
 public:
-    explicit MailSynchronizer( QObject *parent, Imap::Mailbox::Model *model, MailboxFinder *finder, MessageDownloader *downloader, SqlStorage *storage );
+    explicit MailSynchronizer( QObject *parent, Imap::Mailbox::Model *model, MailboxFinder *finder, DownloadScheduler *scheduler,
+                               SqlStorage *storage, XtCache *cache );
+    virtual ~MailSynchronizer();
     void setMailbox( const QString &mailbox );
+    /** @short Save the messages downloaded by @arg downloader, which is one of the downloaders of this mailbox */
+    void addDownloader( MessageDownloader *downloader );
+    /** @short Process the messages above the watermark and retry those which were not archived yet */
+    void walkNewMessages();
     /** @short Ask the Model that we're still here and need updates
 
 This is required if the total number of mailboxes exceeds the configured limit of parallel connections
@@ -81,6 +104,12 @@ private slots:
     void slotGetMailboxIndexAgain();
     void slotMessageDataReady( const QModelIndex &message, const QByteArray &headers, const QByteArray &body, const QString &mainPart );
     void slotWalkDeferredMessages();
+    void slotSaveWatermark();
+    void slotFlushBatch();
+    void slotEnqueueDownloads();
+    void slotDownloadsAbandoned( const QString &mailbox, const Imap::Uids &uids );
+    void slotMessageDownloadFailed( const QModelIndex &message );
+    void slotExpireInProgress();
 private:
     /** @short Walk through the cached messages and store the new ones */
     void walkThroughMessages( int start, int end );
@@ -90,16 +119,39 @@ This function will queue renewal automatically.
 */
     bool renewMailboxIndex();
 
-    void _saveAddrList( const quint64 emlId, const QVariant &addresses, const QLatin1String kind );
+    bool loadWatermark();
+    void processMessage( const QModelIndex &message, const uint uid );
+    void queueDownload( const uint uid );
+    void markArchived( const uint uid );
+    uint rowUid( const QModelIndex &list, const int row ) const;
+    int firstRowAbove( const QModelIndex &list, const uint uid ) const;
+    int findRowByUid( const QModelIndex &list, const uint uid ) const;
+
+    void _appendAddrList( QList<SqlStorage::MailAddress> &target, const QVariant &addresses, const char *kind );
 
     Imap::Mailbox::Model* m_model;
     MailboxFinder *m_finder;
-    MessageDownloader *m_downloader;
+    DownloadScheduler *m_scheduler;
+    QList<MessageDownloader*> m_downloaders;
     SqlStorage *m_storage;
     QString m_mailbox;
     QPersistentModelIndex m_index;
     QList<QPersistentModelIndex> m_deferredMessages;
     QTimer *m_deferredTimer;
+    QPointer<XtCache> m_cache;
+    ArchiveWatermark m_watermark;
+    bool m_watermarkValid;
+    QTimer *m_watermarkTimer;
+    /** @short UIDs which were passed to the downloader and whose result is not known yet, along with the time of the request */
+    QHash<uint, QDateTime> m_inProgress;
+    QTimer *m_inProgressTimer;
+    /** @short UIDs which will be passed to the scheduler soon */
+    Imap::Uids m_toDownload;
+    QTimer *m_downloadTimer;
+    QList<SqlStorage::MailData> m_batch;
+    QList<QPersistentModelIndex> m_batchMessages;
+    QList<uint> m_batchUids;
+    QTimer *m_batchTimer;
 };
 
 }
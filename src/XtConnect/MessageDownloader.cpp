@@ -28,6 +28,7 @@
 */
 
 #include "MessageDownloader.h"
+#include "DownloadScheduler.h"
 #include "Imap/Model/FindInterestingPart.h"
 #include "Imap/Model/ItemRoles.h"
 #include "Imap/Model/MailboxTree.h"
@@ -37,20 +38,15 @@
 
 namespace XtConnect {
 
-enum {BATCH_SIZE = 300};
-
-MessageDownloader::MessageDownloader(QObject *parent, Imap::Mailbox::Model *model, const QString &mailboxName):
-    QObject(parent), m_model(model), registeredMailbox(mailboxName)
+MessageDownloader::MessageDownloader(QObject *parent, Imap::Mailbox::Model *model, DownloadScheduler *scheduler, const QString &mailboxName):
+    QObject(parent), m_model(model), m_scheduler(scheduler), registeredMailbox(mailboxName)
 {
     m_releasingTimer = new QTimer(this);
     m_releasingTimer->setSingleShot(true);
     connect(m_releasingTimer, SIGNAL(timeout()), this, SLOT(slotFreeProcessedMessages()));
 
-    m_queuedTimer = new QTimer(this);
-    m_queuedTimer->setSingleShot(true);
-    connect(m_queuedTimer, SIGNAL(timeout()), this, SLOT(slotFetchQueuedMessages()));
-
     Q_ASSERT(m_model);
+    Q_ASSERT(m_scheduler);
     connect(m_model, SIGNAL(dataChanged(QModelIndex,QModelIndex)), this, SLOT(slotDataChanged(QModelIndex,QModelIndex)));
 }
 
@@ -67,10 +63,12 @@ void MessageDownloader::requestDownload( const QModelIndex &message )
     log(QString::fromUtf8("Requesting download of UID %1 from mailbox %2").arg(
             message.data(Imap::Mailbox::RoleMessageUid).toString(), registeredMailbox));
 
-    if (m_parts.size() >= BATCH_SIZE) {
-        m_queuedEnvelopes << message;
-    } else {
+    // Keep the order of requests intact; nothing can overtake messages which are already waiting
+    if (m_queuedEnvelopes.isEmpty() && m_scheduler->tryAcquire(m_model)) {
         reallyRequestDownload(message);
+    } else {
+        m_queuedEnvelopes << message;
+        m_scheduler->waitForCapacity(this);
     }
 }
 
@@ -220,6 +218,19 @@ void MessageDownloader::slotDataChanged( const QModelIndex &a, const QModelIndex
 #endif
     }
 
+    if ((!it->hasMessage && message.data(Imap::Mailbox::RoleIsUnavailable).toBool()) ||
+            (!it->hasHeader && header.data(Imap::Mailbox::RoleIsUnavailable).toBool()) ||
+            (!it->hasBody && text.data(Imap::Mailbox::RoleIsUnavailable).toBool()) ||
+            (!it->hasMainPart && !it->mainPartFailed && it->mainPart.isValid() &&
+             it->mainPart.data(Imap::Mailbox::RoleIsUnavailable).toBool())) {
+        // The Model won't try again on its own, so don't keep the slot occupied forever
+        log(QString::fromUtf8("Failed to download message %1").arg(QString::number(uid)));
+        m_parts.erase(it);
+        m_scheduler->release(m_model);
+        emit messageDownloadFailed(message);
+        return;
+    }
+
     if (a == message && !it->hasMessage) {
 
         if (!message.data(Imap::Mailbox::RoleIsFetched).toBool()) {
@@ -262,14 +273,12 @@ void MessageDownloader::slotDataChanged( const QModelIndex &a, const QModelIndex
         log(QString::fromUtf8("Downloaded message %1").arg(QString::number(uid)));
         emit messageDownloaded( message, headerData.toByteArray(), bodyData.toByteArray(), mainPart );
         m_parts.erase(it);
+        m_scheduler->release(m_model);
 
         m_messagesToBeFreed << message;
         if (!m_releasingTimer->isActive())
             m_releasingTimer->start();
 
-        if (!m_queuedTimer->isActive() && m_parts.size() <= BATCH_SIZE / 10)
-            m_queuedTimer->start();
-
     } else {
 #ifdef DEBUG_PENDING_MESSAGES
         qDebug() << "Something is missing for" << uid << it->hasHeader << it->hasBody << it->hasMessage << it->hasMainPart;
@@ -306,14 +315,25 @@ void MessageDownloader::slotFreeProcessedMessages()
     m_messagesToBeFreed.clear();
 }
 
-void MessageDownloader::slotFetchQueuedMessages()
+void MessageDownloader::fetchQueuedMessages(const int maxCount)
 {
-    for (int i = 0; i < BATCH_SIZE; ++i) {
+    for (int i = 0; i < maxCount; ++i) {
         if (m_queuedEnvelopes.isEmpty())
             return;
+        if (!m_queuedEnvelopes.head().isValid()) {
+            // The message got expunged while it was waiting
+            m_queuedEnvelopes.dequeue();
+            --i;
+            continue;
+        }
+        if (!m_scheduler->tryAcquire(m_model))
+            break;
         QPersistentModelIndex message = m_queuedEnvelopes.dequeue();
         reallyRequestDownload(message);
     }
+
+    if (!m_queuedEnvelopes.isEmpty())
+        m_scheduler->waitForCapacity(this);
 }
 
 }
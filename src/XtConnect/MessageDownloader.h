@@ -37,29 +37,36 @@ class QTimer;
 
 namespace XtConnect {
 
+class DownloadScheduler;
+
 /** @short Download messages from the IMAP server
 
 This class is responsible for requesting message structure, finding out the "most interesting part",
 downloading all required parts and finally making the data retrieved so far available to other
 parts of the application.
+
+The number of messages which are being downloaded at the same time over each connection is limited by a DownloadScheduler
+which is shared by all downloaders.
 */
 class MessageDownloader : public QObject
 {
     Q_OBJECT
 public:
     /** @short Create a new downloader and inform it to ignore messages which belong to another mailbox */
-    explicit MessageDownloader(QObject *parent, Imap::Mailbox::Model *model, const QString &mailboxName);
+    explicit MessageDownloader(QObject *parent, Imap::Mailbox::Model *model, DownloadScheduler *scheduler, const QString &mailboxName);
     /** @short Find out the body structure of a message and ask for relevant parts */
     void requestDownload( const QModelIndex &message );
     void reallyRequestDownload( const QModelIndex &message );
     int activeMessages() const;
     int pendingMessages() const;
+    const Imap::Mailbox::Model *model() const { return m_model; }
 
     void requestDataDownload(const QModelIndex &message);
+    /** @short Start downloading at most @arg maxCount of the queued messages, subject to the scheduler's capacity */
+    void fetchQueuedMessages(const int maxCount);
 private slots:
     void slotDataChanged( const QModelIndex &a, const QModelIndex &b );
     void slotFreeProcessedMessages();
-    void slotFetchQueuedMessages();
 
 signals:
     /** @short All data for a message are available
@@ -69,6 +76,8 @@ be supported) and all parts of the message were available from the Model, their
 and are passed through the parameters here.
 */
     void messageDownloaded( const QModelIndex &message, const QByteArray &headers, const QByteArray &body, const QString &mainPart );
+    /** @short Some of the data of a message could not be downloaded, so the downloader has given up on it */
+    void messageDownloadFailed( const QModelIndex &message );
 
 private:
     struct MessageMetadata {
@@ -84,6 +93,7 @@ private:
 
     QMap<uint, MessageMetadata> m_parts;
     Imap::Mailbox::Model *m_model;
+    DownloadScheduler *m_scheduler;
 
     /** @short A list of messages for which the Model shall be asked to free memory */
     QList<QPersistentModelIndex> m_messagesToBeFreed;
@@ -92,7 +102,6 @@ private:
     QQueue<QPersistentModelIndex> m_queuedEnvelopes;
 
     QTimer *m_releasingTimer;
-    QTimer *m_queuedTimer;
 
     /** @short Mailbox to which all messages got to belong */
     QString registeredMailbox;
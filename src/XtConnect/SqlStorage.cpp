@@ -30,10 +30,49 @@
 #include "SqlStorage.h"
 #include <QCryptographicHash>
 #include <QDebug>
+#include <QMap>
+#include <QSet>
 #include <QSqlError>
+#include <QStringList>
 #include <QTimer>
 #include <QVariant>
 
+namespace {
+
+/** @short How many addresses to insert by a single statement */
+const int addressesPerStatement = 500;
+
+/** @short Format a list of binary values as a PostgreSQL bytea[] literal */
+QString byteaArrayLiteral( const QList<QByteArray> &items )
+{
+    QStringList res;
+    Q_FOREACH( const QByteArray &item, items ) {
+        res << QLatin1String("\"\\\\x") + QString::fromLatin1(item.toHex()) + QLatin1Char('"');
+    }
+    return QLatin1Char('{') + res.join(QLatin1String(",")) + QLatin1Char('}');
+}
+
+/** @short Format a list of IDs as a PostgreSQL bigint[] literal */
+QString idArrayLiteral( const QList<quint64> &items )
+{
+    QStringList res;
+    Q_FOREACH( const quint64 item, items ) {
+        res << QString::number(item);
+    }
+    return QLatin1Char('{') + res.join(QLatin1String(",")) + QLatin1Char('}');
+}
+
+/** @short Return a VALUES clause with the given number of rows, each of them having a placeholder for every column */
+QString valuesClause( const int rows, const QString &row )
+{
+    QStringList res;
+    for ( int i = 0; i < rows; ++i )
+        res << row;
+    return res.join(QLatin1String(", "));
+}
+
+}
+
 namespace XtConnect {
 
 SqlStorage::SqlStorage(QObject *parent, const QString &host, const int port, const QString &dbname, const QString &username, const QString &password ) :
@@ -184,6 +223,164 @@ SqlStorage::ResultType SqlStorage::markMailReady( const quint64 emlId )
     return RESULT_OK;
 }
 
+QList<SqlStorage::ResultType> SqlStorage::insertMails( const QList<MailData> &mails )
+{
+    QList<QByteArray> hashes;
+    Q_FOREACH( const MailData &mail, mails ) {
+        hashes << QCryptographicHash::hash( mail.body, QCryptographicHash::Sha1 );
+    }
+
+    QList<ResultType> results;
+    if ( _insertMailBatch( mails, hashes, results ) )
+        return results;
+
+    // Something in the batch was wrong; the transaction got rolled back, so let's find out which message was the culprit
+    results.clear();
+    Q_FOREACH( const MailData &mail, mails ) {
+        results << _insertSingleMail( mail );
+    }
+    return results;
+}
+
+bool SqlStorage::_insertMailBatch( const QList<MailData> &mails, const QList<QByteArray> &hashes, QList<ResultType> &results )
+{
+    Q_ASSERT( mails.size() == hashes.size() );
+    if ( mails.isEmpty() )
+        return true;
+
+    Common::SqlTransactionAutoAborter guard = transactionGuard();
+
+    QSqlQuery query( db );
+    if ( ! query.prepare( QLatin1String("SELECT eml_hash::bytea FROM xtbatch.eml WHERE eml_hash::bytea = ANY(CAST(? AS bytea[]))") ) ) {
+        _fail( "Failed to prepare the duplicate check", query );
+        return false;
+    }
+    query.addBindValue( byteaArrayLiteral( hashes ) );
+    if ( ! query.exec() ) {
+        _fail( "Batched duplicate check failed", query );
+        return false;
+    }
+    QSet<QByteArray> knownHashes;
+    while ( query.next() )
+        knownHashes.insert( query.value( 0 ).toByteArray() );
+
+    // Duplicates within the same batch are detected here as well
+    QList<int> newMails;
+    for ( int i = 0; i < mails.size(); ++i ) {
+        if ( knownHashes.contains( hashes[i] ) ) {
+            results << RESULT_DUPLICATE;
+        } else {
+            knownHashes.insert( hashes[i] );
+            newMails << i;
+            results << RESULT_OK;
+        }
+    }
+
+    if ( newMails.isEmpty() )
+        return guard.commit();
+
+    if ( ! query.prepare( QLatin1String("INSERT INTO xtbatch.eml "
+                                        "(eml_hash, eml_date, eml_subj, eml_body, eml_msg, eml_status) VALUES ") +
+                          valuesClause( newMails.size(), QLatin1String("(?, ?, ?, ?, ?, 'I')") ) +
+                          QLatin1String(" RETURNING eml_id, eml_hash::bytea") ) ) {
+        _fail( "Failed to prepare the batched insert", query );
+        return false;
+    }
+    Q_FOREACH( const int i, newMails ) {
+        const MailData &mail = mails[i];
+        query.addBindValue( hashes[i] );
+        // See insertMail() on why ISODate is used
+        query.addBindValue( mail.dateTime.toString(Qt::ISODate) );
+        query.addBindValue( mail.subject );
+        query.addBindValue( mail.readableText );
+        query.addBindValue( mail.headers + mail.body );
+    }
+    if ( ! query.exec() ) {
+        _fail( "Batched insert of messages failed", query );
+        return false;
+    }
+
+    // The order of rows returned by RETURNING is not guaranteed, hence the mapping through the hash
+    QMap<QByteArray, quint64> emlIds;
+    while ( query.next() )
+        emlIds[ query.value( 1 ).toByteArray() ] = query.value( 0 ).toULongLong();
+    if ( emlIds.size() != newMails.size() ) {
+        _fail( "Batched insert of messages did not return all IDs", query );
+        return false;
+    }
+
+    QList<quint64> ids;
+    QList<QVariant> addressValues;
+    Q_FOREACH( const int i, newMails ) {
+        const quint64 emlId = emlIds[ hashes[i] ];
+        ids << emlId;
+        Q_FOREACH( const MailAddress &address, mails[i].addresses ) {
+            addressValues << emlId << QString::fromLatin1( address.kind ) << address.address << address.name;
+        }
+    }
+
+    const int columns = 4;
+    for ( int offset = 0; offset < addressValues.size(); offset += addressesPerStatement * columns ) {
+        const int count = qMin( addressValues.size() - offset, addressesPerStatement * columns );
+        if ( ! query.prepare( QLatin1String("INSERT INTO xtbatch.emladdr "
+                                            "(emladdr_eml_id, emladdr_type, emladdr_addr, emladdr_name) VALUES ") +
+                              valuesClause( count / columns, QLatin1String("(?, ?, ?, ?)") ) ) ) {
+            _fail( "Failed to prepare the batched address insert", query );
+            return false;
+        }
+        for ( int i = offset; i < offset + count; ++i )
+            query.addBindValue( addressValues[i] );
+        if ( ! query.exec() ) {
+            _fail( "Batched insert of addresses failed", query );
+            return false;
+        }
+    }
+
+    if ( ! query.prepare( QLatin1String("UPDATE xtbatch.eml SET eml_status = 'O' WHERE eml_id = ANY(CAST(? AS bigint[]))") ) ) {
+        _fail( "Failed to prepare the batched status update", query );
+        return false;
+    }
+    query.addBindValue( idArrayLiteral( ids ) );
+    if ( ! query.exec() ) {
+        _fail( "Batched status update failed", query );
+        return false;
+    }
+
+    if ( ! guard.commit() ) {
+        _fail( "Failed to commit the batch", db );
+        return false;
+    }
+    return true;
+}
+
+SqlStorage::ResultType SqlStorage::_insertSingleMail( const MailData &mail )
+{
+    Common::SqlTransactionAutoAborter guard = transactionGuard();
+
+    quint64 emlId;
+    ResultType res = insertMail( mail.dateTime, mail.subject, mail.readableText, mail.headers, mail.body, emlId );
+    if ( res != RESULT_OK )
+        return res;
+
+    Q_FOREACH( const MailAddress &address, mail.addresses ) {
+        if ( insertAddress( emlId, address.name, address.address, QLatin1String(address.kind) ) != RESULT_OK ) {
+            qWarning() << "Failed to insert address";
+        }
+    }
+
+    if ( markMailReady( emlId ) != RESULT_OK ) {
+        qWarning() << "Failed to mark mail ready";
+        return RESULT_ERROR;
+    }
+
+    if ( ! guard.commit() ) {
+        _fail( "Failed to commit current transaction", db );
+        return RESULT_ERROR;
+    }
+
+    return RESULT_OK;
+}
+
 void SqlStorage::slotReconnect()
 {
     qDebug() << "Trying to reconnect to the database...";
@@ -32,6 +32,7 @@
 #define SQLSTORAGE_H
 
 #include <QDateTime>
+#include <QList>
 #include <QObject>
 #include <QSqlDatabase>
 #include <QSqlQuery>
@@ -50,6 +51,24 @@ public:
 
     typedef enum { RESULT_OK, RESULT_DUPLICATE, RESULT_ERROR } ResultType;
 
+    /** @short One address of a message which gets saved through insertMails() */
+    struct MailAddress {
+        /** @short FROM, TO, CC or BCC */
+        const char *kind;
+        QString name;
+        QString address;
+    };
+
+    /** @short Everything which insertMails() needs to know about a message */
+    struct MailData {
+        QDateTime dateTime;
+        QString subject;
+        QString readableText;
+        QByteArray headers;
+        QByteArray body;
+        QList<MailAddress> addresses;
+    };
+
     explicit SqlStorage(QObject *parent, const QString &host, const int port, const QString &dbname, const QString &username, const QString &password);
     void open();
 
@@ -60,6 +79,14 @@ public:
     /** @short Mark the row in the eml table as "ready for processing" */
     ResultType markMailReady( const quint64 emlId );
 
+    /** @short Save a batch of messages along with their addresses and mark them as ready
+
+    The whole batch is checked for duplicates by a single query and inserted through multi-row statements within one
+    transaction. Should that fail, each message is retried on its own so that a single bad message cannot prevent the
+    rest of the batch from being saved. The result for each message is returned at the corresponding position.
+    */
+    QList<ResultType> insertMails( const QList<MailData> &mails );
+
     /** @short Return an object which aborts the transaction upon its destruction (RIAA-like approach to transactions) */
     Common::SqlTransactionAutoAborter transactionGuard();
     /** @short Log a message saying that something talking to the DB failed */
@@ -74,6 +101,8 @@ private slots:
 
 private:
     void _prepareStatements();
+    bool _insertMailBatch( const QList<MailData> &mails, const QList<QByteArray> &hashes, QList<ResultType> &results );
+    ResultType _insertSingleMail( const MailData &mail );
     void _fail( const QString &message, const QSqlQuery &query );
     void _fail( const QString &message, const QSqlDatabase &database );
 
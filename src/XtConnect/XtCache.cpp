@@ -19,6 +19,8 @@
    Boston, MA 02110-1301, USA.
 */
 
+#include <QDataStream>
+#include <QSqlError>
 #include "XtCache.h"
 #include "Imap/Model/SQLCache.h"
 
@@ -37,7 +39,31 @@ XtCache::~XtCache()
 
 bool XtCache::open()
 {
-    return _sqlCache->open( _name, _cacheDir + QLatin1String("/imap.cache.sqlite") );
+    if ( ! _sqlCache->open( _name, _cacheDir + QLatin1String("/imap.cache.sqlite") ) )
+        return false;
+
+    // The watermarks live in the same DB file, but the SQLCache doesn't know anything about them
+    QSqlDatabase db = QSqlDatabase::database( _name );
+    QSqlQuery q( QString(), db );
+    if ( ! q.exec( QLatin1String("CREATE TABLE IF NOT EXISTS xt_archive_watermark ( "
+                                 "mailbox STRING NOT NULL PRIMARY KEY, data BINARY )") ) ) {
+        emit error( QString::fromUtf8("XtCache: Can't create table xt_archive_watermark: %1").arg( q.lastError().text() ) );
+        return false;
+    }
+    _queryArchiveWatermark = QSqlQuery( db );
+    if ( ! _queryArchiveWatermark.prepare( QLatin1String("SELECT data FROM xt_archive_watermark WHERE mailbox = ?") ) ) {
+        emit error( QString::fromUtf8("XtCache: Can't prepare queryArchiveWatermark: %1").arg(
+                        _queryArchiveWatermark.lastError().text() ) );
+        return false;
+    }
+    _querySetArchiveWatermark = QSqlQuery( db );
+    if ( ! _querySetArchiveWatermark.prepare( QLatin1String("INSERT OR REPLACE INTO xt_archive_watermark ( mailbox, data ) "
+                                                            "VALUES ( ?, ? )") ) ) {
+        emit error( QString::fromUtf8("XtCache: Can't prepare querySetArchiveWatermark: %1").arg(
+                        _querySetArchiveWatermark.lastError().text() ) );
+        return false;
+    }
+    return true;
 }
 
 QList<Imap::Mailbox::MailboxMetadata> XtCache::childMailboxes( const QString& mailbox ) const
@@ -170,6 +196,41 @@ void XtCache::setMessageSavingStatus( const QString &mailbox, const uint uid, co
     _sqlCache->setMsgFlags( mailbox, uid, flags );
 }
 
+ArchiveWatermark XtCache::archiveWatermark( const QString &mailbox ) const
+{
+    ArchiveWatermark res;
+    _queryArchiveWatermark.bindValue( 0, mailbox );
+    if ( ! _queryArchiveWatermark.exec() ) {
+        emit error( QString::fromUtf8("XtCache: Query queryArchiveWatermark failed: %1").arg(
+                        _queryArchiveWatermark.lastError().text() ) );
+        return res;
+    }
+    if ( _queryArchiveWatermark.first() ) {
+        QByteArray buf = _queryArchiveWatermark.value( 0 ).toByteArray();
+        QDataStream stream( &buf, QIODevice::ReadOnly );
+        stream.setVersion( QDataStream::Qt_4_6 );
+        stream >> res;
+        if ( stream.status() != QDataStream::Ok )
+            res = ArchiveWatermark();
+    }
+    _queryArchiveWatermark.finish();
+    return res;
+}
+
+void XtCache::setArchiveWatermark( const QString &mailbox, const ArchiveWatermark &watermark )
+{
+    QByteArray buf;
+    QDataStream stream( &buf, QIODevice::WriteOnly );
+    stream.setVersion( QDataStream::Qt_4_6 );
+    stream << watermark;
+    _querySetArchiveWatermark.bindValue( 0, mailbox );
+    _querySetArchiveWatermark.bindValue( 1, buf );
+    if ( ! _querySetArchiveWatermark.exec() ) {
+        emit error( QString::fromUtf8("XtCache: Query querySetArchiveWatermark failed: %1").arg(
+                        _querySetArchiveWatermark.lastError().text() ) );
+    }
+}
+
 QVector<Imap::Responses::ThreadingNode> XtCache::messageThreading(const QString &mailbox)
 {
     Q_UNUSED(mailbox);
@@ -22,7 +22,9 @@
 #ifndef XTCONNECT_XTCACHE
 #define XTCONNECT_XTCACHE
 
+#include <QSqlQuery>
 #include "Imap/Model/Cache.h"
+#include "ArchiveWatermark.h"
 
 namespace Imap {
 namespace Mailbox {
@@ -110,6 +112,11 @@ public:
     /** @short Set message saving status */
     void setMessageSavingStatus( const QString &mailbox, const uint uid, const SavingState status );
 
+    /** @short Return the archiving progress of a mailbox, or an empty watermark if nothing is known */
+    ArchiveWatermark archiveWatermark( const QString &mailbox ) const;
+    /** @short Remember the archiving progress of a mailbox */
+    void setArchiveWatermark( const QString &mailbox, const ArchiveWatermark &watermark );
+
 private:
     /** @short The SQL-based cache */
     Imap::Mailbox::SQLCache* _sqlCache;
@@ -117,6 +124,9 @@ private:
     QString _name;
     /** @short Directory to serve as a cache root */
     QString _cacheDir;
+
+    mutable QSqlQuery _queryArchiveWatermark;
+    QSqlQuery _querySetArchiveWatermark;
 };
 
 }
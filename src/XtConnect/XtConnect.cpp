@@ -36,6 +36,8 @@
 #include "Common/FileLogger.h"
 #include "Common/PortNumbers.h"
 #include "Common/SettingsNames.h"
+#include "DownloadScheduler.h"
+#include "DownloadWorker.h"
 #include "XtCache.h"
 #include "Imap/Model/ItemRoles.h"
 #include "Imap/Model/MailboxFinder.h"
@@ -47,7 +49,7 @@
 namespace XtConnect {
 
 XtConnect::XtConnect(QObject *parent, QSettings *s) :
-    QObject(parent), m_model(0), m_settings(s), m_cache(0)
+    QObject(parent), m_settings(s), m_scheduler(0)
 {
     Q_ASSERT(m_settings);
     m_settings->setParent(this);
@@ -63,6 +65,7 @@ XtConnect::XtConnect(QObject *parent, QSettings *s) :
     bool readstdin = true;
     bool logConsole = false;
     QString logFile;
+    int connections = 1;
 
     QStringList args = QCoreApplication::arguments();
     for ( int i = 1; i < args.length(); i++ ) {
@@ -89,6 +92,10 @@ XtConnect::XtConnect(QObject *parent, QSettings *s) :
         } else if (args.at(i) == "--log" && args.length() > i) {
             if (args.length() <= i + 1) qFatal("The \"--log\" option requires a value.");
             logFile = args.at(++i);
+        } else if (args.at(i) == "--connections" && args.length() > i) {
+            if (args.length() <= i + 1) qFatal("The \"--connections\" option requires a value.");
+            connections = args.at(++i).toInt();
+            if (connections < 1) qFatal("The number of connections has to be positive.");
         } else {
             QByteArray err = args.at(i).toLocal8Bit();
             qFatal("Error: unrecognized command line option '%s'.", err.constData());
@@ -100,7 +107,7 @@ XtConnect::XtConnect(QObject *parent, QSettings *s) :
         password = QTextStream(stdin).readLine();
     }
 
-    setupModels();
+    setupModels(connections);
 
     Common::FileLogger *logger = new Common::FileLogger(this);
     if (logConsole)
@@ -109,10 +116,12 @@ XtConnect::XtConnect(QObject *parent, QSettings *s) :
         logger->setFileLogging(true, logFile);
         logger->setAutoFlush(true);
     }
-    connect(m_model, SIGNAL(logged(uint,Common::LogMessage)), logger, SLOT(slotImapLogged(uint,Common::LogMessage)));
+    Q_FOREACH(Imap::Mailbox::Model *model, m_models) {
+        connect(model, SIGNAL(logged(uint,Common::LogMessage)), logger, SLOT(slotImapLogged(uint,Common::LogMessage)));
+        m_finders << new MailboxFinder( this, model );
+    }
 
     // Prepare the mailboxes
-    m_finder = new MailboxFinder( this, m_model );
     SqlStorage *storage = new SqlStorage( this, host, port, dbname, username, password );
     connect(storage, SIGNAL(encounteredError(QString)), this, SLOT(slotSqlError(QString)));
     storage->open();
@@ -122,9 +131,26 @@ XtConnect::XtConnect(QObject *parent, QSettings *s) :
     statsDumper->setInterval( 5000 );
     statsDumper->start();
 
-    Q_FOREACH( const QString &mailbox, s->value( Common::SettingsNames::xtSyncMailboxList ).toStringList() ) {
-        MessageDownloader *downloader = new MessageDownloader(this, m_model, mailbox);
-        MailSynchronizer *sync = new MailSynchronizer(this, m_model, m_finder, downloader, storage);
+    // The same amount of data in flight for each connection as with the original per-mailbox limit
+    m_scheduler = new DownloadScheduler( this, 300 );
+    QList<DownloadWorker*> workers;
+    for ( int i = 0; i < m_models.size(); ++i ) {
+        workers << new DownloadWorker( this, m_models[i], m_finders[i], m_scheduler );
+    }
+
+    const QStringList mailboxes = s->value( Common::SettingsNames::xtSyncMailboxList ).toStringList();
+    for ( int i = 0; i < mailboxes.size(); ++i ) {
+        const QString &mailbox = mailboxes[i];
+        // The progress of a mailbox is tracked by the same worker all the time, otherwise its cached state would be lost.
+        // The messages themselves can be downloaded by any of the workers.
+        const int owner = i % m_models.size();
+        m_mailboxOwners[ mailbox ] = owner;
+        MailSynchronizer *sync = new MailSynchronizer(this, m_models[owner], m_finders[owner], m_scheduler, storage, m_caches[owner]);
+        Q_FOREACH( DownloadWorker *worker, workers ) {
+            MessageDownloader *downloader = new MessageDownloader( this, worker->model(), m_scheduler, mailbox );
+            worker->addDownloader( mailbox, downloader );
+            sync->addDownloader( downloader );
+        }
         connect( sync, SIGNAL(aboutToRequestMessage(QString,QModelIndex,bool*)), this, SLOT(slotAboutToRequestMessage(QString,QModelIndex,bool*)) );
         connect( sync, SIGNAL(messageSaved(QString,QModelIndex)), this, SLOT(slotMessageStored(QString,QModelIndex)) );
         connect( sync, SIGNAL(messageIsDuplicate(QString,QModelIndex)), this, SLOT(slotMessageIsDuplicate(QString,QModelIndex)) );
@@ -138,7 +164,22 @@ XtConnect::XtConnect(QObject *parent, QSettings *s) :
     m_rotateMailboxes->start();
 }
 
-void XtConnect::setupModels()
+XtConnect::~XtConnect()
+{
+    // The synchronizers save their progress into the caches and the database, so they have to go away before these do
+    Q_FOREACH( const QPointer<MailSynchronizer> &sync, m_syncers ) {
+        delete sync.data();
+    }
+}
+
+void XtConnect::setupModels(const int connections)
+{
+    for ( int i = 0; i < connections; ++i ) {
+        m_models << setupModel( i );
+    }
+}
+
+Imap::Mailbox::Model *XtConnect::setupModel(const int number)
 {
     Imap::Mailbox::SocketFactoryPtr factory;
     Imap::Mailbox::TaskFactoryPtr taskFactory( new Imap::Mailbox::TaskFactory() );
@@ -170,34 +211,50 @@ void XtConnect::setupModels()
         shouldUsePersistentCache = false;
     }
 
+    QString cacheName = QLatin1String("trojita-imap-cache");
+    if ( number > 0 ) {
+        // SQLite doesn't cope well with several writers, that's why each connection gets a cache of its own. The first one
+        // keeps using the original location.
+        cacheDir += QString::fromUtf8("/connection-%1").arg(number);
+        cacheName += QString::fromUtf8("-%1").arg(number);
+        if ( shouldUsePersistentCache && ! QDir().mkpath( cacheDir ) ) {
+            qCritical() << "Failed to create directory" << cacheDir << " -- will not remember anything on restart!";
+            shouldUsePersistentCache = false;
+        }
+    }
+
+    XtCache *cache = 0;
     if ( shouldUsePersistentCache ) {
-        m_cache = new XtCache( this, QLatin1String("trojita-imap-cache"), cacheDir );
-        connect( m_cache, SIGNAL(error(QString)), this, SLOT(cacheError(QString)) );
-        if ( ! m_cache->open() ) {
+        cache = new XtCache( this, cacheName, cacheDir );
+        connect( cache, SIGNAL(error(QString)), this, SLOT(cacheError(QString)) );
+        if ( ! cache->open() ) {
             // Error message was already shown by the cacheError() slot
-            m_cache->deleteLater();
-            m_cache = 0;
+            cache->deleteLater();
+            cache = 0;
         }
     }
+    m_caches << cache;
 
-    m_model = new Imap::Mailbox::Model(this, m_cache ? static_cast<Imap::Mailbox::AbstractCache*>(m_cache) :
-                                                       static_cast<Imap::Mailbox::AbstractCache*>(new Imap::Mailbox::MemoryCache(this)),
-                                       factory, taskFactory, m_settings->value(SettingsNames::imapStartOffline).toBool());
-    m_model->setObjectName( QLatin1String("model") );
+    Imap::Mailbox::Model *model = new Imap::Mailbox::Model(this, cache ? static_cast<Imap::Mailbox::AbstractCache*>(cache) :
+                                                                         static_cast<Imap::Mailbox::AbstractCache*>(new Imap::Mailbox::MemoryCache(this)),
+                                                           factory, taskFactory, m_settings->value(SettingsNames::imapStartOffline).toBool());
+    model->setObjectName( number == 0 ? QString::fromUtf8("model") : QString::fromUtf8("model-%1").arg(number) );
     // We want to wait longer to increase the potential of better grouping -- we don't care much about the latency
-    m_model->setProperty( "trojita-imap-delayed-fetch-part", 300 );
+    model->setProperty( "trojita-imap-delayed-fetch-part", 300 );
     // Disable preload of message envelopes. We are aggresively cleaning the cache as soon as possible, and
     // we don't want to re-request message envelopes for messages which have been already processed before.
-    m_model->setProperty("trojita-imap-preload-msg-metadata", 0);
-
-    connect( m_model, SIGNAL( alertReceived( const QString& ) ), this, SLOT( alertReceived( const QString& ) ) );
-    connect( m_model, SIGNAL( imapError( const QString& ) ), this, SLOT( connectionError( const QString& ) ) );
-    connect( m_model, SIGNAL( networkError( const QString& ) ), this, SLOT( connectionError( const QString& ) ) );
-    connect(m_model, SIGNAL(authRequested()), this, SLOT(authenticationRequested()), Qt::QueuedConnection);
-    connect(m_model, SIGNAL(authAttemptFailed(QString)), this, SLOT(authenticationFailed(QString)));
-    connect(m_model, SIGNAL(needsSslDecision(QList<QSslCertificate>,QList<QSslError>)),
+    model->setProperty("trojita-imap-preload-msg-metadata", 0);
+
+    connect( model, SIGNAL( alertReceived( const QString& ) ), this, SLOT( alertReceived( const QString& ) ) );
+    connect( model, SIGNAL( imapError( const QString& ) ), this, SLOT( connectionError( const QString& ) ) );
+    connect( model, SIGNAL( networkError( const QString& ) ), this, SLOT( connectionError( const QString& ) ) );
+    connect(model, SIGNAL(authRequested()), this, SLOT(authenticationRequested()), Qt::QueuedConnection);
+    connect(model, SIGNAL(authAttemptFailed(QString)), this, SLOT(authenticationFailed(QString)));
+    connect(model, SIGNAL(needsSslDecision(QList<QSslCertificate>,QList<QSslError>)),
             this, SLOT(sslErrors(QList<QSslCertificate>,QList<QSslError>)), Qt::QueuedConnection);
-    connect( m_model, SIGNAL(connectionStateChanged(QObject*,Imap::ConnectionState)), this, SLOT(showConnectionStatus(QObject*,Imap::ConnectionState)) );
+    connect( model, SIGNAL(connectionStateChanged(QObject*,Imap::ConnectionState)), this, SLOT(showConnectionStatus(QObject*,Imap::ConnectionState)) );
+
+    return model;
 }
 
 void XtConnect::alertReceived(const QString &alert)
@@ -211,29 +268,35 @@ void XtConnect::authenticationRequested()
         qWarning() << "Warning: no IMAP password set in the configuration.";
         qWarning() << "Please remember to configure the synchronization service in Trojita GUI's settings dialog.";
     }
-    m_model->setImapUser(m_settings->value(Common::SettingsNames::imapUserKey).toString());
-    m_model->setImapPassword(m_settings->value(Common::SettingsNames::imapPassKey).toString());
+    Imap::Mailbox::Model *model = qobject_cast<Imap::Mailbox::Model*>(sender());
+    Q_ASSERT(model);
+    model->setImapUser(m_settings->value(Common::SettingsNames::imapUserKey).toString());
+    model->setImapPassword(m_settings->value(Common::SettingsNames::imapPassKey).toString());
 }
 
 void XtConnect::sslErrors(const QList<QSslCertificate> &certificateChain, const QList<QSslError> &errors)
 {
+    Imap::Mailbox::Model *model = qobject_cast<Imap::Mailbox::Model*>(sender());
+    Q_ASSERT(model);
     QByteArray lastKnownCertPem = m_settings->value(Common::SettingsNames::imapSslPemCertificate).toByteArray();
     QList<QSslCertificate> lastKnownCerts = lastKnownCertPem.isEmpty() ?
                 QList<QSslCertificate>() :
                 QSslCertificate::fromData(lastKnownCertPem, QSsl::Pem);
     if (!certificateChain.isEmpty() && !lastKnownCerts.isEmpty() && certificateChain == lastKnownCerts) {
         // It's the same certificate as the last time; we should accept that
-        m_model->setSslPolicy(certificateChain, errors, true);
+        model->setSslPolicy(certificateChain, errors, true);
         return;
     }
-    m_model->setSslPolicy(certificateChain, errors, false);
+    model->setSslPolicy(certificateChain, errors, false);
     qFatal("SECURITY ERROR: SSL certificate validation has failed. Please run Trojita to accept the certificate.");
 }
 
 void XtConnect::connectionError(const QString &error)
 {
     qCritical() << "Connection error: " << error;
-    m_model->setNetworkOffline();
+    Q_FOREACH(Imap::Mailbox::Model *model, m_models) {
+        model->setNetworkOffline();
+    }
     // FIXME: add some nice behavior for reconnecting. Also handle failed logins...
     qFatal("Reconnects not supported yet -> see you.");
 }
@@ -241,16 +304,19 @@ void XtConnect::connectionError(const QString &error)
 void XtConnect::authenticationFailed(const QString &message)
 {
     qCritical() << "Cannot login to the IMAP server: " << message;
-    m_model->setNetworkOffline();
+    Q_FOREACH(Imap::Mailbox::Model *model, m_models) {
+        model->setNetworkOffline();
+    }
     qFatal("Unable to login to the IMAP server");
 }
 
 void XtConnect::cacheError(const QString &error)
 {
     qCritical() << "Cache error: " << error;
-    if ( m_model ) {
-        m_cache = 0;
-        m_model->setCache(new Imap::Mailbox::MemoryCache(m_model));
+    const int i = m_caches.indexOf( qobject_cast<XtCache*>( sender() ) );
+    if ( i != -1 && i < m_models.size() ) {
+        m_caches[i] = 0;
+        m_models[i]->setCache(new Imap::Mailbox::MemoryCache(m_models[i]));
     }
 }
 
@@ -278,14 +344,16 @@ void XtConnect::goTroughMailboxes()
 {
     Q_FOREACH( MailSynchronizer *sync, m_syncers ) {
         sync->switchHere();
+        sync->walkNewMessages();
     }
 }
 
 void XtConnect::slotAboutToRequestMessage( const QString &mailbox, const QModelIndex &message, bool *shouldLoad )
 {
     Q_ASSERT( shouldLoad );
-    if ( m_cache ) {
-        XtCache::SavingState status = m_cache->messageSavingStatus( mailbox, message.data( Imap::Mailbox::RoleMessageUid ).toUInt() );
+    XtCache *cache = cacheForModel( message.model() );
+    if ( cache ) {
+        XtCache::SavingState status = cache->messageSavingStatus( mailbox, message.data( Imap::Mailbox::RoleMessageUid ).toUInt() );
         switch ( status ) {
         case XtCache::STATE_DUPLICATE:
         case XtCache::STATE_SAVED:
@@ -299,15 +367,18 @@ void XtConnect::slotAboutToRequestMessage( const QString &mailbox, const QModelI
 
 void XtConnect::slotMessageStored( const QString &mailbox, const QModelIndex &message )
 {
-    if ( m_cache ) {
-        m_cache->setMessageSavingStatus( mailbox,  message.data( Imap::Mailbox::RoleMessageUid ).toUInt(), XtCache::STATE_SAVED );
+    // The message might have been downloaded by another connection than the one which has checked it
+    XtCache *cache = cacheForMailbox( mailbox );
+    if ( cache ) {
+        cache->setMessageSavingStatus( mailbox,  message.data( Imap::Mailbox::RoleMessageUid ).toUInt(), XtCache::STATE_SAVED );
     }
 }
 
 void XtConnect::slotMessageIsDuplicate( const QString &mailbox, const QModelIndex &message )
 {
-    if ( m_cache ) {
-        m_cache->setMessageSavingStatus( mailbox,  message.data( Imap::Mailbox::RoleMessageUid ).toUInt(), XtCache::STATE_DUPLICATE );
+    XtCache *cache = cacheForMailbox( mailbox );
+    if ( cache ) {
+        cache->setMessageSavingStatus( mailbox,  message.data( Imap::Mailbox::RoleMessageUid ).toUInt(), XtCache::STATE_DUPLICATE );
     }
 }
 
@@ -317,12 +388,33 @@ void XtConnect::slotDumpStats()
     Q_FOREACH( const QPointer<MailSynchronizer> item, m_syncers ) {
         item->debugStats();
     }
+    qDebug() << "Downloads in flight" << m_scheduler->inFlight() << "of" << m_scheduler->connectionCapacity() * m_models.size() <<
+                ", waiting mailboxes" << m_scheduler->waitingDownloaders() << ", queued ranges" << m_scheduler->queuedRanges();
+    Q_FOREACH( Imap::Mailbox::Model *model, m_models ) {
+        qDebug() << "  " << model->objectName() << ":" << m_scheduler->inFlight( model ) << "in flight";
+    }
+}
+
+XtCache *XtConnect::cacheForModel(const QAbstractItemModel *model) const
+{
+    for ( int i = 0; i < m_models.size(); ++i ) {
+        if ( m_models[i] == model )
+            return m_caches[i];
+    }
+    return 0;
+}
+
+/** @short Cache of the worker which keeps track of the progress of the @arg mailbox */
+XtCache *XtConnect::cacheForMailbox(const QString &mailbox) const
+{
+    QMap<QString, int>::const_iterator it = m_mailboxOwners.constFind( mailbox );
+    return it == m_mailboxOwners.constEnd() ? 0 : m_caches[*it];
 }
 
 void XtConnect::slotSqlError(const QString &message)
 {
     qWarning() << message;
-    m_model->logTrace(0, Common::LOG_OTHER, QLatin1String("SqlCache"), message);
+    m_models.first()->logTrace(0, Common::LOG_OTHER, QLatin1String("SqlCache"), message);
 }
 
 }
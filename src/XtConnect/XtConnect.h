@@ -38,14 +38,22 @@ class QSettings;
 
 namespace XtConnect {
 
+class DownloadScheduler;
 class XtCache;
 
-/** @short Handle storing the mails into the XTuple Connect database */
+/** @short Handle storing the mails into the XTuple Connect database
+
+Several independent Models are used, each of them with its own IMAP connection and its own cache. Each configured
+mailbox is watched by one of them, which decides what has to be archived. The messages themselves are downloaded by
+whichever connection is idle; the DownloadScheduler hands out ranges of UIDs and limits the number of messages in flight
+over each connection. All of them feed the same SQL storage.
+*/
 class XtConnect : public QObject
 {
     Q_OBJECT
 public:
     explicit XtConnect(QObject *parent, QSettings *s);
+    virtual ~XtConnect();
 
 public slots:
     /** @short IMAP alerts */
@@ -78,14 +86,22 @@ public slots:
     void slotSqlError(const QString &message);
 
 private:
-    void setupModels();
-
-    Imap::Mailbox::Model *m_model;
+    void setupModels(const int connections);
+    Imap::Mailbox::Model *setupModel(const int number);
+    XtCache *cacheForModel(const QAbstractItemModel *model) const;
+    XtCache *cacheForMailbox(const QString &mailbox) const;
+
+    /** @short One Model, and therefore one IMAP connection, for each of the parallel workers */
+    QList<Imap::Mailbox::Model*> m_models;
+    /** @short Cache of the corresponding Model, or null if it isn't persistent */
+    QList<XtCache*> m_caches;
+    QList<MailboxFinder*> m_finders;
     QSettings *m_settings;
-    MailboxFinder *m_finder;
+    DownloadScheduler *m_scheduler;
     QMap<QString, QPointer<MailSynchronizer> > m_syncers;
+    /** @short Index of the Model whose MailSynchronizer watches the mailbox */
+    QMap<QString, int> m_mailboxOwners;
     QTimer *m_rotateMailboxes;
-    XtCache *m_cache;
 };
 
 }
@@ -10,6 +10,7 @@
 //
 //
 #include "qwwsmtpclient.h"
+#include <QIODevice>
 #include <QSslSocket>
 #include <QtDebug>
 #include <QQueue>
@@ -60,7 +61,8 @@ struct SMTPCommand {
 
 class QwwSmtpClientPrivate {
 public:
-    QwwSmtpClientPrivate(QwwSmtpClient *qq) {
+    QwwSmtpClientPrivate(QwwSmtpClient *qq):
+        mailFailed(false), content(0), contentChunked(false), contentAtLineStart(true), contentEndsWithNewline(true) {
         q = qq;
     }
     QSslSocket *socket;
@@ -74,6 +76,7 @@ public:
     void onError(QAbstractSocket::SocketError);
     void _q_readFromSocket();
     void _q_encrypted();
+    void _q_bytesWritten();
     void processNextCommand(bool ok = true);
     void abortDialog();
 
@@ -83,7 +86,12 @@ public:
     void sendEhlo();
     void sendHelo();
     void sendQuit();
-    void sendRcpt();
+    QByteArray takeRcpt();
+    void startMail();
+    void continueMail();
+    void handleMailReply(int status, const QString &text);
+    void startContent(bool chunked);
+    void sendMoreContent();
 
     int lastId;
     bool inProgress;
@@ -96,6 +104,18 @@ public:
     QwwSmtpClient::AuthModes authModes;
 
     QQueue<SMTPCommand> commandqueue;
+
+    // Replies which the server still owes us for the mail transaction in progress. Without PIPELINING, there's at most
+    // one of them; with PIPELINING, the whole envelope is sent at once and the replies are matched in order.
+    enum MailReply { ReplyMailFrom, ReplyRcptTo, ReplyData, ReplyBurl, ReplyBdat, ReplyMessageEnd };
+    QQueue<MailReply> mailReplies;
+    bool mailFailed;
+
+    // message body which is being streamed either after the 354 reply to DATA, or as a sequence of BDAT chunks
+    QIODevice *content;
+    bool contentChunked;
+    bool contentAtLineStart;
+    bool contentEndsWithNewline;
 private:
     QwwSmtpClient *q;
 
@@ -117,6 +137,7 @@ void QwwSmtpClientPrivate::onConnected() {
 // - checks the cause of disconnection
 // - aborts or continues processing
 void QwwSmtpClientPrivate::onDisconnected() {
+    content = 0;
     setState(QwwSmtpClient::Disconnected);
     if (commandqueue.isEmpty()) {
         inProgress = false;
@@ -300,59 +321,8 @@ void QwwSmtpClientPrivate::_q_readFromSocket() {
             // trying to send mail
             case SMTPCommand::Mail:
             case SMTPCommand::MailBurl:
-            {
-                int stage = cmd.extra.toInt();
-                // temporary failure upon receiving the sender address (greylisting probably)
-                if (status==421 && stage==0) {
-                    errorString = rxlast.cap(2).trimmed();
-                    // temporary envelope failure (greylisting)
-                    setState(QwwSmtpClient::Connected);
-                    processNextCommand(false);
-                }
-                if (status==250 && stage==0) {
-                    // sender accepted
-                    errorString.clear();
-                    sendRcpt();
-                } else if (status==250 && stage==1) {
-                    // all receivers accepted
-                    if (cmd.type == SMTPCommand::MailBurl) {
-                        errorString.clear();
-                        QByteArray url = cmd.data.toList().at(2).toByteArray();
-                        qDebug() << "SMTP >>> BURL" << url << "LAST";
-                        socket->write("BURL " + url + " LAST\r\n");
-                        cmd.extra=2;
-                    } else {
-                        errorString.clear();
-                        qDebug() << "SMTP >>> DATA";
-                        socket->write("DATA\r\n");
-                        cmd.extra=2;
-                    }
-                } else if ((cmd.type == SMTPCommand::Mail && status==354 && stage==2)) {
-                    // DATA command accepted
-                    errorString.clear();
-                    QByteArray toBeWritten = cmd.data.toList().at(2).toByteArray();
-                    qDebug() << "SMTP >>>" << toBeWritten << "\r\n.\r\n";
-                    socket->write(toBeWritten); // expecting data to be already escaped (CRLF.CRLF)
-                    socket->write("\r\n.\r\n"); // termination token - CRLF.CRLF
-                    cmd.extra=3;
-                } else if ((cmd.type == SMTPCommand::MailBurl && status==250 && stage==2)) {
-                    // BURL succeeded
-                    setState(QwwSmtpClient::Connected);
-                    errorString.clear();
-                    processNextCommand();
-                } else if ((cmd.type == SMTPCommand::Mail && status==250 && stage==3)) {
-                    // mail queued
-                    setState(QwwSmtpClient::Connected);
-                    errorString.clear();
-                    processNextCommand();
-                } else {
-                    // something went wrong
-                    errorString = rxlast.cap(2).trimmed();
-                    setState(QwwSmtpClient::Connected);
-                    emit q->done(false);
-                    processNextCommand();
-                }
-            }
+                handleMailReply(status, rxlast.cap(2).trimmed());
+                break;
                 default: break;
             }
         } else {
@@ -443,13 +413,9 @@ void QwwSmtpClientPrivate::processNextCommand(bool ok) {
     break;
     case SMTPCommand::Mail:
     case SMTPCommand::MailBurl:
-    {
         setState(QwwSmtpClient::Sending);
-        QByteArray buf = QByteArray("MAIL FROM:<").append(cmd.data.toList().at(0).toByteArray()).append(">\r\n");
-        qDebug() << "SMTP >>>" << buf;
-        socket->write(buf);
+        startMail();
         break;
-    }
     case SMTPCommand::RawCommand: {
 	QString cont = cmd.data.toString();
 	if(!cont.endsWith("\r\n")) cont.append("\r\n");
@@ -502,21 +468,180 @@ void QwwSmtpClientPrivate::sendQuit() {
     setState(QwwSmtpClient::Disconnecting);
 }
 
-void QwwSmtpClientPrivate::sendRcpt() {
+// Removes the first of the remaining recipients from the current command and returns the RCPT TO for it
+QByteArray QwwSmtpClientPrivate::takeRcpt() {
     SMTPCommand &cmd = commandqueue.head();
     QVariantList vlist = cmd.data.toList();
     QList<QVariant> rcptlist = vlist.at(1).toList();
     QByteArray buf = QByteArray("RCPT TO:<").append(rcptlist.first().toByteArray()).append(">\r\n");
-    qDebug() << "SMTP >>>" << buf;
-    socket->write(buf);
     rcptlist.removeFirst();
     vlist[1] = rcptlist;
     cmd.data = vlist;
+    mailReplies.enqueue(ReplyRcptTo);
+    return buf;
+}
 
-    if (rcptlist.isEmpty()) cmd.extra = 1;
+// Sends the MAIL FROM. If the server supports PIPELINING (RFC 2920), all RCPT TOs and the DATA follow in the same
+// flight; the BURL and BDAT commands are only sent when the whole envelope was accepted.
+void QwwSmtpClientPrivate::startMail() {
+    SMTPCommand &cmd = commandqueue.head();
+    mailReplies.clear();
+    mailFailed = false;
+    QByteArray buf = QByteArray("MAIL FROM:<").append(cmd.data.toList().at(0).toByteArray()).append(">\r\n");
+    mailReplies.enqueue(ReplyMailFrom);
+    if (options.testFlag(QwwSmtpClient::PipeliningOption)) {
+        while (!cmd.data.toList().at(1).toList().isEmpty())
+            buf += takeRcpt();
+        if (cmd.type == SMTPCommand::Mail && !options.testFlag(QwwSmtpClient::ChunkingOption)) {
+            buf += "DATA\r\n";
+            mailReplies.enqueue(ReplyData);
+        }
+    }
+    qDebug() << "SMTP >>>" << buf;
+    socket->write(buf);
 }
 
+// Sends whatever comes next once all replies to the previous commands have arrived
+void QwwSmtpClientPrivate::continueMail() {
+    SMTPCommand &cmd = commandqueue.head();
+    if (!cmd.data.toList().at(1).toList().isEmpty()) {
+        QByteArray buf = takeRcpt();
+        qDebug() << "SMTP >>>" << buf;
+        socket->write(buf);
+    } else if (cmd.type == SMTPCommand::MailBurl) {
+        QByteArray url = cmd.data.toList().at(2).toByteArray();
+        qDebug() << "SMTP >>> BURL" << url << "LAST";
+        socket->write("BURL " + url + " LAST\r\n");
+        mailReplies.enqueue(ReplyBurl);
+    } else if (options.testFlag(QwwSmtpClient::ChunkingOption)) {
+        startContent(true);
+    } else {
+        qDebug() << "SMTP >>> DATA";
+        socket->write("DATA\r\n");
+        mailReplies.enqueue(ReplyData);
+    }
+}
+
+void QwwSmtpClientPrivate::handleMailReply(int status, const QString &text) {
+    if (mailReplies.isEmpty()) {
+        qDebug() << "SMTP: unexpected reply" << status << text;
+        return;
+    }
+
+    MailReply expected = mailReplies.dequeue();
+    bool ok = false;
+    switch (expected) {
+    case ReplyRcptTo:
+        ok = status == 250 || status == 251;
+        break;
+    case ReplyData:
+        ok = status == 354;
+        break;
+    case ReplyMailFrom:
+    case ReplyBurl:
+    case ReplyBdat:
+    case ReplyMessageEnd:
+        ok = status == 250;
+        break;
+    }
+
+    if (!ok && !mailFailed) {
+        // Only the first error is interesting, the rest are typically just "503 bad sequence of commands"
+        mailFailed = true;
+        errorString = text;
+        // no point in sending further chunks of data
+        content = 0;
+    }
 
+    if (expected == ReplyData && status == 354) {
+        if (mailFailed) {
+            // Part of the pipelined envelope was rejected, yet the server wants the data. Dropping the connection is
+            // the only way of preventing delivery of the message to a subset of the recipients.
+            qDebug() << "SMTP ** aborting the transaction";
+            socket->disconnectFromHost();
+            return;
+        }
+        startContent(false);
+        return;
+    }
+
+    if (!mailReplies.isEmpty() || content) {
+        // still waiting for some pipelined replies, or not done with sending the data yet
+        return;
+    }
+
+    if (mailFailed) {
+        setState(QwwSmtpClient::Connected);
+        emit q->done(false);
+        processNextCommand(false);
+    } else if (expected == ReplyBurl || expected == ReplyMessageEnd) {
+        // mail queued
+        setState(QwwSmtpClient::Connected);
+        errorString.clear();
+        processNextCommand();
+    } else {
+        errorString.clear();
+        continueMail();
+    }
+}
+
+void QwwSmtpClientPrivate::startContent(bool chunked) {
+    SMTPCommand &cmd = commandqueue.head();
+    errorString.clear();
+    content = qobject_cast<QIODevice*>(cmd.data.toList().at(2).value<QObject*>());
+    contentChunked = chunked;
+    contentAtLineStart = true;
+    contentEndsWithNewline = true;
+    if (!chunked)
+        mailReplies.enqueue(ReplyMessageEnd);
+    qDebug() << "SMTP >>> [message data]";
+    sendMoreContent();
+}
+
+// Writes the next chunks of the message body, but only as long as the socket does not have too much data queued.
+//
+// With CHUNKING (RFC 3030), each chunk is sent as a BDAT command whose reply is not waited for. Otherwise, the data are
+// dot-stuffed on the fly (RFC 5321, section 4.5.2) and the CRLF.CRLF terminator is sent at the end.
+void QwwSmtpClientPrivate::sendMoreContent() {
+    enum { CHUNK_SIZE = 64 * 1024, HIGH_WATER_MARK = 4 * CHUNK_SIZE };
+
+    while (content && socket->bytesToWrite() < HIGH_WATER_MARK) {
+        QByteArray chunk = content->read(CHUNK_SIZE);
+        if (contentChunked) {
+            bool last = chunk.isEmpty() || content->atEnd();
+            QByteArray header = "BDAT " + QByteArray::number(chunk.size()) + (last ? " LAST\r\n" : "\r\n");
+            qDebug() << "SMTP >>>" << header;
+            socket->write(header);
+            socket->write(chunk);
+            mailReplies.enqueue(last ? ReplyMessageEnd : ReplyBdat);
+            if (last)
+                content = 0;
+            continue;
+        }
+        if (chunk.isEmpty()) {
+            content = 0;
+            qDebug() << "SMTP >>> .";
+            socket->write(contentEndsWithNewline ? ".\r\n" : "\r\n.\r\n");
+            break;
+        }
+        QByteArray escaped;
+        escaped.reserve(chunk.size() + chunk.size() / 64 + 1);
+        for (int i = 0; i < chunk.size(); ++i) {
+            const char c = chunk.at(i);
+            if (contentAtLineStart && c == '.')
+                escaped.append('.');
+            escaped.append(c);
+            contentAtLineStart = c == '\n';
+        }
+        contentEndsWithNewline = contentAtLineStart;
+        socket->write(escaped);
+    }
+}
+
+void QwwSmtpClientPrivate::_q_bytesWritten() {
+    if (content)
+        sendMoreContent();
+}
 
 void QwwSmtpClientPrivate::sendAuthPlain(const QString & username, const QString & password) {
     QByteArray ba;
@@ -546,6 +671,7 @@ void QwwSmtpClientPrivate::parseOption(const QString &buffer){
     if(buffer.toLower()=="pipelining"){                     options |= QwwSmtpClient::PipeliningOption;     }
     else if(buffer.toLower()=="starttls"){                  options |= QwwSmtpClient::StartTlsOption;       }
     else if(buffer.toLower()=="8bitmime"){                  options |= QwwSmtpClient::EightBitMimeOption;   }
+    else if(buffer.toLower()=="chunking"){                  options |= QwwSmtpClient::ChunkingOption;       }
     else if(buffer.toLower().startsWith("auth ")){          options |= QwwSmtpClient::AuthOption;
         // parse auth modes
         QStringList slist = buffer.mid(5).split(" ");
@@ -574,6 +700,7 @@ QwwSmtpClient::QwwSmtpClient(QObject *parent)
     connect(d->socket, SIGNAL(readyRead()), this, SLOT(_q_readFromSocket()));
     connect(d->socket, SIGNAL(sslErrors(const QList<QSslError> &)), this, SIGNAL(sslErrors(const QList<QSslError>&)));
     connect(d->socket, SIGNAL(encrypted()), this, SLOT(_q_encrypted()));
+    connect(d->socket, SIGNAL(bytesWritten(qint64)), this, SLOT(_q_bytesWritten()));
 }
 
 
@@ -650,7 +777,8 @@ int QwwSmtpClient::authenticate(const QString &user, const QString &password, Au
     return cmd.id;
 }
 
-int QwwSmtpClient::sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &content)
+// The content device is read as the data get sent; it has to remain valid until the command finishes.
+int QwwSmtpClient::sendMail(const QByteArray &from, const QList<QByteArray> &to, QIODevice *content)
 {
     QList<QVariant> rcpts;
     for(QList<QByteArray>::const_iterator it = to.begin(); it != to.end(); it ++) {
@@ -658,7 +786,7 @@ int QwwSmtpClient::sendMail(const QByteArray &from, const QList<QByteArray> &to,
     }
     SMTPCommand cmd;
     cmd.type = SMTPCommand::Mail;
-    cmd.data = QVariantList() << from << QVariant(rcpts) << content;
+    cmd.data = QVariantList() << from << QVariant(rcpts) << QVariant::fromValue(static_cast<QObject*>(content));
     cmd.id = ++d->lastId;
     d->commandqueue.enqueue(cmd);
     if (!d->inProgress)
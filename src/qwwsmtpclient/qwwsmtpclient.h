@@ -17,6 +17,7 @@
 #include <QString>
 #include <QSslError>
 
+class QIODevice;
 class QwwSmtpClientPrivate;
 
 /*!
@@ -33,6 +34,8 @@ class QwwSmtpClientPrivate;
                 - low-level mail sending (everything you pass, goes through to the server)
                 - raw command sending
                 - multiple rcpt
+                - PIPELINING (RFC 2920) of the envelope
+                - CHUNKING (RFC 3030) of the message body via BDAT
                 - option reporting
 
        \todo    CRAM-MD5 Authentication
@@ -54,7 +57,8 @@ public:
     explicit QwwSmtpClient(QObject *parent = 0);
     ~QwwSmtpClient();
     enum State { Disconnected, Connecting, Connected, TLSRequested, Authenticating, Sending, Disconnecting };
-    enum Option { NoOptions = 0, StartTlsOption, SizeOption, PipeliningOption, EightBitMimeOption, AuthOption };
+    enum Option { NoOptions = 0, StartTlsOption = 1, SizeOption = 2, PipeliningOption = 4, EightBitMimeOption = 8,
+                  AuthOption = 16, ChunkingOption = 32 };
     Q_DECLARE_FLAGS ( Options, Option );
     enum AuthMode { AuthNone = 0, AuthAny = 1, AuthPlain = 2, AuthLogin = 4 };
     Q_DECLARE_FLAGS ( AuthModes, AuthMode );
@@ -65,7 +69,7 @@ public:
     int connectToHostEncrypted(const QString &hostName, quint16 port = 465);
 //     int connectToHost ( const QHostAddress & address, quint16 port = 25);
     int authenticate(const QString &user, const QString &password, AuthMode mode = AuthAny);
-    int sendMail(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &content);
+    int sendMail(const QByteArray &from, const QList<QByteArray> &to, QIODevice *content);
     int sendMailBurl(const QByteArray &from, const QList<QByteArray> &to, const QByteArray &url);
     int rawCommand(const QString &cmd);
     AuthModes supportedAuthModes() const;
@@ -96,6 +100,7 @@ private:
     Q_PRIVATE_SLOT(d, void onError(QAbstractSocket::SocketError));
     Q_PRIVATE_SLOT(d, void _q_readFromSocket());
     Q_PRIVATE_SLOT(d, void _q_encrypted());
+    Q_PRIVATE_SLOT(d, void _q_bytesWritten());
     friend class QwwSmtpClientPrivate;
 
     QwwSmtpClient(const QwwSmtpClient&); // don't implement
@@ -0,0 +1,123 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QBuffer>
+#include <QTest>
+#include "test_Composer_MessageStream.h"
+#include "Utils/headless_test.h"
+#include "Composer/MessageStream.h"
+
+using namespace Composer;
+
+namespace {
+
+QSharedPointer<QIODevice> bufferWith(const QByteArray &data)
+{
+    QBuffer *buf = new QBuffer();
+    buf->setData(data);
+    buf->open(QIODevice::ReadOnly);
+    return QSharedPointer<QIODevice>(buf);
+}
+
+QByteArray lineWrappedBase64(const QByteArray &data)
+{
+    QByteArray encoded = data.toBase64();
+    QByteArray res;
+    for (int i = 0; i < encoded.size(); i += 76)
+        res += encoded.mid(i, 76) + "\r\n";
+    return res;
+}
+
+/** @short Read the whole stream in small pieces to exercise the chunk boundaries */
+QByteArray readInPieces(QIODevice *dev, const int pieceSize)
+{
+    QByteArray res;
+    while (true) {
+        QByteArray piece = dev->read(pieceSize);
+        if (piece.isEmpty())
+            break;
+        res += piece;
+    }
+    return res;
+}
+
+}
+
+/** @short The announced size has to match the amount of the base64-encoded data */
+void ComposerMessageStreamTest::testBase64()
+{
+    QFETCH(int, rawSize);
+
+    QByteArray raw;
+    for (int i = 0; i < rawSize; ++i)
+        raw += static_cast<char>(i * 7);
+
+    MessageStream stream;
+    stream.appendData("header\r\n\r\n");
+    QVERIFY(stream.appendDevice(bufferWith(raw), MessageStream::ENCODING_BASE64));
+    stream.appendData("--end--\r\n");
+    QVERIFY(stream.open(QIODevice::ReadOnly | QIODevice::Unbuffered));
+
+    QByteArray expected = "header\r\n\r\n" + lineWrappedBase64(raw) + "--end--\r\n";
+    QCOMPARE(stream.size(), static_cast<qint64>(expected.size()));
+    QCOMPARE(readInPieces(&stream, 13), expected);
+}
+
+void ComposerMessageStreamTest::testBase64_data()
+{
+    QTest::addColumn<int>("rawSize");
+
+    QTest::newRow("empty") << 0;
+    QTest::newRow("one-byte") << 1;
+    QTest::newRow("partial-line") << 56;
+    QTest::newRow("exactly-one-line") << 57;
+    QTest::newRow("one-line-and-a-bit") << 58;
+    QTest::newRow("many-lines") << 57 * 1000 + 2;
+}
+
+/** @short Rewinding shall produce the very same data once again */
+void ComposerMessageStreamTest::testRewind()
+{
+    MessageStream stream;
+    stream.appendData("prefix ");
+    QVERIFY(stream.appendDevice(bufferWith("verbatim data"), MessageStream::ENCODING_NONE));
+    stream.appendData(" suffix");
+    QVERIFY(stream.open(QIODevice::ReadOnly | QIODevice::Unbuffered));
+
+    QByteArray first = readInPieces(&stream, 5);
+    QCOMPARE(first, QByteArray("prefix verbatim data suffix"));
+    QCOMPARE(stream.size(), static_cast<qint64>(first.size()));
+    QVERIFY(!stream.seek(3));
+    QVERIFY(stream.seek(0));
+    QCOMPARE(stream.readAll(), first);
+}
+
+/** @short Devices whose size is not known in advance cannot be used */
+void ComposerMessageStreamTest::testRejectsUnusableDevices()
+{
+    MessageStream stream;
+    QVERIFY(!stream.appendDevice(QSharedPointer<QIODevice>(), MessageStream::ENCODING_NONE));
+    QSharedPointer<QIODevice> closed(new QBuffer());
+    QVERIFY(!stream.appendDevice(closed, MessageStream::ENCODING_BASE64));
+}
+
+TROJITA_HEADLESS_TEST(ComposerMessageStreamTest)
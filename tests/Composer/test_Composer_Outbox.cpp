@@ -0,0 +1,259 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <QDir>
+#include <QScopedPointer>
+#include <QSignalSpy>
+#include <QTest>
+#include "test_Composer_Outbox.h"
+#include "Utils/headless_test.h"
+#include "Common/MetaTypes.h"
+#include "Composer/MessageComposer.h"
+#include "Composer/Outbox.h"
+#include "Imap/Model/MemoryCache.h"
+#include "Imap/Model/Model.h"
+#include "Imap/Model/TaskFactory.h"
+#include "Imap/Model/Utils.h"
+#include "MSA/FakeMSA.h"
+#include "Streams/SocketFactory.h"
+
+using namespace Composer;
+
+void ComposerOutboxTest::init()
+{
+    m_directory = QDir::tempPath() + QString::fromUtf8("/trojita-test-outbox-%1/").arg(QCoreApplication::applicationPid());
+    Imap::removeRecursively(m_directory);
+    m_msaFactory = new MSA::FakeFactory();
+    m_outbox = new Outbox(0, 0, m_msaFactory, m_directory);
+}
+
+void ComposerOutboxTest::cleanup()
+{
+    delete m_outbox;
+    m_outbox = 0;
+    m_msaFactory = 0;
+    Imap::removeRecursively(m_directory);
+}
+
+bool ComposerOutboxTest::enqueueMessage(const QString &subject)
+{
+    MessageComposer composer(0);
+    composer.setFrom(Imap::Message::MailAddress(QLatin1String("Foo Bar"), QString(),
+                                                QLatin1String("foo.bar"), QLatin1String("example.org")));
+    composer.setRecipients(QList<QPair<RecipientKind, Imap::Message::MailAddress> >() <<
+                           qMakePair(ADDRESS_TO, Imap::Message::MailAddress(QString(), QString(),
+                                                                            QLatin1String("rcpt"),
+                                                                            QLatin1String("example.org"))));
+    composer.setSubject(subject);
+    composer.setText(QLatin1String("Sample message"));
+    QString errorMessage;
+    bool ok = m_outbox->enqueue(&composer, QString(), &errorMessage);
+    if (!ok)
+        qDebug() << errorMessage;
+    return ok;
+}
+
+/** @short All queued messages go out through a single MSA session */
+void ComposerOutboxTest::testSessionSendsEverything()
+{
+    Outbox *outbox = m_outbox;
+    QSignalSpy requestedSendingSpy(m_msaFactory, SIGNAL(requestedSending(QByteArray,QList<QByteArray>,QByteArray)));
+    QSignalSpy sentSpy(outbox, SIGNAL(messageSent(QString)));
+
+    QVERIFY(enqueueMessage(QLatin1String("first")));
+    QVERIFY(enqueueMessage(QLatin1String("second")));
+    QCOMPARE(outbox->count(), 2);
+
+    outbox->flush();
+    QCOMPARE(requestedSendingSpy.size(), 1);
+    QCOMPARE(requestedSendingSpy[0][0].toByteArray(), QByteArray("foo.bar@example.org"));
+    QCOMPARE(requestedSendingSpy[0][1].value<QList<QByteArray> >(), QList<QByteArray>() << "rcpt@example.org");
+    QVERIFY(requestedSendingSpy[0][2].toByteArray().contains("Subject: first\r\n"));
+    MSA::Fake *msa = m_msaFactory->lastMSA();
+
+    m_msaFactory->doEmitSent();
+    // The second message is sent through the very same MSA instance
+    QCOMPARE(requestedSendingSpy.size(), 2);
+    QCOMPARE(m_msaFactory->lastMSA(), msa);
+    QVERIFY(requestedSendingSpy[1][2].toByteArray().contains("Subject: second\r\n"));
+
+    m_msaFactory->doEmitSent();
+    QCOMPARE(sentSpy.size(), 2);
+    QCOMPARE(outbox->count(), 0);
+    QVERIFY(QDir(m_directory).entryList(QDir::Files).isEmpty());
+}
+
+/** @short Messages which were not sent are loaded again by a new instance */
+void ComposerOutboxTest::testQueueSurvivesRestart()
+{
+    QVERIFY(enqueueMessage(QLatin1String("persistent")));
+    const QStringList ids = m_outbox->pendingIds();
+    QCOMPARE(ids.size(), 1);
+    delete m_outbox;
+
+    m_msaFactory = new MSA::FakeFactory();
+    Outbox *outbox = new Outbox(0, 0, m_msaFactory, m_directory);
+    m_outbox = outbox;
+    QCOMPARE(outbox->pendingIds(), ids);
+
+    QSignalSpy requestedSendingSpy(m_msaFactory, SIGNAL(requestedSending(QByteArray,QList<QByteArray>,QByteArray)));
+    outbox->flush();
+    QCOMPARE(requestedSendingSpy.size(), 1);
+    QVERIFY(requestedSendingSpy[0][2].toByteArray().contains("Subject: persistent\r\n"));
+}
+
+/** @short A failure postpones the whole batch and keeps the messages around */
+void ComposerOutboxTest::testBackoffAfterFailure()
+{
+    Outbox *outbox = m_outbox;
+    QSignalSpy requestedSendingSpy(m_msaFactory, SIGNAL(requestedSending(QByteArray,QList<QByteArray>,QByteArray)));
+    QSignalSpy failedSpy(outbox, SIGNAL(messageFailed(QString,QString)));
+
+    QVERIFY(enqueueMessage(QLatin1String("first")));
+    QVERIFY(enqueueMessage(QLatin1String("second")));
+    outbox->flush();
+    QCOMPARE(requestedSendingSpy.size(), 1);
+    m_msaFactory->doEmitError(QLatin1String("server is down"));
+    QCOMPARE(failedSpy.size(), 1);
+    QCOMPARE(failedSpy[0][1].toString(), QLatin1String("server is down"));
+    QCOMPARE(requestedSendingSpy.size(), 1);
+    QCOMPARE(outbox->count(), 2);
+
+    // Nothing is due yet
+    outbox->flush();
+    QCOMPARE(requestedSendingSpy.size(), 1);
+}
+
+/** @short Create an offline IMAP model which does not talk to any server */
+static Imap::Mailbox::Model *createModel()
+{
+    Imap::Mailbox::TaskFactoryPtr taskFactory(new Imap::Mailbox::TestingTaskFactory());
+    static_cast<Imap::Mailbox::TestingTaskFactory*>(taskFactory.get())->fakeOpenConnectionTask = true;
+    return new Imap::Mailbox::Model(0, new Imap::Mailbox::MemoryCache(0),
+                                    Imap::Mailbox::SocketFactoryPtr(new Streams::FakeSocketFactory(Imap::CONN_STATE_AUTHENTICATED)),
+                                    std::move(taskFactory));
+}
+
+void ComposerOutboxTest::replaceOutbox(Imap::Mailbox::Model *model)
+{
+    delete m_outbox;
+    m_msaFactory = new MSA::FakeFactory();
+    m_outbox = new Outbox(0, model, m_msaFactory, m_directory);
+}
+
+/** @short Nothing is attempted while offline, and everything goes out as soon as the network is back */
+void ComposerOutboxTest::testSendingAfterGoingOnline()
+{
+    QScopedPointer<Imap::Mailbox::Model> model(createModel());
+    QVERIFY(!model->isNetworkAvailable());
+    replaceOutbox(model.data());
+    Outbox *outbox = m_outbox;
+    QSignalSpy requestedSendingSpy(m_msaFactory, SIGNAL(requestedSending(QByteArray,QList<QByteArray>,QByteArray)));
+    QSignalSpy failedSpy(outbox, SIGNAL(messageFailed(QString,QString)));
+    QSignalSpy sentSpy(outbox, SIGNAL(messageSent(QString)));
+
+    QVERIFY(enqueueMessage(QLatin1String("offline")));
+    QCoreApplication::processEvents();
+    outbox->flush();
+    QCOMPARE(requestedSendingSpy.size(), 0);
+    QCOMPARE(failedSpy.size(), 0);
+    QCOMPARE(outbox->count(), 1);
+
+    model->setNetworkPolicy(Imap::Mailbox::NETWORK_ONLINE);
+    QCOMPARE(requestedSendingSpy.size(), 1);
+    QVERIFY(requestedSendingSpy[0][2].toByteArray().contains("Subject: offline\r\n"));
+    m_msaFactory->doEmitSent();
+    QCOMPARE(sentSpy.size(), 1);
+    QCOMPARE(outbox->count(), 0);
+
+    // A message which has failed gets another chance right after reconnecting instead of waiting for the backoff
+    QVERIFY(enqueueMessage(QLatin1String("flaky")));
+    QCoreApplication::processEvents();
+    QCOMPARE(requestedSendingSpy.size(), 2);
+    m_msaFactory->doEmitError(QLatin1String("connection reset"));
+    QCOMPARE(failedSpy.size(), 1);
+    model->setNetworkPolicy(Imap::Mailbox::NETWORK_OFFLINE);
+    model->setNetworkPolicy(Imap::Mailbox::NETWORK_EXPENSIVE);
+    QCOMPARE(requestedSendingSpy.size(), 3);
+    QVERIFY(requestedSendingSpy[2][2].toByteArray().contains("Subject: flaky\r\n"));
+
+    delete m_outbox;
+    m_outbox = 0;
+}
+
+/** @short The outbox stops retrying eventually, but the message can be retried explicitly */
+void ComposerOutboxTest::testGivingUp()
+{
+    QScopedPointer<Imap::Mailbox::Model> model(createModel());
+    model->setNetworkPolicy(Imap::Mailbox::NETWORK_ONLINE);
+    replaceOutbox(model.data());
+    Outbox *outbox = m_outbox;
+    QSignalSpy requestedSendingSpy(m_msaFactory, SIGNAL(requestedSending(QByteArray,QList<QByteArray>,QByteArray)));
+    QSignalSpy givenUpSpy(outbox, SIGNAL(messageGivenUp(QString,QString)));
+    QSignalSpy failedSpy(outbox, SIGNAL(messageFailed(QString,QString)));
+
+    QVERIFY(enqueueMessage(QLatin1String("rejected")));
+    const QString id = outbox->pendingIds().first();
+    outbox->flush();
+    for (int i = 0; i < Outbox::maximalAttempts; ++i) {
+        QCOMPARE(requestedSendingSpy.size(), i + 1);
+        QCOMPARE(givenUpSpy.size(), 0);
+        m_msaFactory->doEmitError(QLatin1String("550 no such user"));
+        // Reconnecting makes the message due right away
+        model->setNetworkPolicy(Imap::Mailbox::NETWORK_OFFLINE);
+        model->setNetworkPolicy(Imap::Mailbox::NETWORK_ONLINE);
+    }
+    QCOMPARE(requestedSendingSpy.size(), Outbox::maximalAttempts);
+    QCOMPARE(givenUpSpy.size(), 1);
+    QCOMPARE(givenUpSpy[0][0].toString(), id);
+    // The final attempt is not reported as something which will be retried
+    QCOMPARE(failedSpy.size(), Outbox::maximalAttempts - 1);
+    QCOMPARE(outbox->lastError(id), QString::fromUtf8("550 no such user"));
+    QCOMPARE(outbox->count(), 0);
+    QCOMPARE(outbox->failedIds(), QStringList() << id);
+
+    // It stays in the queue across restarts, but it isn't sent automatically
+    replaceOutbox(model.data());
+    outbox = m_outbox;
+    QSignalSpy restartedSendingSpy(m_msaFactory, SIGNAL(requestedSending(QByteArray,QList<QByteArray>,QByteArray)));
+    QCOMPARE(outbox->failedIds(), QStringList() << id);
+    QCoreApplication::processEvents();
+    outbox->flush();
+    QCOMPARE(restartedSendingSpy.size(), 0);
+
+    outbox->retryAllFailed();
+    QCOMPARE(restartedSendingSpy.size(), 1);
+    QVERIFY(outbox->failedIds().isEmpty());
+    QCOMPARE(outbox->count(), 1);
+
+    delete m_outbox;
+    m_outbox = 0;
+}
+
+void ComposerOutboxTest::testRetryDelay()
+{
+    QCOMPARE(Outbox::retryDelay(1), 60);
+    QCOMPARE(Outbox::retryDelay(2), 120);
+    QCOMPARE(Outbox::retryDelay(3), 240);
+    QCOMPARE(Outbox::retryDelay(100), 3600);
+}
+
+TROJITA_HEADLESS_TEST(ComposerOutboxTest)
@@ -224,6 +224,16 @@ void HtmlFormattingTest::testPlainTextFormattingViaHtml_data()
                                  "<span class=\"markup\">_</span></u><span class=\"markup\">*</span></b> "
                                  "<i><span class=\"markup\">/</span><b><span class=\"markup\">*</span>boo"
                                  "<span class=\"markup\">*</span></b><span class=\"markup\">/</span></i>");
+
+    QTest::newRow("formatting-with-entities")
+            << QString::fromUtf8("*a&b* /<x>/")
+            << QString::fromUtf8("<b><span class=\"markup\">*</span>a&amp;b<span class=\"markup\">*</span></b> "
+                                 "<i><span class=\"markup\">/</span>&lt;x&gt;<span class=\"markup\">/</span></i>");
+
+    QTest::newRow("formatting-around-mail")
+            << QString::fromUtf8("*foo@example.org*")
+            << QString::fromUtf8("<b><span class=\"markup\">*</span><a href=\"mailto:foo@example.org\">foo@example.org</a>"
+                                 "<span class=\"markup\">*</span></b>");
 }
 
 WebRenderingTester::WebRenderingTester()
@@ -739,4 +749,142 @@ void HtmlFormattingTest::testSignatures_data()
     QTest::newRow("replacement-of-multiline") << QString("foo\n-- \njohoho\nwtf\nbar") << QString("sig") << QString("foo\n-- \nsig");
 }
 
+/** @short Generate a synthetic text/plain message of roughly the requested size */
+static QString syntheticLongText(const int size, const UiUtils::FlowedFormat format)
+{
+    const QString softBreak = format == UiUtils::FlowedFormat::PLAIN ? QString("\n") : QString(" \n");
+    QString res;
+    int i = 0;
+    while (res.size() < size) {
+        res += QString("Paragraph %1 talks about http://example.org/%1/index.html and mentions ").arg(i) + softBreak
+                + QString("someone%1@example.org as well as some *bold* and /italic/ words which").arg(i) + softBreak
+                + QString("keep going for a while.\n");
+        if (i % 10 == 0) {
+            res += QString("> A quote of the previous mail, line %1\n> with a link https://example.org/?q=%1\n").arg(i);
+            res += QString(">> And a nested quote of something else\n");
+        }
+        res += QString("Reply text %1\n\n").arg(i);
+        ++i;
+    }
+    return res;
+}
+
+/** @short Make sure that the chunks produced for incremental formatting yield the same result as one-shot formatting */
+void HtmlFormattingTest::testIncrementalFormatting()
+{
+    QFETCH(int, format);
+    const UiUtils::FlowedFormat flowed = static_cast<UiUtils::FlowedFormat>(format);
+
+    const QString text = syntheticLongText(300 * 1024, flowed);
+    QStringList chunks = UiUtils::splitPlainTextForIncrementalFormatting(text, flowed, 8 * 1024, 64 * 1024);
+    QVERIFY(chunks.size() > 2);
+    QCOMPARE(chunks.join(QString()), text);
+
+    int interactiveControlsId = 0;
+    QString incremental;
+    Q_FOREACH(const QString &chunk, chunks) {
+        QVERIFY(!chunk.isEmpty());
+        incremental += UiUtils::plainTextToHtml(chunk, flowed, &interactiveControlsId);
+    }
+    QCOMPARE(incremental, UiUtils::plainTextToHtml(text, flowed));
+
+    // Nothing is split after the signature separator
+    chunks = UiUtils::splitPlainTextForIncrementalFormatting(QString("foo\n-- \n") + text, flowed, 1, 1);
+    QCOMPARE(chunks.size(), 2);
+    QCOMPARE(chunks[0], QString("foo\n"));
+}
+
+/** @short The cached markup of a huge part is shown in pieces which are well-formed on their own */
+void HtmlFormattingTest::testIncrementalMarkupReplay()
+{
+    QFETCH(int, format);
+    const UiUtils::FlowedFormat flowed = static_cast<UiUtils::FlowedFormat>(format);
+
+    const QString markup = UiUtils::plainTextToHtml(syntheticLongText(300 * 1024, flowed), flowed);
+    QStringList chunks = UiUtils::splitMarkupForIncrementalDisplay(markup, 8 * 1024, 64 * 1024);
+    QVERIFY(chunks.size() > 2);
+    QCOMPARE(chunks.join(QString()), markup);
+    for (int i = 0; i < chunks.size(); ++i) {
+        QVERIFY(chunks[i].size() >= (i == 0 ? 8 * 1024 : 64 * 1024) || i == chunks.size() - 1);
+        QVERIFY(chunks[i].endsWith(QLatin1Char('\n')) || i == chunks.size() - 1);
+        // Each piece has to be parsed as a fragment of its own, so no element may span the boundary
+        QCOMPARE(chunks[i].count(QString("<span")), chunks[i].count(QString("</span>")));
+        QCOMPARE(chunks[i].count(QString("<blockquote")), chunks[i].count(QString("</blockquote>")));
+        QCOMPARE(chunks[i].count(QString("<label")), chunks[i].count(QString("</label>")));
+    }
+
+    // Short markup comes in one piece
+    chunks = UiUtils::splitMarkupForIncrementalDisplay(QString("<span>foo</span>\nbar\n"), 8 * 1024, 64 * 1024);
+    QCOMPARE(chunks, QStringList() << QString("<span>foo</span>\nbar\n"));
+
+    // The whole document arrives through the formatter's signals, too
+    UiUtils::IncrementalPlainTextFormatter formatter(0);
+    QSignalSpy chunkSpy(&formatter, SIGNAL(chunkReady(QString)));
+    QSignalSpy finishedSpy(&formatter, SIGNAL(finished()));
+    QString replayed = formatter.replay(markup);
+    QCOMPARE(chunkSpy.count(), 0);
+    for (int i = 0; i < 1000 && finishedSpy.isEmpty(); ++i)
+        QCoreApplication::processEvents();
+    QCOMPARE(finishedSpy.count(), 1);
+    Q_FOREACH(const QList<QVariant> &arguments, chunkSpy) {
+        replayed += arguments[0].toString();
+    }
+    QCOMPARE(replayed, markup);
+}
+
+void HtmlFormattingTest::testIncrementalMarkupReplay_data()
+{
+    testIncrementalFormatting_data();
+}
+
+/** @short The formatter collects the complete markup even when the receiver drops the chunks, e.g. while loading */
+void HtmlFormattingTest::testIncrementalFormatterMarkup()
+{
+    QFETCH(int, format);
+    const UiUtils::FlowedFormat flowed = static_cast<UiUtils::FlowedFormat>(format);
+    const QString text = syntheticLongText(300 * 1024, flowed);
+
+    // Nobody takes care of the chunkReady() signals, so all chunks are "dropped"
+    UiUtils::IncrementalPlainTextFormatter formatter(0);
+    QSignalSpy finishedSpy(&formatter, SIGNAL(finished()));
+    const QString firstScreen = formatter.start(text, flowed);
+    QVERIFY(firstScreen.size() < text.size());
+    for (int i = 0; i < 1000 && finishedSpy.isEmpty(); ++i)
+        QTest::qWait(10);
+    QCOMPARE(finishedSpy.count(), 1);
+
+    // This is what goes into the cache
+    QCOMPARE(formatter.markup(), UiUtils::plainTextToHtml(text, flowed));
+}
+
+void HtmlFormattingTest::testIncrementalFormatterMarkup_data()
+{
+    testIncrementalFormatting_data();
+}
+
+void HtmlFormattingTest::testIncrementalFormatting_data()
+{
+    QTest::addColumn<int>("format");
+    QTest::newRow("plain") << static_cast<int>(UiUtils::FlowedFormat::PLAIN);
+    QTest::newRow("flowed") << static_cast<int>(UiUtils::FlowedFormat::FLOWED);
+    QTest::newRow("flowed-delsp") << static_cast<int>(UiUtils::FlowedFormat::FLOWED_DELSP);
+}
+
+/** @short Benchmark the conversion of a multi-megabyte text */
+void HtmlFormattingTest::benchmarkPlainTextFormatting()
+{
+    QFETCH(int, format);
+    const UiUtils::FlowedFormat flowed = static_cast<UiUtils::FlowedFormat>(format);
+    const QString text = syntheticLongText(4 * 1024 * 1024, flowed);
+
+    QBENCHMARK_ONCE {
+        UiUtils::plainTextToHtml(text, flowed);
+    }
+}
+
+void HtmlFormattingTest::benchmarkPlainTextFormatting_data()
+{
+    testIncrementalFormatting_data();
+}
+
 QTEST_MAIN(HtmlFormattingTest)
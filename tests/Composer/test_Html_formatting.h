@@ -24,7 +24,7 @@
 #define TEST_HTML_FORMATTING
 
 #include <QTest>
-#include "UiUtils/PlainTextFormatter.h"
+#include "UiUtils/IncrementalPlainTextFormatter.h"
 
 class QWebView;
 
@@ -53,6 +53,15 @@ private slots:
 
     void testSignatures();
     void testSignatures_data();
+
+    void testIncrementalFormatting();
+    void testIncrementalFormatting_data();
+    void testIncrementalMarkupReplay();
+    void testIncrementalMarkupReplay_data();
+    void testIncrementalFormatterMarkup();
+    void testIncrementalFormatterMarkup_data();
+    void benchmarkPlainTextFormatting();
+    void benchmarkPlainTextFormatting_data();
 };
 
 class WebRenderingTester: public QObject
@@ -29,6 +29,7 @@
 #include "Streams/FakeSocket.h"
 #include "Imap/Model/ItemRoles.h"
 #include "Imap/Model/MailboxTree.h"
+#include "Imap/Model/MemoryCache.h"
 
 struct Data {
     QString key;
@@ -64,6 +65,34 @@ char *toString(const QModelIndex &index)
 
 using namespace Imap::Mailbox;
 
+namespace {
+
+/** @short A cache which answers the requests for message parts only when told to */
+class DeferringCache : public MemoryCache
+{
+public:
+    explicit DeferringCache(QObject *parent): MemoryCache(parent)
+    {
+    }
+
+    virtual bool requestMessagePart(const QString &mailbox, const uint uid, const QByteArray &partId)
+    {
+        if (messagePart(mailbox, uid, partId).isNull())
+            return false;
+        requests << partId;
+        return true;
+    }
+
+    void deliver(const QString &mailbox, const uint uid, const QByteArray &partId, const QByteArray &data)
+    {
+        emit messagePartLoaded(mailbox, uid, partId, data);
+    }
+
+    QList<QByteArray> requests;
+};
+
+}
+
 /** @short Check that the part numbering works properly */
 void BodyPartsTest::testPartIds()
 {
@@ -203,6 +232,55 @@ void BodyPartsTest::testPartIds_data()
                 );
 }
 
+/** @short Check that a message with thousands of MIME parts can be browsed and fetched from */
+void BodyPartsTest::testHugeMimeTree()
+{
+    const int count = 2000;
+    QByteArray bodystructure;
+    for (int i = 0; i < count; ++i) {
+        bodystructure += "(\"message\" \"rfc822\" NIL NIL NIL \"7bit\" 100 "
+                "(NIL \"digest " + QByteArray::number(i) + "\" NIL NIL NIL NIL NIL NIL NIL NIL) "
+                "(\"text\" \"plain\" () NIL NIL \"7bit\" 10 1 NIL NIL NIL NIL) 3)";
+    }
+    bodystructure += " \"digest\"";
+
+    model->setProperty("trojita-imap-delayed-fetch-part", 0);
+
+    helperSyncBNoMessages();
+    cServer("* 1 EXISTS\r\n");
+    cClient(t.mk("UID FETCH 1:* (FLAGS)\r\n"));
+    cServer("* 1 FETCH (UID 333 FLAGS ())\r\n" + t.last("OK fetched\r\n"));
+
+    QModelIndex msg = msgListB.child(0, 0);
+    QVERIFY(msg.isValid());
+    QCOMPARE(model->rowCount(msg), 0);
+    cClient(t.mk("UID FETCH 333 (" FETCH_METADATA_ITEMS ")\r\n"));
+    QBENCHMARK_ONCE {
+        cServer("* 1 FETCH (UID 333 BODYSTRUCTURE (" + bodystructure + "))\r\n" + t.last("OK fetched\r\n"));
+    }
+    QCOMPARE(model->rowCount(msg), 1);
+
+    QModelIndex digest = msg.child(0, 0);
+    QCOMPARE(digest.data(Imap::Mailbox::RolePartMimeType).toString(), QString::fromUtf8("multipart/digest"));
+    QVERIFY(model->hasChildren(digest));
+    QCOMPARE(model->rowCount(digest), count);
+
+    QModelIndex lastMessage = digest.child(count - 1, 0);
+    QCOMPARE(lastMessage.data(Imap::Mailbox::RolePartId).toString(), QString::number(count));
+    QVERIFY(model->hasChildren(lastMessage));
+    QModelIndex lastText = lastMessage.child(0, 0);
+    QCOMPARE(lastText.data(Imap::Mailbox::RolePartMimeType).toString(), QString::fromUtf8("text/plain"));
+    QCOMPARE(lastText.data(Imap::Mailbox::RolePartId).toString(), QString::number(count) + QLatin1String(".1"));
+
+    QCOMPARE(lastText.data(Imap::Mailbox::RolePartData).toString(), QString());
+    cClient(t.mk("UID FETCH 333 (BODY.PEEK[2000.1])\r\n"));
+    cServer("* 1 FETCH (UID 333 BODY[2000.1] \"last one\")\r\n" + t.last("OK fetched\r\n"));
+    QCOMPARE(lastText.data(Imap::Mailbox::RolePartData).toByteArray(), QByteArray("last one"));
+
+    cEmpty();
+    QVERIFY(errorSpy->isEmpty());
+}
+
 /** @short Check that we catch responses which refer to invalid data */
 void BodyPartsTest::testInvalidPartFetch()
 {
@@ -251,6 +329,86 @@ void BodyPartsTest::testInvalidPartFetch_data()
     QTest::newRow("extra-part-signed-1-HEADER") << bsMultipartSignedTextPlain << "1.HEADER";
 }
 
+/** @short Parts which the cache loads in the background are delivered through Model::slotCachedPartLoaded */
+void BodyPartsTest::testCachedPartsLoadedLater()
+{
+    model->setProperty("trojita-imap-delayed-fetch-part", 0);
+    helperSyncBNoMessages();
+    cServer("* 1 EXISTS\r\n");
+    cClient(t.mk("UID FETCH 1:* (FLAGS)\r\n"));
+    cServer("* 1 FETCH (UID 333 FLAGS ())\r\n" + t.last("OK fetched\r\n"));
+    QModelIndex msg = msgListB.child(0, 0);
+    QVERIFY(msg.isValid());
+    QCOMPARE(model->rowCount(msg), 0);
+    cClient(t.mk("UID FETCH 333 (" FETCH_METADATA_ITEMS ")\r\n"));
+    cServer("* 1 FETCH (UID 333 BODYSTRUCTURE (" + bsManyPlaintexts + "))\r\n" + t.last("OK fetched\r\n"));
+    QModelIndex rootMultipart = msg.child(0, 0);
+    QVERIFY(rootMultipart.isValid());
+    QCOMPARE(model->rowCount(rootMultipart), 5);
+
+    DeferringCache *cache = new DeferringCache(model);
+    model->setCache(cache);
+    QSignalSpy dataChangedSpy(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)));
+
+    // The data of a regular part are used as-is
+    QModelIndex part = rootMultipart.child(0, 0);
+    QCOMPARE(part.data(RolePartId).toString(), QString("1"));
+    cache->setMsgPart("b", 333, "1", "Canary 1");
+    QCOMPARE(part.data(RolePartData).toByteArray(), QByteArray());
+    QCOMPARE(cache->requests, QList<QByteArray>() << "1");
+    QVERIFY(part.data(RoleIsFetched).toBool() == false);
+    QVERIFY(dataChangedSpy.isEmpty());
+    cache->deliver("b", 333, "1", "Canary 1");
+    QCOMPARE(dataChangedSpy.size(), 1);
+    QCOMPARE(dataChangedSpy[0][0].value<QModelIndex>(), part);
+    QVERIFY(part.data(RoleIsFetched).toBool());
+    QCOMPARE(part.data(RolePartData).toByteArray(), QByteArray("Canary 1"));
+    cEmpty();
+    dataChangedSpy.clear();
+    cache->requests.clear();
+
+    // Only the raw form is available, so it has to be decoded before it can be used for the part itself
+    QByteArray fakePartData = "Canary 2";
+    part = rootMultipart.child(1, 0);
+    QCOMPARE(part.data(RolePartId).toString(), QString("2"));
+    QModelIndex rawPart = part.child(0, TreeItem::OFFSET_RAW_CONTENTS);
+    QVERIFY(rawPart.isValid());
+    cache->setMsgPart("b", 333, "2.X-RAW", fakePartData.toBase64());
+    QCOMPARE(part.data(RolePartData).toByteArray(), QByteArray());
+    QCOMPARE(cache->requests, QList<QByteArray>() << "2.X-RAW");
+    cache->deliver("b", 333, "2.X-RAW", fakePartData.toBase64());
+    QCOMPARE(dataChangedSpy.size(), 1);
+    QCOMPARE(dataChangedSpy[0][0].value<QModelIndex>(), part);
+    QVERIFY(part.data(RoleIsFetched).toBool());
+    QCOMPARE(part.data(RolePartData).toByteArray(), fakePartData);
+    // The raw part was not asked for, so it's left alone
+    QVERIFY(!rawPart.data(RoleIsFetched).toBool());
+    cEmpty();
+    dataChangedSpy.clear();
+    cache->requests.clear();
+
+    // When the cache cannot read the data after all, they are fetched from the network
+    fakePartData = "Canary 3";
+    part = rootMultipart.child(2, 0);
+    QCOMPARE(part.data(RolePartId).toString(), QString("3"));
+    cache->setMsgPart("b", 333, "3", "lost");
+    QCOMPARE(part.data(RolePartData).toByteArray(), QByteArray());
+    QCOMPARE(cache->requests, QList<QByteArray>() << "3");
+    cache->forgetMessagePart("b", 333, "3");
+    cache->deliver("b", 333, "3", QByteArray());
+    cClient(t.mk("UID FETCH 333 (BODY.PEEK[3])\r\n"));
+    cServer("* 1 FETCH (UID 333 BODY[3] \"" + fakePartData.toBase64() + "\")\r\n" + t.last("OK fetched\r\n"));
+    QVERIFY(part.data(RoleIsFetched).toBool());
+    QCOMPARE(part.data(RolePartData).toByteArray(), fakePartData);
+    cEmpty();
+
+    // Late results for messages which are gone are ignored
+    cache->deliver("b", 666, "1", "foo");
+    cache->deliver("nonexistent", 333, "1", "foo");
+    QCOMPARE(rootMultipart.child(0, 0).data(RolePartData).toByteArray(), QByteArray("Canary 1"));
+    cEmpty();
+}
+
 /** @short Check how fetching the raw part data is handled */
 void BodyPartsTest::testFetchingRawParts()
 {
@@ -27,6 +27,7 @@
 #include "Imap/Model/ItemRoles.h"
 #include "Imap/Model/MailboxTree.h"
 #include "Imap/Model/MsgListModel.h"
+#include "Imap/Model/SQLCache.h"
 #include "Imap/Model/ThreadingMsgListModel.h"
 #include "Imap/Tasks/ObtainSynchronizedMailboxTask.h"
 
@@ -118,6 +119,114 @@ void CopyAndFlagTest::helperMove(const MoveFeatures serverFeatures)
     justKeepTask();
 }
 
+/** @short The COPYUID response makes the cached data of the original messages available in the target mailbox */
+void CopyAndFlagTest::testCopyUidCarriesCache()
+{
+    helperCopyUidCarriesCache();
+}
+
+/** @short The cached data of the copied messages are duplicated within the SQL cache as well */
+void CopyAndFlagTest::testCopyUidCarriesSqlCache()
+{
+    SQLCache *cache = new SQLCache(model);
+    QSignalSpy errorSpy(cache, SIGNAL(error(QString)));
+    QCOMPARE(cache->open(QLatin1String("copy"), QLatin1String(":memory:")), true);
+    model->setCache(cache);
+    helperCopyUidCarriesCache();
+    QVERIFY(errorSpy.isEmpty());
+}
+
+/** @short Check that COPYUID makes the copies available from the cache, so that opening the target mailbox is cheap */
+void CopyAndFlagTest::helperCopyUidCarriesCache()
+{
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability("UIDPLUS");
+
+    existsA = 3;
+    uidNextA = 5;
+    uidValidityA = 666;
+    for (uint i = 1; i <= existsA; ++i)
+        uidMapA << i;
+    helperSyncAWithMessagesEmptyState();
+
+    int start = 0;
+    Imap::Responses::Fetch fetchResponse(1, QByteArray(" (BODYSTRUCTURE (\"text\" \"plain\" (\"chaRset\" \"UTF-8\") "
+                                                       "NIL NIL \"8bit\" 362 15 NIL NIL NIL))\r\n"), start);
+    QString a = QLatin1String("a");
+    QString b = QLatin1String("b");
+    AbstractCache::MessageDataBundle metadata;
+    metadata.uid = 2;
+    metadata.size = 333;
+    metadata.envelope.subject = QLatin1String("copied");
+    metadata.serializedBodyStructure = fetchResponse.serializedBodyStructure();
+    model->cache()->setMessageMetadata(a, 2, metadata);
+    model->cache()->setMsgFlags(a, 2, QStringList() << QLatin1String("\\Answered"));
+    model->cache()->setMsgPart(a, 2, "1", "foo");
+
+    // The target mailbox has been synced at some point in the past
+    SyncState syncStateB;
+    syncStateB.setExists(1);
+    syncStateB.setRecent(0);
+    syncStateB.setUnSeenCount(0);
+    syncStateB.setUidNext(10);
+    syncStateB.setUidValidity(777);
+    model->cache()->setMailboxSyncState(b, syncStateB);
+    model->cache()->setUidMapping(b, Imap::Uids() << 6);
+    AbstractCache::MessageDataBundle metadataB = metadata;
+    metadataB.uid = 6;
+    metadataB.envelope.subject = QLatin1String("old");
+    model->cache()->setMessageMetadata(b, 6, metadataB);
+    model->cache()->setMsgFlags(b, 6, QStringList() << QLatin1String("\\Seen"));
+
+    auto aMailboxPtr = dynamic_cast<TreeItemMailbox *>(Model::realTreeItem(idxA));
+    Q_ASSERT(aMailboxPtr);
+    model->copyMoveMessages(aMailboxPtr, b, Imap::Uids() << 2, MOVE);
+    cClient(t.mk("UID COPY 2 b\r\n"));
+    cServer(t.last("OK [COPYUID 777 2 12] copied\r\n"));
+
+    metadata.uid = 12;
+    QCOMPARE(model->cache()->messageMetadata(b, 12), metadata);
+    QCOMPARE(model->cache()->msgFlags(b, 12), QStringList() << QLatin1String("\\Answered"));
+    QCOMPARE(model->cache()->messagePart(b, 12, "1"), QByteArray("foo"));
+    QCOMPARE(model->cache()->uidMapping(b), Imap::Uids() << 6 << 12);
+    syncStateB = model->cache()->mailboxSyncState(b);
+    QCOMPARE(syncStateB.exists(), 2u);
+    QCOMPARE(syncStateB.uidNext(), 13u);
+    QCOMPARE(syncStateB.unSeenCount(), 1u);
+
+    cClient(t.mk("UID STORE 2 +FLAGS.SILENT \\Deleted\r\n"));
+    cServer(t.last("OK stored\r\n"));
+    cClient(t.mk("UID EXPUNGE 2\r\n"));
+    cServer("* 2 EXPUNGE\r\n" + t.last("OK expunged\r\n"));
+    // The copy is still there
+    QCOMPARE(model->cache()->messageMetadata(b, 12), metadata);
+    cEmpty();
+    justKeepTask();
+
+    // Opening the target mailbox looks like a mere flag resync, nothing has to be downloaded again
+    QCOMPARE(model->rowCount(msgListB), 0);
+    cClient(t.mk("SELECT b\r\n"));
+    cServer("* 2 EXISTS\r\n"
+            "* OK [UIDVALIDITY 777] .\r\n"
+            "* OK [UIDNEXT 13] .\r\n"
+            + t.last("OK selected\r\n"));
+    cClient(t.mk("FETCH 1:2 (FLAGS)\r\n"));
+    cServer("* 1 FETCH (FLAGS (\\Seen))\r\n"
+            "* 2 FETCH (FLAGS (\\Answered))\r\n"
+            + t.last("OK fetched\r\n"));
+    QCOMPARE(model->rowCount(msgListB), 2);
+    QModelIndex copied = msgListB.child(1, 0);
+    QCOMPARE(copied.data(RoleMessageUid).toUInt(), 12u);
+    QCOMPARE(copied.data(RoleMessageSubject).toString(), QString::fromUtf8("copied"));
+    QCOMPARE(copied.data(RoleMessageSize).toUInt(), 333u);
+    QCOMPARE(copied.data(RoleMessageIsMarkedReplied).toBool(), true);
+    QCOMPARE(msgListB.child(0, 0).data(RoleMessageSubject).toString(), QString::fromUtf8("old"));
+    QCOMPARE(model->rowCount(copied), 1);
+    QCOMPARE(copied.child(0, 0).data(RolePartData).toByteArray(), QByteArray("foo"));
+    cEmpty();
+    justKeepTask();
+}
+
 void CopyAndFlagTest::testUpdateAllFlags()
 {
     // Push the data to the cache
@@ -167,4 +276,38 @@ void CopyAndFlagTest::testUpdateAllFlags()
     justKeepTask();
 }
 
+/** @short Dispatching of responses when there's a hundred of tasks active on the same connection */
+void CopyAndFlagTest::benchmarkConcurrentFlagUpdates()
+{
+    // The KeepMailboxOpenTask counts as an active task, too
+    model->setProperty("trojita-imap-limit-active-tasks", 101);
+    existsA = 100;
+    uidNextA = 101;
+    uidValidityA = 666;
+    for (uint i = 1; i <= existsA; ++i)
+        uidMapA << i;
+    helperSyncAWithMessagesEmptyState();
+
+    QBENCHMARK {
+        QByteArray commands;
+        QList<QByteArray> tags;
+        for (uint i = 0; i < existsA; ++i) {
+            model->setMessageFlags(QModelIndexList() << msgListA.child(i, 0), QLatin1String("\\Seen"), FLAG_ADD_SILENT);
+            commands += t.mk(QByteArray("UID STORE " + QByteArray::number(uidMapA[i]) + " +FLAGS.SILENT \\Seen\r\n").constData());
+            tags << t.last();
+        }
+        cClient(commands);
+
+        // Respond in the reverse order so that every response has to skip the other tasks
+        QByteArray responses;
+        for (int i = tags.size() - 1; i >= 0; --i) {
+            responses += tags[i] + " OK stored\r\n";
+        }
+        cServer(responses);
+        justKeepTask();
+    }
+
+    cEmpty();
+}
+
 TROJITA_HEADLESS_TEST(CopyAndFlagTest)
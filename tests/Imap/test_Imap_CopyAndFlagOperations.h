@@ -33,13 +33,18 @@ class CopyAndFlagTest : public LibMailboxSync
 
     typedef enum { JUST_3501, HAS_UIDPLUS, HAS_MOVE } MoveFeatures;
     void helperMove(const MoveFeatures serverFeatures);
+    void helperCopyUidCarriesCache();
 
 private slots:
     void testMoveRfc3501();
     void testMoveUidPlus();
     void testMoveRfcMove();
+    void testCopyUidCarriesCache();
+    void testCopyUidCarriesSqlCache();
 
     void testUpdateAllFlags();
+
+    void benchmarkConcurrentFlagUpdates();
 };
 
 #endif
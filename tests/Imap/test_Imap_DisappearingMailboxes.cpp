@@ -24,6 +24,7 @@
 #include "test_Imap_DisappearingMailboxes.h"
 #include "Utils/headless_test.h"
 #include "Imap/Model/ItemRoles.h"
+#include "Imap/Model/MailboxTree.h"
 #include "Imap/Model/TaskPresentationModel.h"
 #include "Streams/FakeSocket.h"
 #include "Utils/FakeCapabilitiesInjector.h"
@@ -451,4 +452,53 @@ void ImapModelDisappearingMailboxTest::testMailboxHoping()
 // FIXME: write test for the UnSelectTask and its interaction with different scenarios about opened/to-be-opened tasks
 // Redmine #486
 
+/** @short The index of mailbox names shall follow the mailboxes which come and go */
+void ImapModelDisappearingMailboxTest::testMailboxNameIndex()
+{
+    using namespace Imap::Mailbox;
+
+    // The initial fake listing is indexed
+    QVERIFY(model->findMailboxByName(QLatin1String("a")));
+    QCOMPARE(model->findMailboxByName(QLatin1String("a"))->toIndex(model), QModelIndex(idxA));
+    QVERIFY(model->findMailboxByName(QLatin1String("z")));
+    QVERIFY(!model->findMailboxByName(QString()));
+
+    // Reloading the list replaces all items
+    taskFactoryUnsafe->fakeListChildMailboxes = false;
+    model->reloadMailboxList();
+    cClient(t.mk("LIST \"\" \"%\"\r\n"));
+    cServer(QByteArray("* LIST (\\HasChildren) \".\" \"a\"\r\n"
+                       "* LIST (\\HasNoChildren) \".\" \"new\"\r\n")
+            + t.last("OK List done.\r\n"));
+    QVERIFY(!idxA.isValid());
+    QCOMPARE(model->rowCount(QModelIndex()), 3);
+    idxA = model->index(1, 0, QModelIndex());
+    QCOMPARE(model->data(idxA, Qt::DisplayRole), QVariant(QLatin1String("a")));
+    QCOMPARE(model->findMailboxByName(QLatin1String("a"))->toIndex(model), QModelIndex(idxA));
+    QCOMPARE(model->findMailboxByName(QLatin1String("new"))->toIndex(model), model->index(2, 0, QModelIndex()));
+    QVERIFY(!model->findMailboxByName(QLatin1String("b")));
+    QVERIFY(!model->findMailboxByName(QLatin1String("z")));
+
+    // Child mailboxes get indexed once they are known
+    QVERIFY(!model->findMailboxByName(QLatin1String("a.aa")));
+    model->rowCount(idxA);
+    cClient(t.mk("LIST \"\" \"a.%\"\r\n"));
+    cServer(QByteArray("* LIST (\\HasNoChildren) \".\" \"a.aa\"\r\n"
+                       "* LIST (\\HasNoChildren) \".\" \"a.ab\"\r\n")
+            + t.last("OK listed\r\n"));
+    QCOMPARE(model->rowCount(idxA), 3);
+    QCOMPARE(model->findMailboxByName(QLatin1String("a.ab"))->toIndex(model), model->index(2, 0, idxA));
+
+    // Deleting a mailbox removes its children from the index as well
+    model->deleteMailbox(QLatin1String("a"));
+    cClient(t.mk("DELETE a\r\n"));
+    cServer(t.last("OK deleted\r\n"));
+    QCOMPARE(model->rowCount(QModelIndex()), 2);
+    QVERIFY(!model->findMailboxByName(QLatin1String("a")));
+    QVERIFY(!model->findMailboxByName(QLatin1String("a.aa")));
+    QVERIFY(!model->findMailboxByName(QLatin1String("a.ab")));
+    QCOMPARE(model->findMailboxByName(QLatin1String("new"))->toIndex(model), model->index(1, 0, QModelIndex()));
+    cEmpty();
+}
+
 TROJITA_HEADLESS_TEST( ImapModelDisappearingMailboxTest )
@@ -42,6 +42,7 @@ private slots:
     void testSlowOfflineFlags2();
     void testSlowOfflineFlags3();
     void testMailboxHoping();
+    void testMailboxNameIndex();
 private:
 };
 
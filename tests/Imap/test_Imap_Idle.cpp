@@ -279,4 +279,56 @@ void ImapModelIdleTest::testIdleMailboxChange()
 }
 
 
+/** @short Test that a watched mailbox is kept in IDLE on a dedicated connection */
+void ImapModelIdleTest::testWatchedMailbox()
+{
+    using namespace Imap::Mailbox;
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability(QLatin1String("IDLE"));
+    Streams::FakeSocket *mainSocket = SOCK;
+
+    model->setWatchedMailboxes(QStringList() << QLatin1String("b"));
+    QCoreApplication::processEvents();
+    QCoreApplication::processEvents();
+    // A new connection has been opened for the watched mailbox
+    QVERIFY(SOCK != mainSocket);
+    t.reset();
+    cClient(t.mk("EXAMINE b\r\n"));
+    cServer(QByteArray("* 3 EXISTS\r\n* 1 RECENT\r\n* FLAGS (\\Seen)\r\n* OK [UIDVALIDITY 666] .\r\n")
+            + t.last("OK [READ-ONLY] examined\r\n"));
+    cClient(t.mk("SEARCH UNSEEN\r\n"));
+    cServer(QByteArray("* SEARCH 2 3\r\n") + t.last("OK searched\r\n"));
+    QCOMPARE(idxB.data(RoleTotalMessageCount).toInt(), 3);
+    QCOMPARE(idxB.data(RoleUnreadMessageCount).toInt(), 2);
+    QCOMPARE(idxB.data(RoleRecentMessageCount).toInt(), 1);
+
+    // New arrivals are visible right away, the unread count follows after the IDLE is interrupted
+    cClient(t.mk("IDLE\r\n"));
+    cServer(QByteArray("+ idling\r\n* 4 EXISTS\r\n* 2 RECENT\r\n"));
+    QCOMPARE(idxB.data(RoleTotalMessageCount).toInt(), 4);
+    QCOMPARE(idxB.data(RoleUnreadMessageCount).toInt(), 2);
+    cClient(QByteArray("DONE\r\n"));
+    cServer(t.last("OK idle done\r\n"));
+    cClient(t.mk("SEARCH UNSEEN\r\n"));
+    cServer(QByteArray("* SEARCH 2 3 4\r\n") + t.last("OK searched\r\n"));
+    QCOMPARE(idxB.data(RoleTotalMessageCount).toInt(), 4);
+    QCOMPARE(idxB.data(RoleUnreadMessageCount).toInt(), 3);
+    QCOMPARE(idxB.data(RoleRecentMessageCount).toInt(), 2);
+    cClient(t.mk("IDLE\r\n"));
+    QByteArray idleDone = t.last("OK idle done\r\n");
+
+    // Nothing gets polled for the watched mailbox
+    model->invalidateAllMessageCounts();
+    QCOMPARE(idxB.data(RoleTotalMessageCount).toInt(), 4);
+
+    // The connection goes away once the mailbox is not interesting anymore
+    cServer("+ idling\r\n");
+    model->setWatchedMailboxes(QStringList());
+    cClient(QByteArray("DONE\r\n") + t.mk("LOGOUT\r\n"));
+    cServer(idleDone + "* BYE see ya\r\n" + t.last("OK logged out\r\n"));
+    cEmpty();
+    QVERIFY(errorSpy->isEmpty());
+    QVERIFY(mainSocket->writtenStuff().isEmpty());
+}
+
 TROJITA_HEADLESS_TEST( ImapModelIdleTest )
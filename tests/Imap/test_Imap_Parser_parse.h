@@ -52,11 +52,18 @@ private Q_SLOTS:
     /** @short Test for parsing errors */
     void testThrow();
     void testThrow_data();
+    /** @short Test the handover of the queued responses */
+    void testResponseQueue();
+    /** @short Test that the queued commands are sent together and that LITERAL- is used for small literals */
+    void testCommandPipelining();
+    /** @short Test that the parsed lists of flags are shared among the FETCH responses */
+    void testFlagsSharing();
 
     void initTestCase();
     void cleanupTestCase();
 
     void benchmark();
+    void benchmarkFlagsFetch();
     void benchmarkInitialChat();
 };
 
@@ -1010,6 +1010,42 @@ void ImapModelSelectedMailboxUpdatesTest::testMarkAllConcurrentArrival()
     cEmpty();
 }
 
+/** @short Make sure that a burst of EXPUNGEs and a VANISHED with many UIDs remove contiguous ranges at once */
+void ImapModelSelectedMailboxUpdatesTest::testBulkExpunge()
+{
+    initialMessages(10);
+    QCOMPARE(uidMapA, Imap::Uids() << 1 << 2 << 3 << 4 << 5 << 6 << 7 << 8 << 9 << 10);
+    QSignalSpy removedSpy(model, SIGNAL(rowsRemoved(QModelIndex,int,int)));
+
+    // These refer to UIDs 3, 4, 9 and 1, i.e. to three distinct ranges in the original list
+    cServer("* 3 EXPUNGE\r\n* 3 EXPUNGE\r\n* 7 EXPUNGE\r\n* 1 EXPUNGE\r\n");
+    QCOMPARE(removedSpy.size(), 3);
+    QCOMPARE(removedSpy[0][1].toInt(), 8);
+    QCOMPARE(removedSpy[0][2].toInt(), 8);
+    QCOMPARE(removedSpy[1][1].toInt(), 2);
+    QCOMPARE(removedSpy[1][2].toInt(), 3);
+    QCOMPARE(removedSpy[2][1].toInt(), 0);
+    QCOMPARE(removedSpy[2][2].toInt(), 0);
+    uidMapA = Imap::Uids() << 2 << 5 << 6 << 7 << 8 << 10;
+    existsA = uidMapA.size();
+    helperCheckUidMapFromModel();
+    removedSpy.clear();
+
+    cServer("* VANISHED 6:8,10,11\r\n");
+    QCOMPARE(removedSpy.size(), 2);
+    QCOMPARE(removedSpy[0][1].toInt(), 5);
+    QCOMPARE(removedSpy[0][2].toInt(), 5);
+    QCOMPARE(removedSpy[1][1].toInt(), 2);
+    QCOMPARE(removedSpy[1][2].toInt(), 4);
+    uidMapA = Imap::Uids() << 2 << 5;
+    existsA = uidMapA.size();
+    helperCheckUidMapFromModel();
+    helperCheckCache();
+
+    justKeepTask();
+    cEmpty();
+}
+
 /** @short Helper for testMarkAllConcurrentArrival */
 void ImapModelSelectedMailboxUpdatesTest::helperDataChangedUidNonZero(const QModelIndex &a, const QModelIndex &b)
 {
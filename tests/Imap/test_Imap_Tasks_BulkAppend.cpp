@@ -0,0 +1,157 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <QBuffer>
+#include <QtTest>
+#include "test_Imap_Tasks_BulkAppend.h"
+#include "Utils/FakeCapabilitiesInjector.h"
+#include "Utils/headless_test.h"
+#include "Imap/Model/ItemRoles.h"
+#include "Imap/Tasks/BulkAppendTask.h"
+#include "Streams/FakeSocket.h"
+
+using namespace Imap::Mailbox;
+
+namespace {
+
+AppendItem bufferItem(const QByteArray &data, const QStringList &flags = QStringList())
+{
+    QBuffer *buf = new QBuffer();
+    buf->setData(data);
+    buf->open(QIODevice::ReadOnly);
+    return AppendItem(QSharedPointer<QIODevice>(buf), flags, QDateTime());
+}
+
+}
+
+/** @short All messages go out in a single MULTIAPPEND command */
+void BulkAppendTest::testMultiAppend()
+{
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability(QLatin1String("LITERAL+"));
+    injector.injectCapability(QLatin1String("MULTIAPPEND"));
+
+    QPointer<BulkAppendTask> task = model->bulkAppendIntoMailbox(QLatin1String("a"), QList<AppendItem>()
+                                                                 << bufferItem("hello", QStringList() << QLatin1String("\\Seen"))
+                                                                 << bufferItem("world"));
+    QSignalSpy appendedSpy(task.data(), SIGNAL(itemAppended(int)));
+    QSignalSpy completedSpy(task.data(), SIGNAL(completed(Imap::Mailbox::ImapTask*)));
+    cClient(t.mk("APPEND a (\\Seen) {5+}\r\nhello {5+}\r\nworld\r\n"));
+    QCOMPARE(task->taskData(RoleTaskProgress).toInt(), 0);
+    QCOMPARE(task->taskData(RoleTaskProgressMax).toInt(), 2);
+    cServer(t.last("OK appended\r\n"));
+    cEmpty();
+    QCOMPARE(appendedSpy.size(), 2);
+    QCOMPARE(appendedSpy[0][0].toInt(), 0);
+    QCOMPARE(appendedSpy[1][0].toInt(), 1);
+    QCOMPARE(completedSpy.size(), 1);
+    checkNoTasks();
+}
+
+/** @short A rejected MULTIAPPEND batch is retried message by message, so only the bad message fails */
+void BulkAppendTest::testMultiAppendRejected()
+{
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability(QLatin1String("LITERAL+"));
+    injector.injectCapability(QLatin1String("MULTIAPPEND"));
+
+    QPointer<BulkAppendTask> task = model->bulkAppendIntoMailbox(QLatin1String("a"), QList<AppendItem>()
+                                                                 << bufferItem("hello", QStringList() << QLatin1String("\\Seen"))
+                                                                 << bufferItem("bad!!") << bufferItem("world"));
+    QSignalSpy appendedSpy(task.data(), SIGNAL(itemAppended(int)));
+    QSignalSpy itemFailedSpy(task.data(), SIGNAL(itemFailed(int,QString)));
+    QSignalSpy failedSpy(task.data(), SIGNAL(failed(QString)));
+    cClient(t.mk("APPEND a (\\Seen) {5+}\r\nhello {5+}\r\nbad!! {5+}\r\nworld\r\n"));
+    cServer(t.last("NO message too big\r\n"));
+    // Nothing has been reported yet, all three messages are sent again
+    QVERIFY(appendedSpy.isEmpty());
+    QVERIFY(itemFailedSpy.isEmpty());
+    QByteArray first = t.mk("APPEND a (\\Seen) {5+}\r\nhello\r\n");
+    QByteArray firstTag = t.last();
+    QByteArray second = t.mk("APPEND a {5+}\r\nbad!!\r\n");
+    QByteArray secondTag = t.last();
+    QByteArray third = t.mk("APPEND a {5+}\r\nworld\r\n");
+    QByteArray thirdTag = t.last();
+    cClient(first + second + third);
+    cServer(firstTag + " OK appended\r\n" + secondTag + " NO message too big\r\n" + thirdTag + " OK appended\r\n");
+    cEmpty();
+    QCOMPARE(appendedSpy.size(), 2);
+    QCOMPARE(appendedSpy[0][0].toInt(), 0);
+    QCOMPARE(appendedSpy[1][0].toInt(), 2);
+    QCOMPARE(itemFailedSpy.size(), 1);
+    QCOMPARE(itemFailedSpy[0][0].toInt(), 1);
+    QCOMPARE(failedSpy.size(), 1);
+    checkNoTasks();
+}
+
+/** @short Without MULTIAPPEND, the individual APPENDs are pipelined and a failure does not stop the rest */
+void BulkAppendTest::testPipelinedAppends()
+{
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability(QLatin1String("LITERAL+"));
+
+    QPointer<BulkAppendTask> task = model->bulkAppendIntoMailbox(QLatin1String("a"), QList<AppendItem>()
+                                                                 << bufferItem("hello") << bufferItem("world"));
+    QSignalSpy appendedSpy(task.data(), SIGNAL(itemAppended(int)));
+    QSignalSpy itemFailedSpy(task.data(), SIGNAL(itemFailed(int,QString)));
+    QSignalSpy failedSpy(task.data(), SIGNAL(failed(QString)));
+    QByteArray first = t.mk("APPEND a {5+}\r\nhello\r\n");
+    QByteArray firstTag = t.last();
+    QByteArray second = t.mk("APPEND a {5+}\r\nworld\r\n");
+    cClient(first + second);
+    cServer(t.last("OK appended\r\n"));
+    QCOMPARE(appendedSpy.size(), 1);
+    QCOMPARE(appendedSpy[0][0].toInt(), 1);
+    QCOMPARE(task->taskData(RoleTaskProgress).toInt(), 1);
+    QVERIFY(failedSpy.isEmpty());
+    cServer(firstTag + " NO over quota\r\n");
+    cEmpty();
+    QCOMPARE(itemFailedSpy.size(), 1);
+    QCOMPARE(itemFailedSpy[0][0].toInt(), 0);
+    QCOMPARE(failedSpy.size(), 1);
+    checkNoTasks();
+}
+
+/** @short Files which cannot be read are reported without disturbing the rest of the upload */
+void BulkAppendTest::testUnreadableFile()
+{
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability(QLatin1String("LITERAL+"));
+    injector.injectCapability(QLatin1String("MULTIAPPEND"));
+
+    QPointer<BulkAppendTask> task = model->bulkAppendIntoMailbox(QLatin1String("a"), QList<AppendItem>()
+        << AppendItem(QLatin1String("/this/file/does/not/exist.eml"), QStringList(), QDateTime())
+        << bufferItem("world"));
+    QSignalSpy appendedSpy(task.data(), SIGNAL(itemAppended(int)));
+    QSignalSpy itemFailedSpy(task.data(), SIGNAL(itemFailed(int,QString)));
+    QSignalSpy failedSpy(task.data(), SIGNAL(failed(QString)));
+    cClient(t.mk("APPEND a {5+}\r\nworld\r\n"));
+    QCOMPARE(itemFailedSpy.size(), 1);
+    QCOMPARE(itemFailedSpy[0][0].toInt(), 0);
+    cServer(t.last("OK appended\r\n"));
+    cEmpty();
+    QCOMPARE(appendedSpy.size(), 1);
+    QCOMPARE(appendedSpy[0][0].toInt(), 1);
+    QCOMPARE(failedSpy.size(), 1);
+    checkNoTasks();
+}
+
+TROJITA_HEADLESS_TEST(BulkAppendTest)
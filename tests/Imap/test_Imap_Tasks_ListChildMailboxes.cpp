@@ -22,6 +22,7 @@
 
 #include <QtTest>
 #include "test_Imap_Tasks_ListChildMailboxes.h"
+#include "Utils/FakeCapabilitiesInjector.h"
 #include "Utils/headless_test.h"
 #include "Common/MetaTypes.h"
 #include "Streams/FakeSocket.h"
@@ -230,4 +231,198 @@ void ImapModelListChildMailboxesTest::testNoStatusForCachedItems()
 }
 
 
+/** @short Check that the message counters are refreshed through a single LIST-STATUS */
+void ImapModelListChildMailboxesTest::testListStatusRefresh()
+{
+    using namespace Imap::Mailbox;
+
+    QCOMPARE(model->rowCount(QModelIndex()), 1);
+    cClient(t.mk("LIST \"\" \"%\"\r\n"));
+    cServer("* LIST (\\HasNoChildren) \".\" a\r\n"
+            "* LIST (\\HasNoChildren) \".\" b\r\n"
+            + t.last("OK listed\r\n"));
+    QCOMPARE(model->rowCount(QModelIndex()), 3);
+    idxA = model->index(1, 0, QModelIndex());
+    idxB = model->index(2, 0, QModelIndex());
+    QCOMPARE(idxA.data(RoleTotalMessageCount), QVariant());
+    QCOMPARE(idxB.data(RoleTotalMessageCount), QVariant());
+    QByteArray c1 = t.mk("STATUS a (MESSAGES UNSEEN RECENT)\r\n");
+    QByteArray r1 = t.last("OK status\r\n");
+    QByteArray c2 = t.mk("STATUS b (MESSAGES UNSEEN RECENT)\r\n");
+    QByteArray r2 = t.last("OK status\r\n");
+    cClient(c1 + c2);
+    cServer("* STATUS a (MESSAGES 1 RECENT 0 UNSEEN 1)\r\n" + r1 +
+            "* STATUS b (MESSAGES 10 RECENT 0 UNSEEN 0)\r\n" + r2);
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 1);
+    QCOMPARE(idxB.data(RoleTotalMessageCount).toInt(), 10);
+    cEmpty();
+
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability(QLatin1String("LIST-STATUS"));
+    model->invalidateAllMessageCounts();
+    cClient(t.mk("LIST \"\" (a b) RETURN (STATUS (MESSAGES UNSEEN RECENT))\r\n"));
+    // The old numbers remain available in the meanwhile
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 1);
+    QCOMPARE(idxA.data(RoleMailboxNumbersFetched).toBool(), true);
+    cServer("* LIST (\\HasNoChildren) \".\" a\r\n"
+            "* STATUS a (MESSAGES 5 RECENT 1 UNSEEN 3)\r\n"
+            "* LIST (\\HasNoChildren) \".\" b\r\n"
+            "* STATUS b (MESSAGES 11 RECENT 1 UNSEEN 1)\r\n"
+            + t.last("OK listed\r\n"));
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 5);
+    QCOMPARE(idxA.data(RoleUnreadMessageCount).toInt(), 3);
+    QCOMPARE(idxB.data(RoleTotalMessageCount).toInt(), 11);
+    QCOMPARE(idxB.data(RoleUnreadMessageCount).toInt(), 1);
+    QCOMPARE(model->rowCount(QModelIndex()), 3);
+    cEmpty();
+
+    // The LIST responses were consumed, so they cannot leak into the next listing
+    model->reloadMailboxList();
+    cClient(t.mk("LIST \"\" \"%\" RETURN (STATUS (MESSAGES UNSEEN RECENT))\r\n"));
+    cServer("* LIST (\\HasNoChildren) \".\" a\r\n"
+            + t.last("OK listed\r\n"));
+    QCOMPARE(model->rowCount(QModelIndex()), 2);
+    cEmpty();
+}
+
+/** @short Subscribe to the NOTIFY events, telling the Model about the namespaces through @arg namespaceResponse
+
+An empty @arg namespaceResponse makes the NAMESPACE command fail.
+*/
+void ImapModelListChildMailboxesTest::helperEnableNotify(const QByteArray &namespaceResponse)
+{
+    FakeCapabilitiesInjector injector(model);
+    injector.injectCapability(QLatin1String("NAMESPACE"));
+    injector.injectCapability(QLatin1String("NOTIFY"));
+    QPointer<Imap::Mailbox::ImapTask> notifyTask =
+            taskFactoryUnsafe->createNotifyTask(model, taskFactoryUnsafe->createGetAnyConnectionTask(model));
+    QSignalSpy completedSpy(notifyTask.data(), SIGNAL(completed(Imap::Mailbox::ImapTask*)));
+    QByteArray c1 = t.mk("NAMESPACE\r\n");
+    QByteArray r1 = namespaceResponse.isEmpty() ? t.last("NO no namespaces here\r\n") : t.last("OK namespace\r\n");
+    QByteArray c2 = t.mk("NOTIFY SET (personal (MessageNew MessageExpunge FlagChange))\r\n");
+    QByteArray r2 = t.last("OK notifying\r\n");
+    cClient(c1 + c2);
+    cServer(namespaceResponse + r1 + r2);
+    QCOMPARE(completedSpy.size(), 1);
+    cEmpty();
+}
+
+/** @short The counters of mailboxes covered by NOTIFY are pushed by the server instead of being polled for */
+void ImapModelListChildMailboxesTest::testNotify()
+{
+    using namespace Imap::Mailbox;
+
+    QCOMPARE(model->rowCount(QModelIndex()), 1);
+    cClient(t.mk("LIST \"\" \"%\"\r\n"));
+    cServer("* LIST (\\HasNoChildren) \".\" a\r\n"
+            "* LIST (\\HasNoChildren) \".\" shared\r\n"
+            + t.last("OK listed\r\n"));
+    QCOMPARE(model->rowCount(QModelIndex()), 3);
+    idxA = model->index(1, 0, QModelIndex());
+    QModelIndex idxShared = model->index(2, 0, QModelIndex());
+    QCOMPARE(idxShared.data(RoleMailboxName).toString(), QString::fromUtf8("shared"));
+    QCOMPARE(idxA.data(RoleTotalMessageCount), QVariant());
+    QCOMPARE(idxShared.data(RoleTotalMessageCount), QVariant());
+    QByteArray c1 = t.mk("STATUS a (MESSAGES UNSEEN RECENT)\r\n");
+    QByteArray r1 = t.last("OK status\r\n");
+    QByteArray c2 = t.mk("STATUS shared (MESSAGES UNSEEN RECENT)\r\n");
+    QByteArray r2 = t.last("OK status\r\n");
+    cClient(c1 + c2);
+    cServer("* STATUS a (MESSAGES 1 RECENT 0 UNSEEN 1)\r\n" + r1 +
+            "* STATUS shared (MESSAGES 10 RECENT 0 UNSEEN 0)\r\n" + r2);
+    cEmpty();
+
+    helperEnableNotify("* NAMESPACE ((\"\" \".\")) NIL ((\"shared.\" \".\"))\r\n");
+
+    // Only the mailbox from outside of the personal namespace is polled
+    model->invalidateAllMessageCounts();
+    QCOMPARE(idxA.data(RoleMailboxNumbersFetched).toBool(), true);
+    QCOMPARE(idxShared.data(RoleMailboxNumbersFetched).toBool(), false);
+    cEmpty();
+    QCOMPARE(idxShared.data(RoleTotalMessageCount), QVariant());
+    cClient(t.mk("STATUS shared (MESSAGES UNSEEN RECENT)\r\n"));
+    cServer("* STATUS shared (MESSAGES 11 RECENT 0 UNSEEN 1)\r\n" + t.last("OK status\r\n"));
+    QCOMPARE(idxShared.data(RoleTotalMessageCount).toInt(), 11);
+    cEmpty();
+
+    // A complete pushed STATUS is used right away
+    cServer("* STATUS a (MESSAGES 3 RECENT 0 UNSEEN 2)\r\n");
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 3);
+    QCOMPARE(idxA.data(RoleUnreadMessageCount).toInt(), 2);
+    cEmpty();
+
+    // The STATUS pushed through NOTIFY has no UNSEEN, so the number of unread messages has to be refreshed
+    cServer("* STATUS a (MESSAGES 4 UIDNEXT 10 UIDVALIDITY 1)\r\n");
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 4);
+    cClient(t.mk("STATUS a (MESSAGES UNSEEN RECENT)\r\n"));
+    cServer("* STATUS a (MESSAGES 4 RECENT 0 UNSEEN 3)\r\n" + t.last("OK status\r\n"));
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 4);
+    QCOMPARE(idxA.data(RoleUnreadMessageCount).toInt(), 3);
+    QCOMPARE(idxA.data(RoleMailboxNumbersFetched).toBool(), true);
+    cEmpty();
+
+    // The server gave up on the notifications, so everything has to be polled again
+    cServer("* OK [NOTIFICATIONOVERFLOW] too many changes\r\n");
+    QCOMPARE(idxA.data(RoleMailboxNumbersFetched).toBool(), false);
+    QCOMPARE(idxShared.data(RoleMailboxNumbersFetched).toBool(), false);
+    cEmpty();
+    QCOMPARE(idxA.data(RoleTotalMessageCount), QVariant());
+    cClient(t.mk("STATUS a (MESSAGES UNSEEN RECENT)\r\n"));
+    cServer("* STATUS a (MESSAGES 5 RECENT 0 UNSEEN 4)\r\n" + t.last("OK status\r\n"));
+    QCOMPARE(idxA.data(RoleTotalMessageCount).toInt(), 5);
+    cEmpty();
+    model->invalidateAllMessageCounts();
+    QCOMPARE(idxA.data(RoleMailboxNumbersFetched).toBool(), false);
+    cEmpty();
+}
+
+/** @short Check which mailboxes are considered to be covered by NOTIFY, i.e. the longest matching namespace wins */
+void ImapModelListChildMailboxesTest::testNotifyCoverage()
+{
+    using namespace Imap::Mailbox;
+    QFETCH(QByteArray, namespaceResponse);
+    QFETCH(QString, mailbox);
+    QFETCH(bool, covered);
+
+    QCOMPARE(model->rowCount(QModelIndex()), 1);
+    cClient(t.mk("LIST \"\" \"%\"\r\n"));
+    // The hierarchy separator is different so that all of them end up in the top-level list
+    cServer("* LIST (\\HasNoChildren) \"/\" \"" + mailbox.toUtf8() + "\"\r\n" + t.last("OK listed\r\n"));
+    QCOMPARE(model->rowCount(QModelIndex()), 2);
+    QModelIndex idx = model->index(1, 0, QModelIndex());
+    QCOMPARE(idx.data(RoleMailboxName).toString(), mailbox);
+    QCOMPARE(idx.data(RoleTotalMessageCount), QVariant());
+    cClient(t.mk("STATUS " + mailbox.toUtf8() + " (MESSAGES UNSEEN RECENT)\r\n"));
+    cServer("* STATUS " + mailbox.toUtf8() + " (MESSAGES 1 RECENT 0 UNSEEN 1)\r\n" + t.last("OK status\r\n"));
+    QCOMPARE(idx.data(RoleMailboxNumbersFetched).toBool(), true);
+
+    helperEnableNotify(namespaceResponse);
+
+    model->invalidateAllMessageCounts();
+    QCOMPARE(idx.data(RoleMailboxNumbersFetched).toBool(), covered);
+    cEmpty();
+}
+
+void ImapModelListChildMailboxesTest::testNotifyCoverage_data()
+{
+    QTest::addColumn<QByteArray>("namespaceResponse");
+    QTest::addColumn<QString>("mailbox");
+    QTest::addColumn<bool>("covered");
+
+    QByteArray flat = "* NAMESPACE ((\"\" \".\")) ((\"user.\" \".\")) ((\"shared.\" \".\"))\r\n";
+    QTest::newRow("personal") << flat << QString::fromUtf8("a") << true;
+    QTest::newRow("shared") << flat << QString::fromUtf8("shared.a") << false;
+    QTest::newRow("shared-root") << flat << QString::fromUtf8("shared") << false;
+    QTest::newRow("other-users") << flat << QString::fromUtf8("user.joe") << false;
+
+    QByteArray nested = "* NAMESPACE ((\"INBOX.\" \".\")) NIL ((\"INBOX.shared.\" \".\"))\r\n";
+    QTest::newRow("nested-personal") << nested << QString::fromUtf8("INBOX.a") << true;
+    QTest::newRow("nested-shared") << nested << QString::fromUtf8("INBOX.shared.a") << false;
+    QTest::newRow("outside-of-namespaces") << nested << QString::fromUtf8("a") << false;
+    QTest::newRow("inbox") << nested << QString::fromUtf8("INBOX") << true;
+
+    QTest::newRow("unknown-namespaces") << QByteArray() << QString::fromUtf8("a") << false;
+    QTest::newRow("unknown-namespaces-inbox") << QByteArray() << QString::fromUtf8("INBOX") << true;
+}
+
 TROJITA_HEADLESS_TEST( ImapModelListChildMailboxesTest )
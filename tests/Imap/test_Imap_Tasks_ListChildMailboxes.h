@@ -44,6 +44,15 @@ private slots:
     void testNoStatusForCachedItems();
 
     void testFailingList();
+
+    void testListStatusRefresh();
+
+    void testNotify();
+    void testNotifyCoverage();
+    void testNotifyCoverage_data();
+
+private:
+    void helperEnableNotify(const QByteArray &namespaceResponse);
 };
 
 #endif
@@ -245,6 +245,14 @@ void ImapModelObtainSynchronizedMailboxTest::testSyncWithMessages()
     uidNextA = qMax( 666u, uidMapA.last() );
     helperSyncAWithMessagesEmptyState();
     helperVerifyUidMapA();
+
+    // Messages #2 and #3 have the same flags, see helperSyncFlags(), so they shall not need separate copies of the list
+    const QStringList flags2 = msgListA.child(1, 0).data(Imap::Mailbox::RoleMessageFlags).toStringList();
+    const QStringList flags3 = msgListA.child(2, 0).data(Imap::Mailbox::RoleMessageFlags).toStringList();
+    const QStringList flags5 = msgListA.child(4, 0).data(Imap::Mailbox::RoleMessageFlags).toStringList();
+    QCOMPARE(flags2, QStringList() << QLatin1String("\\Answered") << QLatin1String("\\Seen"));
+    QVERIFY(flags2.isSharedWith(flags3));
+    QVERIFY(!flags2.isSharedWith(flags5));
 }
 
 /** @short Go back to a selected mailbox after some time, the mailbox doesn't have any modifications */
@@ -2393,7 +2401,7 @@ void ImapModelObtainSynchronizedMailboxTest::testOfflineOpening()
     Imap::Responses::Fetch fetchResponse(666, QByteArray(" (BODYSTRUCTURE (\"text\" \"plain\" (\"chaRset\" \"UTF-8\" "
                                                          "\"format\" \"flowed\") NIL NIL \"8bit\" 362 15 NIL NIL NIL))\r\n"),
                                          start);
-    msg10.serializedBodyStructure = dynamic_cast<const Imap::Responses::RespData<QByteArray>&>(*(fetchResponse.data["x-trojita-bodystructure"])).data;
+    msg10.serializedBodyStructure = fetchResponse.serializedBodyStructure();
     msg20.serializedBodyStructure = msg10.serializedBodyStructure;
 
     model->cache()->setMessageMetadata("a", 10, msg10);
@@ -422,6 +422,41 @@ void ImapModelOpenConnectionTest::testCapabilityAfterLogin()
     QCOMPARE(model->imapAuthError(), QString());
 }
 
+/** @short Test that a reconnect reuses the post-login capabilities instead of waiting for CAPABILITY */
+void ImapModelOpenConnectionTest::testCachedCapabilitiesAfterReconnect()
+{
+    cServer("* OK [CAPABILITY IMAP4rev1] hi there\r\n");
+    cClient("y0 LOGIN luzr sikrit\r\n");
+    cServer("* CAPABILITY IMAP4rev1 UNSELECT\r\ny0 OK logged in\r\n");
+    QCOMPARE(completedSpy->size(), 1);
+    cEmpty();
+
+    // The server greets us the same way, so the connection is ready right after the LOGIN
+    Imap::Mailbox::OpenConnectionTask *secondTask = new Imap::Mailbox::OpenConnectionTask(model);
+    QSignalSpy secondCompletedSpy(secondTask, SIGNAL(completed(Imap::Mailbox::ImapTask*)));
+    cServer("* OK [CAPABILITY IMAP4rev1] hi there\r\n");
+    cClient("y0 LOGIN luzr sikrit\r\n");
+    cServer("y0 OK logged in\r\n");
+    QCOMPARE(secondCompletedSpy.size(), 1);
+    cClient("y1 CAPABILITY\r\n");
+    cServer("* CAPABILITY IMAP4rev1 UNSELECT\r\ny1 OK capability completed\r\n");
+    cEmpty();
+
+    // A different greeting means that the cached data cannot be trusted
+    Imap::Mailbox::OpenConnectionTask *thirdTask = new Imap::Mailbox::OpenConnectionTask(model);
+    QSignalSpy thirdCompletedSpy(thirdTask, SIGNAL(completed(Imap::Mailbox::ImapTask*)));
+    cServer("* OK [CAPABILITY IMAP4rev1 XYZZY] hi there\r\n");
+    cClient("y0 LOGIN luzr sikrit\r\n");
+    cServer("y0 OK logged in\r\n");
+    cClient("y1 CAPABILITY\r\n");
+    QVERIFY(thirdCompletedSpy.isEmpty());
+    cServer("* CAPABILITY IMAP4rev1 XYZZY UNSELECT\r\ny1 OK capability completed\r\n");
+    QCOMPARE(thirdCompletedSpy.size(), 1);
+    cEmpty();
+    QVERIFY(failedSpy->isEmpty());
+    QCOMPARE(authErrorSpy->size(), 0);
+}
+
 /** @short Test conf-requested STARTTLS when the server doesn't support STARTTLS at all */
 void ImapModelOpenConnectionTest::testOkStartTlsForbidden()
 {
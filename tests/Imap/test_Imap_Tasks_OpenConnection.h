@@ -53,6 +53,7 @@ private slots:
     void testOkStartTlsForbidden();
     void testOkStartTlsDiscardCaps();
     void testCapabilityAfterLogin();
+    void testCachedCapabilitiesAfterReconnect();
 
     void testCompressDeflateOk();
     void testCompressDeflateNo();
@@ -326,6 +326,41 @@ void ImapModelThreadingTest::testVanishedHierarchyReplacement()
     QVERIFY(errorSpy->isEmpty());
 }
 
+/** @short Removing a chain of parents shall only affect their thread, and persistent indexes elsewhere shall stay intact */
+void ImapModelThreadingTest::testPruneKeepsUnrelatedThreads()
+{
+    initialMessages(6);
+    cClient(t.mk("UID THREAD REFS utf-8 ALL\r\n"));
+    cServer("* THREAD (1)(2 (3 4)(5))(6)\r\n" + t.last("OK thread\r\n"));
+    QCOMPARE(treeToThreading(QModelIndex()), QByteArray("(1)(2 (3 4)(5))(6)"));
+
+    QPersistentModelIndex msg1 = findItem("0");
+    QPersistentModelIndex msg2 = findItem("1");
+    QPersistentModelIndex msg3 = findItem("1.0");
+    QPersistentModelIndex msg4 = findItem("1.0.0");
+    QPersistentModelIndex msg5 = findItem("1.1");
+    QPersistentModelIndex msg6 = findItem("2");
+    QCOMPARE(msg4.data(Imap::Mailbox::RoleMessageUid).toUInt(), 4u);
+    QCOMPARE(msg5.data(Imap::Mailbox::RoleMessageUid).toUInt(), 5u);
+
+    QSignalSpy layoutChanged(threadingModel, SIGNAL(layoutChanged()));
+    cServer("* 2 EXPUNGE\r\n* 2 EXPUNGE\r\n");
+    QCOMPARE(layoutChanged.size(), 1);
+    QCOMPARE(treeToThreading(QModelIndex()), QByteArray("(1)(4 5)(6)"));
+
+    QVERIFY(!msg2.isValid());
+    QVERIFY(!msg3.isValid());
+    QCOMPARE(QModelIndex(msg1), findItem("0"));
+    QCOMPARE(QModelIndex(msg4), findItem("1"));
+    QCOMPARE(QModelIndex(msg5), findItem("1.0"));
+    QCOMPARE(QModelIndex(msg6), findItem("2"));
+    QCOMPARE(msg4.data(Imap::Mailbox::RoleMessageUid).toUInt(), 4u);
+    QCOMPARE(msg5.data(Imap::Mailbox::RoleMessageUid).toUInt(), 5u);
+    QCOMPARE(msg6.data(Imap::Mailbox::RoleMessageUid).toUInt(), 6u);
+    cEmpty();
+    QVERIFY(errorSpy->isEmpty());
+}
+
 /** @short Test deletion of one message */
 void ImapModelThreadingTest::testDynamicThreading()
 {
@@ -1290,6 +1325,12 @@ void ImapModelThreadingTest::testIncrementalThreading()
     verifyIndexMap(indexMap, mapping);
     // The response is actually slightly different, but never mind (extra parentheses around 7)
     QCOMPARE(treeToThreading(QModelIndex()), QByteArray("(1)(2 3)(4 (5)(6))(7 (8)(9 10))"));
+    QPersistentModelIndex msg1 = findItem("0");
+    QPersistentModelIndex msg4 = findItem("2");
+    QPersistentModelIndex msg9 = findItem("3.1");
+    QCOMPARE(msg1.data(Imap::Mailbox::RoleMessageUid).toUInt(), 1u);
+    QCOMPARE(msg4.data(Imap::Mailbox::RoleMessageUid).toUInt(), 4u);
+    QCOMPARE(msg9.data(Imap::Mailbox::RoleMessageUid).toUInt(), 9u);
 
     // Activate support for the INCTHREAD extension
     FakeCapabilitiesInjector injector(model);
@@ -1309,6 +1350,18 @@ void ImapModelThreadingTest::testIncrementalThreading()
     QCOMPARE(treeToThreading(QModelIndex()), QByteArray("(1)(2 3)(7 (8 9 11)(10))(4 (5)(6))"));
     cServer(t.last("OK done\r\n"));
 
+    // The persistent indexes follow their messages, including those which were moved into another thread
+    QVERIFY(msg1.isValid());
+    QCOMPARE(msg1.row(), 0);
+    QCOMPARE(msg1.data(Imap::Mailbox::RoleMessageUid).toUInt(), 1u);
+    QVERIFY(msg4.isValid());
+    QCOMPARE(msg4.row(), 3);
+    QCOMPARE(msg4.data(Imap::Mailbox::RoleMessageUid).toUInt(), 4u);
+    QVERIFY(msg9.isValid());
+    QCOMPARE(QModelIndex(msg9), findItem("2.0.0"));
+    QCOMPARE(msg9.data(Imap::Mailbox::RoleMessageUid).toUInt(), 9u);
+    QCOMPARE(msg9.parent().data(Imap::Mailbox::RoleMessageUid).toUInt(), 8u);
+
     cEmpty();
 }
 
@@ -45,6 +45,7 @@ private slots:
     void testRemovingRootWithThreadingInFlight();
     void testMultipleExpunges();
     void testVanishedHierarchyReplacement();
+    void testPruneKeepsUnrelatedThreads();
     void testDataChangedUnknownUid();
     void testThreadingPerformance();
     void testSortingPerformance();
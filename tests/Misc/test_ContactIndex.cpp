@@ -0,0 +1,178 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QTest>
+#include "test_ContactIndex.h"
+#include "Utils/headless_test.h"
+#include "Plugins/ContactIndex.h"
+
+using namespace Plugins;
+
+namespace {
+
+QStringList emails(const NameEmailList &list)
+{
+    QStringList res;
+    Q_FOREACH(const NameEmail &item, list) {
+        res << item.email;
+    }
+    return res;
+}
+
+void populate(ContactIndex &index)
+{
+    index.setContact(1, QLatin1String("Jan Kundrát"), QStringList() << QLatin1String("jkt@flaska.net")
+                     << QLatin1String("jan.kundrat@example.org"));
+    index.setContact(2, QLatin1String("Nobody Special"), QStringList() << QLatin1String("no-reply@mail.example.com"));
+    index.setContact(3, QLatin1String("Jane Doe"), QStringList() << QLatin1String("JANE_DOE@Example.ORG"));
+}
+
+}
+
+/** @short Matching on word boundaries of names and on delimited parts of the addresses */
+void ContactIndexTest::testMatching()
+{
+    QFETCH(QString, input);
+    QFETCH(QStringList, expected);
+
+    ContactIndex index;
+    populate(index);
+    QCOMPARE(emails(index.complete(input, QStringList())), expected);
+}
+
+void ContactIndexTest::testMatching_data()
+{
+    QTest::addColumn<QString>("input");
+    QTest::addColumn<QStringList>("expected");
+
+    QTest::newRow("name-prefix") << QString::fromUtf8("jan") << (QStringList() << QLatin1String("jkt@flaska.net")
+        << QLatin1String("jan.kundrat@example.org") << QLatin1String("JANE_DOE@Example.ORG"));
+    QTest::newRow("name-word") << QString::fromUtf8("kundr") << (QStringList() << QLatin1String("jkt@flaska.net")
+        << QLatin1String("jan.kundrat@example.org"));
+    QTest::newRow("name-non-ascii") << QString::fromUtf8("KUNDRÁT") << (QStringList() << QLatin1String("jkt@flaska.net")
+        << QLatin1String("jan.kundrat@example.org"));
+    QTest::newRow("name-several-words") << QString::fromUtf8("jan k") << (QStringList() << QLatin1String("jkt@flaska.net")
+        << QLatin1String("jan.kundrat@example.org"));
+    QTest::newRow("name-middle-of-word") << QString::fromUtf8("undr") << QStringList();
+    QTest::newRow("mail-local-part") << QString::fromUtf8("jkt") << (QStringList() << QLatin1String("jkt@flaska.net"));
+    QTest::newRow("mail-domain") << QString::fromUtf8("flaska") << (QStringList() << QLatin1String("jkt@flaska.net"));
+    QTest::newRow("mail-after-dash") << QString::fromUtf8("reply") << (QStringList() << QLatin1String("no-reply@mail.example.com"));
+    QTest::newRow("mail-after-underscore") << QString::fromUtf8("doe@") << (QStringList() << QLatin1String("JANE_DOE@Example.ORG"));
+    QTest::newRow("mail-subdomain") << QString::fromUtf8("mail.ex") << (QStringList() << QLatin1String("no-reply@mail.example.com"));
+    QTest::newRow("mail-whole") << QString::fromUtf8("jkt@flaska.net") << (QStringList() << QLatin1String("jkt@flaska.net"));
+    QTest::newRow("mail-tld") << QString::fromUtf8("net") << QStringList();
+    QTest::newRow("nothing") << QString::fromUtf8("xyz") << QStringList();
+}
+
+/** @short The addresses which were used most often go first */
+void ContactIndexTest::testUsageRanking()
+{
+    ContactIndex index;
+    populate(index);
+    index.addUsage(QString(), QLatin1String("Jane_Doe@example.org"), 2);
+    index.addUsage(QString(), QLatin1String("jan.kundrat@example.org"));
+    QCOMPARE(index.usage(QLatin1String("JANE_DOE@EXAMPLE.ORG")), 2);
+    QCOMPARE(emails(index.complete(QLatin1String("jan"), QStringList())), QStringList() << QLatin1String("JANE_DOE@Example.ORG")
+             << QLatin1String("jan.kundrat@example.org") << QLatin1String("jkt@flaska.net"));
+    QCOMPARE(index.namesForAddress(QLatin1String("jane_doe@example.org")), QStringList() << QLatin1String("Jane Doe"));
+}
+
+/** @short Addresses which are not in the address book are offered once they have been used */
+void ContactIndexTest::testUsedAddresses()
+{
+    ContactIndex index;
+    populate(index);
+    index.addUsage(QLatin1String("Mailing List"), QLatin1String("trojita@kde.org"));
+    index.addUsage(QLatin1String("Someone Else"), QLatin1String("jkt@flaska.net"));
+
+    NameEmailList res = index.complete(QLatin1String("mailing"), QStringList());
+    QCOMPARE(res.size(), 1);
+    QCOMPARE(res[0].name, QString::fromUtf8("Mailing List"));
+    QCOMPARE(res[0].email, QString::fromUtf8("trojita@kde.org"));
+
+    // The contact shadows the used address
+    QVERIFY(index.complete(QLatin1String("someone"), QStringList()).isEmpty());
+    QCOMPARE(index.usedAddresses().size(), 2);
+
+    // ...but only as long as it exists
+    index.removeContact(1);
+    res = index.complete(QLatin1String("someone"), QStringList());
+    QCOMPARE(res.size(), 1);
+    QCOMPARE(res[0].email, QString::fromUtf8("jkt@flaska.net"));
+
+    // The most recent name wins
+    index.addUsage(QLatin1String("Trojita Devel"), QLatin1String("TROJITA@kde.org"));
+    QVERIFY(index.complete(QLatin1String("mailing"), QStringList()).isEmpty());
+    QCOMPARE(emails(index.complete(QLatin1String("devel"), QStringList())), QStringList() << QLatin1String("TROJITA@kde.org"));
+    QCOMPARE(index.usage(QLatin1String("trojita@kde.org")), 2);
+}
+
+/** @short Contacts can be changed one by one */
+void ContactIndexTest::testIncrementalUpdates()
+{
+    ContactIndex index;
+    populate(index);
+    index.setContact(3, QLatin1String("Jane Roe"), QStringList() << QLatin1String("jane@roe.name"));
+    QVERIFY(index.complete(QLatin1String("doe"), QStringList()).isEmpty());
+    QCOMPARE(emails(index.complete(QLatin1String("roe"), QStringList())), QStringList() << QLatin1String("jane@roe.name"));
+    QVERIFY(index.namesForAddress(QLatin1String("jane_doe@example.org")).isEmpty());
+
+    index.removeContact(2);
+    QVERIFY(index.complete(QLatin1String("nobody"), QStringList()).isEmpty());
+
+    index.clearContacts();
+    QVERIFY(index.complete(QLatin1String("j"), QStringList()).isEmpty());
+}
+
+void ContactIndexTest::testIgnoresAndLimits()
+{
+    ContactIndex index;
+    populate(index);
+    QCOMPARE(emails(index.complete(QLatin1String("jan"), QStringList() << QLatin1String("Jan <JKT@flaska.net>"))),
+             QStringList() << QLatin1String("jan.kundrat@example.org") << QLatin1String("JANE_DOE@Example.ORG"));
+    QCOMPARE(emails(index.complete(QLatin1String("jan"), QStringList(), 2)),
+             QStringList() << QLatin1String("jkt@flaska.net") << QLatin1String("jan.kundrat@example.org"));
+    QVERIFY(index.complete(QLatin1String("jan"), QStringList(), 0).isEmpty());
+    QVERIFY(index.complete(QString(), QStringList()).isEmpty());
+}
+
+/** @short Completing a short prefix in a big address book */
+void ContactIndexTest::benchmarkCompletion()
+{
+    const int count = 50000;
+    ContactIndex index;
+    for (int i = 0; i < count; ++i) {
+        const QString n = QString::number(i);
+        index.setContact(i + 1, QLatin1String("Contact ") + n + QLatin1String(" Surname"),
+                         QStringList() << QLatin1String("user") + n + QLatin1String("@domain") + QString::number(i % 100) + QLatin1String(".org"));
+        if (i % 10 == 0)
+            index.addUsage(QString(), QLatin1String("used") + n + QLatin1String("@example.org"), i % 7);
+    }
+
+    NameEmailList res;
+    QBENCHMARK {
+        res = index.complete(QLatin1String("user4"), QStringList(), 8);
+    }
+    QCOMPARE(res.size(), 8);
+}
+
+TROJITA_HEADLESS_TEST( ContactIndexTest )
@@ -0,0 +1,109 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QTest>
+#include "test_Metrics.h"
+#include "Utils/headless_test.h"
+#include "Common/Metrics.h"
+
+using namespace Common;
+
+void MetricsTest::testCounter()
+{
+    MetricsCounter c;
+    QCOMPARE(c.value(), Q_INT64_C(0));
+    c.add();
+    c.add(41);
+    QCOMPARE(c.value(), Q_INT64_C(42));
+    c.reset();
+    QCOMPARE(c.value(), Q_INT64_C(0));
+}
+
+void MetricsTest::testHistogramBuckets()
+{
+    QFETCH(qint64, value);
+    QFETCH(int, bucket);
+    QCOMPARE(MetricsHistogram::bucketForValue(value), bucket);
+}
+
+void MetricsTest::testHistogramBuckets_data()
+{
+    QTest::addColumn<qint64>("value");
+    QTest::addColumn<int>("bucket");
+
+    QTest::newRow("zero") << Q_INT64_C(0) << 0;
+    QTest::newRow("one") << Q_INT64_C(1) << 1;
+    QTest::newRow("two") << Q_INT64_C(2) << 2;
+    QTest::newRow("three") << Q_INT64_C(3) << 2;
+    QTest::newRow("four") << Q_INT64_C(4) << 3;
+    QTest::newRow("1023") << Q_INT64_C(1023) << 10;
+    QTest::newRow("1024") << Q_INT64_C(1024) << 11;
+    QTest::newRow("huge") << (Q_INT64_C(1) << 40) << static_cast<int>(MetricsHistogram::BUCKETS - 1);
+}
+
+void MetricsTest::testHistogramStats()
+{
+    MetricsHistogram h;
+    QCOMPARE(h.count(), Q_INT64_C(0));
+    QCOMPARE(h.percentile(50), Q_INT64_C(0));
+
+    for (int i = 1; i <= 100; ++i)
+        h.record(i);
+    h.record(-5);
+
+    QCOMPARE(h.count(), Q_INT64_C(101));
+    QCOMPARE(h.sum(), Q_INT64_C(5050));
+    QCOMPARE(h.max(), Q_INT64_C(100));
+    QCOMPARE(h.bucket(0), Q_INT64_C(1));
+    QCOMPARE(h.bucket(1), Q_INT64_C(1));
+    // 64..100 are all in the same bucket
+    QCOMPARE(h.bucket(7), Q_INT64_C(37));
+    // The median (51) lies within [32, 64)
+    QCOMPARE(h.percentile(50), Q_INT64_C(63));
+    // ...while the top percentiles are capped by the maximum
+    QCOMPARE(h.percentile(99), Q_INT64_C(100));
+
+    h.reset();
+    QCOMPARE(h.count(), Q_INT64_C(0));
+    QCOMPARE(h.max(), Q_INT64_C(0));
+}
+
+void MetricsTest::testRegistry()
+{
+    MetricsRegistry *registry = MetricsRegistry::instance();
+    MetricsCounter *c = registry->counter(QLatin1String("test.counter"));
+    QCOMPARE(registry->counter(QLatin1String("test.counter")), c);
+    c->add(3);
+    MetricsHistogram *h = registry->histogram(QLatin1String("test.histogram"));
+    QCOMPARE(registry->histogram(QLatin1String("test.histogram")), h);
+    h->record(10);
+
+    QStringList dump = registry->dump();
+    QVERIFY(dump.contains(QLatin1String("counter test.counter 3")));
+    QVERIFY(dump.contains(QLatin1String("histogram test.histogram count=1 sum=10 max=10 p50<=10 p90<=10 p99<=10")));
+
+    registry->reset();
+    QCOMPARE(c->value(), Q_INT64_C(0));
+    QCOMPARE(h->count(), Q_INT64_C(0));
+}
+
+TROJITA_HEADLESS_TEST( MetricsTest )
@@ -0,0 +1,272 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <QBuffer>
+#include <QSignalSpy>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTest>
+#include "test_QwwSmtpClient.h"
+#include "Utils/headless_test.h"
+#include "qwwsmtpclient/qwwsmtpclient.h"
+
+FakeSmtpServer::FakeSmtpServer(QObject *parent):
+    QObject(parent), holdEnvelopeReplies(0), messageCompleted(false), quitReceived(false), clientGone(false), m_client(0),
+    m_mode(MODE_COMMANDS), m_envelopeCommands(0), m_acceptedRecipients(0), m_bdatLeft(0), m_bdatLast(false)
+{
+    m_server = new QTcpServer(this);
+    connect(m_server, SIGNAL(newConnection()), this, SLOT(slotNewConnection()));
+    m_server->listen(QHostAddress::LocalHost);
+}
+
+quint16 FakeSmtpServer::port() const
+{
+    return m_server->serverPort();
+}
+
+void FakeSmtpServer::slotNewConnection()
+{
+    m_client = m_server->nextPendingConnection();
+    connect(m_client, SIGNAL(readyRead()), this, SLOT(slotReadyRead()));
+    connect(m_client, SIGNAL(disconnected()), this, SLOT(slotDisconnected()));
+    reply("220 fake ESMTP");
+}
+
+void FakeSmtpServer::slotDisconnected()
+{
+    clientGone = true;
+}
+
+void FakeSmtpServer::slotReadyRead()
+{
+    m_buffer += m_client->readAll();
+    while (true) {
+        if (m_mode == MODE_BDAT) {
+            int n = qMin(m_bdatLeft, m_buffer.size());
+            message += m_buffer.left(n);
+            m_buffer.remove(0, n);
+            m_bdatLeft -= n;
+            if (m_bdatLeft)
+                break;
+            m_mode = MODE_COMMANDS;
+            if (m_bdatLast)
+                messageCompleted = true;
+            reply(m_bdatLast ? "250 message queued" : "250 chunk received");
+            continue;
+        }
+
+        int eol = m_buffer.indexOf("\r\n");
+        if (eol == -1)
+            break;
+        QByteArray line = m_buffer.left(eol);
+        m_buffer.remove(0, eol + 2);
+
+        if (m_mode == MODE_DATA) {
+            if (line == ".") {
+                m_mode = MODE_COMMANDS;
+                messageCompleted = true;
+                reply("250 message queued");
+            } else {
+                message += (line.startsWith('.') ? line.mid(1) : line) + "\r\n";
+            }
+            continue;
+        }
+
+        commands << line;
+        handleCommand(line);
+    }
+}
+
+void FakeSmtpServer::handleCommand(const QByteArray &line)
+{
+    QByteArray verb = line.left(line.indexOf(' ')).toUpper();
+    if (verb == "EHLO") {
+        QList<QByteArray> lines = QList<QByteArray>() << "fake" << capabilities;
+        for (int i = 0; i < lines.size(); ++i)
+            reply("250" + QByteArray(i == lines.size() - 1 ? " " : "-") + lines[i]);
+    } else if (verb == "MAIL") {
+        ++m_envelopeCommands;
+        reply("250 sender ok");
+    } else if (verb == "RCPT") {
+        ++m_envelopeCommands;
+        QByteArray rcpt = line.mid(line.indexOf('<') + 1);
+        rcpt.chop(1);
+        if (rejectedRecipients.contains(rcpt)) {
+            reply("550 no such user");
+        } else {
+            ++m_acceptedRecipients;
+            reply("250 recipient ok");
+        }
+    } else if (verb == "DATA") {
+        ++m_envelopeCommands;
+        if (m_acceptedRecipients) {
+            m_mode = MODE_DATA;
+            reply("354 go ahead");
+        } else {
+            reply("554 no valid recipients");
+        }
+    } else if (verb == "BDAT") {
+        QList<QByteArray> args = line.split(' ');
+        m_bdatLeft = args.value(1).toInt();
+        m_bdatLast = args.size() > 2 && args[2].toUpper() == "LAST";
+        m_mode = MODE_BDAT;
+    } else if (verb == "QUIT") {
+        quitReceived = true;
+        reply("221 bye");
+        m_client->disconnectFromHost();
+    } else {
+        reply("500 unrecognized command");
+    }
+}
+
+void FakeSmtpServer::reply(const QByteArray &line)
+{
+    m_heldReplies += line + "\r\n";
+    if (m_envelopeCommands > 0 && m_envelopeCommands < holdEnvelopeReplies)
+        return;
+    m_client->write(m_heldReplies);
+    m_heldReplies.clear();
+}
+
+namespace {
+
+/** @short Run the event loop until the client reports the outcome and the server sees the connection closed */
+void waitForDone(QSignalSpy &spy, const FakeSmtpServer &server)
+{
+    for (int i = 0; i < 500 && (spy.isEmpty() || !server.clientGone); ++i) {
+        QTest::qWait(10);
+    }
+}
+
+QByteArray sampleMessage()
+{
+    return QByteArray("Subject: test\r\n\r\n.a line with a leading dot\r\nfoo\r\n..\r\n.\r\nbar\r\n");
+}
+
+}
+
+/** @short Without any extension, each command waits for its reply and the body gets dot-stuffed */
+void QwwSmtpClientTest::testPlainData()
+{
+    FakeSmtpServer server;
+    QwwSmtpClient client;
+    QSignalSpy doneSpy(&client, SIGNAL(done(bool)));
+    QBuffer body;
+    body.setData(sampleMessage());
+    body.open(QIODevice::ReadOnly);
+
+    client.connectToHost(QLatin1String("127.0.0.1"), server.port());
+    client.sendMail("from@example.org", QList<QByteArray>() << "a@example.org" << "b@example.org", &body);
+    client.disconnectFromHost();
+    waitForDone(doneSpy, server);
+
+    QCOMPARE(doneSpy.size(), 1);
+    QCOMPARE(doneSpy[0][0].toBool(), true);
+    QCOMPARE(server.commands, QList<QByteArray>() << "EHLO localhost" << "MAIL FROM:<from@example.org>"
+             << "RCPT TO:<a@example.org>" << "RCPT TO:<b@example.org>" << "DATA" << "QUIT");
+    QVERIFY(server.messageCompleted);
+    QCOMPARE(server.message, sampleMessage());
+}
+
+/** @short With PIPELINING, the whole envelope has to be sent without waiting for any reply
+
+The server only replies once it has got all four envelope commands, so a client which waits for a reply after each
+command would never finish.
+*/
+void QwwSmtpClientTest::testPipelining()
+{
+    FakeSmtpServer server;
+    server.capabilities << "PIPELINING";
+    server.holdEnvelopeReplies = 4;
+    QwwSmtpClient client;
+    QSignalSpy doneSpy(&client, SIGNAL(done(bool)));
+    QBuffer body;
+    body.setData(sampleMessage());
+    body.open(QIODevice::ReadOnly);
+
+    client.connectToHost(QLatin1String("127.0.0.1"), server.port());
+    client.sendMail("from@example.org", QList<QByteArray>() << "a@example.org" << "b@example.org", &body);
+    client.disconnectFromHost();
+    waitForDone(doneSpy, server);
+
+    QCOMPARE(doneSpy.size(), 1);
+    QCOMPARE(doneSpy[0][0].toBool(), true);
+    QCOMPARE(server.commands, QList<QByteArray>() << "EHLO localhost" << "MAIL FROM:<from@example.org>"
+             << "RCPT TO:<a@example.org>" << "RCPT TO:<b@example.org>" << "DATA" << "QUIT");
+    QVERIFY(server.messageCompleted);
+    QCOMPARE(server.message, sampleMessage());
+}
+
+/** @short A refused recipient in a pipelined envelope must not lead to a partial delivery */
+void QwwSmtpClientTest::testPipeliningRejectedRecipient()
+{
+    FakeSmtpServer server;
+    server.capabilities << "PIPELINING";
+    server.rejectedRecipients << "b@example.org";
+    QwwSmtpClient client;
+    QSignalSpy doneSpy(&client, SIGNAL(done(bool)));
+    QBuffer body;
+    body.setData(sampleMessage());
+    body.open(QIODevice::ReadOnly);
+
+    client.connectToHost(QLatin1String("127.0.0.1"), server.port());
+    client.sendMail("from@example.org", QList<QByteArray>() << "a@example.org" << "b@example.org", &body);
+    client.disconnectFromHost();
+    waitForDone(doneSpy, server);
+
+    QVERIFY(!doneSpy.isEmpty());
+    QCOMPARE(doneSpy[0][0].toBool(), false);
+    QCOMPARE(client.errorString(), QString::fromUtf8("no such user"));
+    QVERIFY(!server.messageCompleted);
+}
+
+/** @short With CHUNKING, the body goes out as a series of BDAT commands without any dot-stuffing */
+void QwwSmtpClientTest::testChunking()
+{
+    FakeSmtpServer server;
+    server.capabilities << "PIPELINING" << "CHUNKING";
+    server.holdEnvelopeReplies = 2;
+    QwwSmtpClient client;
+    QSignalSpy doneSpy(&client, SIGNAL(done(bool)));
+    QByteArray data;
+    while (data.size() < 200000)
+        data += sampleMessage();
+    QBuffer body;
+    body.setData(data);
+    body.open(QIODevice::ReadOnly);
+
+    client.connectToHost(QLatin1String("127.0.0.1"), server.port());
+    client.sendMail("from@example.org", QList<QByteArray>() << "a@example.org", &body);
+    client.disconnectFromHost();
+    waitForDone(doneSpy, server);
+
+    QCOMPARE(doneSpy.size(), 1);
+    QCOMPARE(doneSpy[0][0].toBool(), true);
+    const QByteArray chunk = QByteArray::number(64 * 1024);
+    QCOMPARE(server.commands, QList<QByteArray>() << "EHLO localhost" << "MAIL FROM:<from@example.org>"
+             << "RCPT TO:<a@example.org>" << "BDAT " + chunk << "BDAT " + chunk << "BDAT " + chunk
+             << "BDAT " + QByteArray::number(data.size() - 3 * 64 * 1024) + " LAST" << "QUIT");
+    QVERIFY(server.messageCompleted);
+    QCOMPARE(server.message, data);
+}
+
+TROJITA_HEADLESS_TEST(QwwSmtpClientTest)
@@ -0,0 +1,85 @@
+/* Copyright (C) 2006 - 2014 Jan Kundrát <jkt@flaska.net>
+
+   This file is part of the Trojita Qt IMAP e-mail client,
+   http://trojita.flaska.net/
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of
+   the License or (at your option) version 3 or any later version
+   accepted by the membership of KDE e.V. (or its successor approved
+   by the membership of KDE e.V.), which shall act as a proxy
+   defined in Section 14 of version 3 of the license.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TEST_QWWSMTPCLIENT_H
+#define TEST_QWWSMTPCLIENT_H
+
+#include <QObject>
+#include <QStringList>
+
+class QTcpServer;
+class QTcpSocket;
+
+/** @short A scripted SMTP server listening on the loopback interface */
+class FakeSmtpServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FakeSmtpServer(QObject *parent = 0);
+    quint16 port() const;
+
+    /** @short Extensions to announce in the EHLO response */
+    QList<QByteArray> capabilities;
+    /** @short Recipients which get refused with a 550 */
+    QList<QByteArray> rejectedRecipients;
+    /** @short Do not reply to MAIL, RCPT and DATA until this many of them have arrived */
+    int holdEnvelopeReplies;
+
+    /** @short All command lines received so far, without the CRLF */
+    QList<QByteArray> commands;
+    /** @short Message data received via DATA (with dot-stuffing removed) or BDAT */
+    QByteArray message;
+    bool messageCompleted;
+    bool quitReceived;
+    bool clientGone;
+
+private slots:
+    void slotNewConnection();
+    void slotReadyRead();
+    void slotDisconnected();
+
+private:
+    void handleCommand(const QByteArray &line);
+    void reply(const QByteArray &line);
+
+    QTcpServer *m_server;
+    QTcpSocket *m_client;
+    QByteArray m_buffer;
+    enum { MODE_COMMANDS, MODE_DATA, MODE_BDAT } m_mode;
+    int m_envelopeCommands;
+    int m_acceptedRecipients;
+    int m_bdatLeft;
+    bool m_bdatLast;
+    QByteArray m_heldReplies;
+};
+
+/** @short Tests of the SMTP dialog, including PIPELINING and CHUNKING */
+class QwwSmtpClientTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testPlainData();
+    void testPipelining();
+    void testPipeliningRejectedRecipient();
+    void testChunking();
+};
+
+#endif
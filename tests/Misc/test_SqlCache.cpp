@@ -20,9 +20,12 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <QCoreApplication>
+#include <QDir>
 #include <QTest>
 #include "test_SqlCache.h"
 #include "Utils/headless_test.h"
+#include "Imap/Model/CombinedCache.h"
 #include "Imap/Model/SQLCache.h"
 
 Q_DECLARE_METATYPE(QList<Imap::Mailbox::MailboxMetadata>)
@@ -92,4 +95,194 @@ void TestSqlCache::testMailboxOperation()
     QVERIFY(errorSpy->isEmpty());
 }
 
+/** @short Check that the rendered message parts are remembered and properly invalidated */
+void TestSqlCache::testRenderedParts()
+{
+    using namespace Imap::Mailbox;
+
+    QString cacheDir = QDir::tempPath() + QLatin1String("/trojita-test-rendered-")
+            + QString::number(QCoreApplication::applicationPid());
+    {
+        QDir().mkpath(cacheDir);
+        CombinedCache combined(0, QLatin1String("rendered"), cacheDir);
+        QSignalSpy combinedErrorSpy(&combined, SIGNAL(error(QString)));
+        // Forgetting about messages goes through the SQL cache as well
+        QCOMPARE(combined.open(), true);
+        const QString small = QLatin1String("<span>foo</span>");
+        const QString big = QString(QLatin1String("b&amp;r\n")).repeated(20 * 1024);
+
+        QCOMPARE(combined.renderedPart(QLatin1String("a"), 1, "1", "x"), QString());
+        combined.setRenderedPart(QLatin1String("a"), 1, "1", "x", small);
+        combined.setRenderedPart(QLatin1String("a"), 1, "2", "x", big);
+        combined.setRenderedPart(QLatin1String("a"), 2, "1", "x", small);
+        combined.setRenderedPart(QLatin1String("b"), 1, "1", "x", small);
+        QCOMPARE(combined.renderedPart(QLatin1String("a"), 1, "1", "x"), small);
+        QCOMPARE(combined.renderedPart(QLatin1String("a"), 1, "2", "x"), big);
+        // A different variant is a cache miss
+        QCOMPARE(combined.renderedPart(QLatin1String("a"), 1, "1", "y"), QString());
+
+        // The big part survives a restart
+        CombinedCache another(0, QLatin1String("rendered-another"), cacheDir);
+        QCOMPARE(another.renderedPart(QLatin1String("a"), 1, "2", "x"), big);
+        QCOMPARE(another.renderedPart(QLatin1String("a"), 1, "1", "x"), QString());
+
+        combined.forgetMessagePart(QLatin1String("a"), 1, "1");
+        QCOMPARE(combined.renderedPart(QLatin1String("a"), 1, "1", "x"), QString());
+        QCOMPARE(combined.renderedPart(QLatin1String("a"), 1, "2", "x"), big);
+
+        combined.clearMessage(QLatin1String("a"), 1);
+        QCOMPARE(combined.renderedPart(QLatin1String("a"), 1, "2", "x"), QString());
+        QCOMPARE(combined.renderedPart(QLatin1String("a"), 2, "1", "x"), small);
+
+        combined.clearAllMessages(QLatin1String("a"));
+        QCOMPARE(combined.renderedPart(QLatin1String("a"), 2, "1", "x"), QString());
+        QCOMPARE(combined.renderedPart(QLatin1String("b"), 1, "1", "x"), small);
+
+        QVERIFY(combinedErrorSpy.isEmpty());
+    }
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    QDir(cacheDir).removeRecursively();
+#endif
+}
+
+/** @short Big message parts are read by a background thread */
+void TestSqlCache::testAsyncPartLoading()
+{
+    using namespace Imap::Mailbox;
+
+    QString cacheDir = QDir::tempPath() + QLatin1String("/trojita-test-async-")
+            + QString::number(QCoreApplication::applicationPid());
+    {
+        QDir().mkpath(cacheDir);
+        CombinedCache combined(0, QLatin1String("async"), cacheDir);
+        QSignalSpy combinedErrorSpy(&combined, SIGNAL(error(QString)));
+        QCOMPARE(combined.open(), true);
+        QSignalSpy loadedSpy(&combined, SIGNAL(messagePartLoaded(QString,uint,QByteArray,QByteArray)));
+        const QByteArray big = QByteArray("0123456789abcdef").repeated(128 * 1024);
+
+        // Nothing is there yet, so there's nothing to wait for
+        QCOMPARE(combined.requestMessagePart(QLatin1String("a"), 1, "1"), false);
+
+        combined.setMsgPart(QLatin1String("a"), 1, "1", big);
+        QCOMPARE(combined.requestMessagePart(QLatin1String("a"), 1, "1"), true);
+        for (int i = 0; i < 500 && loadedSpy.isEmpty(); ++i) {
+            QTest::qWait(10);
+        }
+        QCOMPARE(loadedSpy.size(), 1);
+        QCOMPARE(loadedSpy[0][0].toString(), QString::fromUtf8("a"));
+        QCOMPARE(loadedSpy[0][1].toUInt(), 1u);
+        QCOMPARE(loadedSpy[0][2].toByteArray(), QByteArray("1"));
+        QCOMPARE(loadedSpy[0][3].toByteArray(), big);
+
+        // The synchronous access still works
+        QCOMPARE(combined.messagePart(QLatin1String("a"), 1, "1"), big);
+
+        combined.clearMessage(QLatin1String("a"), 1);
+        QCOMPARE(combined.requestMessagePart(QLatin1String("a"), 1, "1"), false);
+
+        QVERIFY(combinedErrorSpy.isEmpty());
+    }
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    QDir(cacheDir).removeRecursively();
+#endif
+}
+
+/** @short Copied messages share the cached parts, which are removed once the last message using them is gone */
+void TestSqlCache::testSharedParts()
+{
+    using namespace Imap::Mailbox;
+
+    QString cacheDir = QDir::tempPath() + QLatin1String("/trojita-test-shared-")
+            + QString::number(QCoreApplication::applicationPid());
+    {
+        QDir().mkpath(cacheDir);
+        CombinedCache combined(0, QLatin1String("shared"), cacheDir);
+        QSignalSpy combinedErrorSpy(&combined, SIGNAL(error(QString)));
+        QCOMPARE(combined.open(), true);
+        const QByteArray small = QByteArray("foo bar baz");
+        const QByteArray big = QByteArray("0123456789abcdef").repeated(128 * 1024);
+        const QString blobDir = cacheDir + QLatin1String("/blobs");
+        const QDir::Filters blobFilter = QDir::Files | QDir::NoDotAndDotDot;
+
+        combined.setMsgPart(QLatin1String("a"), 1, "1", small);
+        combined.setMsgPart(QLatin1String("a"), 1, "2", big);
+        // The same data in another message are stored just once
+        combined.setMsgPart(QLatin1String("a"), 2, "1", big);
+        QDir blobs(blobDir);
+        QStringList subdirs = blobs.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+        QCOMPARE(subdirs.size(), 1);
+        QCOMPARE(QDir(blobDir + QLatin1Char('/') + subdirs.first()).entryList(blobFilter).size(), 1);
+
+        combined.copyMessageParts(QLatin1String("a"), Imap::Uids() << 1, QLatin1String("b"), Imap::Uids() << 10);
+        QCOMPARE(combined.messagePart(QLatin1String("b"), 10, "1"), small);
+        QCOMPARE(combined.messagePart(QLatin1String("b"), 10, "2"), big);
+
+        // The copy survives the removal of the original
+        combined.clearAllMessages(QLatin1String("a"));
+        QCOMPARE(combined.messagePart(QLatin1String("a"), 1, "1"), QByteArray());
+        QCOMPARE(combined.messagePart(QLatin1String("b"), 10, "1"), small);
+        QCOMPARE(combined.messagePart(QLatin1String("b"), 10, "2"), big);
+        QCOMPARE(QDir(blobDir + QLatin1Char('/') + subdirs.first()).entryList(blobFilter).size(), 1);
+
+        // ...and the file is gone along with the last message which uses it
+        combined.clearMessage(QLatin1String("b"), 10);
+        QCOMPARE(combined.messagePart(QLatin1String("b"), 10, "2"), QByteArray());
+        QCOMPARE(QDir(blobDir + QLatin1Char('/') + subdirs.first()).entryList(blobFilter).size(), 0);
+
+        QVERIFY(combinedErrorSpy.isEmpty());
+    }
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    QDir(cacheDir).removeRecursively();
+#endif
+}
+
+/** @short A blob which is missing or cannot be written does not leave a dangling reference behind */
+void TestSqlCache::testMissingBlobs()
+{
+    using namespace Imap::Mailbox;
+
+    QString cacheDir = QDir::tempPath() + QLatin1String("/trojita-test-missing-")
+            + QString::number(QCoreApplication::applicationPid());
+    {
+        QDir().mkpath(cacheDir);
+        CombinedCache combined(0, QLatin1String("missing"), cacheDir);
+        QSignalSpy combinedErrorSpy(&combined, SIGNAL(error(QString)));
+        QCOMPARE(combined.open(), true);
+        const QByteArray big = QByteArray("0123456789abcdef").repeated(128 * 1024);
+        const QString hex = QString::fromUtf8(SQLCache::partHash(big).toHex());
+        const QString blobFile = cacheDir + QLatin1String("/blobs/") + hex.left(2) + QLatin1Char('/') + hex
+                + QLatin1String(".blob");
+
+        combined.setMsgPart(QLatin1String("a"), 1, "1", big);
+        combined.setMsgPart(QLatin1String("a"), 2, "1", big);
+        QVERIFY(QFile::exists(blobFile));
+
+        // Someone has removed the file, so the data have to be fetched again...
+        QVERIFY(QFile::remove(blobFile));
+        QCOMPARE(combined.messagePart(QLatin1String("a"), 1, "1"), QByteArray());
+        QCOMPARE(combined.requestMessagePart(QLatin1String("a"), 1, "1"), false);
+        // ...and storing them once again restores the file even though the blob is still known to the database
+        combined.setMsgPart(QLatin1String("a"), 1, "1", big);
+        QVERIFY(QFile::exists(blobFile));
+        QCOMPARE(combined.messagePart(QLatin1String("a"), 1, "1"), big);
+        QCOMPARE(combined.messagePart(QLatin1String("a"), 2, "1"), big);
+        QVERIFY(combinedErrorSpy.isEmpty());
+
+        // When the blob cannot be written, the part is not recorded as cached at all
+        const QByteArray another = QByteArray("fedcba9876543210").repeated(128 * 1024);
+        const QString anotherHex = QString::fromUtf8(SQLCache::partHash(another).toHex());
+        const QString anotherFile = cacheDir + QLatin1String("/blobs/") + anotherHex.left(2) + QLatin1Char('/')
+                + anotherHex + QLatin1String(".blob");
+        // A directory in place of the file makes sure that the write fails even when running as root
+        QVERIFY(QDir().mkpath(anotherFile));
+        combined.setMsgPart(QLatin1String("a"), 3, "1", another);
+        QCOMPARE(combinedErrorSpy.size(), 1);
+        QCOMPARE(combined.messagePart(QLatin1String("a"), 3, "1"), QByteArray());
+        QCOMPARE(combined.requestMessagePart(QLatin1String("a"), 3, "1"), false);
+    }
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    QDir(cacheDir).removeRecursively();
+#endif
+}
+
 TROJITA_HEADLESS_TEST(TestSqlCache)
@@ -39,6 +39,10 @@ private Q_SLOTS:
     void initTestCase();
     void cleanupTestCase();
     void testMailboxOperation();
+    void testRenderedParts();
+    void testAsyncPartLoading();
+    void testSharedParts();
+    void testMissingBlobs();
 
 private:
     Imap::Mailbox::SQLCache *cache;